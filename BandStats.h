@@ -0,0 +1,457 @@
+#ifndef BANDSTATS_H
+#define BANDSTATS_H
+#include <vector>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <ForceInline.h>
+#include <NoDataClassifier.h>
+#include <StatsContext.h>
+
+// pixels handled per block. With 13 bands the deinterleaved block, its masks
+// and the centred copy used for cross-band covariance still fit in L1
+constexpr size_t band_stats_block_pixels = 256;
+
+enum class BandInterleave
+{
+    PixelInterleaved,   // BIP: p0b0 p0b1 ... p0bN p1b0 ...
+    LineInterleaved     // BIL: line0 of band0, line0 of band1, ... line1 of band0 ...
+};
+
+struct BandLayout
+{
+    size_t num_bands = 1;
+    BandInterleave interleave = BandInterleave::PixelInterleaved;
+    // pixels per line, only needed for line interleaved data
+    size_t samples_per_line = 0;
+};
+
+// statistics of one band
+struct BandSummary
+{
+    size_t count = 0;
+    double sum = 0.0;
+    float mean = std::numeric_limits<float>::quiet_NaN();
+    float variance = std::numeric_limits<float>::quiet_NaN();
+    float min = std::numeric_limits<float>::quiet_NaN();
+    float max = std::numeric_limits<float>::quiet_NaN();
+    bool contains_ndvs = false;
+    bool contains_nan_infs = false;
+    bool isGood() const{
+        return !contains_ndvs && !contains_nan_infs;
+    }
+};
+
+// mergeable per band state
+struct BandMoments
+{
+    double count = 0.0;
+    double sum = 0.0;
+    double mean = 0.0;
+    double m2 = 0.0;
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+    bool contains_ndvs = false;
+    bool contains_nan_infs = false;
+    void accumulate(const float* values, const uint8_t* valid, size_t count);
+    void merge(const BandMoments& partial);
+};
+
+// mergeable co-moments between every pair of bands, over pixels valid in all bands
+struct CrossBandMoments
+{
+    size_t num_bands = 0;
+    double count = 0.0;
+    std::vector<double> means;
+    // num_bands x num_bands, row major, symmetric
+    std::vector<double> comoments;
+    void resize(size_t bands);
+    // values holds num_bands rows of stride floats, centred is scratch for num_bands
+    // rows of centred_stride floats
+    void accumulate(const float* values, size_t stride, const uint8_t* valid, size_t count,
+                    float* centred, size_t centred_stride);
+    void merge(const CrossBandMoments& partial);
+};
+
+// computes per band statistics of band interleaved imagery in one sweep. Pixel
+// interleaved blocks are deinterleaved into an L1 sized scratch so every band
+// is reduced from contiguous memory and every cache line of the input is read once
+template<int i = 0>
+class DoesTheBandStats
+{
+private:
+    std::vector<BandSummary> bands;
+    CrossBandMoments cross;
+    bool layout_ok = true;
+    bool with_covariance = false;
+public:
+    DoesTheBandStats(const std::vector<float>& data, const BandLayout& layout, const std::vector<float>& ndvs,
+                     bool cross_band_covariance = false, const StatsContext& context = defaultStatsContext());
+    size_t getNumBands() const{
+        return bands.size();
+    }
+    const BandSummary& getBand(size_t band) const{
+        return bands[band];
+    }
+    // sample covariance between two bands over pixels valid in every band.
+    // nan unless constructed with cross_band_covariance
+    float getCovariance(size_t band_a, size_t band_b) const;
+    float getCorrelation(size_t band_a, size_t band_b) const;
+    // number of pixels valid in every band, used by the covariances
+    size_t getJointCount() const{
+        return static_cast<size_t>(cross.count);
+    }
+    // false when the data size does not fit the layout
+    bool isLayoutValid() const{
+        return layout_ok;
+    }
+    bool isGood() const;
+};
+
+template <size_t NB>
+FORCE_INLINE void deinterleaveFixed(const float* in, size_t count, float* out, size_t out_stride)
+{
+    // band outer so each band is a constant stride gather the compiler can turn
+    // into shuffles, the block is in L1 after the first band
+    for(size_t b=0; b<NB; b++){
+        float* out_band = out + b * out_stride;
+        for(size_t p=0; p<count; p++){
+            out_band[p] = in[p * NB + b];
+        }
+    }
+}
+
+inline void deinterleaveGeneric(const float* in, size_t num_bands, size_t count, float* out, size_t out_stride)
+{
+    for(size_t b=0; b<num_bands; b++){
+        float* out_band = out + b * out_stride;
+        for(size_t p=0; p<count; p++){
+            out_band[p] = in[p * num_bands + b];
+        }
+    }
+}
+
+// splits count pixel interleaved pixels into num_bands rows of out_stride floats
+inline void deinterleaveBlock(const float* in, size_t num_bands, size_t count, float* out, size_t out_stride)
+{
+    switch(num_bands){
+    case 1: return deinterleaveFixed<1>(in, count, out, out_stride);
+    case 2: return deinterleaveFixed<2>(in, count, out, out_stride);
+    case 3: return deinterleaveFixed<3>(in, count, out, out_stride);
+    case 4: return deinterleaveFixed<4>(in, count, out, out_stride);
+    case 5: return deinterleaveFixed<5>(in, count, out, out_stride);
+    case 6: return deinterleaveFixed<6>(in, count, out, out_stride);
+    case 7: return deinterleaveFixed<7>(in, count, out, out_stride);
+    case 8: return deinterleaveFixed<8>(in, count, out, out_stride);
+    case 9: return deinterleaveFixed<9>(in, count, out, out_stride);
+    case 10: return deinterleaveFixed<10>(in, count, out, out_stride);
+    case 11: return deinterleaveFixed<11>(in, count, out, out_stride);
+    case 12: return deinterleaveFixed<12>(in, count, out, out_stride);
+    case 13: return deinterleaveFixed<13>(in, count, out, out_stride);
+    case 14: return deinterleaveFixed<14>(in, count, out, out_stride);
+    case 15: return deinterleaveFixed<15>(in, count, out, out_stride);
+    case 16: return deinterleaveFixed<16>(in, count, out, out_stride);
+    default: return deinterleaveGeneric(in, num_bands, count, out, out_stride);
+    }
+}
+
+inline void BandMoments::accumulate(const float* values, const uint8_t* valid, size_t count)
+{
+    double n = 0.0, block_sum = 0.0;
+    float block_min = std::numeric_limits<float>::infinity();
+    float block_max = -std::numeric_limits<float>::infinity();
+    #pragma omp simd reduction(+:n,block_sum) reduction(min:block_min) reduction(max:block_max)
+    for(size_t k=0; k<count; k++){
+        n += valid[k];
+        block_sum += valid[k] ? values[k] : 0.f;
+        block_min = std::min(block_min, valid[k] ? values[k] : std::numeric_limits<float>::infinity());
+        block_max = std::max(block_max, valid[k] ? values[k] : -std::numeric_limits<float>::infinity());
+    }
+    if(n == 0.0){
+        return;
+    }
+    BandMoments block;
+    block.count = n;
+    block.sum = block_sum;
+    block.mean = block_sum / n;
+    block.min = block_min;
+    block.max = block_max;
+    const double mean = block.mean;
+    double m2 = 0.0;
+    #pragma omp simd reduction(+:m2)
+    for(size_t k=0; k<count; k++){
+        const double d = valid[k] ? values[k] - mean : 0.0;
+        m2 += d * d;
+    }
+    block.m2 = m2;
+    merge(block);
+}
+
+inline void BandMoments::merge(const BandMoments& partial)
+{
+    contains_ndvs |= partial.contains_ndvs;
+    contains_nan_infs |= partial.contains_nan_infs;
+    if(partial.count == 0.0){
+        return;
+    }
+    min = std::min(min, partial.min);
+    max = std::max(max, partial.max);
+    sum += partial.sum;
+    if(count == 0.0){
+        count = partial.count;
+        mean = partial.mean;
+        m2 = partial.m2;
+        return;
+    }
+    const double n = count + partial.count;
+    const double delta = partial.mean - mean;
+    mean += delta * partial.count / n;
+    m2 += partial.m2 + delta * delta * count * partial.count / n;
+    count = n;
+}
+
+inline void CrossBandMoments::resize(size_t bands)
+{
+    num_bands = bands;
+    means.assign(bands, 0.0);
+    comoments.assign(bands * bands, 0.0);
+}
+
+inline void CrossBandMoments::accumulate(const float* values, size_t stride, const uint8_t* valid, size_t count,
+                                         float* centred, size_t centred_stride)
+{
+    double n = 0.0;
+    for(size_t k=0; k<count; k++){
+        n += valid[k];
+    }
+    if(n == 0.0){
+        return;
+    }
+    CrossBandMoments block;
+    block.resize(num_bands);
+    block.count = n;
+    for(size_t b=0; b<num_bands; b++){
+        const float* band = values + b * stride;
+        double band_sum = 0.0;
+        #pragma omp simd reduction(+:band_sum)
+        for(size_t k=0; k<count; k++){
+            band_sum += valid[k] ? band[k] : 0.f;
+        }
+        block.means[b] = band_sum / n;
+        const float mean = static_cast<float>(block.means[b]);
+        float* centred_band = centred + b * centred_stride;
+        for(size_t k=0; k<count; k++){
+            centred_band[k] = valid[k] ? band[k] - mean : 0.f;
+        }
+    }
+    for(size_t a=0; a<num_bands; a++){
+        const float* centred_a = centred + a * centred_stride;
+        for(size_t b=a; b<num_bands; b++){
+            const float* centred_b = centred + b * centred_stride;
+            double c = 0.0;
+            #pragma omp simd reduction(+:c)
+            for(size_t k=0; k<count; k++){
+                c += static_cast<double>(centred_a[k]) * centred_b[k];
+            }
+            block.comoments[a * num_bands + b] = c;
+            block.comoments[b * num_bands + a] = c;
+        }
+    }
+    merge(block);
+}
+
+inline void CrossBandMoments::merge(const CrossBandMoments& partial)
+{
+    if(partial.count == 0.0){
+        return;
+    }
+    if(count == 0.0){
+        count = partial.count;
+        means = partial.means;
+        comoments = partial.comoments;
+        return;
+    }
+    const double n = count + partial.count;
+    const double weight = count * partial.count / n;
+    for(size_t a=0; a<num_bands; a++){
+        const double delta_a = partial.means[a] - means[a];
+        for(size_t b=0; b<num_bands; b++){
+            const double delta_b = partial.means[b] - means[b];
+            comoments[a * num_bands + b] += partial.comoments[a * num_bands + b] + delta_a * delta_b * weight;
+        }
+    }
+    for(size_t a=0; a<num_bands; a++){
+        means[a] += (partial.means[a] - means[a]) * partial.count / n;
+    }
+    count = n;
+}
+
+template<int i>
+DoesTheBandStats<i>::DoesTheBandStats(const std::vector<float>& data, const BandLayout& layout, const std::vector<float>& ndvs,
+                                      bool cross_band_covariance, const StatsContext& context)
+{
+    const size_t num_bands = layout.num_bands;
+    with_covariance = cross_band_covariance;
+    bands.resize(num_bands);
+    cross.resize(num_bands);
+    if(num_bands == 0){
+        layout_ok = false;
+        return;
+    }
+    const NoDataClassifier classifier(ndvs);
+    const bool line_interleaved = layout.interleave == BandInterleave::LineInterleaved;
+    const size_t samples_per_line = line_interleaved ? layout.samples_per_line : 0;
+    if(line_interleaved && samples_per_line == 0){
+        layout_ok = false;
+        return;
+    }
+    // a block is a run of up to band_stats_block_pixels pixels. Line interleaved
+    // data is split into blocks along each line so a block never spans two lines
+    const size_t pixel_stride = line_interleaved ? num_bands * samples_per_line : num_bands;
+    const size_t num_units = data.size() / pixel_stride;
+    layout_ok = num_units * pixel_stride == data.size();
+    const size_t pixels_per_unit = line_interleaved ? samples_per_line : num_units;
+    const size_t blocks_per_unit = (pixels_per_unit + band_stats_block_pixels - 1) / band_stats_block_pixels;
+    const size_t num_blocks = line_interleaved ? num_units * blocks_per_unit : blocks_per_unit;
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(num_units * pixel_stride, cross_band_covariance ? num_bands + 1 : 1,
+                                                   executor.concurrency());
+    const size_t elements_per_block = band_stats_block_pixels * num_bands;
+    const size_t blocks_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max<size_t>(plan.chunk_size / elements_per_block, 1) : num_blocks;
+
+    struct ChunkResult
+    {
+        std::vector<BandMoments> bands;
+        CrossBandMoments cross;
+    };
+    // scratch is reused by every chunk a worker runs
+    struct WorkerScratch
+    {
+        std::vector<float> deinterleaved;
+        std::vector<float> centred;
+        std::vector<uint8_t> band_valid;
+        std::vector<uint8_t> joint_valid;
+    };
+    const ChunkLayout chunk_layout(num_blocks, blocks_per_chunk, plan.schedule, plan.num_threads);
+    std::vector<ChunkResult> chunk_results(chunk_layout.numChunks());
+    std::vector<WorkerScratch> worker_scratch(executor.concurrency());
+    // counts the elements of a full block, so the telemetry of line interleaved
+    // data is approximate
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan, elements_per_block);
+    // the home hint spreads the data evenly over the blocks, which is exact for
+    // pixel interleaved data and close enough for placing line interleaved chunks
+    runChunked(executor, chunk_layout, [&](size_t chunk, size_t first_block, size_t end_block, size_t worker){
+        ChunkResult& result = chunk_results[chunk];
+        result.bands.resize(num_bands);
+        result.cross.resize(num_bands);
+        WorkerScratch& scratch = worker_scratch[worker];
+        if(scratch.band_valid.empty()){
+            scratch.deinterleaved.resize(num_bands * band_stats_block_pixels);
+            scratch.centred.resize(cross_band_covariance ? num_bands * band_stats_block_pixels : 0);
+            scratch.band_valid.resize(band_stats_block_pixels);
+            scratch.joint_valid.resize(band_stats_block_pixels);
+        }
+        for(size_t block=first_block; block<end_block; block++)
+        {
+            const size_t unit = line_interleaved ? block / blocks_per_unit : 0;
+            const size_t first_pixel = (block - unit * blocks_per_unit) * band_stats_block_pixels;
+            const size_t count = std::min(band_stats_block_pixels, pixels_per_unit - first_pixel);
+            const float* band_rows;
+            size_t stride;
+            if(line_interleaved){
+                // each band's line is already contiguous
+                band_rows = data.data() + unit * pixel_stride + first_pixel;
+                stride = samples_per_line;
+            }
+            else{
+                deinterleaveBlock(data.data() + first_pixel * num_bands, num_bands, count,
+                                  scratch.deinterleaved.data(), band_stats_block_pixels);
+                band_rows = scratch.deinterleaved.data();
+                stride = band_stats_block_pixels;
+            }
+            std::fill_n(scratch.joint_valid.begin(), count, uint8_t(1));
+            for(size_t b=0; b<num_bands; b++){
+                const float* band = band_rows + b * stride;
+                std::fill_n(scratch.band_valid.begin(), count, uint8_t(1));
+                const BlockClassification classification = classifier.classifyBlock(band, count, scratch.band_valid.data());
+                result.bands[b].contains_nan_infs |= classification.num_nan_infs > 0;
+                result.bands[b].contains_ndvs |= classification.num_ndvs > 0;
+                result.bands[b].accumulate(band, scratch.band_valid.data(), count);
+                for(size_t k=0; k<count; k++){
+                    scratch.joint_valid[k] &= scratch.band_valid[k];
+                }
+            }
+            if(cross_band_covariance){
+                result.cross.accumulate(band_rows, stride, scratch.joint_valid.data(), count,
+                                        scratch.centred.data(), band_stats_block_pixels);
+            }
+        }
+    }, data.data(), num_blocks > 0 ? data.size() * sizeof(float) / num_blocks : 0, telemetry.get());
+    telemetry.startMerge();
+    std::vector<BandMoments> merged_bands(num_bands);
+    for(const ChunkResult& result : chunk_results){
+        for(size_t b=0; b<num_bands && b<result.bands.size(); b++){
+            merged_bands[b].merge(result.bands[b]);
+        }
+        cross.merge(result.cross);
+    }
+    telemetry.publish();
+    for(size_t b=0; b<num_bands; b++){
+        const BandMoments& merged = merged_bands[b];
+        BandSummary& band = bands[b];
+        band.count = static_cast<size_t>(merged.count);
+        band.sum = merged.sum;
+        band.contains_ndvs = merged.contains_ndvs;
+        band.contains_nan_infs = merged.contains_nan_infs;
+        if(band.count > 0){
+            band.mean = static_cast<float>(merged.mean);
+            band.min = merged.min;
+            band.max = merged.max;
+        }
+        if(band.count > 1){
+            band.variance = static_cast<float>(merged.m2 / (merged.count - 1.0));
+        }
+    }
+}
+
+template<int i>
+float DoesTheBandStats<i>::getCovariance(size_t band_a, size_t band_b) const
+{
+    if(!with_covariance || cross.count < 2.0){
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+    return static_cast<float>(cross.comoments[band_a * cross.num_bands + band_b] / (cross.count - 1.0));
+}
+
+template<int i>
+float DoesTheBandStats<i>::getCorrelation(size_t band_a, size_t band_b) const
+{
+    if(!with_covariance || cross.count < 2.0){
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+    const size_t n = cross.num_bands;
+    const double denominator = std::sqrt(cross.comoments[band_a * n + band_a] * cross.comoments[band_b * n + band_b]);
+    if(denominator == 0.0){
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+    return static_cast<float>(cross.comoments[band_a * n + band_b] / denominator);
+}
+
+template<int i>
+bool DoesTheBandStats<i>::isGood() const
+{
+    if(!layout_ok){
+        return false;
+    }
+    for(const BandSummary& band : bands){
+        if(!band.isGood()){
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // BANDSTATS_H
@@ -0,0 +1,139 @@
+#include <BandStats.h>
+#include <MultiStats.h>
+#include <numeric>
+#include <gtest/gtest.h>
+
+namespace {
+
+// pixel interleaved test image where band b of pixel p is a simple function of both
+std::vector<float> makePixelInterleaved(size_t num_pixels, size_t num_bands)
+{
+    std::vector<float> data(num_pixels * num_bands);
+    for(size_t p=0; p<num_pixels; p++){
+        for(size_t b=0; b<num_bands; b++){
+            data[p * num_bands + b] = static_cast<float>((p * (b + 3)) % 101) + 10.f * b;
+        }
+    }
+    return data;
+}
+
+std::vector<float> extractBand(const std::vector<float>& data, size_t num_bands, size_t band)
+{
+    std::vector<float> values;
+    for(size_t p=band; p<data.size(); p+=num_bands){
+        values.push_back(data[p]);
+    }
+    return values;
+}
+
+}
+
+TEST(BandStats, PixelInterleavedMatchesPerBand)
+{
+    const size_t num_pixels = 5000;
+    const size_t num_bands = 5;
+    const std::vector<float> data = makePixelInterleaved(num_pixels, num_bands);
+    BandLayout layout;
+    layout.num_bands = num_bands;
+    DoesTheBandStats stats(data, layout, {});
+
+    EXPECT_TRUE(stats.isGood());
+    ASSERT_EQ(stats.getNumBands(), num_bands);
+    for(size_t b=0; b<num_bands; b++){
+        const std::vector<float> band = extractBand(data, num_bands, b);
+        const double sum = std::accumulate(band.begin(), band.end(), 0.0);
+        const double mean = sum / band.size();
+        double m2 = 0.0;
+        for(float v : band){
+            m2 += (v - mean) * (v - mean);
+        }
+        const BandSummary& summary = stats.getBand(b);
+        EXPECT_EQ(summary.count, num_pixels);
+        EXPECT_DOUBLE_EQ(summary.sum, sum);
+        EXPECT_FLOAT_EQ(summary.mean, static_cast<float>(mean));
+        EXPECT_NEAR(summary.variance, m2 / (band.size() - 1), 1e-3);
+        EXPECT_EQ(summary.min, *std::min_element(band.begin(), band.end()));
+        EXPECT_EQ(summary.max, *std::max_element(band.begin(), band.end()));
+    }
+}
+
+// line interleaved is the same image reordered line by line
+TEST(BandStats, LineInterleavedMatchesPixelInterleaved)
+{
+    const size_t width = 300;
+    const size_t height = 7;
+    const size_t num_bands = 4;
+    const std::vector<float> bip = makePixelInterleaved(width * height, num_bands);
+    std::vector<float> bil(bip.size());
+    for(size_t row=0; row<height; row++){
+        for(size_t b=0; b<num_bands; b++){
+            for(size_t x=0; x<width; x++){
+                bil[(row * num_bands + b) * width + x] = bip[(row * width + x) * num_bands + b];
+            }
+        }
+    }
+    BandLayout bip_layout;
+    bip_layout.num_bands = num_bands;
+    BandLayout bil_layout = bip_layout;
+    bil_layout.interleave = BandInterleave::LineInterleaved;
+    bil_layout.samples_per_line = width;
+    DoesTheBandStats from_bip(bip, bip_layout, {}, true);
+    DoesTheBandStats from_bil(bil, bil_layout, {}, true);
+
+    EXPECT_TRUE(from_bil.isGood());
+    for(size_t b=0; b<num_bands; b++){
+        EXPECT_EQ(from_bil.getBand(b).count, from_bip.getBand(b).count);
+        EXPECT_DOUBLE_EQ(from_bil.getBand(b).sum, from_bip.getBand(b).sum);
+        EXPECT_FLOAT_EQ(from_bil.getBand(b).variance, from_bip.getBand(b).variance);
+        EXPECT_EQ(from_bil.getBand(b).min, from_bip.getBand(b).min);
+        for(size_t c=0; c<num_bands; c++){
+            EXPECT_NEAR(from_bil.getCovariance(b, c), from_bip.getCovariance(b, c), 1e-2);
+        }
+    }
+}
+
+// no data values only remove the pixel from the band they are in, but
+// remove the whole pixel from the cross band covariance
+TEST(BandStats, NoDataPerBandAndCrossBand)
+{
+    const size_t num_pixels = 1000;
+    const size_t num_bands = 3;
+    std::vector<float> data = makePixelInterleaved(num_pixels, num_bands);
+    data[10 * num_bands + 1] = -9999.f;
+    data[20 * num_bands + 2] = -9999.f;
+    BandLayout layout;
+    layout.num_bands = num_bands;
+    DoesTheBandStats stats(data, layout, {-9999.f}, true);
+
+    EXPECT_FALSE(stats.isGood());
+    EXPECT_TRUE(stats.getBand(0).isGood());
+    EXPECT_FALSE(stats.getBand(1).isGood());
+    EXPECT_EQ(stats.getBand(0).count, num_pixels);
+    EXPECT_EQ(stats.getBand(1).count, num_pixels - 1);
+    EXPECT_EQ(stats.getBand(2).count, num_pixels - 1);
+    EXPECT_EQ(stats.getJointCount(), num_pixels - 2);
+
+    // the same pair through the lockstep loop drops the same pixels
+    std::vector<float> band0 = extractBand(data, num_bands, 0);
+    std::vector<float> band1 = extractBand(data, num_bands, 1);
+    std::vector<float> band2 = extractBand(data, num_bands, 2);
+    for(size_t p=0; p<num_pixels; p++){
+        if(band2[p] == -9999.f){
+            band0[p] = band1[p] = -9999.f;
+        }
+    }
+    DoesThePairedStats pair(band0, band1, {-9999.f});
+    EXPECT_NEAR(stats.getCovariance(0, 1), pair.getCovariance(), 1e-2);
+    EXPECT_NEAR(stats.getCorrelation(0, 1), pair.getCorrelation(), 1e-5);
+}
+
+TEST(BandStats, InvalidLayout)
+{
+    const std::vector<float> data = {1,2,3,4,5};
+    BandLayout layout;
+    layout.num_bands = 2;
+    DoesTheBandStats stats(data, layout, {});
+    EXPECT_FALSE(stats.isLayoutValid());
+    EXPECT_FALSE(stats.isGood());
+    EXPECT_EQ(stats.getBand(0).count, 2u);
+}
@@ -2,63 +2,91 @@
 #define BASICSTATS_H
 #include <vector>
 #include <ForceInline.h>
+#include <Prefetch.h>
+#include <NoDataClassifier.h>
+#include <FirstTouchAllocator.h>
+#include <ReducerCapabilities.h>
+#include <StatsContext.h>
+#include <PerfCounters.h>
 #include <cmath>
 #include <array>
 #include <tuple>
 #include <optional>
+#include <algorithm>
+#include <cstdint>
 
-// iterates through data vector efficiently and applies lambdas
+// iterates through data vector efficiently and applies reducers, see
+// ReducerCapabilities.h for what a reducer can provide
 template<typename... Args>
 class BasicStatsLoop
 {
     std::tuple<Args...> lambdas;
     const static size_t tuple_size = std::tuple_size_v<std::tuple<Args...> >;
+    // reducers run element by element inside a block
+    constexpr static size_t num_element_reducers = (size_t(!ReducerCapabilities<Args>::block_wise) + ... + 0);
     std::array<float, tuple_size> results;
-    std::vector<float> m_ndvs;
+    NoDataClassifier m_classifier;
     bool m_contains_nan_infs = false;
     bool m_contains_ndvs = false;
-    FORCE_INLINE bool isFloatBad(float data_value) const;
-    FORCE_INLINE bool isFloatNoDataValue(float data_value) const;
+    ExecutionPlan m_plan;
+    size_t m_prefetch_distance = 0;
+    // only read when built with BASICSTATS_PERF_COUNTERS
+    PerfReport* m_perf_report = nullptr;
+    FORCE_INLINE void reduceScalar(const float* data, size_t begin, size_t end, float* totals,
+                                   bool& contains_nan_infs, bool& contains_ndvs) const;
+    void reduceBlocked(const float* data, size_t begin, size_t end, float* totals,
+                       bool& contains_nan_infs, bool& contains_ndvs) const;
 public:
     BasicStatsLoop(const std::vector<float>& data, const std::vector<float>& no_data_values, const std::array<float, tuple_size>& starting_values, Args... args);
+    BasicStatsLoop(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& no_data_values,
+                   const std::array<float, tuple_size>& starting_values, Args... args);
     void setNonDataValues(const std::vector<float>& ndvs);
     bool isGood() const;
+    // how the loop chose to run, see StatsTuning
+    const ExecutionPlan& getExecutionPlan() const{
+        return m_plan;
+    }
     template<int i> float getResult() const{
         return std::get<i>(results);
     }
 };
 
-// assembles a BasicStatsLoop using lambdas for sum, product, differences
-template<int i = 0>
+// assembles a BasicStatsLoop using lambdas for sum, product, differences.
+// With FirstTouchAllocator<float> the differences are faulted in by the
+// threads that compute them instead of by the constructing thread. With
+// ContextAllocator<float> they come from the context's allocator, so a pooled
+// one hands the buffer of a finished call to the next
+template<int i = 0, typename Allocator = std::allocator<float> >
 class DoesTheStats
 {
 private:
-    std::vector<float> diffs_array;
+    std::vector<float, Allocator> diffs_array;
     float sum;
     float product;
     bool good;
 public:
-    DoesTheStats(const std::vector<float>& numbers, const std::vector<float>& ndvs)
+    DoesTheStats(const std::vector<float>& numbers, const std::vector<float>& ndvs,
+                 const StatsContext& context = defaultStatsContext())
+        : diffs_array(contextAllocator<Allocator>(context))
     {
-        // added methods would go here as lambda expressions following the same outline
+        // added methods would go here as reducers following the same outline
         diffs_array.resize(numbers.size()-1);
-        constexpr auto plus = [](std::optional<size_t> index, float value, float& total)->void{
-            total += value;
-        };
-        constexpr auto multiply = [](std::optional<size_t> index, float value, float& total)->void{
-            total *= value;
-        };
-        auto diff = [&](std::optional<size_t> index, float value, float& total)->void{
-            if(index){
-                size_t index_v = index.value();
-                if(index_v > 0){
-                    diffs_array[index_v-1] = value - numbers[index_v-1];
-                }
+        if constexpr(isFirstTouchAllocator<Allocator>::value){
+            // same chunks as the loop below, so each page lands where it is written
+            StatsExecutor& executor = context.getExecutor();
+            const ExecutionPlan plan = context.tuning.plan(numbers.size(), 3, executor.concurrency());
+            const size_t chunk_size = plan.mode == ExecutionMode::Parallel ? plan.chunk_size : diffs_array.size();
+            firstTouchFill(diffs_array, 0.f, executor, chunk_size, numbers.data(), sizeof(float));
+        }
+        // only the differences need the index
+        const auto diff = indexedReducer([&](size_t index, float value, float&)->void{
+            if(index > 0){
+                diffs_array[index-1] = value - numbers[index-1];
             }
-        };
-        auto the_action = BasicStatsLoop(numbers, ndvs, {0.f, 1.f, 0.f}, plus, multiply, diff);
-        sum = the_action.getResult<0>();
-        product = the_action.getResult<1>();
+        }, [](float, float&)->void{});
+        auto the_action = BasicStatsLoop(context, numbers, ndvs, {0.f, 1.f, 0.f}, PlusReducer(), MultiplyReducer(), diff);
+        sum = the_action.template getResult<0>();
+        product = the_action.template getResult<1>();
         good = the_action.isGood();
     }
     float getSum() const{
@@ -67,7 +95,7 @@ public:
     float getProduct() const{
         return product;
     }
-    const std::vector<float>& getDifferences() const{
+    const std::vector<float, Allocator>& getDifferences() const{
         return diffs_array;
     }
     bool isGood() const{
@@ -75,98 +103,213 @@ public:
     }
 };
 
-template <unsigned N, typename Tup> struct faux_unroll_tuple_fns
+// skip_block_wise leaves out the reducers that already took the whole block
+template <unsigned N, typename Tup, bool skip_block_wise = false> struct faux_unroll_tuple_fns
+{
+    FORCE_INLINE static void call(size_t i, float iteration_value, float* totals, const Tup & tup)
+    {
+        using Fn = std::tuple_element_t<N-1, Tup>;
+        if constexpr(!skip_block_wise || !ReducerCapabilities<Fn>::block_wise){
+            reduceElement(std::get<N-1>(tup), i, iteration_value, totals[N-1]);
+        }
+        faux_unroll_tuple_fns<N-1, Tup, skip_block_wise>::call(i, iteration_value, totals, tup);
+    }
+};
+
+template <typename Tup, bool skip_block_wise> struct faux_unroll_tuple_fns<0u, Tup, skip_block_wise>
+{
+    FORCE_INLINE static void call(size_t, float, float*, const Tup&) {}
+};
+
+// the block-wise reducers, each over the whole classified block
+template <unsigned N, typename Tup> struct faux_unroll_tuple_fns_block
 {
-    static void call(size_t i, float iteration_value, float* totals, const Tup & tup)
+    static void call(size_t block_begin, const float* values, const uint8_t* valid, size_t count, float* totals, const Tup & tup)
     {
-        std::get<N-1>(tup)(i, iteration_value, totals[N-1]);
-        faux_unroll_tuple_fns<N-1, Tup>::call(i, iteration_value, totals, tup);
+        if constexpr(ReducerCapabilities<std::tuple_element_t<N-1, Tup> >::block_wise){
+            std::get<N-1>(tup).block(block_begin, values, valid, count, totals[N-1]);
+        }
+        faux_unroll_tuple_fns_block<N-1, Tup>::call(block_begin, values, valid, count, totals, tup);
     }
 };
 
-template <typename Tup> struct faux_unroll_tuple_fns<0u, Tup>
+template <typename Tup> struct faux_unroll_tuple_fns_block<0u, Tup>
 {
-    static void call(size_t i, float iteration_value, float* totals, const Tup&) {}
+    static void call(size_t, const float*, const uint8_t*, size_t, float*, const Tup&) {}
 };
 
 template <unsigned N, typename Tup> struct faux_unroll_tuple_fns_critical_section
 {
     static void call(float* iteration_values, float* totals, const Tup & tup)
     {
-        std::get<N-1>(tup)({}, iteration_values[N-1], totals[N-1]);
+        mergeTotal(std::get<N-1>(tup), iteration_values[N-1], totals[N-1]);
         faux_unroll_tuple_fns_critical_section<N-1, Tup>::call(iteration_values, totals, tup);
     }
 };
 
 template <typename Tup> struct faux_unroll_tuple_fns_critical_section<0u, Tup>
 {
-    static void call(float* iteration_values, float* totals, const Tup&) {}
+    static void call(float*, float*, const Tup&) {}
 };
 
 template <typename... Args>
-FORCE_INLINE bool BasicStatsLoop<Args...>::isFloatBad(float data_value) const
+void BasicStatsLoop<Args...>::setNonDataValues(const std::vector<float>& ndvs)
 {
-    return std::isnan(data_value) || std::isinf(data_value);
+    m_classifier.setNonDataValues(ndvs);
 }
 
 template <typename... Args>
-FORCE_INLINE bool BasicStatsLoop<Args...>::isFloatNoDataValue(float data_value) const
+bool BasicStatsLoop<Args...>::isGood() const
+{
+    return !m_contains_ndvs && !m_contains_nan_infs;
+}
+
+template <typename... Args>
+FORCE_INLINE void BasicStatsLoop<Args...>::reduceScalar(const float* data, size_t begin, size_t end, float* totals,
+                                                        bool& contains_nan_infs, bool& contains_ndvs) const
 {
-    // m_ndvs is assumed to be small. If m_ndvs were large,
-    // checking a hash could be more efficient
-    for(float ndv : m_ndvs){
-        // floating point comparison should generaly be safe in the case of ndvs,
-        if(data_value == ndv){
-            return true;
+    for(size_t i=begin; i<end; i++)
+    {
+        // Zero cost abstraction but very helpful for debugging because opening
+        // a large vector is very slow. Could be achieved using range based for,
+        // but we need to index into differences vector
+        const float& iteration_value = data[i];
+        if(m_classifier.isFloatBad(iteration_value)){
+            contains_nan_infs = true;
+            continue;
+        }
+        if(m_classifier.isFloatNoDataValue(iteration_value)){
+            // could choose to carry forward the ndv in differences vector or
+            // handle some over way with a priori knowledge
+            contains_ndvs = true;
+            continue;
         }
+        faux_unroll_tuple_fns<tuple_size, std::tuple<Args...> >::call(i, iteration_value, totals, lambdas);
     }
-    return false;
 }
 
 template <typename... Args>
-bool BasicStatsLoop<Args...>::isGood() const
+void BasicStatsLoop<Args...>::reduceBlocked(const float* data, size_t begin, size_t end, float* totals,
+                                            bool& contains_nan_infs, bool& contains_ndvs) const
 {
-    return !m_contains_ndvs && !m_contains_nan_infs;
+    // classifying a whole block first keeps the nan/inf and ndv checks in
+    // vectorized loops, the lambdas then only see valid values. A block is
+    // small enough to stay in L1 between classification and the lambdas, and
+    // the block prefetch_distance elements ahead is requested meanwhile
+    std::array<uint8_t, basic_stats_block_size> valid;
+    static_assert(basic_stats_block_size <= 65536, "block offsets are stored as uint16_t");
+    std::array<uint16_t, basic_stats_block_size> positions;
+    for(size_t block_begin=begin; block_begin<end; block_begin+=basic_stats_block_size){
+        const size_t count = std::min(basic_stats_block_size, end - block_begin);
+        if(m_prefetch_distance > 0 && block_begin + m_prefetch_distance < end){
+            const char* ahead = reinterpret_cast<const char*>(data + block_begin + m_prefetch_distance);
+            const size_t ahead_bytes = std::min(count, end - block_begin - m_prefetch_distance) * sizeof(float);
+            for(size_t offset=0; offset<ahead_bytes; offset+=prefetch_stride_bytes){
+                PREFETCH_READ(ahead + offset);
+            }
+        }
+        BlockClassification classification;
+        {
+            STATS_PERF_SCOPE(m_perf_report, StatsPhase::Classify);
+            std::fill_n(valid.begin(), count, uint8_t(1));
+            classification = m_classifier.classifyBlock(data + block_begin, count, valid.data());
+        }
+        STATS_PERF_SCOPE(m_perf_report, StatsPhase::Reduce);
+        contains_nan_infs |= classification.num_nan_infs > 0;
+        contains_ndvs |= classification.num_ndvs > 0;
+        const float* values = data + block_begin;
+        faux_unroll_tuple_fns_block<tuple_size, std::tuple<Args...> >::call(block_begin, values, valid.data(), count,
+                                                                           totals, lambdas);
+        if constexpr(num_element_reducers == 0){
+            continue;
+        }
+        // the other reducers see an element straight after each other, so their
+        // independent totals overlap and the block is read from L1 only once.
+        // Blocks holding invalid values are compacted first, branch free, so the
+        // reducers never wait on a mispredicted validity check
+        if(classification.num_nan_infs == 0 && classification.num_ndvs == 0){
+            for(size_t k=0; k<count; k++){
+                faux_unroll_tuple_fns<tuple_size, std::tuple<Args...>, true>::call(block_begin + k, values[k], totals, lambdas);
+            }
+            continue;
+        }
+        size_t num_valid = 0;
+        for(size_t k=0; k<count; k++){
+            positions[num_valid] = static_cast<uint16_t>(k);
+            num_valid += valid[k];
+        }
+        for(size_t j=0; j<num_valid; j++){
+            const size_t k = positions[j];
+            faux_unroll_tuple_fns<tuple_size, std::tuple<Args...>, true>::call(block_begin + k, values[k], totals, lambdas);
+        }
+    }
 }
 
 template <typename... Args>
 BasicStatsLoop<Args...>::BasicStatsLoop(const std::vector<float>& data, const std::vector<float>& no_data_values,
+                                        const std::array<float, tuple_size>& starting_values, Args... args)
+    : BasicStatsLoop(defaultStatsContext(), data, no_data_values, starting_values, args...)
+{
+}
+
+template <typename... Args>
+BasicStatsLoop<Args...>::BasicStatsLoop(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& no_data_values,
                                         const std::array<float, tuple_size>& starting_values, Args... args) : lambdas(args...)
 {
     const size_t num_elements = data.size();
-    m_ndvs = no_data_values;
+    m_classifier.setNonDataValues(no_data_values);
     results = starting_values;
+    StatsExecutor& executor = context.getExecutor();
+    m_plan = context.tuning.plan(num_elements, tuple_size, executor.concurrency());
+    m_prefetch_distance = context.tuning.prefetch_distance;
+    m_perf_report = context.perf_report;
 
-    const int64_t num_elements_64_t = static_cast<int64_t>(num_elements);
     // Generally it's most computationally efficient done in one loop.
     // Requires less paging of heap memory into cache.
-    #pragma omp parallel
-    {
-        std::array<float, tuple_size> thread_local_totals = starting_values;
-        #pragma omp for
-        for(int64_t i=0; i<num_elements_64_t; i++)
-        {
-            // Zero cost abstraction but very helpful for debugging because opening
-            // a large vector is very slow. Could be achieved using range based for,
-            // but we need to index into differences vector
-            const float& iteration_value = data[i];
-            if(isFloatBad(iteration_value)){
-                m_contains_nan_infs = true;
-                continue;
-            }
-            if(isFloatNoDataValue(iteration_value)){
-                // could choose to carry forward the ndv in differences vector or
-                // handle some over way with a priori knowledge
-                m_contains_ndvs = true;
-                continue;
-            }
-            faux_unroll_tuple_fns<tuple_size, std::tuple<Args...> >::call(i, iteration_value, &thread_local_totals[0], lambdas);
+    if(m_plan.mode != ExecutionMode::Parallel){
+        // tiny inputs never pay for a parallel region
+        std::array<float, tuple_size> totals = starting_values;
+        if(m_plan.mode == ExecutionMode::Serial){
+            // classification and reduction are interleaved here, counted as reduction
+            STATS_PERF_SCOPE(m_perf_report, StatsPhase::Reduce);
+            reduceScalar(data.data(), 0, num_elements, &totals[0], m_contains_nan_infs, m_contains_ndvs);
         }
-        #pragma omp critical
-        {
-            faux_unroll_tuple_fns_critical_section<tuple_size, std::tuple<Args...> >::call(&thread_local_totals[0], &results[0], lambdas);
+        else{
+            reduceBlocked(data.data(), 0, num_elements, &totals[0], m_contains_nan_infs, m_contains_ndvs);
+        }
+        STATS_PERF_SCOPE(m_perf_report, StatsPhase::Merge);
+        faux_unroll_tuple_fns_critical_section<tuple_size, std::tuple<Args...> >::call(&totals[0], &results[0], lambdas);
+        return;
+    }
+
+    // every chunk keeps its own totals, merged in chunk order afterwards so the
+    // result does not depend on which thread ran which chunk
+    const ChunkLayout layout(num_elements, m_plan.chunk_size, m_plan.schedule, m_plan.num_threads);
+    const size_t num_chunks = layout.numChunks();
+    StatsAllocator& allocator = context.getAllocator();
+    ContextVector<std::array<float, tuple_size> > chunk_totals(num_chunks, allocator);
+    ContextVector<uint8_t> chunk_nan_infs(num_chunks, 0, allocator);
+    ContextVector<uint8_t> chunk_ndvs(num_chunks, 0, allocator);
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, m_plan);
+    runChunked(executor, layout, [&](size_t chunk, size_t begin, size_t end, size_t){
+        std::array<float, tuple_size> totals = starting_values;
+        bool contains_nan_infs = false;
+        bool contains_ndvs = false;
+        reduceBlocked(data.data(), begin, end, &totals[0], contains_nan_infs, contains_ndvs);
+        chunk_totals[chunk] = totals;
+        chunk_nan_infs[chunk] = contains_nan_infs;
+        chunk_ndvs[chunk] = contains_ndvs;
+    }, data.data(), sizeof(float), telemetry.get());
+    telemetry.startMerge();
+    {
+        STATS_PERF_SCOPE(m_perf_report, StatsPhase::Merge);
+        for(size_t chunk=0; chunk<num_chunks; chunk++){
+            faux_unroll_tuple_fns_critical_section<tuple_size, std::tuple<Args...> >::call(&chunk_totals[chunk][0], &results[0], lambdas);
+            m_contains_nan_infs |= chunk_nan_infs[chunk] != 0;
+            m_contains_ndvs |= chunk_ndvs[chunk] != 0;
         }
     }
+    telemetry.publish();
 }
 
 #endif // BASICSTATS_H
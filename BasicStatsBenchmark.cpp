@@ -0,0 +1,185 @@
+#include <BasicStats.h>
+#include <NumaExecutor.h>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <utility>
+
+// compares the adaptive execution plan against always entering a parallel
+// region, which is what BasicStatsLoop did before StatsTuning. Sizes double
+// from 1 KB up to the limit given in MB as the first argument (default 1024).
+// A second table shows how throughput holds up as reducers are added, with
+// and without software prefetching. A third table reads an input placed on each NUMA node in turn with a
+// NumaExecutor and reports the bandwidth every node reached. Built with
+// BASICSTATS_PERF_COUNTERS=1 a last table splits the counters by loop phase.
+
+namespace {
+
+double secondsPerCall(const std::vector<float>& values, const StatsContext& context)
+{
+    // repeat small inputs so every measurement lasts long enough to trust
+    const size_t repetitions = std::max<size_t>(1, (size_t(1) << 24) / std::max<size_t>(values.size(), 1));
+    double best = 1e30;
+    for(int trial=0; trial<3; trial++){
+        const auto begin = std::chrono::steady_clock::now();
+        for(size_t r=0; r<repetitions; r++){
+            DoesTheStats stats(values, {}, context);
+            if(stats.getSum() < 0.f){
+                std::cout << "";
+            }
+        }
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - begin).count() / repetitions);
+    }
+    return best;
+}
+
+template<size_t... I>
+double secondsWithReducers(const std::vector<float>& values, const StatsContext& context, std::index_sequence<I...>)
+{
+    const auto square_plus = elementReducer([](float value, float& total)->void{
+        total += value * value;
+    }, [](float partial, float& total)->void{
+        total += partial;
+    });
+    double best = 1e30;
+    for(int trial=0; trial<3; trial++){
+        const auto begin = std::chrono::steady_clock::now();
+        BasicStatsLoop loop(context, values, {}, {((void)I, 0.f)...}, ((void)I, square_plus)...);
+        const auto end = std::chrono::steady_clock::now();
+        if(loop.template getResult<0>() < 0.f){
+            std::cout << "";
+        }
+        best = std::min(best, std::chrono::duration<double>(end - begin).count());
+    }
+    return best;
+}
+
+template<size_t NumReducers>
+void benchmarkReducerCount(const std::vector<float>& values)
+{
+    StatsContext context = defaultStatsContext();
+    const double bytes = static_cast<double>(values.size() * sizeof(float));
+    context.tuning.prefetch_distance = 4 * basic_stats_block_size;
+    const double prefetched = secondsWithReducers(values, context, std::make_index_sequence<NumReducers>());
+    context.tuning.prefetch_distance = 0;
+    const double plain = secondsWithReducers(values, context, std::make_index_sequence<NumReducers>());
+    std::cout << std::left << std::setw(10) << NumReducers << std::setw(16) << bytes / prefetched * 1e-9
+              << bytes / plain * 1e-9 << std::endl;
+}
+
+void benchmarkReducers(size_t bytes)
+{
+    const std::vector<float> values(bytes / sizeof(float), 1.f);
+    std::cout << std::endl << std::left << std::setw(10) << "reducers" << std::setw(16) << "prefetch GB/s"
+              << "no prefetch GB/s" << std::endl;
+    benchmarkReducerCount<1>(values);
+    benchmarkReducerCount<2>(values);
+    benchmarkReducerCount<4>(values);
+    benchmarkReducerCount<8>(values);
+    benchmarkReducerCount<10>(values);
+}
+
+void benchmarkNodes(size_t bytes)
+{
+    NumaExecutor::Options options;
+    // keeps every node on its own memory so the table shows local bandwidth
+    options.allow_remote_steal = false;
+    NumaExecutor numa(NumaTopology::discover(), options);
+    StatsContext context;
+    context.executor = &numa;
+    context.tuning.forced_mode = ExecutionMode::Parallel;
+    const NumaTopology& topology = numa.getTopology();
+
+    std::cout << std::endl << std::left << std::setw(8) << "node" << std::setw(10) << "cpus"
+              << std::setw(12) << "GB/s" << std::setw(10) << "chunks" << "remote" << std::endl;
+    for(size_t node=0; node<topology.numNodes(); node++){
+        // first touch from a thread on the node puts the pages there
+        pinCurrentThread(topology.node_cpus[node]);
+        const std::vector<float> values(bytes / sizeof(float), 1.f);
+        numa.resetNodeStats();
+        const double seconds = secondsPerCall(values, context);
+        const std::vector<NumaExecutor::NodeStats> stats = numa.getNodeStats();
+        size_t chunks = 0;
+        size_t remote = 0;
+        for(const NumaExecutor::NodeStats& node_stats : stats){
+            chunks += node_stats.chunks;
+            remote += node_stats.remote_chunks;
+        }
+        std::cout << std::left << std::setw(8) << topology.node_ids[node] << std::setw(10) << topology.node_cpus[node].size()
+                  << std::setw(12) << bytes / seconds * 1e-9 << std::setw(10) << chunks << remote << std::endl;
+    }
+}
+
+#if BASICSTATS_PERF_COUNTERS
+void benchmarkPhases(size_t bytes)
+{
+    const std::vector<float> values(bytes / sizeof(float), 1.f);
+    PerfReport report;
+    StatsContext context = defaultStatsContext();
+    context.perf_report = &report;
+    secondsPerCall(values, context);
+    const std::array<const char*, num_perf_counters> names = {"cycles", "instructions", "llc misses", "branch misses", "task ns"};
+    const std::array<const char*, num_stats_phases> phases = {"classify", "reduce", "merge"};
+    std::cout << std::endl << std::left << std::setw(16) << "counter";
+    for(const char* phase : phases){
+        std::cout << std::setw(18) << phase;
+    }
+    std::cout << std::endl;
+    for(size_t c=0; c<num_perf_counters; c++){
+        std::cout << std::left << std::setw(16) << names[c];
+        for(size_t p=0; p<num_stats_phases; p++){
+            if(report.isAvailable(static_cast<PerfCounter>(c))){
+                std::cout << std::setw(18) << report.getPhase(static_cast<StatsPhase>(p)).counts[c];
+            }
+            else{
+                std::cout << std::setw(18) << "n/a";
+            }
+        }
+        std::cout << std::endl;
+    }
+}
+#endif
+
+const char* modeName(ExecutionMode mode)
+{
+    switch(mode){
+    case ExecutionMode::Serial: return "serial";
+    case ExecutionMode::SimdOnly: return "simd";
+    case ExecutionMode::Parallel: return "parallel";
+    }
+    return "";
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    const size_t max_megabytes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024;
+    const size_t max_bytes = max_megabytes << 20;
+
+    const StatsContext& adaptive = defaultStatsContext();
+    StatsContext always_parallel;
+    always_parallel.tuning.forced_mode = ExecutionMode::Parallel;
+    always_parallel.tuning.min_grain_work = 0;
+
+    std::cout << std::left << std::setw(14) << "bytes" << std::setw(10) << "plan"
+              << std::setw(16) << "adaptive us" << std::setw(16) << "parallel us"
+              << "speedup" << std::endl;
+    for(size_t bytes=1024; bytes<=max_bytes; bytes*=2){
+        const std::vector<float> values(bytes / sizeof(float), 1.f);
+        const ExecutionPlan plan = adaptive.tuning.plan(values.size(), 3, adaptive.getExecutor().concurrency());
+        const double adaptive_seconds = secondsPerCall(values, adaptive);
+        const double parallel_seconds = secondsPerCall(values, always_parallel);
+        std::cout << std::left << std::setw(14) << bytes << std::setw(10) << modeName(plan.mode)
+                  << std::setw(16) << adaptive_seconds * 1e6 << std::setw(16) << parallel_seconds * 1e6
+                  << parallel_seconds / adaptive_seconds << std::endl;
+    }
+    benchmarkReducers(std::min<size_t>(max_bytes, size_t(256) << 20));
+    benchmarkNodes(std::min<size_t>(max_bytes, size_t(256) << 20));
+#if BASICSTATS_PERF_COUNTERS
+    benchmarkPhases(std::min<size_t>(max_bytes, size_t(256) << 20));
+#endif
+    return 0;
+}
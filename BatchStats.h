@@ -0,0 +1,206 @@
+#ifndef BATCHSTATS_H
+#define BATCHSTATS_H
+#include <vector>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <ForceInline.h>
+#include <NoDataClassifier.h>
+#include <StatsContext.h>
+
+// longest run of a series classified at once. Typical series (50-500
+// elements) are handled as a single block
+constexpr size_t batch_stats_block_size = 512;
+// series handed to a thread at a time. Keeps scheduling overhead low while
+// still balancing ragged batches
+constexpr size_t batch_stats_series_per_chunk = 64;
+
+// computes the DoesTheStats results for many short series at once. Threads
+// split the batch by series rather than splitting each series, so there is one
+// parallelFor per batch instead of one per series. Results are stored as a
+// structure of arrays, entry s belonging to series s. Products, differences,
+// min, max and counts are those of DoesTheStats bit for bit; sums are added in
+// vector lanes and may differ from a serial DoesTheStats in the last bits.
+template<int i = 0>
+class DoesTheBatchStats
+{
+private:
+    std::vector<float> sums;
+    std::vector<float> products;
+    std::vector<float> mins;
+    std::vector<float> maxs;
+    std::vector<uint32_t> counts;
+    std::vector<uint8_t> good;
+    // differences of every series back to back, series s starts at
+    // difference_offsets[s] and has one element less than the series
+    std::vector<float> differences;
+    std::vector<size_t> difference_offsets;
+    bool offsets_ok = true;
+    void run(const float* values, size_t num_series, const size_t* offsets, size_t series_length,
+             const std::vector<float>& ndvs, bool with_differences, const StatsContext& context);
+public:
+    // ragged batch: series s is values[offsets[s], offsets[s+1]), so offsets has
+    // one more entry than there are series
+    DoesTheBatchStats(const std::vector<float>& values, const std::vector<size_t>& offsets,
+                      const std::vector<float>& ndvs, bool with_differences = false,
+                      const StatsContext& context = defaultStatsContext());
+    // fixed length batch: values holds values.size() / series_length rows of series_length
+    DoesTheBatchStats(const std::vector<float>& values, size_t series_length,
+                      const std::vector<float>& ndvs, bool with_differences = false,
+                      const StatsContext& context = defaultStatsContext());
+    size_t getNumSeries() const{
+        return sums.size();
+    }
+    const std::vector<float>& getSums() const{
+        return sums;
+    }
+    const std::vector<float>& getProducts() const{
+        return products;
+    }
+    // nan for series without a valid value
+    const std::vector<float>& getMins() const{
+        return mins;
+    }
+    const std::vector<float>& getMaxs() const{
+        return maxs;
+    }
+    // number of valid values per series
+    const std::vector<uint32_t>& getCounts() const{
+        return counts;
+    }
+    // 1 when the series contains no nan/inf and no no data value
+    const std::vector<uint8_t>& getGood() const{
+        return good;
+    }
+    // empty unless constructed with_differences
+    const std::vector<float>& getDifferences() const{
+        return differences;
+    }
+    const std::vector<size_t>& getDifferenceOffsets() const{
+        return difference_offsets;
+    }
+    // false when the offsets are not ascending or run past the values
+    bool isLayoutValid() const{
+        return offsets_ok;
+    }
+};
+
+template<int i>
+DoesTheBatchStats<i>::DoesTheBatchStats(const std::vector<float>& values, const std::vector<size_t>& offsets,
+                                        const std::vector<float>& ndvs, bool with_differences,
+                                        const StatsContext& context)
+{
+    const size_t num_series = offsets.empty() ? 0 : offsets.size() - 1;
+    for(size_t s=0; s<num_series; s++){
+        if(offsets[s] > offsets[s+1]){
+            offsets_ok = false;
+        }
+    }
+    if(num_series > 0 && offsets[num_series] > values.size()){
+        offsets_ok = false;
+    }
+    if(!offsets_ok){
+        return;
+    }
+    run(values.data(), num_series, offsets.data(), 0, ndvs, with_differences, context);
+}
+
+template<int i>
+DoesTheBatchStats<i>::DoesTheBatchStats(const std::vector<float>& values, size_t series_length,
+                                        const std::vector<float>& ndvs, bool with_differences,
+                                        const StatsContext& context)
+{
+    if(series_length == 0){
+        offsets_ok = values.empty();
+        return;
+    }
+    offsets_ok = values.size() % series_length == 0;
+    run(values.data(), values.size() / series_length, nullptr, series_length, ndvs, with_differences, context);
+}
+
+template<int i>
+void DoesTheBatchStats<i>::run(const float* values, size_t num_series, const size_t* offsets, size_t series_length,
+                               const std::vector<float>& ndvs, bool with_differences, const StatsContext& context)
+{
+    sums.resize(num_series);
+    products.resize(num_series);
+    mins.resize(num_series);
+    maxs.resize(num_series);
+    counts.resize(num_series);
+    good.resize(num_series);
+    if(with_differences){
+        difference_offsets.resize(num_series + 1);
+        size_t total = 0;
+        for(size_t s=0; s<num_series; s++){
+            difference_offsets[s] = total;
+            const size_t length = offsets ? offsets[s+1] - offsets[s] : series_length;
+            total += length > 0 ? length - 1 : 0;
+        }
+        difference_offsets[num_series] = total;
+        differences.assign(total, 0.f);
+    }
+    const NoDataClassifier classifier(ndvs);
+    const size_t num_values = offsets ? (num_series > 0 ? offsets[num_series] - offsets[0] : 0) : num_series * series_length;
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(num_values, 2, executor.concurrency());
+    const size_t series_per_chunk = plan.mode == ExecutionMode::Parallel ? batch_stats_series_per_chunk : num_series;
+    // a single parallelFor for the whole batch, each series is reduced serially.
+    // Fixed length rows tell the executor where each chunk lives
+    runChunked(executor, num_series, series_per_chunk, [&](size_t, size_t first_series, size_t end_series, size_t){
+        std::array<uint8_t, batch_stats_block_size> valid;
+        for(size_t s=first_series; s<end_series; s++)
+        {
+            const size_t begin = offsets ? offsets[s] : static_cast<size_t>(s) * series_length;
+            const size_t length = offsets ? offsets[s+1] - begin : series_length;
+            const float* series = values + begin;
+            float sum = 0.f;
+            float product = 1.f;
+            float min = std::numeric_limits<float>::infinity();
+            float max = -std::numeric_limits<float>::infinity();
+            uint32_t count = 0;
+            bool series_good = true;
+            for(size_t block_begin=0; block_begin<length; block_begin+=batch_stats_block_size){
+                const float* block = series + block_begin;
+                const size_t block_count = std::min(batch_stats_block_size, length - block_begin);
+                std::fill_n(valid.begin(), block_count, uint8_t(1));
+                const BlockClassification classification = classifier.classifyBlock(block, block_count, valid.data());
+                series_good &= classification.num_nan_infs == 0 && classification.num_ndvs == 0;
+                uint32_t block_valid = 0;
+                #pragma omp simd reduction(+:sum,block_valid) reduction(min:min) reduction(max:max)
+                for(size_t k=0; k<block_count; k++){
+                    block_valid += valid[k];
+                    sum += valid[k] ? block[k] : 0.f;
+                    min = std::min(min, valid[k] ? block[k] : std::numeric_limits<float>::infinity());
+                    max = std::max(max, valid[k] ? block[k] : -std::numeric_limits<float>::infinity());
+                }
+                // in order, like MultiplyReducer: an overflow to inf and a zero in
+                // different lanes would give nan where DoesTheStats gives 0
+                for(size_t k=0; k<block_count; k++){
+                    product *= valid[k] ? block[k] : 1.f;
+                }
+                count += block_valid;
+                if(with_differences){
+                    // same rule as DoesTheStats: only valid values get a difference
+                    // to their raw predecessor within the series
+                    float* series_differences = differences.data() + difference_offsets[s];
+                    for(size_t k=0; k<block_count; k++){
+                        const size_t index = block_begin + k;
+                        if(index > 0 && valid[k]){
+                            series_differences[index-1] = block[k] - series[index-1];
+                        }
+                    }
+                }
+            }
+            sums[s] = sum;
+            products[s] = product;
+            mins[s] = count > 0 ? min : std::numeric_limits<float>::quiet_NaN();
+            maxs[s] = count > 0 ? max : std::numeric_limits<float>::quiet_NaN();
+            counts[s] = count;
+            good[s] = series_good ? 1 : 0;
+        }
+    }, offsets ? nullptr : values, series_length * sizeof(float));
+}
+
+#endif // BATCHSTATS_H
@@ -0,0 +1,93 @@
+#include <BatchStats.h>
+#include <BasicStats.h>
+#include <numeric>
+#include <gtest/gtest.h>
+
+// every series of a ragged batch gives the same answers as DoesTheStats
+TEST(BatchStats, RaggedMatchesDoesTheStats)
+{
+    std::vector<float> values;
+    std::vector<size_t> offsets = {0};
+    const size_t num_series = 300;
+    for(size_t s=0; s<num_series; s++){
+        const size_t length = 2 + (s * 37) % 600;
+        for(size_t k=0; k<length; k++){
+            values.push_back(static_cast<float>((s + k) % 9) - 4.f);
+        }
+        offsets.push_back(values.size());
+    }
+    const std::vector<float> ndvs = {-4.f};
+    DoesTheBatchStats batch(values, offsets, ndvs, true);
+
+    ASSERT_TRUE(batch.isLayoutValid());
+    ASSERT_EQ(batch.getNumSeries(), num_series);
+    for(size_t s=0; s<num_series; s++){
+        const std::vector<float> series(values.begin() + offsets[s], values.begin() + offsets[s+1]);
+        DoesTheStats stats(series, ndvs);
+        EXPECT_EQ(batch.getSums()[s], stats.getSum());
+        EXPECT_EQ(batch.getProducts()[s], stats.getProduct());
+        EXPECT_EQ(batch.getGood()[s] != 0, stats.isGood());
+        const std::vector<float>& differences = stats.getDifferences();
+        EXPECT_TRUE(std::equal(differences.begin(), differences.end(),
+                               batch.getDifferences().begin() + batch.getDifferenceOffsets()[s]));
+        const size_t expected_count = std::count_if(series.begin(), series.end(), [](float v){ return v != -4.f; });
+        EXPECT_EQ(batch.getCounts()[s], expected_count);
+    }
+}
+
+// a zero before an overflow is 0 in order, nan if lanes multiply apart
+TEST(BatchStats, ProductKeepsTheOrder)
+{
+    std::vector<float> series(16, 1.f);
+    series[0] = 0.f;
+    series[1] = 1e30f;
+    series[9] = 1e30f;
+    DoesTheBatchStats batch(series, series.size(), {});
+    const DoesTheStats stats(series, {});
+    EXPECT_EQ(stats.getProduct(), 0.f);
+    EXPECT_EQ(batch.getProducts()[0], stats.getProduct());
+}
+
+TEST(BatchStats, FixedLengthMatrix)
+{
+    const size_t series_length = 50;
+    const size_t num_series = 1000;
+    std::vector<float> values(series_length * num_series);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = static_cast<float>(i % series_length);
+    }
+    float zero = 0.f;
+    values[3 * series_length + 7] = 1.f / zero;
+    DoesTheBatchStats batch(values, series_length, {});
+
+    ASSERT_EQ(batch.getNumSeries(), num_series);
+    EXPECT_TRUE(batch.getDifferences().empty());
+    for(size_t s=0; s<num_series; s++){
+        if(s == 3){
+            EXPECT_EQ(batch.getGood()[s], 0);
+            EXPECT_EQ(batch.getCounts()[s], series_length - 1);
+            EXPECT_EQ(batch.getSums()[s], 1225.f - 7.f);
+            continue;
+        }
+        EXPECT_EQ(batch.getGood()[s], 1);
+        EXPECT_EQ(batch.getSums()[s], 1225.f);
+        EXPECT_EQ(batch.getMins()[s], 0.f);
+        EXPECT_EQ(batch.getMaxs()[s], 49.f);
+    }
+}
+
+TEST(BatchStats, EmptyAndInvalidLayouts)
+{
+    const std::vector<float> values = {1,2,3,4,5};
+    DoesTheBatchStats empty_series(values, std::vector<size_t>{0, 0, 5}, {});
+    EXPECT_EQ(empty_series.getCounts()[0], 0u);
+    EXPECT_TRUE(std::isnan(empty_series.getMins()[0]));
+    EXPECT_EQ(empty_series.getSums()[1], 15.f);
+
+    DoesTheBatchStats past_the_end(values, std::vector<size_t>{0, 6}, {});
+    EXPECT_FALSE(past_the_end.isLayoutValid());
+
+    DoesTheBatchStats not_a_matrix(values, size_t(2), {});
+    EXPECT_FALSE(not_a_matrix.isLayoutValid());
+    EXPECT_EQ(not_a_matrix.getNumSeries(), 2u);
+}
@@ -0,0 +1,191 @@
+#ifndef BENCHMARKHARNESS_H
+#define BENCHMARKHARNESS_H
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// small in tree replacement for Google Benchmark, which the project does not
+// depend on. A case is run in growing batches of iterations until a batch
+// lasts min_seconds, the way Google Benchmark picks its iteration count, and
+// the fastest of several such batches is reported.
+
+// time stamp counter ticks, 0 where there is none. Counts at the nominal
+// clock rate on current x86, so cycles per element are reference cycles
+inline uint64_t readCycleCounter()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+struct BenchmarkCase
+{
+    std::string name;
+    // parameters that identify the case, reported as they are
+    std::vector<std::pair<std::string, std::string> > params;
+    // bytes read and elements reduced by one call of run
+    size_t bytes = 0;
+    size_t elements = 0;
+    std::function<void()> run;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    std::vector<std::pair<std::string, std::string> > params;
+    size_t bytes = 0;
+    size_t elements = 0;
+    size_t iterations = 0;
+    double seconds_per_iteration = 0.0;
+    double gigabytes_per_second = 0.0;
+    double elements_per_second = 0.0;
+    // negative when the platform has no cycle counter
+    double cycles_per_element = -1.0;
+};
+
+struct BenchmarkOptions
+{
+    double min_seconds = 0.1;
+    int repetitions = 3;
+    // only cases whose name contains filter run
+    std::string filter;
+};
+
+inline BenchmarkResult runBenchmark(const BenchmarkCase& benchmark, const BenchmarkOptions& options)
+{
+    BenchmarkResult result;
+    result.name = benchmark.name;
+    result.params = benchmark.params;
+    result.bytes = benchmark.bytes;
+    result.elements = benchmark.elements;
+    // warm up, faults in any pages and builds lazily created pools
+    benchmark.run();
+    size_t iterations = 1;
+    double best_seconds = 1e30;
+    uint64_t best_cycles = 0;
+    for(int repetition=0; repetition<std::max(options.repetitions, 1); repetition++){
+        for(;;){
+            const uint64_t cycles_begin = readCycleCounter();
+            const auto begin = std::chrono::steady_clock::now();
+            for(size_t i=0; i<iterations; i++){
+                benchmark.run();
+            }
+            const auto end = std::chrono::steady_clock::now();
+            const uint64_t cycles_end = readCycleCounter();
+            const double seconds = std::chrono::duration<double>(end - begin).count();
+            if(seconds < options.min_seconds && repetition == 0 && iterations < (size_t(1) << 30)){
+                // aim a little past min_seconds, at most ten times more iterations per step
+                const double factor = seconds > 0.0 ? 1.4 * options.min_seconds / seconds : 10.0;
+                iterations = std::max(iterations + 1, static_cast<size_t>(iterations * std::min(factor, 10.0)));
+                continue;
+            }
+            if(seconds / iterations < best_seconds){
+                best_seconds = seconds / iterations;
+                best_cycles = (cycles_end - cycles_begin) / iterations;
+            }
+            break;
+        }
+    }
+    result.iterations = iterations;
+    result.seconds_per_iteration = best_seconds;
+    result.gigabytes_per_second = static_cast<double>(benchmark.bytes) / best_seconds * 1e-9;
+    result.elements_per_second = static_cast<double>(benchmark.elements) / best_seconds;
+    if(best_cycles > 0 && benchmark.elements > 0){
+        result.cycles_per_element = static_cast<double>(best_cycles) / static_cast<double>(benchmark.elements);
+    }
+    return result;
+}
+
+inline void printBenchmarkHeader(std::ostream& os)
+{
+    os << std::left << std::setw(88) << "benchmark" << std::right << std::setw(12) << "time us"
+       << std::setw(10) << "GB/s" << std::setw(14) << "Melements/s" << std::setw(12) << "cycles/el" << std::endl;
+}
+
+// the name followed by the case parameters as /key:value pairs
+inline std::string benchmarkLabel(const BenchmarkResult& result)
+{
+    std::string label = result.name;
+    for(const auto& param : result.params){
+        label += "/" + param.first + ":" + param.second;
+    }
+    return label;
+}
+
+inline void printBenchmarkResult(std::ostream& os, const BenchmarkResult& result)
+{
+    os << std::left << std::setw(88) << benchmarkLabel(result) << std::right << std::fixed << std::setprecision(2)
+       << std::setw(12) << result.seconds_per_iteration * 1e6 << std::setw(10) << result.gigabytes_per_second
+       << std::setw(14) << result.elements_per_second * 1e-6 << std::setw(12) << result.cycles_per_element
+       << std::defaultfloat << std::endl;
+}
+
+inline std::string jsonEscape(const std::string& text)
+{
+    std::string escaped;
+    for(char c : text){
+        if(c == '"' || c == '\\'){
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+// writes the results in the layout of Google Benchmark's JSON reporter, named
+// by their full label so that cases stay distinct, with the case parameters
+// and throughput numbers as extra fields
+inline bool writeBenchmarkJson(const std::string& path, const std::vector<BenchmarkResult>& results,
+                               const std::vector<std::pair<std::string, std::string> >& context)
+{
+    std::ofstream file(path);
+    if(!file){
+        return false;
+    }
+    file << "{\n  \"context\": {\n";
+    file << "    \"num_cpus\": " << std::thread::hardware_concurrency();
+    for(const auto& entry : context){
+        file << ",\n    \"" << jsonEscape(entry.first) << "\": \"" << jsonEscape(entry.second) << "\"";
+    }
+    file << "\n  },\n  \"benchmarks\": [";
+    for(size_t i=0; i<results.size(); i++){
+        const BenchmarkResult& result = results[i];
+        file << (i == 0 ? "\n" : ",\n") << "    {\n";
+        file << "      \"name\": \"" << jsonEscape(benchmarkLabel(result)) << "\",\n";
+        for(const auto& param : result.params){
+            file << "      \"" << jsonEscape(param.first) << "\": \"" << jsonEscape(param.second) << "\",\n";
+        }
+        file << std::setprecision(10);
+        file << "      \"iterations\": " << result.iterations << ",\n";
+        file << "      \"real_time\": " << result.seconds_per_iteration * 1e9 << ",\n";
+        file << "      \"time_unit\": \"ns\",\n";
+        file << "      \"bytes\": " << result.bytes << ",\n";
+        file << "      \"elements\": " << result.elements << ",\n";
+        file << "      \"bytes_per_second\": " << result.gigabytes_per_second * 1e9 << ",\n";
+        file << "      \"items_per_second\": " << result.elements_per_second << ",\n";
+        file << "      \"cycles_per_element\": " << result.cycles_per_element << "\n";
+        file << "    }";
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+#endif // BENCHMARKHARNESS_H
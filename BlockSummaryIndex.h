@@ -0,0 +1,171 @@
+#ifndef BLOCKSUMMARYINDEX_H
+#define BLOCKSUMMARYINDEX_H
+#include <vector>
+#include <algorithm>
+#include <StatsExpression.h>
+
+// values summarised together by default. An edit recomputes at least one
+// block, and every update merges one summary per block
+constexpr size_t block_summary_default_block_size = 64 * expression_stats_block_size;
+
+// the feature states of a ReducerSet kept per fixed size block of a buffer
+// the caller goes on editing. After a write to a range only the blocks it
+// touched are reduced again and the block summaries merged anew, in block
+// order, so the results are bit for bit those of an index built from scratch
+// over the edited data. Counts, sums, moments, min/max and histograms all stay
+// exact that way. With differences, the DoesTheStats differences are kept too,
+// the seam with the value before an edited range included.
+//
+// The buffer is not copied and must outlive the index without being resized.
+template<typename... Reducers>
+class BlockSummaryIndex
+{
+public:
+    using States = typename ExpressionStatsLoop<Reducers...>::States;
+private:
+    struct BlockSummary
+    {
+        States states;
+        bool contains_nan_infs = false;
+        bool contains_ndvs = false;
+    };
+    StatsContext m_context;
+    const std::vector<float>& m_data;
+    NoDataClassifier m_classifier;
+    size_t m_block_size;
+    bool m_with_differences;
+    std::vector<BlockSummary> m_blocks;
+    std::vector<float> m_differences;
+    States m_states;
+    bool m_contains_nan_infs = false;
+    bool m_contains_ndvs = false;
+    size_t m_recomputed_blocks = 0;
+    void summarize(size_t first_block, size_t end_block);
+    void mergeBlocks();
+public:
+    // block_size is rounded up to a multiple of expression_stats_block_size
+    BlockSummaryIndex(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& ndvs,
+                      ReducerSet<Reducers...> reducers = {}, bool with_differences = false,
+                      size_t block_size = block_summary_default_block_size);
+    BlockSummaryIndex(const std::vector<float>& data, const std::vector<float>& ndvs,
+                      ReducerSet<Reducers...> reducers = {}, bool with_differences = false)
+        : BlockSummaryIndex(defaultStatsContext(), data, ndvs, reducers, with_differences)
+    {
+    }
+    // call after writing data[begin, end). false, leaving the index as it
+    // was, for a range past the end or a buffer that changed size
+    bool update(size_t begin, size_t end);
+    template<typename Reducer>
+    typename Reducer::Result get() const{
+        static_assert((std::is_same_v<Reducer, Reducers> || ...), "reducer is not part of this index");
+        return Reducer::finalize(m_states);
+    }
+    const States& getStates() const{
+        return m_states;
+    }
+    // empty unless constructed with_differences
+    const std::vector<float>& getDifferences() const{
+        return m_differences;
+    }
+    size_t getBlockSize() const{
+        return m_block_size;
+    }
+    size_t getNumBlocks() const{
+        return m_blocks.size();
+    }
+    // blocks reduced by the last update, or by the constructor
+    size_t getRecomputedBlocks() const{
+        return m_recomputed_blocks;
+    }
+    bool isGood() const{
+        return !m_contains_nan_infs && !m_contains_ndvs;
+    }
+};
+
+template<typename... Reducers>
+BlockSummaryIndex<Reducers...>::BlockSummaryIndex(const StatsContext& context, const std::vector<float>& data,
+                                                  const std::vector<float>& ndvs, ReducerSet<Reducers...>,
+                                                  bool with_differences, size_t block_size)
+    : m_context(context), m_data(data), m_classifier(ndvs), m_with_differences(with_differences)
+{
+    m_block_size = std::max<size_t>((block_size + expression_stats_block_size - 1) / expression_stats_block_size, 1)
+            * expression_stats_block_size;
+    m_blocks.resize((data.size() + m_block_size - 1) / m_block_size);
+    if(with_differences && !data.empty()){
+        m_differences.assign(data.size() - 1, 0.f);
+    }
+    summarize(0, m_blocks.size());
+    mergeBlocks();
+}
+
+template<typename... Reducers>
+bool BlockSummaryIndex<Reducers...>::update(size_t begin, size_t end)
+{
+    const size_t num_blocks = (m_data.size() + m_block_size - 1) / m_block_size;
+    if(begin > end || end > m_data.size() || num_blocks != m_blocks.size()){
+        return false;
+    }
+    if(begin == end){
+        m_recomputed_blocks = 0;
+        return true;
+    }
+    const size_t first_block = begin / m_block_size;
+    const size_t end_block = (end - 1) / m_block_size + 1;
+    summarize(first_block, end_block);
+    if(m_with_differences && end < m_data.size()){
+        // the difference after the range reads its last value
+        const float value = m_data[end];
+        m_differences[end - 1] = m_classifier.isValid(value) ? value - m_data[end - 1] : 0.f;
+    }
+    mergeBlocks();
+    return true;
+}
+
+template<typename... Reducers>
+void BlockSummaryIndex<Reducers...>::summarize(size_t first_block, size_t end_block)
+{
+    StatsExecutor& executor = m_context.getExecutor();
+    const size_t num_elements = std::min(end_block * m_block_size, m_data.size()) - first_block * m_block_size;
+    const ExecutionPlan plan = m_context.tuning.plan(num_elements, std::tuple_size_v<typename ExpressionStatsLoop<Reducers...>::Features>,
+                                                     executor.concurrency());
+    const size_t num_blocks = end_block - first_block;
+    const size_t blocks_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max<size_t>(plan.chunk_size / m_block_size, 1) : num_blocks;
+    const ChunkLayout layout(num_blocks, blocks_per_chunk, plan.schedule, plan.num_threads);
+    const float* data = m_data.data();
+    LoopTelemetryRecorder telemetry(m_context.telemetry_callback, plan, m_block_size);
+    runChunked(executor, layout, [&](size_t, size_t chunk_begin, size_t chunk_end, size_t){
+        for(size_t b=first_block+chunk_begin; b<first_block+chunk_end; b++){
+            const size_t begin = b * m_block_size;
+            const size_t end = std::min(begin + m_block_size, m_data.size());
+            BlockSummary& summary = m_blocks[b];
+            summary = BlockSummary();
+            accumulateExpressionBlocks(summary.states, m_classifier, data + begin, end - begin,
+                                       summary.contains_nan_infs, summary.contains_ndvs);
+            if(m_with_differences){
+                // differences ending in the block, the first one reads the block before
+                for(size_t i=std::max<size_t>(begin, 1); i<end; i++){
+                    m_differences[i - 1] = m_classifier.isValid(data[i]) ? data[i] - data[i - 1] : 0.f;
+                }
+            }
+        }
+    }, data + first_block * m_block_size, m_block_size * sizeof(float), telemetry.get());
+    telemetry.startMerge();
+    m_recomputed_blocks = num_blocks;
+    telemetry.publish();
+}
+
+template<typename... Reducers>
+void BlockSummaryIndex<Reducers...>::mergeBlocks()
+{
+    m_states = States();
+    m_contains_nan_infs = false;
+    m_contains_ndvs = false;
+    for(const BlockSummary& summary : m_blocks){
+        m_states.merge(summary.states);
+        m_contains_nan_infs |= summary.contains_nan_infs;
+        m_contains_ndvs |= summary.contains_ndvs;
+    }
+}
+
+#endif // BLOCKSUMMARYINDEX_H
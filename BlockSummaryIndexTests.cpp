@@ -0,0 +1,111 @@
+#include <BlockSummaryIndex.h>
+#include <BasicStats.h>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+struct TestBins
+{
+    static constexpr float lower = 0.f;
+    static constexpr float upper = 100.f;
+    static constexpr size_t count = 20;
+};
+
+using TestReducers = ReducerSet<Sum, Count, MinMax, Moments<4>, Histogram<TestBins> >;
+
+std::vector<float> testSeries(size_t count)
+{
+    std::vector<float> values = patternSeries(count, 109);
+    values[500] = -9999.f;
+    return values;
+}
+
+// an edited index has to be the index of the edited data
+template<typename Index>
+void expectSameAsRebuilt(const Index& index, const std::vector<float>& data, const StatsContext& context)
+{
+    const BlockSummaryIndex rebuilt(context, data, {-9999.f}, TestReducers(), true, index.getBlockSize());
+    EXPECT_EQ(index.template get<Sum>(), rebuilt.template get<Sum>());
+    EXPECT_EQ(index.template get<Count>(), rebuilt.template get<Count>());
+    EXPECT_EQ(index.template get<MinMax>().min, rebuilt.template get<MinMax>().min);
+    EXPECT_EQ(index.template get<MinMax>().max, rebuilt.template get<MinMax>().max);
+    EXPECT_EQ(index.template get<Moments<4> >().variance, rebuilt.template get<Moments<4> >().variance);
+    EXPECT_EQ(index.template get<Moments<4> >().kurtosis, rebuilt.template get<Moments<4> >().kurtosis);
+    EXPECT_EQ(index.template get<Histogram<TestBins> >().counts, rebuilt.template get<Histogram<TestBins> >().counts);
+    EXPECT_EQ(index.template get<Histogram<TestBins> >().above, rebuilt.template get<Histogram<TestBins> >().above);
+    EXPECT_EQ(index.isGood(), rebuilt.isGood());
+    // and the differences those of DoesTheStats, seams included
+    const DoesTheStats stats(data, {-9999.f}, context);
+    ASSERT_EQ(index.getDifferences().size(), stats.getDifferences().size());
+    for(size_t i=0; i<stats.getDifferences().size(); i++){
+        const float difference = index.getDifferences()[i];
+        const float expected = stats.getDifferences()[i];
+        ASSERT_TRUE(difference == expected || (std::isnan(difference) && std::isnan(expected))) << "difference " << i;
+    }
+}
+
+}
+
+TEST(BlockSummaryIndex, EditsMatchARebuild)
+{
+    ThreadPoolExecutor pool(3);
+    StatsContext context = parallelContext(pool);
+    std::vector<float> data = testSeries(300001);
+    BlockSummaryIndex index(context, data, {-9999.f}, TestReducers(), true, 4096);
+    EXPECT_EQ(index.getBlockSize(), 4096u);
+    EXPECT_EQ(index.getNumBlocks(), 74u);
+    EXPECT_EQ(index.getRecomputedBlocks(), 74u);
+    expectSameAsRebuilt(index, data, context);
+
+    // inside one block
+    data[10000] = 250.f;
+    data[10001] = -3.f;
+    ASSERT_TRUE(index.update(10000, 10002));
+    EXPECT_EQ(index.getRecomputedBlocks(), 1u);
+    expectSameAsRebuilt(index, data, context);
+
+    // ending on a block boundary, the next difference reads the edit
+    std::fill(data.begin() + 4096, data.begin() + 8192, 42.f);
+    ASSERT_TRUE(index.update(4096, 8192));
+    EXPECT_EQ(index.getRecomputedBlocks(), 1u);
+    expectSameAsRebuilt(index, data, context);
+
+    // across blocks, with a nan and a no data value
+    for(size_t i=70000; i<90000; i++){
+        data[i] = static_cast<float>(i % 13) * 0.5f;
+    }
+    data[75000] = std::numeric_limits<float>::quiet_NaN();
+    data[80000] = -9999.f;
+    ASSERT_TRUE(index.update(70000, 90000));
+    EXPECT_EQ(index.getRecomputedBlocks(), 5u);
+    expectSameAsRebuilt(index, data, context);
+    EXPECT_FALSE(index.isGood());
+
+    // the last, short block and the removal of every bad value
+    data[75000] = 1.f;
+    data[80000] = 1.f;
+    data[500] = 1.f;
+    data.back() = 99.5f;
+    ASSERT_TRUE(index.update(500, 501));
+    ASSERT_TRUE(index.update(75000, 80001));
+    ASSERT_TRUE(index.update(data.size() - 1, data.size()));
+    expectSameAsRebuilt(index, data, context);
+    EXPECT_TRUE(index.isGood());
+}
+
+TEST(BlockSummaryIndex, RejectsBadRanges)
+{
+    std::vector<float> data = testSeries(10000);
+    BlockSummaryIndex index(data, {-9999.f}, Sum{} | Count{});
+    const float sum = index.get<Sum>();
+    EXPECT_FALSE(index.update(5, 4));
+    EXPECT_FALSE(index.update(0, 10001));
+    EXPECT_TRUE(index.update(7, 7));
+    EXPECT_EQ(index.getRecomputedBlocks(), 0u);
+    EXPECT_TRUE(index.getDifferences().empty());
+    // a resized buffer no longer fits the blocks
+    data.resize(data.size() + block_summary_default_block_size);
+    EXPECT_FALSE(index.update(0, 1));
+    EXPECT_EQ(index.get<Sum>(), sum);
+}
@@ -0,0 +1,69 @@
+#include "BufferValidation.h"
+#include <NoDataClassifier.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace {
+
+// lowers the shared bad index to index unless a lower one is there already
+void lowerBadIndex(std::atomic<size_t>& bad_index, size_t index)
+{
+    size_t current = bad_index.load(std::memory_order_relaxed);
+    while(index < current && !bad_index.compare_exchange_weak(current, index, std::memory_order_relaxed)){
+    }
+}
+
+}
+
+ValidationResult validateBuffer(const float* values, size_t count, const std::vector<float>& ndvs,
+                                ValidationMode mode, const StatsContext& context)
+{
+    ValidationResult result;
+    result.bad_index = count;
+    result.values_checked = count;
+    if(count == 0){
+        return result;
+    }
+    const NoDataClassifier classifier(ndvs);
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(count, 1, executor.concurrency());
+    const size_t per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::clamp(plan.chunk_size, validation_block_size, validation_max_chunk_size) : count;
+    // equal chunks handed out in order, so the workers move through the buffer together
+    const ChunkLayout layout(count, per_chunk);
+    std::vector<std::vector<uint8_t> > worker_valid(executor.concurrency(), std::vector<uint8_t>(validation_block_size));
+    // count while nothing bad was found, the shared cancellation flag
+    std::atomic<size_t> bad_index(count);
+    std::atomic<size_t> values_checked(0);
+    const bool any = mode == ValidationMode::Any;
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan);
+    runChunked(executor, layout, [&](size_t, size_t begin, size_t end, size_t worker){
+        uint8_t* valid = worker_valid[worker].data();
+        size_t checked = 0;
+        for(size_t block_begin=begin; block_begin<end; block_begin+=validation_block_size){
+            const size_t found = bad_index.load(std::memory_order_relaxed);
+            if(any ? found != count : found < block_begin){
+                break;
+            }
+            const size_t block_count = std::min(validation_block_size, end - block_begin);
+            std::fill_n(valid, block_count, uint8_t(1));
+            const BlockClassification classification = classifier.classifyBlock(values + block_begin, block_count, valid);
+            checked += block_count;
+            if(classification.num_nan_infs + classification.num_ndvs > 0){
+                const size_t first = static_cast<size_t>(std::find(valid, valid + block_count, uint8_t(0)) - valid);
+                lowerBadIndex(bad_index, block_begin + first);
+                break;
+            }
+        }
+        values_checked.fetch_add(checked, std::memory_order_relaxed);
+    }, values, sizeof(float), telemetry.get());
+    telemetry.startMerge();
+    result.bad_index = bad_index.load();
+    result.values_checked = values_checked.load();
+    if(result.bad_index < count){
+        result.bad_value = NoDataClassifier::isFloatBad(values[result.bad_index]) ? BadValue::NanInf : BadValue::NoData;
+    }
+    telemetry.publish();
+    return result;
+}
@@ -0,0 +1,53 @@
+#ifndef BUFFERVALIDATION_H
+#define BUFFERVALIDATION_H
+#include <vector>
+#include <cstddef>
+#include <StatsContext.h>
+
+// values classified at once, the cancellation flag is read between blocks
+constexpr size_t validation_block_size = 1024;
+// longest chunk a validation hands to a worker. Short chunks keep the work done
+// past a bad value small whatever chunk size the tuning picks for stats
+constexpr size_t validation_max_chunk_size = 64 * validation_block_size;
+
+enum class ValidationMode
+{
+    First,  // the lowest bad index, values before it are all read
+    Any     // whichever bad value a worker meets first, the fastest rejection
+};
+
+enum class BadValue
+{
+    None,
+    NanInf,
+    NoData
+};
+
+struct ValidationResult
+{
+    // the offending value, count for a clean buffer
+    size_t bad_index = 0;
+    BadValue bad_value = BadValue::None;
+    // values classified before the workers stopped, count for a clean buffer
+    size_t values_checked = 0;
+    bool isGood() const{
+        return bad_value == BadValue::None;
+    }
+};
+
+// whether count values hold no nan/inf and no no data value, without reducing
+// anything. Workers share the lowest bad index found so far and stop at the
+// next block once nothing they could still find would be lower, or in Any mode
+// once anything was found, so a corrupt buffer is rejected after reading about
+// one chunk per worker past the bad value
+ValidationResult validateBuffer(const float* values, size_t count, const std::vector<float>& ndvs,
+                                ValidationMode mode = ValidationMode::First,
+                                const StatsContext& context = defaultStatsContext());
+inline ValidationResult validateBuffer(const std::vector<float>& data, const std::vector<float>& ndvs,
+                                       ValidationMode mode = ValidationMode::First,
+                                       const StatsContext& context = defaultStatsContext())
+{
+    return validateBuffer(data.data(), data.size(), ndvs, mode, context);
+}
+
+#endif // BUFFERVALIDATION_H
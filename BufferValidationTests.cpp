@@ -0,0 +1,57 @@
+#include <BufferValidation.h>
+#include <limits>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+TEST(BufferValidation, ReportsTheFirstBadIndex)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext parallel = parallelContext(pool);
+    StatsContext serial;
+    serial.tuning.forced_mode = ExecutionMode::Serial;
+    const StatsContext* contexts[] = {&serial, &parallel};
+    const float ndv = -9999.f;
+    std::vector<float> data(1000003);
+    for(size_t i=0; i<data.size(); i++){
+        data[i] = static_cast<float>(i % 97) * 0.5f;
+    }
+    for(const StatsContext* context : contexts){
+        const ValidationResult clean = validateBuffer(data, {ndv}, ValidationMode::First, *context);
+        EXPECT_TRUE(clean.isGood());
+        EXPECT_EQ(clean.bad_index, data.size());
+        EXPECT_EQ(clean.values_checked, data.size());
+    }
+
+    // bad values in several chunks, the lowest one wins whichever worker finds it
+    data[900000] = std::numeric_limits<float>::infinity();
+    data[612345] = std::numeric_limits<float>::quiet_NaN();
+    data[400001] = ndv;
+    for(const StatsContext* context : contexts){
+        const ValidationResult result = validateBuffer(data, {ndv}, ValidationMode::First, *context);
+        EXPECT_FALSE(result.isGood());
+        EXPECT_EQ(result.bad_index, 400001u);
+        EXPECT_EQ(result.bad_value, BadValue::NoData);
+        EXPECT_LT(result.values_checked, data.size());
+    }
+    data[7] = std::numeric_limits<float>::quiet_NaN();
+    const ValidationResult first = validateBuffer(data, {ndv}, ValidationMode::First, parallel);
+    EXPECT_EQ(first.bad_index, 7u);
+    EXPECT_EQ(first.bad_value, BadValue::NanInf);
+}
+
+TEST(BufferValidation, StopsSoonAfterABadValue)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext parallel = parallelContext(pool);
+    std::vector<float> data(size_t(16) << 20, 1.f);
+    data[100] = std::numeric_limits<float>::infinity();
+    // every worker stops within a chunk of it
+    const size_t bound = (pool.concurrency() + 1) * validation_max_chunk_size;
+    const ValidationResult first = validateBuffer(data, {}, ValidationMode::First, parallel);
+    EXPECT_EQ(first.bad_index, 100u);
+    EXPECT_LE(first.values_checked, bound);
+    data[data.size() - 1] = std::numeric_limits<float>::quiet_NaN();
+    const ValidationResult any = validateBuffer(data, {}, ValidationMode::Any, parallel);
+    EXPECT_FALSE(any.isGood());
+    EXPECT_LE(any.values_checked, bound);
+}
@@ -0,0 +1,233 @@
+#include "CompressedSeries.h"
+#include <algorithm>
+#include <cstring>
+#if defined(BASICSTATS_ZSTD) && __has_include(<zstd.h>)
+#include <zstd.h>
+#define COMPRESSED_SERIES_ZSTD 1
+#endif
+
+namespace {
+
+constexpr size_t header_bytes = 24;
+constexpr size_t frame_entry_bytes = 24;
+// the shortest LZ4 match, the match length of a token counts from it
+constexpr size_t lz4_min_match = 4;
+
+template<typename T>
+T readValue(const uint8_t* data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+// the rest of an LZ4 length after a nibble of 15, false when it runs off the end
+bool readLz4Length(const uint8_t*& in, const uint8_t* end, size_t& length)
+{
+    uint8_t byte = 0;
+    do{
+        if(in == end){
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    }while(byte == 255);
+    return true;
+}
+
+void undoDelta(uint32_t* words, size_t count)
+{
+    for(size_t i=1; i<count; i++){
+        words[i] += words[i - 1];
+    }
+}
+
+void undoXor(uint32_t* words, size_t count)
+{
+    for(size_t i=1; i<count; i++){
+        words[i] ^= words[i - 1];
+    }
+}
+
+bool isShuffled(FrameFilter filter)
+{
+    return filter == FrameFilter::ShuffleDelta || filter == FrameFilter::ShuffleXor;
+}
+
+}
+
+CompressedSeriesReader::CompressedSeriesReader(const uint8_t* data, size_t bytes)
+{
+    if(!data || bytes < header_bytes || readValue<uint32_t>(data) != compressed_series_magic ||
+       readValue<uint32_t>(data + 4) != compressed_series_version){
+        return;
+    }
+    m_num_values = readValue<uint64_t>(data + 8);
+    const size_t header_frame_values = std::min<size_t>(readValue<uint32_t>(data + 16), compressed_series_max_frame_values);
+    const size_t num_frames = readValue<uint32_t>(data + 20);
+    if(num_frames > (bytes - header_bytes) / frame_entry_bytes){
+        return;
+    }
+    m_frames.resize(num_frames);
+    size_t total_values = 0;
+    for(size_t f=0; f<num_frames; f++){
+        const uint8_t* entry = data + header_bytes + f * frame_entry_bytes;
+        const uint64_t offset = readValue<uint64_t>(entry);
+        CompressedFrame& frame = m_frames[f];
+        frame.bytes = readValue<uint32_t>(entry + 8);
+        frame.num_values = readValue<uint32_t>(entry + 12);
+        frame.filter = static_cast<FrameFilter>(entry[16]);
+        frame.codec = static_cast<FrameCodec>(entry[17]);
+        if(offset > bytes || frame.bytes > bytes - offset || frame.num_values > header_frame_values){
+            return;
+        }
+        frame.data = data + offset;
+        total_values += frame.num_values;
+        m_frame_values = std::max(m_frame_values, frame.num_values);
+    }
+    m_valid = total_values == m_num_values;
+}
+
+long lz4DecompressBlock(const uint8_t* source, size_t source_bytes, uint8_t* out, size_t out_capacity)
+{
+    const uint8_t* in = source;
+    const uint8_t* const in_end = source + source_bytes;
+    uint8_t* op = out;
+    uint8_t* const out_end = out + out_capacity;
+    while(in < in_end){
+        const uint8_t token = *in++;
+        size_t literals = token >> 4;
+        if(literals == 15 && !readLz4Length(in, in_end, literals)){
+            return -1;
+        }
+        if(literals > static_cast<size_t>(in_end - in) || literals > static_cast<size_t>(out_end - op)){
+            return -1;
+        }
+        std::memcpy(op, in, literals);
+        in += literals;
+        op += literals;
+        // the last sequence has no match
+        if(in == in_end){
+            break;
+        }
+        if(in_end - in < 2){
+            return -1;
+        }
+        const size_t offset = in[0] | (size_t(in[1]) << 8);
+        in += 2;
+        size_t match_length = token & 15;
+        if(match_length == 15 && !readLz4Length(in, in_end, match_length)){
+            return -1;
+        }
+        match_length += lz4_min_match;
+        if(offset == 0 || offset > static_cast<size_t>(op - out) || match_length > static_cast<size_t>(out_end - op)){
+            return -1;
+        }
+        const uint8_t* match = op - offset;
+        if(offset >= match_length){
+            std::memcpy(op, match, match_length);
+            op += match_length;
+        }
+        else{
+            // overlapping, the match repeats the last offset bytes
+            for(size_t k=0; k<match_length; k++){
+                *op++ = match[k];
+            }
+        }
+    }
+    return static_cast<long>(op - out);
+}
+
+bool isFrameCodecSupported(FrameCodec codec)
+{
+    switch(codec){
+    case FrameCodec::None:
+    case FrameCodec::Lz4:
+        return true;
+    case FrameCodec::Zstd:
+#ifdef COMPRESSED_SERIES_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+bool decodeFrame(const CompressedFrame& frame, float* out)
+{
+    if(static_cast<uint8_t>(frame.filter) > static_cast<uint8_t>(FrameFilter::ShuffleXor)){
+        return false;
+    }
+    const size_t out_bytes = frame.num_values * sizeof(float);
+    uint8_t* const target = reinterpret_cast<uint8_t*>(out);
+    // shuffled frames decompress beside out and are regrouped into it
+    thread_local std::vector<uint8_t> shuffled;
+    const bool shuffle = isShuffled(frame.filter);
+    uint8_t* decompressed = target;
+    if(shuffle && frame.codec != FrameCodec::None){
+        shuffled.resize(out_bytes);
+        decompressed = shuffled.data();
+    }
+    const uint8_t* filtered = decompressed;
+    switch(frame.codec){
+    case FrameCodec::None:
+        if(frame.bytes != out_bytes){
+            return false;
+        }
+        filtered = frame.data;
+        if(!shuffle){
+            std::memcpy(target, frame.data, out_bytes);
+        }
+        break;
+    case FrameCodec::Lz4:
+        if(lz4DecompressBlock(frame.data, frame.bytes, decompressed, out_bytes) != static_cast<long>(out_bytes)){
+            return false;
+        }
+        break;
+    case FrameCodec::Zstd:
+#ifdef COMPRESSED_SERIES_ZSTD
+        if(ZSTD_decompress(decompressed, out_bytes, frame.data, frame.bytes) != out_bytes){
+            return false;
+        }
+        break;
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+    if(shuffle){
+        unshuffleBytes(filtered, frame.num_values, target);
+    }
+    uint32_t* words = reinterpret_cast<uint32_t*>(out);
+    if(frame.filter == FrameFilter::Delta || frame.filter == FrameFilter::ShuffleDelta){
+        undoDelta(words, frame.num_values);
+    }
+    else if(frame.filter == FrameFilter::Xor || frame.filter == FrameFilter::ShuffleXor){
+        undoXor(words, frame.num_values);
+    }
+    return true;
+}
+
+void shuffleBytes(const uint8_t* values, size_t count, uint8_t* out)
+{
+    for(size_t b=0; b<sizeof(float); b++){
+        uint8_t* plane = out + b * count;
+        #pragma omp simd
+        for(size_t i=0; i<count; i++){
+            plane[i] = values[i * sizeof(float) + b];
+        }
+    }
+}
+
+void unshuffleBytes(const uint8_t* planes, size_t count, uint8_t* out)
+{
+    for(size_t b=0; b<sizeof(float); b++){
+        const uint8_t* plane = planes + b * count;
+        #pragma omp simd
+        for(size_t i=0; i<count; i++){
+            out[i * sizeof(float) + b] = plane[i];
+        }
+    }
+}
@@ -0,0 +1,180 @@
+#ifndef COMPRESSEDSERIES_H
+#define COMPRESSEDSERIES_H
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <StatsExpression.h>
+
+// first bytes of a compressed series
+constexpr uint32_t compressed_series_magic = 0x52455343; // "CSER"
+constexpr uint32_t compressed_series_version = 1;
+// values per frame the encoders write by default: a decoded frame is 256 KiB,
+// so it stays in L2 while it is reduced
+constexpr size_t compressed_series_default_frame_values = 64 * 1024;
+// values per frame a reader accepts, so an untrusted header cannot make every
+// worker allocate gigabytes of scratch. A decoded frame is at most 64 MiB
+constexpr size_t compressed_series_max_frame_values = 16 * 1024 * 1024;
+
+// what is done to a frame's values before compression, undone after it
+enum class FrameFilter : uint8_t
+{
+    None = 0,
+    // each value's bits less the bits of the value before, as 32 bit integers.
+    // The first value of a frame is stored as it is
+    Delta = 1,
+    // each value's bits xor the bits of the value before, which zeroes the
+    // sign, exponent and high mantissa bits neighbours share
+    Xor = 2,
+    // the predictors, then the bytes regrouped by position in the value: all
+    // first bytes, all second bytes and so on, so the mostly zero high bytes
+    // of a smooth series end up next to each other
+    ShuffleDelta = 3,
+    ShuffleXor = 4
+};
+
+enum class FrameCodec : uint8_t
+{
+    None = 0,
+    // one LZ4 block per frame
+    Lz4 = 1,
+    // one zstd frame per frame, only decoded when built with BASICSTATS_ZSTD
+    Zstd = 2
+};
+
+// a compressed series is a header, a table of frames and the frames, all
+// little endian. Frames are independent, so they decode in any order:
+//
+//  u32 magic, u32 version, u64 values, u32 frame values, u32 frames
+//  per frame: u64 offset from the start, u32 bytes, u32 values, u8 filter, u8 codec, 6 bytes zero
+//  the frames
+struct CompressedFrame
+{
+    const uint8_t* data = nullptr;
+    size_t bytes = 0;
+    size_t num_values = 0;
+    FrameFilter filter = FrameFilter::None;
+    FrameCodec codec = FrameCodec::None;
+};
+
+// the frames of a compressed series in memory, which must outlive the reader.
+// Nothing is decoded; isValid() is false for a header or frame table that does
+// not fit the buffer, or a frame of more than compressed_series_max_frame_values
+class CompressedSeriesReader
+{
+public:
+    CompressedSeriesReader(const uint8_t* data, size_t bytes);
+    bool isValid() const{
+        return m_valid;
+    }
+    size_t getNumValues() const{
+        return m_num_values;
+    }
+    // most values of any frame in the table, not the header's frame values
+    size_t getFrameValues() const{
+        return m_frame_values;
+    }
+    size_t getNumFrames() const{
+        return m_frames.size();
+    }
+    const CompressedFrame& getFrame(size_t frame) const{
+        return m_frames[frame];
+    }
+private:
+    std::vector<CompressedFrame> m_frames;
+    size_t m_num_values = 0;
+    size_t m_frame_values = 0;
+    bool m_valid = false;
+};
+
+// decodes an LZ4 block into out, checking every length and offset. The number
+// of bytes written, or -1 for a corrupt block or one that does not fit
+long lz4DecompressBlock(const uint8_t* source, size_t source_bytes, uint8_t* out, size_t out_capacity);
+bool isFrameCodecSupported(FrameCodec codec);
+// decompresses and unfilters a frame into its num_values floats at out. false
+// for a corrupt frame or a codec this build does not have
+bool decodeFrame(const CompressedFrame& frame, float* out);
+// byte b of value i goes to out[b * count + i], and back
+void shuffleBytes(const uint8_t* values, size_t count, uint8_t* out);
+void unshuffleBytes(const uint8_t* planes, size_t count, uint8_t* out);
+
+// a ReducerSet over a compressed series without ever holding the decoded
+// series. Each frame is decoded into its worker's scratch block and reduced
+// straight away; frames are spread over the context's executor and their
+// summaries merged in series order
+template<typename... Reducers>
+class CompressedStats
+{
+public:
+    CompressedStats(const StatsContext& context, const uint8_t* data, size_t bytes, const std::vector<float>& ndvs,
+                    ReducerSet<Reducers...> reducers = {});
+    CompressedStats(const StatsContext& context, const std::vector<uint8_t>& data, const std::vector<float>& ndvs,
+                    ReducerSet<Reducers...> reducers = {})
+        : CompressedStats(context, data.data(), data.size(), ndvs, reducers)
+    {
+    }
+    template<typename Reducer>
+    typename Reducer::Result get() const{
+        return m_summary.template get<Reducer>();
+    }
+    const StatsSummary<Reducers...>& getSummary() const{
+        return m_summary;
+    }
+    bool isGood() const{
+        return m_summary.isGood();
+    }
+    // every frame decoded. The statistics are only meaningful when it is
+    bool isDecodeGood() const{
+        return m_decode_good;
+    }
+    size_t getNumValues() const{
+        return m_num_values;
+    }
+private:
+    StatsSummary<Reducers...> m_summary;
+    size_t m_num_values = 0;
+    bool m_decode_good = false;
+};
+
+template<typename... Reducers>
+CompressedStats<Reducers...>::CompressedStats(const StatsContext& context, const uint8_t* data, size_t bytes,
+                                              const std::vector<float>& ndvs, ReducerSet<Reducers...>)
+{
+    const CompressedSeriesReader reader(data, bytes);
+    if(!reader.isValid()){
+        return;
+    }
+    const NoDataClassifier classifier(ndvs);
+    const size_t num_frames = reader.getNumFrames();
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(reader.getNumValues(),
+                                                   std::tuple_size_v<typename ExpressionStatsLoop<Reducers...>::Features>,
+                                                   executor.concurrency());
+    const size_t frames_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max<size_t>(plan.chunk_size / std::max<size_t>(reader.getFrameValues(), 1), 1) : num_frames;
+    const ChunkLayout layout(num_frames, frames_per_chunk, plan.schedule, plan.num_threads);
+    std::vector<StatsSummary<Reducers...> > frame_summaries(num_frames);
+    std::vector<std::vector<float> > worker_scratch(executor.concurrency());
+    std::atomic<bool> decode_good(true);
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan, reader.getFrameValues());
+    runChunked(executor, layout, [&](size_t, size_t first_frame, size_t end_frame, size_t worker){
+        std::vector<float>& scratch = worker_scratch[worker];
+        scratch.resize(reader.getFrameValues());
+        for(size_t f=first_frame; f<end_frame; f++){
+            const CompressedFrame& frame = reader.getFrame(f);
+            if(!decodeFrame(frame, scratch.data())){
+                decode_good.store(false, std::memory_order_relaxed);
+                return;
+            }
+            frame_summaries[f].accumulate(classifier, scratch.data(), frame.num_values);
+        }
+    }, nullptr, 0, telemetry.get());
+    telemetry.startMerge();
+    for(const StatsSummary<Reducers...>& summary : frame_summaries){
+        m_summary.merge(summary);
+    }
+    m_decode_good = decode_good.load();
+    m_num_values = reader.getNumValues();
+    telemetry.publish();
+}
+
+#endif // COMPRESSEDSERIES_H
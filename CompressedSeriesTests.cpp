@@ -0,0 +1,176 @@
+#include <CompressedSeries.h>
+#include <cstring>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+using TestReducers = ReducerSet<Sum, Count, MinMax>;
+
+struct TestFrame
+{
+    std::vector<uint8_t> bytes;
+    size_t num_values = 0;
+    FrameFilter filter = FrameFilter::None;
+    FrameCodec codec = FrameCodec::None;
+};
+
+template<typename T>
+void append(std::vector<uint8_t>& out, T value)
+{
+    const size_t at = out.size();
+    out.resize(at + sizeof(T));
+    std::memcpy(out.data() + at, &value, sizeof(T));
+}
+
+std::vector<uint8_t> makeSeries(const std::vector<TestFrame>& frames, size_t frame_values)
+{
+    size_t num_values = 0;
+    for(const TestFrame& frame : frames){
+        num_values += frame.num_values;
+    }
+    std::vector<uint8_t> out;
+    append<uint32_t>(out, compressed_series_magic);
+    append<uint32_t>(out, compressed_series_version);
+    append<uint64_t>(out, num_values);
+    append<uint32_t>(out, static_cast<uint32_t>(frame_values));
+    append<uint32_t>(out, static_cast<uint32_t>(frames.size()));
+    uint64_t offset = out.size() + frames.size() * 24;
+    for(const TestFrame& frame : frames){
+        append<uint64_t>(out, offset);
+        append<uint32_t>(out, static_cast<uint32_t>(frame.bytes.size()));
+        append<uint32_t>(out, static_cast<uint32_t>(frame.num_values));
+        append<uint8_t>(out, static_cast<uint8_t>(frame.filter));
+        append<uint8_t>(out, static_cast<uint8_t>(frame.codec));
+        out.resize(out.size() + 6, 0);
+        offset += frame.bytes.size();
+    }
+    for(const TestFrame& frame : frames){
+        out.insert(out.end(), frame.bytes.begin(), frame.bytes.end());
+    }
+    return out;
+}
+
+void appendLz4Length(std::vector<uint8_t>& out, size_t length)
+{
+    for(length-=15; length>=255; length-=255){
+        out.push_back(255);
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+// a valid LZ4 block of literals only
+std::vector<uint8_t> lz4Literals(const uint8_t* data, size_t bytes)
+{
+    std::vector<uint8_t> out;
+    out.push_back(static_cast<uint8_t>(std::min<size_t>(bytes, 15) << 4));
+    if(bytes >= 15){
+        appendLz4Length(out, bytes);
+    }
+    out.insert(out.end(), data, data + bytes);
+    return out;
+}
+
+TestFrame rawFrame(const float* values, size_t count, FrameFilter filter, FrameCodec codec)
+{
+    std::vector<uint32_t> words(count);
+    std::memcpy(words.data(), values, count * sizeof(float));
+    if(filter == FrameFilter::Delta){
+        for(size_t i=count; i-->1;){
+            words[i] -= words[i - 1];
+        }
+    }
+    TestFrame frame;
+    frame.num_values = count;
+    frame.filter = filter;
+    frame.codec = codec;
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(words.data());
+    if(codec == FrameCodec::Lz4){
+        frame.bytes = lz4Literals(bytes, count * sizeof(float));
+    }
+    else{
+        frame.bytes.assign(bytes, bytes + count * sizeof(float));
+    }
+    return frame;
+}
+
+}
+
+TEST(CompressedSeries, DecodesLz4Matches)
+{
+    // one value, then a match repeating it 300 times over itself, then a last literal value
+    const float first = 2.5f;
+    const float last = -1.f;
+    std::vector<uint8_t> block;
+    block.push_back(static_cast<uint8_t>((4 << 4) | 15));
+    block.insert(block.end(), reinterpret_cast<const uint8_t*>(&first), reinterpret_cast<const uint8_t*>(&first) + 4);
+    block.push_back(4);
+    block.push_back(0);
+    appendLz4Length(block, 300 * 4 - 4);
+    block.push_back(4 << 4);
+    block.insert(block.end(), reinterpret_cast<const uint8_t*>(&last), reinterpret_cast<const uint8_t*>(&last) + 4);
+
+    std::vector<float> decoded(302);
+    ASSERT_EQ(lz4DecompressBlock(block.data(), block.size(), reinterpret_cast<uint8_t*>(decoded.data()), decoded.size() * 4),
+              long(decoded.size() * 4));
+    for(size_t i=0; i<301; i++){
+        ASSERT_EQ(decoded[i], first) << "index " << i;
+    }
+    EXPECT_EQ(decoded[301], last);
+    // too small an output and a match reaching before the start are refused
+    EXPECT_EQ(lz4DecompressBlock(block.data(), block.size(), reinterpret_cast<uint8_t*>(decoded.data()), 100), -1);
+    block[5] = 8;
+    EXPECT_EQ(lz4DecompressBlock(block.data(), block.size(), reinterpret_cast<uint8_t*>(decoded.data()), decoded.size() * 4), -1);
+}
+
+TEST(CompressedSeries, StatsMatchDecodedSeries)
+{
+    const size_t frame_values = 1000;
+    std::vector<float> values(10 * frame_values + 123);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = static_cast<float>(i % 501) * 0.5f - 30.f;
+    }
+    values[4321] = -9999.f;
+    std::vector<TestFrame> frames;
+    for(size_t begin=0, f=0; begin<values.size(); begin+=frame_values, f++){
+        const size_t count = std::min(frame_values, values.size() - begin);
+        frames.push_back(rawFrame(values.data() + begin, count, f % 2 ? FrameFilter::Delta : FrameFilter::None,
+                                  f % 3 ? FrameCodec::Lz4 : FrameCodec::None));
+    }
+    const std::vector<uint8_t> series = makeSeries(frames, frame_values);
+    const ExpressionStatsLoop direct(values, {-9999.f}, TestReducers());
+
+    ThreadPoolExecutor pool(3);
+    StatsContext parallel = parallelContext(pool);
+    StatsContext serial;
+    serial.tuning.forced_mode = ExecutionMode::Serial;
+    const StatsContext* contexts[] = {&serial, &parallel};
+    for(const StatsContext* context : contexts){
+        const CompressedStats stats(*context, series, {-9999.f}, TestReducers());
+        ASSERT_TRUE(stats.isDecodeGood());
+        EXPECT_FALSE(stats.isGood());
+        EXPECT_EQ(stats.getNumValues(), values.size());
+        EXPECT_EQ(stats.get<Count>(), direct.get<Count>());
+        EXPECT_EQ(stats.get<MinMax>().min, direct.get<MinMax>().min);
+        EXPECT_EQ(stats.get<MinMax>().max, direct.get<MinMax>().max);
+        EXPECT_NEAR(stats.get<Sum>(), direct.get<Sum>(), std::abs(direct.get<Sum>()) * 1e-5f);
+    }
+
+    // a frame running past the buffer, and a frame whose codec is unknown
+    std::vector<uint8_t> truncated(series.begin(), series.end() - 1);
+    EXPECT_FALSE(CompressedStats(serial, truncated, {}, TestReducers()).isDecodeGood());
+    frames[3].codec = static_cast<FrameCodec>(7);
+    EXPECT_FALSE(CompressedStats(parallel, makeSeries(frames, frame_values), {}, TestReducers()).isDecodeGood());
+    frames[3].codec = FrameCodec::None;
+
+    // scratch follows the frames, not a header claiming huge ones
+    const std::vector<uint8_t> inflated = makeSeries(frames, 0xFFFFFFFFu);
+    const CompressedSeriesReader reader(inflated.data(), inflated.size());
+    ASSERT_TRUE(reader.isValid());
+    EXPECT_EQ(reader.getFrameValues(), frame_values);
+    EXPECT_TRUE(CompressedStats(parallel, inflated, {-9999.f}, TestReducers()).isDecodeGood());
+    // and frames past the cap are refused
+    frames.push_back({{}, compressed_series_max_frame_values + 1});
+    const std::vector<uint8_t> oversized = makeSeries(frames, 0xFFFFFFFFu);
+    EXPECT_FALSE(CompressedSeriesReader(oversized.data(), oversized.size()).isValid());
+}
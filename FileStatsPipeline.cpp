@@ -0,0 +1,486 @@
+#include "FileStatsPipeline.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <thread>
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define FILE_PIPELINE_POSIX 1
+#else
+#include <fstream>
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define FILE_PIPELINE_IO_URING 1
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct AlignedFree
+{
+    void operator()(void* pointer) const{
+        ::operator delete(pointer, std::align_val_t(file_pipeline_alignment));
+    }
+};
+
+// one buffer of the ring and the read going into it
+struct Slot
+{
+    std::unique_ptr<void, AlignedFree> buffer;
+    size_t offset = 0;
+    // bytes of the file the chunk covers, and of those read so far
+    size_t expected = 0;
+    size_t done = 0;
+    bool pending = false;
+    bool failed = false;
+    Clock::time_point submitted;
+    Clock::time_point completed;
+};
+
+#ifdef FILE_PIPELINE_IO_URING
+// the few io_uring calls the reader needs, straight through the system calls so
+// no liburing is required
+class IoUring
+{
+public:
+    ~IoUring(){
+        if(m_sqes){
+            munmap(m_sqes, m_sqes_size);
+        }
+        if(m_cq_ring && m_cq_ring != m_sq_ring){
+            munmap(m_cq_ring, m_cq_size);
+        }
+        if(m_sq_ring){
+            munmap(m_sq_ring, m_sq_size);
+        }
+        if(m_fd >= 0){
+            close(m_fd);
+        }
+    }
+    bool setup(unsigned entries){
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if(m_fd < 0){
+            return false;
+        }
+        m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if(single_mmap){
+            m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+        }
+        m_sq_ring = map(m_sq_size, IORING_OFF_SQ_RING);
+        m_cq_ring = single_mmap ? m_sq_ring : map(m_cq_size, IORING_OFF_CQ_RING);
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = static_cast<io_uring_sqe*>(map(m_sqes_size, IORING_OFF_SQES));
+        if(!m_sq_ring || !m_cq_ring || !m_sqes){
+            return false;
+        }
+        char* sq = static_cast<char*>(m_sq_ring);
+        char* cq = static_cast<char*>(m_cq_ring);
+        m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        // IORING_OP_READ and the probe came with Linux 5.6, older kernels set up
+        // the ring but fail every read with -EINVAL
+        return supports(IORING_OP_READ);
+    }
+    bool read(int fd, void* buffer, unsigned length, uint64_t offset, uint64_t user_data){
+        const unsigned tail = *m_sq_tail;
+        const unsigned index = tail & m_sq_mask;
+        io_uring_sqe& sqe = m_sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uintptr_t>(buffer);
+        sqe.len = length;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        m_sq_array[index] = index;
+        __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+        for(;;){
+            const long submitted = syscall(__NR_io_uring_enter, m_fd, 1, 0, 0, nullptr, 0);
+            if(submitted >= 0 || errno != EINTR){
+                return submitted == 1;
+            }
+        }
+    }
+    // the next completion, waiting for one if there is none
+    bool complete(uint64_t& user_data, int& result){
+        for(;;){
+            const unsigned head = *m_cq_head;
+            if(head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)){
+                const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+                user_data = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if(syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR){
+                return false;
+            }
+        }
+    }
+private:
+    bool supports(unsigned opcode){
+        const unsigned num_ops = 256;
+        std::vector<uint64_t> storage((sizeof(io_uring_probe) + num_ops * sizeof(io_uring_probe_op) + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if(syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, num_ops) < 0){
+            return false;
+        }
+        return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    }
+    void* map(size_t size, off_t offset){
+        void* pointer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+        return pointer == MAP_FAILED ? nullptr : pointer;
+    }
+    int m_fd = -1;
+    void* m_sq_ring = nullptr;
+    void* m_cq_ring = nullptr;
+    size_t m_sq_size = 0;
+    size_t m_cq_size = 0;
+    size_t m_sqes_size = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    unsigned* m_sq_tail = nullptr;
+    unsigned m_sq_mask = 0;
+    unsigned* m_sq_array = nullptr;
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    unsigned m_cq_mask = 0;
+    io_uring_cqe* m_cqes = nullptr;
+};
+#endif
+
+}
+
+struct FileChunkReader::Impl
+{
+#ifdef FILE_PIPELINE_POSIX
+    int fd = -1;
+#else
+    // one stream the read threads take turns on
+    std::ifstream file;
+    std::mutex file_mutex;
+#endif
+    bool open = false;
+    size_t file_size = 0;
+    size_t chunk_bytes = 0;
+    bool direct_io = false;
+    FileReadBackend backend = FileReadBackend::PreadThreads;
+    std::vector<Slot> slots;
+    // [submitted, completed) of every finished read, for the time reads were in flight
+    std::vector<std::pair<Clock::time_point, Clock::time_point> > read_spans;
+#ifdef FILE_PIPELINE_IO_URING
+    std::unique_ptr<IoUring> ring;
+#endif
+    // the pread threads and the slots waiting for them
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<size_t> requests;
+    std::vector<std::thread> threads;
+    bool stop = false;
+
+    bool usesRing() const{
+        return backend == FileReadBackend::IoUring;
+    }
+    // where the next read of a slot starts. Direct I/O needs an aligned offset
+    // and buffer, so after a short read it reads again from the last aligned block
+    size_t requestStart(const Slot& slot) const{
+        return direct_io ? slot.done / file_pipeline_alignment * file_pipeline_alignment : slot.done;
+    }
+    // the rest of a slot's chunk, rounded up to whole aligned blocks for direct I/O
+    size_t requestLength(const Slot& slot) const{
+        const size_t remaining = slot.expected - requestStart(slot);
+        return direct_io ? (remaining + file_pipeline_alignment - 1) / file_pipeline_alignment * file_pipeline_alignment : remaining;
+    }
+    // a read of result bytes from requestStart finished, true once the chunk
+    // is complete or failed
+    bool account(Slot& slot, long result){
+        if(result < 0){
+            slot.failed = true;
+        }
+        else{
+            const size_t reached = std::min(slot.expected, requestStart(slot) + static_cast<size_t>(result));
+            // nothing more where there should have been data, the file shrank
+            slot.failed = reached <= slot.done && slot.done < slot.expected;
+            slot.done = std::max(slot.done, reached);
+        }
+        return slot.failed || slot.done == slot.expected;
+    }
+    // bytes read at offset, or -1
+    long readAt(void* target, size_t length, size_t offset){
+#ifdef FILE_PIPELINE_POSIX
+        for(;;){
+            const ssize_t result = pread(fd, target, length, static_cast<off_t>(offset));
+            if(result >= 0 || errno != EINTR){
+                return static_cast<long>(result);
+            }
+        }
+#else
+        std::lock_guard<std::mutex> lock(file_mutex);
+        file.clear();
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(static_cast<char*>(target), static_cast<std::streamsize>(length));
+        return file.bad() ? -1 : static_cast<long>(file.gcount());
+#endif
+    }
+    void preadLoop(){
+        for(;;){
+            size_t index = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&](){
+                    return stop || !requests.empty();
+                });
+                if(requests.empty()){
+                    return;
+                }
+                index = requests.front();
+                requests.pop_front();
+            }
+            Slot& slot = slots[index];
+            bool finished = false;
+            while(!finished){
+                const size_t start = requestStart(slot);
+                char* target = static_cast<char*>(slot.buffer.get()) + start;
+                finished = account(slot, readAt(target, requestLength(slot), slot.offset + start));
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slot.completed = Clock::now();
+                slot.pending = false;
+            }
+            changed.notify_all();
+        }
+    }
+#ifdef FILE_PIPELINE_IO_URING
+    bool submitRing(size_t index){
+        Slot& slot = slots[index];
+        const size_t start = requestStart(slot);
+        char* target = static_cast<char*>(slot.buffer.get()) + start;
+        return ring->read(fd, target, static_cast<unsigned>(requestLength(slot)), slot.offset + start, index);
+    }
+#endif
+};
+
+FileChunkReader::FileChunkReader(const std::string& path, const FilePipelineOptions& options)
+    : m_impl(std::make_unique<Impl>())
+{
+    Impl& impl = *m_impl;
+    // a ring read takes a 32 bit length
+    const size_t max_chunk_bytes = std::numeric_limits<unsigned>::max() / file_pipeline_alignment * file_pipeline_alignment;
+    const size_t chunk_bytes = std::min(options.chunk_bytes, max_chunk_bytes);
+    impl.chunk_bytes = std::max<size_t>((chunk_bytes + file_pipeline_alignment - 1) / file_pipeline_alignment, 1)
+            * file_pipeline_alignment;
+#ifdef FILE_PIPELINE_POSIX
+    if(options.direct_io){
+#ifdef O_DIRECT
+        impl.fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+        impl.direct_io = impl.fd >= 0;
+#endif
+    }
+    if(impl.fd < 0){
+        impl.fd = open(path.c_str(), O_RDONLY);
+    }
+    struct stat status;
+    if(impl.fd < 0 || fstat(impl.fd, &status) != 0){
+        return;
+    }
+    impl.file_size = static_cast<size_t>(status.st_size);
+#else
+    // no direct I/O, the stream reads through the cache
+    impl.file.open(path, std::ios::binary | std::ios::ate);
+    if(!impl.file.is_open()){
+        return;
+    }
+    impl.file_size = static_cast<size_t>(impl.file.tellg());
+#endif
+    impl.open = true;
+    const size_t num_buffers = std::max<size_t>(std::min(options.num_buffers, std::max<size_t>(getNumChunks(), 1)), 1);
+    impl.slots.resize(num_buffers);
+    for(Slot& slot : impl.slots){
+        slot.buffer.reset(::operator new(impl.chunk_bytes, std::align_val_t(file_pipeline_alignment)));
+    }
+#ifdef FILE_PIPELINE_IO_URING
+    if(options.backend != FileReadBackend::PreadThreads){
+        impl.ring = std::make_unique<IoUring>();
+        if(impl.ring->setup(static_cast<unsigned>(num_buffers))){
+            impl.backend = FileReadBackend::IoUring;
+        }
+        else{
+            impl.ring.reset();
+        }
+    }
+#endif
+    if(impl.backend == FileReadBackend::PreadThreads){
+        for(size_t i=0; i<std::max<size_t>(std::min(options.num_read_threads, num_buffers), 1); i++){
+            impl.threads.emplace_back([&impl](){
+                impl.preadLoop();
+            });
+        }
+    }
+}
+
+FileChunkReader::~FileChunkReader()
+{
+    Impl& impl = *m_impl;
+    {
+        std::lock_guard<std::mutex> lock(impl.mutex);
+        impl.stop = true;
+    }
+    impl.changed.notify_all();
+    for(std::thread& thread : impl.threads){
+        thread.join();
+    }
+#ifdef FILE_PIPELINE_IO_URING
+    // the kernel may still write into the buffers until every read is reaped
+    for(size_t index=0; impl.usesRing() && index<impl.slots.size(); index++){
+        size_t bytes = 0;
+        wait(index, bytes);
+    }
+    impl.ring.reset();
+#endif
+#ifdef FILE_PIPELINE_POSIX
+    if(impl.fd >= 0){
+        close(impl.fd);
+    }
+#endif
+}
+
+bool FileChunkReader::isOpen() const
+{
+    return m_impl->open && !m_impl->slots.empty();
+}
+
+size_t FileChunkReader::getFileSize() const
+{
+    return m_impl->file_size;
+}
+
+size_t FileChunkReader::getChunkBytes() const
+{
+    return m_impl->chunk_bytes;
+}
+
+size_t FileChunkReader::getNumChunks() const
+{
+    return (m_impl->file_size + m_impl->chunk_bytes - 1) / m_impl->chunk_bytes;
+}
+
+size_t FileChunkReader::getNumBuffers() const
+{
+    return m_impl->slots.size();
+}
+
+void FileChunkReader::submit(size_t slot_index, size_t chunk)
+{
+    Impl& impl = *m_impl;
+    Slot& slot = impl.slots[slot_index];
+    slot.offset = chunk * impl.chunk_bytes;
+    slot.expected = std::min(impl.chunk_bytes, impl.file_size - std::min(slot.offset, impl.file_size));
+    slot.done = 0;
+    slot.failed = false;
+    slot.pending = true;
+    slot.submitted = Clock::now();
+#ifdef FILE_PIPELINE_IO_URING
+    if(impl.usesRing()){
+        if(slot.expected == 0 || !impl.submitRing(slot_index)){
+            slot.failed = slot.expected != 0;
+            slot.pending = false;
+            slot.completed = slot.submitted;
+        }
+        return;
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> lock(impl.mutex);
+        impl.requests.push_back(slot_index);
+    }
+    impl.changed.notify_all();
+}
+
+const void* FileChunkReader::wait(size_t slot_index, size_t& bytes)
+{
+    Impl& impl = *m_impl;
+    Slot& slot = impl.slots[slot_index];
+#ifdef FILE_PIPELINE_IO_URING
+    if(impl.usesRing()){
+        // completions of other slots are kept until those are waited for
+        while(slot.pending){
+            uint64_t index = 0;
+            int result = 0;
+            if(!impl.ring->complete(index, result)){
+                slot.failed = true;
+                slot.pending = false;
+                break;
+            }
+            Slot& finished = impl.slots[index];
+            if(!impl.account(finished, result)){
+                // a short read, the rest goes in again
+                if(impl.submitRing(index)){
+                    continue;
+                }
+                finished.failed = true;
+            }
+            finished.completed = Clock::now();
+            finished.pending = false;
+        }
+    }
+#endif
+    if(!impl.usesRing()){
+        std::unique_lock<std::mutex> lock(impl.mutex);
+        impl.changed.wait(lock, [&](){
+            return !slot.pending;
+        });
+    }
+    if(slot.submitted != slot.completed || slot.done > 0){
+        impl.read_spans.emplace_back(slot.submitted, slot.completed);
+        slot.submitted = slot.completed;
+    }
+    bytes = slot.done;
+    return slot.failed ? nullptr : slot.buffer.get();
+}
+
+FileReadBackend FileChunkReader::getBackend() const
+{
+    return m_impl->backend;
+}
+
+bool FileChunkReader::usesDirectIo() const
+{
+    return m_impl->direct_io;
+}
+
+double FileChunkReader::getReadSeconds() const
+{
+    // the union of the spans, reads in flight together count once
+    std::vector<std::pair<Clock::time_point, Clock::time_point> > spans = m_impl->read_spans;
+    std::sort(spans.begin(), spans.end());
+    double seconds = 0.0;
+    Clock::time_point covered = Clock::time_point::min();
+    for(const auto& span : spans){
+        const Clock::time_point begin = std::max(span.first, covered);
+        if(span.second > begin){
+            seconds += std::chrono::duration<double>(span.second - begin).count();
+            covered = span.second;
+        }
+    }
+    return seconds;
+}
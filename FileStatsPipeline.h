@@ -0,0 +1,165 @@
+#ifndef FILESTATSPIPELINE_H
+#define FILESTATSPIPELINE_H
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <StatsExpression.h>
+
+// chunk offsets and lengths are multiples of this, which direct I/O needs
+constexpr size_t file_pipeline_alignment = 4096;
+
+enum class FileReadBackend
+{
+    Auto,           // io_uring when the kernel allows it, pread threads otherwise
+    IoUring,        // falls back to pread threads when io_uring or its read cannot be set up
+    PreadThreads
+};
+
+struct FilePipelineOptions
+{
+    // bytes read and reduced at once, rounded up to file_pipeline_alignment and
+    // kept below 4 GiB, the longest read io_uring takes
+    size_t chunk_bytes = size_t(8) << 20;
+    // 2 reads the next chunk while one is reduced, 3 keeps two reads in flight
+    size_t num_buffers = 3;
+    FileReadBackend backend = FileReadBackend::Auto;
+    // threads of the pread fallback
+    size_t num_read_threads = 2;
+    // O_DIRECT, so a large scan does not push everything else out of the page
+    // cache. Files on file systems without it are read through the cache
+    bool direct_io = false;
+};
+
+// how the reads and the reductions of a file went
+struct FilePipelineReport
+{
+    FileReadBackend backend = FileReadBackend::PreadThreads;
+    bool direct_io = false;
+    size_t bytes_read = 0;
+    size_t num_chunks = 0;
+    double wall_seconds = 0.0;
+    // time with at least one read in flight
+    double read_seconds = 0.0;
+    // time reducing chunks
+    double compute_seconds = 0.0;
+    // time the reductions waited for a read, 0 when the disk kept up
+    double stall_seconds = 0.0;
+    double disk_bytes_per_second = 0.0;
+    double compute_bytes_per_second = 0.0;
+    // what the pipeline sustains, min(disk, compute)
+    double throughput = 0.0;
+};
+
+// reads a file chunk by chunk into a ring of aligned buffers, the reads of
+// later chunks in flight while the caller works on an earlier one
+class FileChunkReader
+{
+public:
+    FileChunkReader(const std::string& path, const FilePipelineOptions& options);
+    ~FileChunkReader();
+    FileChunkReader(const FileChunkReader&) = delete;
+    FileChunkReader& operator=(const FileChunkReader&) = delete;
+    bool isOpen() const;
+    size_t getFileSize() const;
+    size_t getChunkBytes() const;
+    size_t getNumChunks() const;
+    size_t getNumBuffers() const;
+    // starts reading chunk into buffer slot, which must not be in use
+    void submit(size_t slot, size_t chunk);
+    // waits for slot's read, nullptr after a read error. bytes is what the
+    // chunk holds, less at the end of the file
+    const void* wait(size_t slot, size_t& bytes);
+    FileReadBackend getBackend() const;
+    bool usesDirectIo() const;
+    // time with at least one read in flight so far
+    double getReadSeconds() const;
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_impl;
+};
+
+// a ReducerSet over a file of native float values, reduced chunk by chunk
+// while the next chunks are read. Each chunk is reduced in parallel with the
+// context and the chunk summaries merged in file order. A trailing partial
+// value is ignored
+template<typename... Reducers>
+class FileStats
+{
+public:
+    FileStats(const StatsContext& context, const std::string& path, const std::vector<float>& ndvs,
+              ReducerSet<Reducers...> reducers = {}, const FilePipelineOptions& options = FilePipelineOptions());
+    template<typename Reducer>
+    typename Reducer::Result get() const{
+        return m_summary.template get<Reducer>();
+    }
+    const StatsSummary<Reducers...>& getSummary() const{
+        return m_summary;
+    }
+    bool isGood() const{
+        return m_summary.isGood();
+    }
+    // the file opened and every chunk was read
+    bool isReadComplete() const{
+        return m_read_complete;
+    }
+    const FilePipelineReport& getReport() const{
+        return m_report;
+    }
+private:
+    StatsSummary<Reducers...> m_summary;
+    FilePipelineReport m_report;
+    bool m_read_complete = false;
+};
+
+template<typename... Reducers>
+FileStats<Reducers...>::FileStats(const StatsContext& context, const std::string& path, const std::vector<float>& ndvs,
+                                  ReducerSet<Reducers...>, const FilePipelineOptions& options)
+{
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    FileChunkReader reader(path, options);
+    if(!reader.isOpen()){
+        return;
+    }
+    const size_t num_chunks = reader.getNumChunks();
+    const size_t num_buffers = reader.getNumBuffers();
+    for(size_t chunk=0; chunk<std::min(num_chunks, num_buffers); chunk++){
+        reader.submit(chunk, chunk);
+    }
+    m_read_complete = true;
+    for(size_t chunk=0; chunk<num_chunks; chunk++){
+        const size_t slot = chunk % num_buffers;
+        size_t bytes = 0;
+        const Clock::time_point waited = Clock::now();
+        const void* data = reader.wait(slot, bytes);
+        const Clock::time_point arrived = Clock::now();
+        m_report.stall_seconds += std::chrono::duration<double>(arrived - waited).count();
+        if(!data){
+            m_read_complete = false;
+            // the reads already in flight still land in their buffers
+            for(size_t pending=chunk+1; pending<std::min(num_chunks, chunk + num_buffers); pending++){
+                reader.wait(pending % num_buffers, bytes);
+            }
+            break;
+        }
+        const ExpressionStatsLoop<Reducers...> loop(context, static_cast<const float*>(data), bytes / sizeof(float), ndvs);
+        m_summary.merge(StatsSummary<Reducers...>(loop));
+        m_report.compute_seconds += std::chrono::duration<double>(Clock::now() - arrived).count();
+        m_report.bytes_read += bytes;
+        m_report.num_chunks++;
+        if(chunk + num_buffers < num_chunks){
+            reader.submit(slot, chunk + num_buffers);
+        }
+    }
+    m_report.backend = reader.getBackend();
+    m_report.direct_io = reader.usesDirectIo();
+    m_report.wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    m_report.read_seconds = reader.getReadSeconds();
+    const double bytes = static_cast<double>(m_report.bytes_read);
+    m_report.disk_bytes_per_second = m_report.read_seconds > 0.0 ? bytes / m_report.read_seconds : 0.0;
+    m_report.compute_bytes_per_second = m_report.compute_seconds > 0.0 ? bytes / m_report.compute_seconds : 0.0;
+    m_report.throughput = std::min(m_report.disk_bytes_per_second, m_report.compute_bytes_per_second);
+}
+
+#endif // FILESTATSPIPELINE_H
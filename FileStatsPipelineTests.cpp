@@ -0,0 +1,66 @@
+#include <FileStatsPipeline.h>
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+
+namespace {
+
+using TestReducers = ReducerSet<Sum, Count, MinMax>;
+
+std::string writeSeries(const std::vector<float>& values, const std::string& name, size_t extra_bytes = 0)
+{
+    const std::string path = testing::TempDir() + name;
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(float)));
+    const char padding[3] = {};
+    file.write(padding, static_cast<std::streamsize>(extra_bytes));
+    return path;
+}
+
+}
+
+TEST(FileStatsPipeline, MatchesInMemoryStatsForEveryBackend)
+{
+    std::vector<float> values(300007);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = static_cast<float>(i % 1013) * 0.25f - 100.f;
+    }
+    values[123456] = -9999.f;
+    const std::string path = writeSeries(values, "file_stats_pipeline.bin", 3);
+    const ExpressionStatsLoop direct(values, {-9999.f}, TestReducers());
+    StatsContext context;
+    context.tuning.forced_mode = ExecutionMode::Serial;
+
+    const FileReadBackend backends[] = {FileReadBackend::IoUring, FileReadBackend::PreadThreads};
+    for(FileReadBackend backend : backends){
+        for(bool direct_io : {false, true}){
+            FilePipelineOptions options;
+            options.backend = backend;
+            options.direct_io = direct_io;
+            options.chunk_bytes = 64 * 1024;
+            const FileStats stats(context, path, {-9999.f}, TestReducers(), options);
+            ASSERT_TRUE(stats.isReadComplete());
+            EXPECT_FALSE(stats.isGood());
+            EXPECT_EQ(stats.get<Count>(), direct.get<Count>());
+            EXPECT_EQ(stats.get<MinMax>().min, direct.get<MinMax>().min);
+            EXPECT_EQ(stats.get<MinMax>().max, direct.get<MinMax>().max);
+            EXPECT_NEAR(stats.get<Sum>(), direct.get<Sum>(), std::abs(direct.get<Sum>()) * 1e-5f);
+            const FilePipelineReport& report = stats.getReport();
+            EXPECT_EQ(report.bytes_read, values.size() * sizeof(float) + 3);
+            EXPECT_EQ(report.num_chunks, (report.bytes_read + options.chunk_bytes - 1) / options.chunk_bytes);
+            EXPECT_LE(report.throughput, report.disk_bytes_per_second);
+            EXPECT_LE(report.throughput, report.compute_bytes_per_second);
+            if(backend == FileReadBackend::PreadThreads){
+                EXPECT_EQ(report.backend, FileReadBackend::PreadThreads);
+            }
+        }
+    }
+    std::remove(path.c_str());
+}
+
+TEST(FileStatsPipeline, MissingFileIsNotRead)
+{
+    const FileStats stats(defaultStatsContext(), testing::TempDir() + "no_such_file.bin", {}, TestReducers());
+    EXPECT_FALSE(stats.isReadComplete());
+    EXPECT_EQ(stats.get<Count>(), 0u);
+}
@@ -0,0 +1,71 @@
+#ifndef FIRSTTOUCHALLOCATOR_H
+#define FIRSTTOUCHALLOCATOR_H
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <StatsExecutor.h>
+
+// Linux places a page on the NUMA node of the thread that first writes it. A
+// std::vector zero fills on resize from the calling thread, which puts every
+// page of a large output on one node. This allocator leaves elements default
+// initialized so firstTouchFill can write them from the threads that later
+// produce the output.
+template<typename T>
+struct FirstTouchAllocator
+{
+    using value_type = T;
+    FirstTouchAllocator() = default;
+    template<typename U>
+    FirstTouchAllocator(const FirstTouchAllocator<U>&){
+    }
+    T* allocate(size_t n){
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n){
+        std::allocator<T>().deallocate(p, n);
+    }
+    // value initialization (the zero fill) is skipped, anything else is forwarded
+    template<typename U, typename... CtorArgs>
+    void construct(U* p, CtorArgs&&... args){
+        if constexpr(sizeof...(CtorArgs) == 0){
+            ::new(static_cast<void*>(p)) U;
+        }
+        else{
+            ::new(static_cast<void*>(p)) U(std::forward<CtorArgs>(args)...);
+        }
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const FirstTouchAllocator<T>&, const FirstTouchAllocator<U>&)
+{
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const FirstTouchAllocator<T>&, const FirstTouchAllocator<U>&)
+{
+    return false;
+}
+
+template<typename Allocator> struct isFirstTouchAllocator : std::false_type {};
+template<typename T> struct isFirstTouchAllocator<FirstTouchAllocator<T> > : std::true_type {};
+
+// writes value over out in chunks of items_per_chunk through executor. Chunk k
+// is homed at input + k * items_per_chunk * input_item_bytes, so a placement
+// aware executor touches each output page on the node that holds the input the
+// same chunk of the stats loop reads
+template<typename T, typename Allocator>
+void firstTouchFill(std::vector<T, Allocator>& out, const T& value, StatsExecutor& executor, size_t items_per_chunk,
+                    const void* input = nullptr, size_t input_item_bytes = 0)
+{
+    T* values = out.data();
+    runChunked(executor, out.size(), items_per_chunk, [&](size_t, size_t begin, size_t end, size_t){
+        std::fill(values + begin, values + end, value);
+    }, input, input_item_bytes);
+}
+
+#endif // FIRSTTOUCHALLOCATOR_H
@@ -0,0 +1,345 @@
+#ifndef FOCALSTATS_H
+#define FOCALSTATS_H
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <ForceInline.h>
+#include <NoDataClassifier.h>
+#include <StatsContext.h>
+
+// cells along each edge of a tile. A tile and its halo of window / 2 cells on
+// every side stay within L2 while both passes run over it
+constexpr size_t focal_stats_tile_size = 128;
+// tiles span at least this many windows so the halo read around a tile stays
+// a small part of it
+constexpr size_t focal_stats_min_tile_windows = 4;
+
+// focal mean, standard deviation, min and max over the window x window cells
+// centred on each cell of a row major raster. Windows are cut off at the
+// raster edge, and no data values, nans and infs are left out, so counts says
+// how many cells each window used. The raster is split into tiles that threads
+// take independently, each reading a halo of window / 2 cells around itself
+// straight from the input. Within a tile both passes are separable: row window
+// sums from prefix sums along each row, then the column prefix sums of those
+// (a summed-area table of the tile) give every window's sum and sum of squares
+// from two reads, and min/max run van Herk/Gil-Werman along rows then columns.
+template<int i = 0>
+class DoesTheFocalStats
+{
+private:
+    std::vector<float> means;
+    std::vector<float> std_devs;
+    std::vector<float> mins;
+    std::vector<float> maxs;
+    std::vector<uint32_t> counts;
+    bool window_ok = true;
+    bool layout_ok = true;
+    bool contains_ndvs = false;
+    bool contains_nan_infs = false;
+public:
+    DoesTheFocalStats(const std::vector<float>& raster, size_t width, size_t height, size_t window,
+                      const std::vector<float>& ndvs, const StatsContext& context = defaultStatsContext());
+    // all below are row major like the raster, nan where a window has no
+    // valid cell
+    const std::vector<float>& getMeans() const{
+        return means;
+    }
+    // sample standard deviation, nan for windows with less than two valid cells
+    const std::vector<float>& getStdDevs() const{
+        return std_devs;
+    }
+    const std::vector<float>& getMins() const{
+        return mins;
+    }
+    const std::vector<float>& getMaxs() const{
+        return maxs;
+    }
+    const std::vector<uint32_t>& getCounts() const{
+        return counts;
+    }
+    // false unless window is odd
+    bool isWindowValid() const{
+        return window_ok;
+    }
+    // false when the raster does not hold width * height cells
+    bool isLayoutValid() const{
+        return layout_ok;
+    }
+    // no nan/inf and no no data value anywhere in the raster
+    bool isGood() const{
+        return !contains_ndvs && !contains_nan_infs;
+    }
+};
+
+// van Herk/Gil-Werman along one row: out[k] gets the extreme of
+// in[k .. k + window - 1]. Runs of window values keep prefix and suffix
+// extremes, a window spans the suffix of one run and the prefix of the next
+template<typename Pick>
+void slidingRowExtreme(const float* in, float* out, size_t count, size_t window, float* prefix, float* suffix, Pick pick)
+{
+    for(size_t run_begin=0; run_begin<count; run_begin+=window){
+        const size_t run_end = std::min(run_begin + window, count);
+        prefix[run_begin] = in[run_begin];
+        for(size_t k=run_begin+1; k<run_end; k++){
+            prefix[k] = pick(prefix[k - 1], in[k]);
+        }
+        suffix[run_end - 1] = in[run_end - 1];
+        for(size_t k=run_end-1; k-->run_begin;){
+            suffix[k] = pick(suffix[k + 1], in[k]);
+        }
+    }
+    #pragma omp simd
+    for(size_t k=0; k<count+1-window; k++){
+        out[k] = pick(suffix[k], prefix[k + window - 1]);
+    }
+}
+
+// the same down columns of count rows spaced stride apart, columns
+// neighbouring lanes at once so the pass walks whole rows and vectorizes
+// across them
+template<typename Pick>
+void slidingExtreme(const float* in, float* out, size_t count, size_t window, size_t stride, size_t columns,
+                    float* prefix, float* suffix, Pick pick)
+{
+    for(size_t run_begin=0; run_begin<count; run_begin+=window){
+        const size_t run_end = std::min(run_begin + window, count);
+        std::copy_n(in + run_begin * stride, columns, prefix + run_begin * stride);
+        for(size_t k=run_begin+1; k<run_end; k++){
+            #pragma omp simd
+            for(size_t c=0; c<columns; c++){
+                prefix[k * stride + c] = pick(prefix[(k - 1) * stride + c], in[k * stride + c]);
+            }
+        }
+        std::copy_n(in + (run_end - 1) * stride, columns, suffix + (run_end - 1) * stride);
+        for(size_t k=run_end-1; k-->run_begin;){
+            #pragma omp simd
+            for(size_t c=0; c<columns; c++){
+                suffix[k * stride + c] = pick(suffix[(k + 1) * stride + c], in[k * stride + c]);
+            }
+        }
+    }
+    for(size_t k=0; k+window<=count; k++){
+        #pragma omp simd
+        for(size_t c=0; c<columns; c++){
+            out[k * stride + c] = pick(suffix[k * stride + c], prefix[(k + window - 1) * stride + c]);
+        }
+    }
+}
+
+template<int i>
+DoesTheFocalStats<i>::DoesTheFocalStats(const std::vector<float>& raster, size_t width, size_t height, size_t window,
+                                        const std::vector<float>& ndvs, const StatsContext& context)
+{
+    if(window == 0 || window % 2 == 0){
+        window_ok = false;
+        return;
+    }
+    if(raster.size() != width * height){
+        layout_ok = false;
+        return;
+    }
+    const size_t num_cells = raster.size();
+    means.resize(num_cells);
+    std_devs.resize(num_cells);
+    mins.resize(num_cells);
+    maxs.resize(num_cells);
+    counts.resize(num_cells);
+    if(num_cells == 0){
+        return;
+    }
+    const size_t radius = window / 2;
+    const size_t tile_edge = std::max(focal_stats_tile_size, focal_stats_min_tile_windows * window);
+    const size_t tiles_x = (width + tile_edge - 1) / tile_edge;
+    const size_t tiles_y = (height + tile_edge - 1) / tile_edge;
+    const size_t num_tiles = tiles_x * tiles_y;
+    const NoDataClassifier classifier(ndvs);
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(num_cells, 6, executor.concurrency());
+    const size_t tiles_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max<size_t>(plan.chunk_size / (tile_edge * tile_edge), 1) : num_tiles;
+    const float inf = std::numeric_limits<float>::infinity();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    // a tile with its halo, padded to the full window at the raster edges so
+    // every cell has the same window. Padding is invalid, 0 in the sums and
+    // +-inf in the extremes
+    struct WorkerScratch
+    {
+        std::vector<uint8_t> valid;
+        std::vector<float> low;
+        std::vector<float> high;
+        // row window results, one row per padded row and one column per tile column
+        std::vector<double> row_sums;
+        std::vector<double> row_squares;
+        std::vector<uint32_t> row_counts;
+        std::vector<float> row_mins;
+        std::vector<float> row_maxs;
+        std::vector<double> prefix;
+        std::vector<float> extreme_prefix;
+        std::vector<float> extreme_suffix;
+        bool contains_ndvs = false;
+        bool contains_nan_infs = false;
+    };
+    std::vector<WorkerScratch> worker_scratch(executor.concurrency());
+    const ChunkLayout layout(num_tiles, tiles_per_chunk, plan.schedule, plan.num_threads);
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan, tile_edge * tile_edge);
+    runChunked(executor, layout, [&](size_t, size_t first_tile, size_t end_tile, size_t worker){
+        WorkerScratch& scratch = worker_scratch[worker];
+        for(size_t tile=first_tile; tile<end_tile; tile++)
+        {
+            const size_t x0 = (tile % tiles_x) * tile_edge;
+            const size_t y0 = (tile / tiles_x) * tile_edge;
+            const size_t tile_width = std::min(tile_edge, width - x0);
+            const size_t tile_height = std::min(tile_edge, height - y0);
+            // padded cell (pr, pc) is raster cell (y0 + pr - radius, x0 + pc - radius)
+            const size_t padded_width = tile_width + 2 * radius;
+            const size_t padded_height = tile_height + 2 * radius;
+            const size_t padded_cells = padded_width * padded_height;
+            scratch.valid.assign(padded_cells, 0);
+            scratch.low.assign(padded_cells, inf);
+            scratch.high.assign(padded_cells, -inf);
+            scratch.row_sums.resize(padded_height * tile_width);
+            scratch.row_squares.resize(padded_height * tile_width);
+            scratch.row_counts.resize(padded_height * tile_width);
+            scratch.row_mins.resize(padded_height * tile_width);
+            scratch.row_maxs.resize(padded_height * tile_width);
+            scratch.prefix.resize(3 * (std::max(padded_width, padded_height) + 1) * tile_width);
+            scratch.extreme_prefix.resize(std::max(padded_cells, padded_height * tile_width));
+            scratch.extreme_suffix.resize(std::max(padded_cells, padded_height * tile_width));
+
+            // the halo comes straight from the input, the cells inside the raster
+            // are classified once per tile that reads them
+            const size_t first_column = x0 >= radius ? x0 - radius : 0;
+            const size_t end_column = std::min(width, x0 + tile_width + radius);
+            const size_t column_offset = first_column + radius - x0;
+            const size_t first_row = y0 >= radius ? y0 - radius : 0;
+            const size_t end_row = std::min(height, y0 + tile_height + radius);
+            // sums of value - reference keep the squares small for data far from 0
+            double reference = 0.0;
+            bool has_reference = false;
+            for(size_t y=first_row; y<end_row; y++){
+                const size_t pr = y + radius - y0;
+                const float* row = raster.data() + y * width + first_column;
+                const size_t count = end_column - first_column;
+                uint8_t* valid = scratch.valid.data() + pr * padded_width + column_offset;
+                std::fill_n(valid, count, uint8_t(1));
+                const BlockClassification classification = classifier.classifyBlock(row, count, valid);
+                scratch.contains_nan_infs |= classification.num_nan_infs > 0;
+                scratch.contains_ndvs |= classification.num_ndvs > 0;
+                float* low = scratch.low.data() + pr * padded_width + column_offset;
+                float* high = scratch.high.data() + pr * padded_width + column_offset;
+                #pragma omp simd
+                for(size_t k=0; k<count; k++){
+                    low[k] = valid[k] ? row[k] : inf;
+                    high[k] = valid[k] ? row[k] : -inf;
+                }
+                for(size_t k=0; k<count && !has_reference; k++){
+                    if(valid[k]){
+                        reference = row[k];
+                        has_reference = true;
+                    }
+                }
+            }
+
+            // row pass: window sums from prefix sums along each padded row
+            double* prefix_sums = scratch.prefix.data();
+            double* prefix_squares = prefix_sums + padded_width + 1;
+            double* prefix_counts = prefix_squares + padded_width + 1;
+            for(size_t pr=0; pr<padded_height; pr++){
+                const uint8_t* valid = scratch.valid.data() + pr * padded_width;
+                const float* row = scratch.low.data() + pr * padded_width;
+                prefix_sums[0] = 0.0;
+                prefix_squares[0] = 0.0;
+                prefix_counts[0] = 0.0;
+                for(size_t pc=0; pc<padded_width; pc++){
+                    const double shifted = valid[pc] ? row[pc] - reference : 0.0;
+                    prefix_sums[pc + 1] = prefix_sums[pc] + shifted;
+                    prefix_squares[pc + 1] = prefix_squares[pc] + shifted * shifted;
+                    prefix_counts[pc + 1] = prefix_counts[pc] + valid[pc];
+                }
+                double* sums = scratch.row_sums.data() + pr * tile_width;
+                double* squares = scratch.row_squares.data() + pr * tile_width;
+                uint32_t* row_counts = scratch.row_counts.data() + pr * tile_width;
+                #pragma omp simd
+                for(size_t c=0; c<tile_width; c++){
+                    sums[c] = prefix_sums[c + window] - prefix_sums[c];
+                    squares[c] = prefix_squares[c + window] - prefix_squares[c];
+                    row_counts[c] = static_cast<uint32_t>(prefix_counts[c + window] - prefix_counts[c]);
+                }
+                slidingRowExtreme(scratch.low.data() + pr * padded_width, scratch.row_mins.data() + pr * tile_width,
+                                  padded_width, window, scratch.extreme_prefix.data(), scratch.extreme_suffix.data(),
+                                  [](float a, float b){ return std::min(a, b); });
+                slidingRowExtreme(scratch.high.data() + pr * padded_width, scratch.row_maxs.data() + pr * tile_width,
+                                  padded_width, window, scratch.extreme_prefix.data(), scratch.extreme_suffix.data(),
+                                  [](float a, float b){ return std::max(a, b); });
+            }
+
+            // column pass: the prefix sums of the row window sums down each column
+            // are the summed-area table of the tile, one row of it kept per step
+            double* table_sums = scratch.prefix.data();
+            double* table_squares = table_sums + (padded_height + 1) * tile_width;
+            double* table_counts = table_squares + (padded_height + 1) * tile_width;
+            std::fill_n(table_sums, tile_width, 0.0);
+            std::fill_n(table_squares, tile_width, 0.0);
+            std::fill_n(table_counts, tile_width, 0.0);
+            for(size_t pr=0; pr<padded_height; pr++){
+                const double* sums = scratch.row_sums.data() + pr * tile_width;
+                const double* squares = scratch.row_squares.data() + pr * tile_width;
+                const uint32_t* row_counts = scratch.row_counts.data() + pr * tile_width;
+                #pragma omp simd
+                for(size_t c=0; c<tile_width; c++){
+                    table_sums[(pr + 1) * tile_width + c] = table_sums[pr * tile_width + c] + sums[c];
+                    table_squares[(pr + 1) * tile_width + c] = table_squares[pr * tile_width + c] + squares[c];
+                    table_counts[(pr + 1) * tile_width + c] = table_counts[pr * tile_width + c] + row_counts[c];
+                }
+            }
+            slidingExtreme(scratch.row_mins.data(), scratch.row_mins.data(), padded_height, window, tile_width, tile_width,
+                           scratch.extreme_prefix.data(), scratch.extreme_suffix.data(),
+                           [](float a, float b){ return std::min(a, b); });
+            slidingExtreme(scratch.row_maxs.data(), scratch.row_maxs.data(), padded_height, window, tile_width, tile_width,
+                           scratch.extreme_prefix.data(), scratch.extreme_suffix.data(),
+                           [](float a, float b){ return std::max(a, b); });
+            for(size_t r=0; r<tile_height; r++){
+                const double* sums_above = table_sums + r * tile_width;
+                const double* sums_below = table_sums + (r + window) * tile_width;
+                const double* squares_above = table_squares + r * tile_width;
+                const double* squares_below = table_squares + (r + window) * tile_width;
+                const double* counts_above = table_counts + r * tile_width;
+                const double* counts_below = table_counts + (r + window) * tile_width;
+                const float* row_mins = scratch.row_mins.data() + r * tile_width;
+                const float* row_maxs = scratch.row_maxs.data() + r * tile_width;
+                const size_t out = (y0 + r) * width + x0;
+                uint32_t* out_counts = counts.data() + out;
+                float* out_means = means.data() + out;
+                float* out_std_devs = std_devs.data() + out;
+                float* out_mins = mins.data() + out;
+                float* out_maxs = maxs.data() + out;
+                #pragma omp simd
+                for(size_t c=0; c<tile_width; c++){
+                    const double count = counts_below[c] - counts_above[c];
+                    const double sum = sums_below[c] - sums_above[c];
+                    const double sum_squares = squares_below[c] - squares_above[c];
+                    // a window with a valid cell has at least 1, the max keeps the
+                    // division finite for the others
+                    const double divisor = std::max(count, 1.0);
+                    out_counts[c] = static_cast<uint32_t>(count);
+                    out_means[c] = count > 0 ? static_cast<float>(sum / divisor + reference) : nan;
+                    const double variance = std::max(sum_squares - sum * sum / divisor, 0.0) / std::max(count - 1.0, 1.0);
+                    out_std_devs[c] = count > 1 ? static_cast<float>(std::sqrt(variance)) : nan;
+                    out_mins[c] = count > 0 ? row_mins[c] : nan;
+                    out_maxs[c] = count > 0 ? row_maxs[c] : nan;
+                }
+            }
+        }
+    }, raster.data(), num_tiles > 0 ? num_cells * sizeof(float) / num_tiles : 0, telemetry.get());
+    telemetry.startMerge();
+    for(const WorkerScratch& scratch : worker_scratch){
+        contains_ndvs |= scratch.contains_ndvs;
+        contains_nan_infs |= scratch.contains_nan_infs;
+    }
+    telemetry.publish();
+}
+
+#endif // FOCALSTATS_H
@@ -0,0 +1,106 @@
+#include <FocalStats.h>
+#include <limits>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+// checks every cell against a direct computation in double
+void expectMatchesDirect(const DoesTheFocalStats<>& focal, const std::vector<float>& raster, size_t width, size_t height,
+                         size_t window, float ndv)
+{
+    const long radius = static_cast<long>(window / 2);
+    for(size_t y=0; y<height; y++){
+        for(size_t x=0; x<width; x++){
+            double sum = 0.0;
+            double sum_squares = 0.0;
+            size_t count = 0;
+            float min = std::numeric_limits<float>::infinity();
+            float max = -std::numeric_limits<float>::infinity();
+            for(long wy=static_cast<long>(y)-radius; wy<=static_cast<long>(y)+radius; wy++){
+                for(long wx=static_cast<long>(x)-radius; wx<=static_cast<long>(x)+radius; wx++){
+                    if(wy < 0 || wx < 0 || wy >= static_cast<long>(height) || wx >= static_cast<long>(width)){
+                        continue;
+                    }
+                    const float value = raster[wy * width + wx];
+                    if(!std::isfinite(value) || value == ndv){
+                        continue;
+                    }
+                    sum += value;
+                    sum_squares += static_cast<double>(value) * value;
+                    count++;
+                    min = std::min(min, value);
+                    max = std::max(max, value);
+                }
+            }
+            const size_t cell = y * width + x;
+            ASSERT_EQ(focal.getCounts()[cell], count) << x << "," << y;
+            if(count == 0){
+                EXPECT_TRUE(std::isnan(focal.getMeans()[cell]));
+                EXPECT_TRUE(std::isnan(focal.getMaxs()[cell]));
+                continue;
+            }
+            EXPECT_NEAR(focal.getMeans()[cell], sum / count, 1e-4 * (std::abs(sum / count) + 1.0)) << x << "," << y;
+            EXPECT_EQ(focal.getMins()[cell], min) << x << "," << y;
+            EXPECT_EQ(focal.getMaxs()[cell], max) << x << "," << y;
+            if(count > 1){
+                const double std_dev = std::sqrt(std::max(sum_squares - sum * sum / count, 0.0) / (count - 1.0));
+                EXPECT_NEAR(focal.getStdDevs()[cell], std_dev, 1e-3 * (std_dev + 1.0)) << x << "," << y;
+            }
+            else{
+                EXPECT_TRUE(std::isnan(focal.getStdDevs()[cell]));
+            }
+        }
+    }
+}
+
+std::vector<float> makeRaster(size_t width, size_t height)
+{
+    return patternSeries(width * height, 101, 0.5f, -20.f);
+}
+
+}
+
+// tiles of 128 cells, so the raster is cut into several with halos crossing them
+TEST(FocalStats, MatchesDirectAcrossTiles)
+{
+    const size_t width = 300;
+    const size_t height = 170;
+    std::vector<float> raster = makeRaster(width, height);
+    const float ndv = -9999.f;
+    raster[5 * width + 127] = std::numeric_limits<float>::quiet_NaN();
+    // a no data patch larger than the small windows, right on a tile corner
+    for(size_t y=120; y<136; y++){
+        std::fill(raster.begin() + y * width + 120, raster.begin() + y * width + 136, ndv);
+    }
+    ThreadPoolExecutor pool(3);
+    StatsContext context = parallelContext(pool);
+    for(size_t window : {size_t(1), size_t(3), size_t(7), size_t(41)}){
+        DoesTheFocalStats focal(raster, width, height, window, {ndv}, context);
+        ASSERT_TRUE(focal.isWindowValid());
+        ASSERT_TRUE(focal.isLayoutValid());
+        EXPECT_FALSE(focal.isGood());
+        expectMatchesDirect(focal, raster, width, height, window, ndv);
+    }
+}
+
+TEST(FocalStats, WindowLargerThanRaster)
+{
+    const std::vector<float> raster = makeRaster(5, 4);
+    DoesTheFocalStats focal(raster, 5, 4, 9, {});
+    EXPECT_TRUE(focal.isGood());
+    expectMatchesDirect(focal, raster, 5, 4, 9, std::numeric_limits<float>::quiet_NaN());
+    // every window covers the whole raster
+    EXPECT_EQ(focal.getCounts()[0], 20u);
+}
+
+TEST(FocalStats, InvalidArguments)
+{
+    const std::vector<float> raster = makeRaster(5, 4);
+    EXPECT_FALSE(DoesTheFocalStats(raster, 5, 4, 4, {}).isWindowValid());
+    EXPECT_FALSE(DoesTheFocalStats(raster, 5, 4, 0, {}).isWindowValid());
+    EXPECT_FALSE(DoesTheFocalStats(raster, 6, 4, 3, {}).isLayoutValid());
+    DoesTheFocalStats empty(std::vector<float>(), 0, 0, 3, {});
+    EXPECT_TRUE(empty.isLayoutValid());
+    EXPECT_TRUE(empty.getMeans().empty());
+}
@@ -0,0 +1,106 @@
+#include "LoopTelemetry.h"
+#include <algorithm>
+
+double LoopTelemetry::imbalance() const
+{
+    double total = 0.0;
+    double slowest = 0.0;
+    for(const WorkerTelemetry& worker : workers){
+        total += worker.busy_seconds;
+        slowest = std::max(slowest, worker.busy_seconds);
+    }
+    if(total <= 0.0){
+        return 1.0;
+    }
+    // threads the plan meant to use but that got no chunk count as idle
+    const double num_threads = static_cast<double>(std::max<int>(plan.num_threads, 1));
+    return std::max(slowest * num_threads / total, 1.0);
+}
+
+ChunkTimer::ChunkTimer(LoopTelemetry& telemetry, size_t concurrency)
+    : m_telemetry(telemetry), m_slots(std::max<size_t>(concurrency, 1)), m_begin(Clock::now())
+{
+}
+
+void ChunkTimer::chunkDone(size_t worker, Clock::time_point begin, Clock::time_point end, size_t items)
+{
+    Slot& slot = m_slots[worker];
+    slot.telemetry.busy_seconds += std::chrono::duration<double>(end - begin).count();
+    slot.telemetry.elements += items * m_telemetry.elements_per_item;
+    slot.telemetry.chunks++;
+    slot.last_end = end;
+}
+
+void ChunkTimer::finish()
+{
+    const Clock::time_point end = Clock::now();
+    m_telemetry.parallel_seconds = std::chrono::duration<double>(end - m_begin).count();
+    m_telemetry.workers.resize(m_slots.size());
+    for(size_t worker=0; worker<m_slots.size(); worker++){
+        WorkerTelemetry& telemetry = m_telemetry.workers[worker];
+        telemetry = m_slots[worker].telemetry;
+        if(telemetry.chunks > 0){
+            telemetry.merge_wait_seconds = std::chrono::duration<double>(end - m_slots[worker].last_end).count();
+        }
+    }
+}
+
+LoopTelemetryRecorder::LoopTelemetryRecorder(const LoopTelemetryCallback& callback, const ExecutionPlan& plan,
+                                             size_t elements_per_item) : m_callback(callback)
+{
+    m_telemetry.plan = plan;
+    m_telemetry.elements_per_item = elements_per_item;
+}
+
+void LoopTelemetryRecorder::startMerge()
+{
+    if(isRecording()){
+        m_merge_begin = ChunkTimer::Clock::now();
+    }
+}
+
+void LoopTelemetryRecorder::publish()
+{
+    if(!isRecording()){
+        return;
+    }
+    m_telemetry.merge_seconds = std::chrono::duration<double>(ChunkTimer::Clock::now() - m_merge_begin).count();
+    m_callback(m_telemetry);
+}
+
+ScheduleBalancer::ScheduleBalancer(StatsTuning& tuning, double max_imbalance, size_t max_chunks_per_thread)
+    : m_tuning(tuning), m_max_imbalance(max_imbalance), m_max_chunks_per_thread(max_chunks_per_thread)
+{
+}
+
+void ScheduleBalancer::operator()(const LoopTelemetry& telemetry)
+{
+    if(telemetry.plan.mode != ExecutionMode::Parallel || telemetry.plan.num_threads < 2 ||
+       telemetry.imbalance() <= m_max_imbalance){
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    switch(m_tuning.schedule.load()){
+    case ChunkSchedule::Static:
+        m_tuning.schedule = ChunkSchedule::Dynamic;
+        break;
+    case ChunkSchedule::Dynamic:
+        if(m_tuning.chunks_per_thread < m_max_chunks_per_thread){
+            m_tuning.chunks_per_thread = std::min(std::max<size_t>(m_tuning.chunks_per_thread, 1) * 2, m_max_chunks_per_thread);
+        }
+        else{
+            m_tuning.schedule = ChunkSchedule::Guided;
+        }
+        break;
+    case ChunkSchedule::Guided:
+        // nothing finer to try
+        return;
+    }
+    m_adjustments++;
+}
+
+size_t ScheduleBalancer::getAdjustments() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_adjustments;
+}
@@ -0,0 +1,107 @@
+#ifndef LOOPTELEMETRY_H
+#define LOOPTELEMETRY_H
+#include <StatsTuning.h>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// what every worker of a stats loop did, for finding load imbalance such as
+// threads that skip most of a no data heavy region while others reduce theirs.
+// Recorded for parallel loops when StatsContext::telemetry_callback is set, at
+// two clock reads per chunk, otherwise nothing
+
+struct WorkerTelemetry
+{
+    // inside chunks
+    double busy_seconds = 0.0;
+    size_t elements = 0;
+    size_t chunks = 0;
+    // from the end of the worker's last chunk until the merge could start,
+    // idle while the other workers finished
+    double merge_wait_seconds = 0.0;
+};
+
+struct LoopTelemetry
+{
+    ExecutionPlan plan;
+    // by worker index, workers that got no chunk are all zero
+    std::vector<WorkerTelemetry> workers;
+    // from handing out the chunks until all had finished
+    double parallel_seconds = 0.0;
+    // merging the chunk results on the calling thread
+    double merge_seconds = 0.0;
+    // elements in one item of runChunked, blocks for the block loops
+    size_t elements_per_item = 1;
+    // busy time of the slowest worker over the mean of the plan's threads,
+    // 1 when perfectly balanced
+    double imbalance() const;
+};
+
+using LoopTelemetryCallback = std::function<void(const LoopTelemetry&)>;
+
+// times the chunks of one runChunked call, workers write their own slot
+class ChunkTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    ChunkTimer(LoopTelemetry& telemetry, size_t concurrency);
+    void chunkDone(size_t worker, Clock::time_point begin, Clock::time_point end, size_t items);
+    // fills the telemetry once every chunk has finished
+    void finish();
+private:
+    struct alignas(64) Slot
+    {
+        WorkerTelemetry telemetry;
+        Clock::time_point last_end;
+    };
+    LoopTelemetry& m_telemetry;
+    std::vector<Slot> m_slots;
+    Clock::time_point m_begin;
+};
+
+// the telemetry of one loop. Loops pass get() to runChunked, then bracket their
+// merge with startMerge() and publish()
+class LoopTelemetryRecorder
+{
+public:
+    LoopTelemetryRecorder(const LoopTelemetryCallback& callback, const ExecutionPlan& plan, size_t elements_per_item = 1);
+    // nullptr when nobody listens or the plan is not parallel
+    LoopTelemetry* get(){
+        return isRecording() ? &m_telemetry : nullptr;
+    }
+    void startMerge();
+    void publish();
+private:
+    bool isRecording() const{
+        return m_callback && m_telemetry.plan.mode == ExecutionMode::Parallel;
+    }
+    const LoopTelemetryCallback& m_callback;
+    LoopTelemetry m_telemetry;
+    ChunkTimer::Clock::time_point m_merge_begin;
+};
+
+// a telemetry callback that reschedules the loops it watches while they stay
+// imbalanced: Static becomes Dynamic, then chunks_per_thread doubles up to
+// max_chunks_per_thread, then Guided. Loops that ran on one thread are
+// ignored. Install it by reference, it keeps a count:
+//     ScheduleBalancer balancer(context.tuning);
+//     context.telemetry_callback = std::ref(balancer);
+// Safe on a context shared by concurrent loops: adjustments are made one at a
+// time and the loops read the tuning fields atomically
+class ScheduleBalancer
+{
+public:
+    explicit ScheduleBalancer(StatsTuning& tuning, double max_imbalance = 1.25, size_t max_chunks_per_thread = 32);
+    void operator()(const LoopTelemetry& telemetry);
+    size_t getAdjustments() const;
+private:
+    mutable std::mutex m_mutex;
+    StatsTuning& m_tuning;
+    double m_max_imbalance;
+    size_t m_max_chunks_per_thread;
+    size_t m_adjustments = 0;
+};
+
+#endif // LOOPTELEMETRY_H
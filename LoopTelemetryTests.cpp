@@ -0,0 +1,171 @@
+#include <BasicStats.h>
+#include <MultiStats.h>
+#include <StatsExpression.h>
+#include <LoopTelemetry.h>
+#include <thread>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+TEST(LoopTelemetry, GuidedLayoutShrinks)
+{
+    const ChunkLayout layout(100000, 64, ChunkSchedule::Guided, 4);
+    ASSERT_GT(layout.numChunks(), 8u);
+    EXPECT_EQ(layout.begin(0), 0u);
+    EXPECT_EQ(layout.end(layout.numChunks() - 1), 100000u);
+    for(size_t chunk=0; chunk<layout.numChunks(); chunk++){
+        const size_t size = layout.end(chunk) - layout.begin(chunk);
+        if(chunk + 1 < layout.numChunks()){
+            EXPECT_EQ(size % 64, 0u);
+            EXPECT_EQ(layout.end(chunk), layout.begin(chunk + 1));
+            EXPECT_GE(size, layout.end(chunk + 1) - layout.begin(chunk + 1));
+        }
+    }
+    EXPECT_GT(layout.end(0) - layout.begin(0), 64u * 8);
+
+    // the other schedules are equal chunks
+    const ChunkLayout even(1000, 300, ChunkSchedule::Dynamic, 4);
+    EXPECT_EQ(even.numChunks(), 4u);
+    EXPECT_EQ(even.begin(3), 900u);
+    EXPECT_EQ(even.end(3), 1000u);
+}
+
+TEST(LoopTelemetry, WorkersAreRecorded)
+{
+    ThreadPoolExecutor pool(3);
+    StatsContext context = parallelContext(pool);
+    std::vector<LoopTelemetry> seen;
+    context.telemetry_callback = [&](const LoopTelemetry& telemetry){
+        seen.push_back(telemetry);
+    };
+    std::vector<float> values(1 << 18, 1.f);
+    // a no data heavy half, the kind of skew the telemetry is for
+    std::fill(values.begin(), values.begin() + values.size() / 2, -9999.f);
+    DoesTheStats stats(values, {-9999.f}, context);
+    ASSERT_EQ(seen.size(), 1u);
+    const LoopTelemetry& telemetry = seen[0];
+    EXPECT_EQ(telemetry.workers.size(), pool.concurrency());
+    size_t elements = 0;
+    size_t chunks = 0;
+    for(const WorkerTelemetry& worker : telemetry.workers){
+        elements += worker.elements;
+        chunks += worker.chunks;
+        EXPECT_GE(worker.merge_wait_seconds, 0.0);
+        if(worker.chunks == 0){
+            EXPECT_EQ(worker.busy_seconds, 0.0);
+        }
+    }
+    EXPECT_EQ(elements, values.size());
+    EXPECT_EQ(chunks, chunkCount(values.size(), telemetry.plan.chunk_size));
+    EXPECT_GE(telemetry.imbalance(), 1.0);
+    EXPECT_GE(telemetry.parallel_seconds, 0.0);
+
+    // block loops count elements too, and serial plans report nothing
+    seen.clear();
+    ExpressionStatsLoop expression(context, values, {-9999.f}, Sum{} | Count{});
+    ASSERT_EQ(seen.size(), 1u);
+    elements = 0;
+    for(const WorkerTelemetry& worker : seen[0].workers){
+        elements += worker.elements;
+    }
+    EXPECT_GE(elements, values.size());
+    context.tuning.forced_mode = ExecutionMode::SimdOnly;
+    DoesTheStats simd(values, {-9999.f}, context);
+    EXPECT_EQ(seen.size(), 1u);
+}
+
+TEST(LoopTelemetry, SchedulesAgree)
+{
+    ThreadPoolExecutor pool(3);
+    std::vector<float> values(300000);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = static_cast<float>(i % 97) - 3.f;
+    }
+    StatsContext context;
+    context.executor = &pool;
+    context.tuning.forced_mode = ExecutionMode::Parallel;
+    context.tuning.min_grain_work = 1024;
+    std::vector<float> sums;
+    std::vector<size_t> counts;
+    for(ChunkSchedule schedule : {ChunkSchedule::Static, ChunkSchedule::Dynamic, ChunkSchedule::Guided}){
+        context.tuning.schedule = schedule;
+        DoesTheStats stats(values, {-3.f}, context);
+        sums.push_back(stats.getSum());
+        DoesThePairedStats paired(values, values, {-3.f}, context);
+        counts.push_back(paired.getCount());
+        if(schedule == ChunkSchedule::Static){
+            const ExecutionPlan plan = context.tuning.plan(values.size(), 3, pool.concurrency());
+            EXPECT_EQ(chunkCount(values.size(), plan.chunk_size), pool.concurrency());
+        }
+    }
+    for(size_t s=1; s<sums.size(); s++){
+        EXPECT_NEAR(sums[s], sums[0], std::abs(sums[0]) * 1e-5f);
+        EXPECT_EQ(counts[s], counts[0]);
+    }
+}
+
+TEST(LoopTelemetry, BalancerMovesToFinerSchedules)
+{
+    StatsTuning tuning;
+    tuning.schedule = ChunkSchedule::Static;
+    tuning.chunks_per_thread = 4;
+    ScheduleBalancer balancer(tuning, 1.25, 16);
+    LoopTelemetry telemetry;
+    telemetry.plan.mode = ExecutionMode::Parallel;
+    telemetry.plan.num_threads = 2;
+    telemetry.workers.resize(2);
+    telemetry.workers[0].busy_seconds = 1.0;
+    telemetry.workers[1].busy_seconds = 1.0;
+    // balanced loops change nothing
+    balancer(telemetry);
+    EXPECT_EQ(tuning.schedule, ChunkSchedule::Static);
+    EXPECT_EQ(balancer.getAdjustments(), 0u);
+
+    telemetry.workers[1].busy_seconds = 0.1;
+    balancer(telemetry);
+    EXPECT_EQ(tuning.schedule, ChunkSchedule::Dynamic);
+    balancer(telemetry);
+    EXPECT_EQ(tuning.chunks_per_thread, 8u);
+    balancer(telemetry);
+    EXPECT_EQ(tuning.chunks_per_thread, 16u);
+    balancer(telemetry);
+    EXPECT_EQ(tuning.schedule, ChunkSchedule::Guided);
+    balancer(telemetry);
+    EXPECT_EQ(balancer.getAdjustments(), 4u);
+
+    // a loop on one thread says nothing about balance
+    telemetry.plan.num_threads = 1;
+    tuning.schedule = ChunkSchedule::Static;
+    balancer(telemetry);
+    EXPECT_EQ(tuning.schedule, ChunkSchedule::Static);
+}
+
+TEST(LoopTelemetry, BalancerIsSafeOnASharedTuning)
+{
+    StatsTuning tuning;
+    tuning.schedule = ChunkSchedule::Static;
+    tuning.chunks_per_thread = 4;
+    ScheduleBalancer balancer(tuning, 1.25, 16);
+    LoopTelemetry telemetry;
+    telemetry.plan.mode = ExecutionMode::Parallel;
+    telemetry.plan.num_threads = 2;
+    telemetry.workers.resize(2);
+    telemetry.workers[0].busy_seconds = 1.0;
+    telemetry.workers[1].busy_seconds = 0.1;
+    // loops finishing together while others plan with the same tuning
+    std::vector<std::thread> threads;
+    for(size_t t=0; t<4; t++){
+        threads.emplace_back([&](){
+            for(size_t k=0; k<100; k++){
+                balancer(telemetry);
+                const ExecutionPlan plan = tuning.plan(size_t(1) << 20, 1, 4);
+                EXPECT_EQ(plan.mode, ExecutionMode::Parallel);
+            }
+        });
+    }
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+    EXPECT_EQ(tuning.schedule, ChunkSchedule::Guided);
+    EXPECT_EQ(tuning.chunks_per_thread, 16u);
+    EXPECT_EQ(balancer.getAdjustments(), 4u);
+}
@@ -0,0 +1,410 @@
+#ifndef MULTISTATS_H
+#define MULTISTATS_H
+#include <vector>
+#include <array>
+#include <tuple>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <ForceInline.h>
+#include <NoDataClassifier.h>
+#include <StatsContext.h>
+
+// number of element positions classified and reduced together. Small enough
+// that every input block and the validity mask stay in L1 while all of the
+// reducers run over them
+constexpr size_t multi_stats_block_size = 1024;
+
+// iterates through two or more equally sized data vectors in lockstep. A position
+// is only handed to the reducers when it is valid in every input, so a no data
+// value or nan in either array invalidates the whole pair.
+// Reducers are structs with a State, a block-wise accumulate and a merge, which lets
+// the partial results of each chunk be combined afterwards.
+template<size_t N, typename... Reducers>
+class MultiStatsLoop
+{
+    static_assert(N >= 2, "MultiStatsLoop streams two or more inputs");
+    using States = std::tuple<typename Reducers::State...>;
+    std::tuple<Reducers...> reducers;
+    States results;
+    NoDataClassifier m_classifier;
+    size_t m_valid_count = 0;
+    bool m_contains_nan_infs = false;
+    bool m_contains_ndvs = false;
+    bool m_sizes_match = true;
+    template<size_t... I>
+    void accumulateBlock(std::index_sequence<I...>, States& states, const std::array<const float*, N>& block,
+                         const uint8_t* valid, size_t count) const;
+    template<size_t... I>
+    void mergeStates(std::index_sequence<I...>, States& total, const States& partial) const;
+public:
+    MultiStatsLoop(const std::array<const std::vector<float>*, N>& inputs, const std::vector<float>& no_data_values, Reducers... args);
+    MultiStatsLoop(const StatsContext& context, const std::array<const std::vector<float>*, N>& inputs,
+                   const std::vector<float>& no_data_values, Reducers... args);
+    bool isGood() const;
+    // number of positions valid in every input
+    size_t getValidCount() const{
+        return m_valid_count;
+    }
+    template<int i> const auto& getState() const{
+        return std::get<i>(results);
+    }
+    template<int i> const auto& getReducer() const{
+        return std::get<i>(reducers);
+    }
+};
+
+// sum of a*b over valid pairs
+template<size_t A = 0, size_t B = 1>
+struct DotProduct
+{
+    struct State
+    {
+        double dot = 0.0;
+    };
+    template<size_t N>
+    void accumulate(State& state, const std::array<const float*, N>& block, const uint8_t* valid, size_t count) const
+    {
+        static_assert(A < N && B < N, "input index out of range");
+        const float* a = block[A];
+        const float* b = block[B];
+        double dot = 0.0;
+        #pragma omp simd reduction(+:dot)
+        for(size_t k=0; k<count; k++){
+            dot += valid[k] ? static_cast<double>(a[k]) * b[k] : 0.0;
+        }
+        state.dot += dot;
+    }
+    static void merge(State& total, const State& partial){
+        total.dot += partial.dot;
+    }
+    static float result(const State& state){
+        return static_cast<float>(state.dot);
+    }
+};
+
+// co-moments of a and b. Each block is reduced with a two pass (mean then centred)
+// sweep while it is in cache, and blocks are combined with the pairwise update of
+// Chan et al. so the result stays accurate for large offsets.
+template<size_t A = 0, size_t B = 1>
+struct Covariance
+{
+    struct State
+    {
+        double count = 0.0;
+        double mean_a = 0.0;
+        double mean_b = 0.0;
+        double m2_a = 0.0;
+        double m2_b = 0.0;
+        double c_ab = 0.0;
+    };
+    template<size_t N>
+    void accumulate(State& state, const std::array<const float*, N>& block, const uint8_t* valid, size_t count) const
+    {
+        static_assert(A < N && B < N, "input index out of range");
+        const float* a = block[A];
+        const float* b = block[B];
+        double n = 0.0, sum_a = 0.0, sum_b = 0.0;
+        #pragma omp simd reduction(+:n,sum_a,sum_b)
+        for(size_t k=0; k<count; k++){
+            n += valid[k];
+            sum_a += valid[k] ? a[k] : 0.f;
+            sum_b += valid[k] ? b[k] : 0.f;
+        }
+        if(n == 0.0){
+            return;
+        }
+        State block_state;
+        block_state.count = n;
+        block_state.mean_a = sum_a / n;
+        block_state.mean_b = sum_b / n;
+        const double mean_a = block_state.mean_a;
+        const double mean_b = block_state.mean_b;
+        double m2_a = 0.0, m2_b = 0.0, c_ab = 0.0;
+        #pragma omp simd reduction(+:m2_a,m2_b,c_ab)
+        for(size_t k=0; k<count; k++){
+            const double da = valid[k] ? a[k] - mean_a : 0.0;
+            const double db = valid[k] ? b[k] - mean_b : 0.0;
+            m2_a += da * da;
+            m2_b += db * db;
+            c_ab += da * db;
+        }
+        block_state.m2_a = m2_a;
+        block_state.m2_b = m2_b;
+        block_state.c_ab = c_ab;
+        merge(state, block_state);
+    }
+    static void merge(State& total, const State& partial){
+        if(partial.count == 0.0){
+            return;
+        }
+        if(total.count == 0.0){
+            total = partial;
+            return;
+        }
+        const double n = total.count + partial.count;
+        const double delta_a = partial.mean_a - total.mean_a;
+        const double delta_b = partial.mean_b - total.mean_b;
+        const double weight = total.count * partial.count / n;
+        total.mean_a += delta_a * partial.count / n;
+        total.mean_b += delta_b * partial.count / n;
+        total.m2_a += partial.m2_a + delta_a * delta_a * weight;
+        total.m2_b += partial.m2_b + delta_b * delta_b * weight;
+        total.c_ab += partial.c_ab + delta_a * delta_b * weight;
+        total.count = n;
+    }
+    // sample covariance (n-1 denominator). nan with fewer than two pairs
+    static float covariance(const State& state){
+        if(state.count < 2.0){
+            return std::numeric_limits<float>::quiet_NaN();
+        }
+        return static_cast<float>(state.c_ab / (state.count - 1.0));
+    }
+    // Pearson correlation coefficient. nan when either input is constant
+    static float correlation(const State& state){
+        const double denominator = std::sqrt(state.m2_a * state.m2_b);
+        if(state.count < 2.0 || denominator == 0.0){
+            return std::numeric_limits<float>::quiet_NaN();
+        }
+        return static_cast<float>(state.c_ab / denominator);
+    }
+};
+
+// shared shape of the error metrics: a sum of some function of a-b and a count
+template<size_t A, size_t B, typename ErrorFn>
+struct PairedErrorSum
+{
+    struct State
+    {
+        double sum = 0.0;
+        double count = 0.0;
+    };
+    template<size_t N>
+    void accumulate(State& state, const std::array<const float*, N>& block, const uint8_t* valid, size_t count) const
+    {
+        static_assert(A < N && B < N, "input index out of range");
+        const float* a = block[A];
+        const float* b = block[B];
+        double sum = 0.0, n = 0.0;
+        #pragma omp simd reduction(+:sum,n)
+        for(size_t k=0; k<count; k++){
+            n += valid[k];
+            sum += valid[k] ? ErrorFn::apply(static_cast<double>(a[k]) - b[k]) : 0.0;
+        }
+        state.sum += sum;
+        state.count += n;
+    }
+    static void merge(State& total, const State& partial){
+        total.sum += partial.sum;
+        total.count += partial.count;
+    }
+    static double mean(const State& state){
+        if(state.count == 0.0){
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        return state.sum / state.count;
+    }
+};
+
+struct SignedError
+{
+    FORCE_INLINE static double apply(double difference){
+        return difference;
+    }
+};
+
+struct AbsoluteError
+{
+    FORCE_INLINE static double apply(double difference){
+        return std::fabs(difference);
+    }
+};
+
+struct SquaredError
+{
+    FORCE_INLINE static double apply(double difference){
+        return difference * difference;
+    }
+};
+
+// mean of a-b, e.g. model minus observation
+template<size_t A = 0, size_t B = 1>
+struct Bias : PairedErrorSum<A, B, SignedError>
+{
+    static float result(const typename PairedErrorSum<A, B, SignedError>::State& state){
+        return static_cast<float>(PairedErrorSum<A, B, SignedError>::mean(state));
+    }
+};
+
+// mean of |a-b|
+template<size_t A = 0, size_t B = 1>
+struct MeanAbsoluteError : PairedErrorSum<A, B, AbsoluteError>
+{
+    static float result(const typename PairedErrorSum<A, B, AbsoluteError>::State& state){
+        return static_cast<float>(PairedErrorSum<A, B, AbsoluteError>::mean(state));
+    }
+};
+
+// square root of the mean of (a-b)^2
+template<size_t A = 0, size_t B = 1>
+struct RootMeanSquareError : PairedErrorSum<A, B, SquaredError>
+{
+    static float result(const typename PairedErrorSum<A, B, SquaredError>::State& state){
+        return static_cast<float>(std::sqrt(PairedErrorSum<A, B, SquaredError>::mean(state)));
+    }
+};
+
+// assembles a MultiStatsLoop comparing two co-registered series, e.g. a model
+// (first) against an observation (second)
+template<int i = 0>
+class DoesThePairedStats
+{
+private:
+    float dot;
+    float covariance;
+    float correlation;
+    float bias;
+    float mae;
+    float rmse;
+    size_t count;
+    bool good;
+public:
+    DoesThePairedStats(const std::vector<float>& first, const std::vector<float>& second, const std::vector<float>& ndvs,
+                       const StatsContext& context = defaultStatsContext())
+    {
+        // added metrics would go here as reducers following the same outline
+        const std::array<const std::vector<float>*, 2> inputs = {&first, &second};
+        auto the_action = MultiStatsLoop(context, inputs, ndvs, DotProduct<>(), Covariance<>(), Bias<>(),
+                                         MeanAbsoluteError<>(), RootMeanSquareError<>());
+        dot = DotProduct<>::result(the_action.template getState<0>());
+        covariance = Covariance<>::covariance(the_action.template getState<1>());
+        correlation = Covariance<>::correlation(the_action.template getState<1>());
+        bias = Bias<>::result(the_action.template getState<2>());
+        mae = MeanAbsoluteError<>::result(the_action.template getState<3>());
+        rmse = RootMeanSquareError<>::result(the_action.template getState<4>());
+        count = the_action.getValidCount();
+        good = the_action.isGood();
+    }
+    float getDotProduct() const{
+        return dot;
+    }
+    float getCovariance() const{
+        return covariance;
+    }
+    float getCorrelation() const{
+        return correlation;
+    }
+    float getBias() const{
+        return bias;
+    }
+    float getMeanAbsoluteError() const{
+        return mae;
+    }
+    float getRootMeanSquareError() const{
+        return rmse;
+    }
+    // number of pairs that were valid in both series
+    size_t getCount() const{
+        return count;
+    }
+    bool isGood() const{
+        return good;
+    }
+};
+
+template<size_t N, typename... Reducers>
+bool MultiStatsLoop<N, Reducers...>::isGood() const
+{
+    return m_sizes_match && !m_contains_ndvs && !m_contains_nan_infs;
+}
+
+template<size_t N, typename... Reducers>
+template<size_t... I>
+void MultiStatsLoop<N, Reducers...>::accumulateBlock(std::index_sequence<I...>, States& states, const std::array<const float*, N>& block,
+                                                     const uint8_t* valid, size_t count) const
+{
+    (std::get<I>(reducers).accumulate(std::get<I>(states), block, valid, count), ...);
+}
+
+template<size_t N, typename... Reducers>
+template<size_t... I>
+void MultiStatsLoop<N, Reducers...>::mergeStates(std::index_sequence<I...>, States& total, const States& partial) const
+{
+    (std::get<I>(reducers).merge(std::get<I>(total), std::get<I>(partial)), ...);
+}
+
+template<size_t N, typename... Reducers>
+MultiStatsLoop<N, Reducers...>::MultiStatsLoop(const std::array<const std::vector<float>*, N>& inputs,
+                                               const std::vector<float>& no_data_values, Reducers... args)
+    : MultiStatsLoop(defaultStatsContext(), inputs, no_data_values, args...)
+{
+}
+
+template<size_t N, typename... Reducers>
+MultiStatsLoop<N, Reducers...>::MultiStatsLoop(const StatsContext& context, const std::array<const std::vector<float>*, N>& inputs,
+                                               const std::vector<float>& no_data_values, Reducers... args) : reducers(args...)
+{
+    m_classifier.setNonDataValues(no_data_values);
+    // mismatched inputs are reduced over their common length but are never good
+    size_t num_elements = inputs[0]->size();
+    for(const std::vector<float>* input : inputs){
+        if(input->size() != num_elements){
+            m_sizes_match = false;
+            num_elements = std::min(num_elements, input->size());
+        }
+    }
+    const size_t num_blocks = (num_elements + multi_stats_block_size - 1) / multi_stats_block_size;
+    StatsExecutor& executor = context.getExecutor();
+    // the plan counts the values of all N inputs, a block position holds N of them
+    const ExecutionPlan plan = context.tuning.plan(num_elements * N, sizeof...(Reducers), executor.concurrency());
+    const size_t blocks_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max<size_t>(plan.chunk_size / (N * multi_stats_block_size), 1) : num_blocks;
+
+    struct ChunkResult
+    {
+        States states;
+        size_t valid_count = 0;
+        bool contains_nan_infs = false;
+        bool contains_ndvs = false;
+    };
+    const ChunkLayout layout(num_blocks, blocks_per_chunk, plan.schedule, plan.num_threads);
+    std::vector<ChunkResult> chunk_results(layout.numChunks());
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan, multi_stats_block_size);
+    runChunked(executor, layout, [&](size_t chunk, size_t first_block, size_t end_block, size_t){
+        ChunkResult& result = chunk_results[chunk];
+        std::array<uint8_t, multi_stats_block_size> valid;
+        for(size_t b=first_block; b<end_block; b++)
+        {
+            const size_t begin = b * multi_stats_block_size;
+            const size_t count = std::min(multi_stats_block_size, num_elements - begin);
+            std::fill_n(valid.begin(), count, uint8_t(1));
+            // every input is classified into the same mask, so one bad value
+            // removes the position for all of them
+            std::array<const float*, N> block;
+            for(size_t input=0; input<N; input++){
+                block[input] = inputs[input]->data() + begin;
+                const BlockClassification classification = m_classifier.classifyBlock(block[input], count, valid.data());
+                result.contains_nan_infs |= classification.num_nan_infs > 0;
+                result.contains_ndvs |= classification.num_ndvs > 0;
+            }
+            size_t block_valid_count = 0;
+            for(size_t k=0; k<count; k++){
+                block_valid_count += valid[k];
+            }
+            result.valid_count += block_valid_count;
+            accumulateBlock(std::index_sequence_for<Reducers...>(), result.states, block, valid.data(), count);
+        }
+    }, inputs[0]->data(), multi_stats_block_size * sizeof(float), telemetry.get());
+    telemetry.startMerge();
+    for(const ChunkResult& result : chunk_results){
+        mergeStates(std::index_sequence_for<Reducers...>(), results, result.states);
+        m_valid_count += result.valid_count;
+        m_contains_nan_infs |= result.contains_nan_infs;
+        m_contains_ndvs |= result.contains_ndvs;
+    }
+    telemetry.publish();
+}
+
+#endif // MULTISTATS_H
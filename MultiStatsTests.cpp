@@ -0,0 +1,131 @@
+#include <MultiStats.h>
+#include <numeric>
+#include <gtest/gtest.h>
+
+namespace {
+
+// straightforward double precision reference for the paired metrics,
+// skipping positions where either value is in skip
+struct PairedReference
+{
+    double dot = 0, covariance = 0, correlation = 0, bias = 0, mae = 0, rmse = 0;
+    size_t count = 0;
+};
+
+PairedReference computeReference(const std::vector<float>& a, const std::vector<float>& b, const std::vector<float>& ndvs)
+{
+    PairedReference reference;
+    std::vector<double> xs, ys;
+    for(size_t i=0; i<a.size(); i++){
+        const bool bad = !std::isfinite(a[i]) || !std::isfinite(b[i]) ||
+                std::find(ndvs.begin(), ndvs.end(), a[i]) != ndvs.end() ||
+                std::find(ndvs.begin(), ndvs.end(), b[i]) != ndvs.end();
+        if(!bad){
+            xs.push_back(a[i]);
+            ys.push_back(b[i]);
+        }
+    }
+    const size_t n = xs.size();
+    reference.count = n;
+    double mean_x = std::accumulate(xs.begin(), xs.end(), 0.0) / n;
+    double mean_y = std::accumulate(ys.begin(), ys.end(), 0.0) / n;
+    double sxx = 0, syy = 0, sxy = 0;
+    for(size_t i=0; i<n; i++){
+        reference.dot += xs[i] * ys[i];
+        sxx += (xs[i]-mean_x) * (xs[i]-mean_x);
+        syy += (ys[i]-mean_y) * (ys[i]-mean_y);
+        sxy += (xs[i]-mean_x) * (ys[i]-mean_y);
+        reference.bias += xs[i] - ys[i];
+        reference.mae += std::fabs(xs[i] - ys[i]);
+        reference.rmse += (xs[i] - ys[i]) * (xs[i] - ys[i]);
+    }
+    reference.covariance = sxy / (n - 1);
+    reference.correlation = sxy / std::sqrt(sxx * syy);
+    reference.bias /= n;
+    reference.mae /= n;
+    reference.rmse = std::sqrt(reference.rmse / n);
+    return reference;
+}
+
+}
+
+TEST(MultiStats, NaivePair)
+{
+    const std::vector<float> model = {1,2,3,4,5,6};
+    const std::vector<float> observation = {2,2,4,3,6,7};
+    DoesThePairedStats stats(model, observation, {});
+    const PairedReference reference = computeReference(model, observation, {});
+
+    EXPECT_TRUE(stats.isGood());
+    EXPECT_EQ(stats.getCount(), 6u);
+    EXPECT_FLOAT_EQ(stats.getDotProduct(), reference.dot);
+    EXPECT_FLOAT_EQ(stats.getCovariance(), reference.covariance);
+    EXPECT_FLOAT_EQ(stats.getCorrelation(), reference.correlation);
+    EXPECT_FLOAT_EQ(stats.getBias(), reference.bias);
+    EXPECT_FLOAT_EQ(stats.getMeanAbsoluteError(), reference.mae);
+    EXPECT_FLOAT_EQ(stats.getRootMeanSquareError(), reference.rmse);
+}
+
+// a no data value or nan in either series drops the pair from every metric
+TEST(MultiStats, InvalidInEitherDropsPair)
+{
+    float negative = -1.f;
+    const std::vector<float> model = {1,-9999,3,4,5,6,7};
+    const std::vector<float> observation = {2,2,4,std::sqrt(negative),6,-9999,8};
+    const std::vector<float> ndvs = {-9999};
+    DoesThePairedStats stats(model, observation, ndvs);
+    const PairedReference reference = computeReference(model, observation, ndvs);
+
+    EXPECT_FALSE(stats.isGood());
+    EXPECT_EQ(stats.getCount(), 4u);
+    EXPECT_EQ(reference.count, 4u);
+    EXPECT_FLOAT_EQ(stats.getDotProduct(), reference.dot);
+    EXPECT_FLOAT_EQ(stats.getCovariance(), reference.covariance);
+    EXPECT_FLOAT_EQ(stats.getBias(), reference.bias);
+    EXPECT_FLOAT_EQ(stats.getRootMeanSquareError(), reference.rmse);
+}
+
+// many blocks so thread local states have to be merged. The large offset
+// would lose the covariance with a naive sum of squares in float
+TEST(MultiStats, MergesAcrossBlocks)
+{
+    const size_t big_number = 100003;
+    std::vector<float> model(big_number), observation(big_number);
+    for(size_t i=0; i<big_number; i++){
+        model[i] = 10000.f + static_cast<float>(i % 17);
+        observation[i] = 10000.f + static_cast<float>((i * 7) % 13);
+    }
+    model[500] = -1.f;
+    DoesThePairedStats stats(model, observation, {-1.f});
+    const PairedReference reference = computeReference(model, observation, {-1.f});
+
+    EXPECT_EQ(stats.getCount(), big_number - 1);
+    EXPECT_NEAR(stats.getCovariance(), reference.covariance, 1e-4);
+    EXPECT_NEAR(stats.getCorrelation(), reference.correlation, 1e-5);
+    EXPECT_NEAR(stats.getMeanAbsoluteError(), reference.mae, 1e-4);
+    EXPECT_NEAR(stats.getDotProduct() / reference.dot, 1.0, 1e-6);
+}
+
+// mismatched inputs are reduced over the common length and flagged
+TEST(MultiStats, SizeMismatch)
+{
+    const std::vector<float> first = {1,2,3};
+    const std::vector<float> second = {1,2};
+    DoesThePairedStats stats(first, second, {});
+    EXPECT_FALSE(stats.isGood());
+    EXPECT_EQ(stats.getCount(), 2u);
+}
+
+// more than two inputs stream in lockstep and reducers pick their pair
+TEST(MultiStats, ThreeInputs)
+{
+    const std::vector<float> a = {1,2,3,4};
+    const std::vector<float> b = {1,1,1,0};
+    const std::vector<float> c = {2,2,2,2};
+    const std::array<const std::vector<float>*, 3> inputs = {&a, &b, &c};
+    MultiStatsLoop loop(inputs, {0.f}, DotProduct<0, 2>(), DotProduct<1, 2>());
+    // last position is dropped because b holds a no data value there
+    EXPECT_EQ(loop.getValidCount(), 3u);
+    EXPECT_FLOAT_EQ((DotProduct<0, 2>::result(loop.getState<0>())), 12.f);
+    EXPECT_FLOAT_EQ((DotProduct<1, 2>::result(loop.getState<1>())), 6.f);
+}
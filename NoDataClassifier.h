@@ -0,0 +1,115 @@
+#ifndef NODATACLASSIFIER_H
+#define NODATACLASSIFIER_H
+#include <vector>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <ForceInline.h>
+
+// result of classifying a block of values
+struct BlockClassification
+{
+    size_t num_nan_infs = 0;
+    size_t num_ndvs = 0;
+};
+
+// decides whether a value is usable: nan/inf values and no data values are not.
+// Shared by every stats loop so they agree on what "bad" means
+class NoDataClassifier
+{
+    // a classifier is built by every stats call, and there are rarely more
+    // than a few no data values, so they are kept inline without a heap copy
+    static constexpr size_t max_inline_ndvs = 4;
+    std::array<float, max_inline_ndvs> m_inline_ndvs{};
+    std::vector<float> m_overflow_ndvs;
+    const float* m_ndvs = m_inline_ndvs.data();
+    size_t m_num_ndvs = 0;
+public:
+    NoDataClassifier() = default;
+    explicit NoDataClassifier(const std::vector<float>& ndvs){
+        setNonDataValues(ndvs);
+    }
+    NoDataClassifier(const NoDataClassifier& other){
+        *this = other;
+    }
+    NoDataClassifier& operator=(const NoDataClassifier& other){
+        if(this != &other){
+            setNonDataValues(other.m_ndvs, other.m_num_ndvs);
+        }
+        return *this;
+    }
+    void setNonDataValues(const std::vector<float>& ndvs){
+        setNonDataValues(ndvs.data(), ndvs.size());
+    }
+    void setNonDataValues(const float* ndvs, size_t count){
+        if(count <= max_inline_ndvs){
+            std::copy(ndvs, ndvs + count, m_inline_ndvs.begin());
+            m_overflow_ndvs.clear();
+            m_ndvs = m_inline_ndvs.data();
+        }
+        else{
+            m_overflow_ndvs.assign(ndvs, ndvs + count);
+            m_ndvs = m_overflow_ndvs.data();
+        }
+        m_num_ndvs = count;
+    }
+    std::vector<float> getNonDataValues() const{
+        return std::vector<float>(m_ndvs, m_ndvs + m_num_ndvs);
+    }
+    FORCE_INLINE static bool isFloatBad(float data_value);
+    FORCE_INLINE bool isFloatNoDataValue(float data_value) const;
+    FORCE_INLINE bool isValid(float data_value) const{
+        return !isFloatBad(data_value) && !isFloatNoDataValue(data_value);
+    }
+    // clears valid[k] for every value that is nan/inf or a no data value. Values
+    // are never set back to valid, so calling it once per input over the same
+    // mask gives the validity of the whole tuple. Written as flat loops without
+    // early exits so the compiler can vectorize them.
+    BlockClassification classifyBlock(const float* values, size_t count, uint8_t* valid) const;
+};
+
+FORCE_INLINE bool NoDataClassifier::isFloatBad(float data_value)
+{
+    return std::isnan(data_value) || std::isinf(data_value);
+}
+
+FORCE_INLINE bool NoDataClassifier::isFloatNoDataValue(float data_value) const
+{
+    // m_ndvs is assumed to be small. If m_ndvs were large,
+    // checking a hash could be more efficient
+    for(size_t n=0; n<m_num_ndvs; n++){
+        const float ndv = m_ndvs[n];
+        // floating point comparison should generaly be safe in the case of ndvs,
+        if(data_value == ndv){
+            return true;
+        }
+    }
+    return false;
+}
+
+inline BlockClassification NoDataClassifier::classifyBlock(const float* values, size_t count, uint8_t* valid) const
+{
+    BlockClassification classification;
+    size_t num_nan_infs = 0;
+    for(size_t k=0; k<count; k++){
+        const uint8_t finite = std::isfinite(values[k]) ? 1 : 0;
+        num_nan_infs += 1 - finite;
+        valid[k] &= finite;
+    }
+    classification.num_nan_infs = num_nan_infs;
+    size_t num_ndvs = 0;
+    for(size_t n=0; n<m_num_ndvs; n++){
+        const float ndv = m_ndvs[n];
+        for(size_t k=0; k<count; k++){
+            const uint8_t is_ndv = values[k] == ndv ? 1 : 0;
+            num_ndvs += is_ndv;
+            valid[k] &= 1 - is_ndv;
+        }
+    }
+    classification.num_ndvs = num_ndvs;
+    return classification;
+}
+
+#endif // NODATACLASSIFIER_H
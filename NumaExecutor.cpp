@@ -0,0 +1,331 @@
+#include "NumaExecutor.h"
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+// executor the current thread is a worker of, nested parallelFor calls from a
+// worker run inline instead of waiting on their own pool
+thread_local const void* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+bool readFirstLine(const std::string& path, std::string& line)
+{
+    std::ifstream file(path);
+    return file && std::getline(file, line);
+}
+
+}
+
+std::vector<int> NumaTopology::parseCpuList(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+    while(std::getline(ranges, range, ',')){
+        if(range.empty() || range == "\n"){
+            continue;
+        }
+        const size_t dash = range.find('-');
+        try{
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for(int cpu=first; cpu<=last; cpu++){
+                cpus.push_back(cpu);
+            }
+        }
+        catch(const std::exception&){
+            return {};
+        }
+    }
+    return cpus;
+}
+
+NumaTopology NumaTopology::discover(const std::string& sysfs_root)
+{
+    NumaTopology topology;
+    std::string online;
+    if(readFirstLine(sysfs_root + "/online", online)){
+        for(int node : parseCpuList(online)){
+            std::string cpulist;
+            if(!readFirstLine(sysfs_root + "/node" + std::to_string(node) + "/cpulist", cpulist)){
+                continue;
+            }
+            std::vector<int> cpus = parseCpuList(cpulist);
+            // memory only nodes have no cpus to run workers on
+            if(!cpus.empty()){
+                topology.node_ids.push_back(node);
+                topology.node_cpus.push_back(cpus);
+            }
+        }
+    }
+    if(topology.node_cpus.empty()){
+        const int hardware_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        std::vector<int> cpus;
+        for(int cpu=0; cpu<hardware_threads; cpu++){
+            cpus.push_back(cpu);
+        }
+        topology.node_ids = {0};
+        topology.node_cpus = {cpus};
+    }
+    return topology;
+}
+
+std::vector<int> numaNodesOfAddresses(const std::vector<const void*>& addresses)
+{
+    std::vector<int> nodes(addresses.size(), -1);
+#if defined(__linux__) && defined(SYS_move_pages)
+    if(addresses.empty()){
+        return nodes;
+    }
+    const uintptr_t page_mask = ~static_cast<uintptr_t>(sysconf(_SC_PAGESIZE) - 1);
+    std::vector<void*> pages(addresses.size());
+    for(size_t i=0; i<addresses.size(); i++){
+        pages[i] = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(addresses[i]) & page_mask);
+    }
+    std::vector<int> status(addresses.size(), -1);
+    // move_pages without target nodes only reports where each page is
+    if(syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) == 0){
+        for(size_t i=0; i<status.size(); i++){
+            nodes[i] = status[i] >= 0 ? status[i] : -1;
+        }
+    }
+#endif
+    return nodes;
+}
+
+bool pinCurrentThread(const std::vector<int>& cpus)
+{
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(int cpu : cpus){
+        if(cpu >= 0 && cpu < CPU_SETSIZE){
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+struct NumaExecutor::Worker
+{
+    std::thread thread;
+    size_t node = 0;
+    int cpu = 0;
+    // since the last job merged its numbers into m_node_stats
+    size_t chunks = 0;
+    size_t remote_chunks = 0;
+    double busy_seconds = 0.0;
+};
+
+struct NumaExecutor::Job
+{
+    const ChunkFunction* fn = nullptr;
+    // chunks homed on each node and how far each node got through them
+    std::vector<std::vector<size_t> > node_chunks;
+    std::unique_ptr<std::atomic<size_t>[]> node_next;
+    std::atomic<size_t> workers_left{0};
+    // set once a chunk threw, the workers stop taking chunks
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+NumaExecutor::NumaExecutor(const NumaTopology& topology) : NumaExecutor(topology, Options())
+{
+}
+
+NumaExecutor::NumaExecutor(const NumaTopology& topology, const Options& options)
+    : m_topology(topology), m_options(options)
+{
+    if(m_topology.node_cpus.empty()){
+        m_topology = NumaTopology::discover("");
+    }
+    m_node_stats.resize(m_topology.numNodes());
+    for(size_t node=0; node<m_topology.numNodes(); node++){
+        for(int cpu : m_topology.node_cpus[node]){
+            auto worker = std::make_unique<Worker>();
+            worker->node = node;
+            worker->cpu = cpu;
+            m_workers.push_back(std::move(worker));
+        }
+    }
+    for(size_t index=0; index<m_workers.size(); index++){
+        m_workers[index]->thread = std::thread([this, index](){
+            workerLoop(index);
+        });
+    }
+}
+
+NumaExecutor::~NumaExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for(auto& worker : m_workers){
+        worker->thread.join();
+    }
+}
+
+std::vector<NumaExecutor::NodeStats> NumaExecutor::getNodeStats() const
+{
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    return m_node_stats;
+}
+
+void NumaExecutor::resetNodeStats()
+{
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    m_node_stats.assign(m_topology.numNodes(), NodeStats());
+}
+
+void NumaExecutor::parallelFor(size_t num_chunks, const ChunkFunction& fn)
+{
+    parallelForPlaced(num_chunks, fn, ChunkHomeFunction());
+}
+
+void NumaExecutor::parallelForPlaced(size_t num_chunks, const ChunkFunction& fn, const ChunkHomeFunction& home)
+{
+    if(num_chunks == 0){
+        return;
+    }
+    if(current_executor == this){
+        for(size_t chunk=0; chunk<num_chunks; chunk++){
+            fn(chunk, current_worker);
+        }
+        return;
+    }
+    const size_t num_nodes = m_topology.numNodes();
+    auto job = std::make_shared<Job>();
+    job->fn = &fn;
+    job->node_chunks.resize(num_nodes);
+    job->node_next.reset(new std::atomic<size_t>[num_nodes]);
+    for(size_t node=0; node<num_nodes; node++){
+        job->node_next[node] = 0;
+    }
+    std::vector<int> kernel_nodes(num_chunks, -1);
+    if(home && num_nodes > 1){
+        std::vector<const void*> addresses(num_chunks);
+        for(size_t chunk=0; chunk<num_chunks; chunk++){
+            addresses[chunk] = home(chunk);
+        }
+        kernel_nodes = numaNodesOfAddresses(addresses);
+    }
+    size_t round_robin = 0;
+    for(size_t chunk=0; chunk<num_chunks; chunk++){
+        const auto found = std::find(m_topology.node_ids.begin(), m_topology.node_ids.end(), kernel_nodes[chunk]);
+        size_t node;
+        if(found != m_topology.node_ids.end()){
+            node = static_cast<size_t>(found - m_topology.node_ids.begin());
+        }
+        else{
+            node = round_robin++ % num_nodes;
+        }
+        job->node_chunks[node].push_back(chunk);
+    }
+
+    std::lock_guard<std::mutex> job_lock(m_job_mutex);
+    job->workers_left = m_workers.size();
+    {
+        std::lock_guard<std::mutex> lock(m_wake_mutex);
+        m_job = job;
+        m_generation++;
+    }
+    m_wake.notify_all();
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&](){
+        return job->workers_left.load() == 0;
+    });
+    std::lock_guard<std::mutex> stats_lock(m_stats_mutex);
+    for(auto& worker : m_workers){
+        NodeStats& stats = m_node_stats[worker->node];
+        stats.chunks += worker->chunks;
+        stats.remote_chunks += worker->remote_chunks;
+        stats.busy_seconds += worker->busy_seconds;
+        worker->chunks = 0;
+        worker->remote_chunks = 0;
+        worker->busy_seconds = 0.0;
+    }
+    // the workers are done with fn, hand the first failure to the caller
+    if(job->error){
+        std::rethrow_exception(job->error);
+    }
+}
+
+void NumaExecutor::runJob(const std::shared_ptr<Job>& job)
+{
+    Worker& worker = *m_workers[current_worker];
+    const size_t num_nodes = job->node_chunks.size();
+    // own node first, then the others in order when stealing is allowed
+    const size_t nodes_to_visit = m_options.allow_remote_steal ? num_nodes : 1;
+    for(size_t offset=0; offset<nodes_to_visit; offset++){
+        const size_t node = (worker.node + offset) % num_nodes;
+        const std::vector<size_t>& chunks = job->node_chunks[node];
+        while(!job->failed.load(std::memory_order_relaxed)){
+            const size_t next = job->node_next[node].fetch_add(1);
+            if(next >= chunks.size()){
+                break;
+            }
+            const auto begin = std::chrono::steady_clock::now();
+            try{
+                (*job->fn)(chunks[next], current_worker);
+            }
+            catch(...){
+                std::lock_guard<std::mutex> lock(job->mutex);
+                if(!job->error){
+                    job->error = std::current_exception();
+                }
+                job->failed.store(true, std::memory_order_relaxed);
+                break;
+            }
+            worker.busy_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            worker.chunks++;
+            worker.remote_chunks += offset > 0 ? 1 : 0;
+        }
+    }
+    if(job->workers_left.fetch_sub(1) == 1){
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished.notify_all();
+    }
+}
+
+void NumaExecutor::workerLoop(size_t index)
+{
+    current_executor = this;
+    current_worker = index;
+    if(m_options.pin_threads){
+        pinCurrentThread({m_workers[index]->cpu});
+    }
+    size_t seen_generation = 0;
+    for(;;){
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(m_wake_mutex);
+            m_wake.wait(lock, [&](){
+                return m_stop || m_generation != seen_generation;
+            });
+            if(m_stop){
+                return;
+            }
+            seen_generation = m_generation;
+            job = m_job;
+        }
+        runJob(job);
+    }
+}
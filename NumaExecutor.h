@@ -0,0 +1,82 @@
+#ifndef NUMAEXECUTOR_H
+#define NUMAEXECUTOR_H
+#include <StatsExecutor.h>
+#include <vector>
+#include <string>
+
+// cpus of every NUMA node, read from /sys/devices/system/node. Machines without
+// that directory (or non Linux builds) report a single node holding every cpu
+struct NumaTopology
+{
+    // kernel node number of each entry in node_cpus. Nodes without cpus are left out
+    std::vector<int> node_ids;
+    std::vector<std::vector<int> > node_cpus;
+    size_t numNodes() const{
+        return node_cpus.size();
+    }
+    static NumaTopology discover(const std::string& sysfs_root = "/sys/devices/system/node");
+    // parses the "0-3,8,10-11" format of cpulist files
+    static std::vector<int> parseCpuList(const std::string& list);
+};
+
+// node holding the page of every address, -1 where the page is not yet
+// faulted in or the kernel cannot say
+std::vector<int> numaNodesOfAddresses(const std::vector<const void*>& addresses);
+// restricts the calling thread to the cpus given. False if the platform refuses
+bool pinCurrentThread(const std::vector<int>& cpus);
+
+// executor with one pinned worker per cpu, grouped by NUMA node. Chunks are queued
+// on the node that holds the pages of their data, so every socket reduces memory
+// attached to it. Chunks without a known home are spread round robin over the nodes.
+class NumaExecutor : public StatsExecutor
+{
+public:
+    struct Options
+    {
+        bool pin_threads = true;
+        // lets a node whose queue ran dry take chunks homed on other nodes.
+        // Keeps every core busy when data is unevenly spread, at the price of remote reads
+        bool allow_remote_steal = true;
+    };
+    // what each node did since the last resetNodeStats()
+    struct NodeStats
+    {
+        size_t chunks = 0;
+        size_t remote_chunks = 0;
+        double busy_seconds = 0.0;
+    };
+    explicit NumaExecutor(const NumaTopology& topology = NumaTopology::discover());
+    NumaExecutor(const NumaTopology& topology, const Options& options);
+    ~NumaExecutor() override;
+    NumaExecutor(const NumaExecutor&) = delete;
+    NumaExecutor& operator=(const NumaExecutor&) = delete;
+    void parallelFor(size_t num_chunks, const ChunkFunction& fn) override;
+    void parallelForPlaced(size_t num_chunks, const ChunkFunction& fn, const ChunkHomeFunction& home) override;
+    size_t concurrency() const override{
+        return m_workers.size();
+    }
+    const NumaTopology& getTopology() const{
+        return m_topology;
+    }
+    std::vector<NodeStats> getNodeStats() const;
+    void resetNodeStats();
+private:
+    struct Job;
+    struct Worker;
+    NumaTopology m_topology;
+    Options m_options;
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::vector<NodeStats> m_node_stats;
+    mutable std::mutex m_stats_mutex;
+    // one job runs at a time, workers wait for the next generation
+    std::mutex m_job_mutex;
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    std::shared_ptr<Job> m_job;
+    size_t m_generation = 0;
+    bool m_stop = false;
+    void workerLoop(size_t index);
+    void runJob(const std::shared_ptr<Job>& job);
+};
+
+#endif // NUMAEXECUTOR_H
@@ -0,0 +1,147 @@
+#include <BasicStats.h>
+#include <NumaExecutor.h>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+// two nodes sharing cpu 0 so the tests run on any machine
+NumaTopology twoNodeTopology()
+{
+    NumaTopology topology;
+    topology.node_ids = {0, 1};
+    topology.node_cpus = {{0}, {0}};
+    return topology;
+}
+
+void writeFile(const std::filesystem::path& path, const std::string& text)
+{
+    std::filesystem::create_directories(path.parent_path());
+    std::ofstream(path) << text;
+}
+
+}
+
+TEST(NumaExecutor, ParseCpuList)
+{
+    EXPECT_EQ(NumaTopology::parseCpuList("0-3,8,10-11\n"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(NumaTopology::parseCpuList("5"), std::vector<int>{5});
+    EXPECT_TRUE(NumaTopology::parseCpuList("").empty());
+    EXPECT_TRUE(NumaTopology::parseCpuList("x-y").empty());
+}
+
+TEST(NumaExecutor, DiscoverReadsSysfs)
+{
+    const std::filesystem::path root = std::filesystem::path(testing::TempDir()) / "numa_sysfs";
+    std::filesystem::remove_all(root);
+    writeFile(root / "online", "0-2\n");
+    writeFile(root / "node0" / "cpulist", "0-1\n");
+    // memory only node
+    writeFile(root / "node1" / "cpulist", "\n");
+    writeFile(root / "node2" / "cpulist", "2,3\n");
+    const NumaTopology topology = NumaTopology::discover(root.string());
+    ASSERT_EQ(topology.numNodes(), 2u);
+    EXPECT_EQ(topology.node_ids, (std::vector<int>{0, 2}));
+    EXPECT_EQ(topology.node_cpus[0], (std::vector<int>{0, 1}));
+    EXPECT_EQ(topology.node_cpus[1], (std::vector<int>{2, 3}));
+
+    // no sysfs at all falls back to one node
+    const NumaTopology fallback = NumaTopology::discover((root / "missing").string());
+    ASSERT_EQ(fallback.numNodes(), 1u);
+    EXPECT_FALSE(fallback.node_cpus[0].empty());
+    std::filesystem::remove_all(root);
+}
+
+TEST(NumaExecutor, RunsEveryChunkOnce)
+{
+    NumaExecutor executor(twoNodeTopology());
+    EXPECT_EQ(executor.concurrency(), 2u);
+    const size_t num_chunks = 1000;
+    std::vector<std::atomic<int> > runs(num_chunks);
+    std::atomic<bool> worker_out_of_range{false};
+    executor.parallelFor(num_chunks, [&](size_t chunk, size_t worker){
+        worker_out_of_range = worker_out_of_range || worker >= 2;
+        runs[chunk]++;
+    });
+    EXPECT_FALSE(worker_out_of_range);
+    for(size_t chunk=0; chunk<num_chunks; chunk++){
+        EXPECT_EQ(runs[chunk], 1);
+    }
+    size_t chunks = 0;
+    for(const NumaExecutor::NodeStats& stats : executor.getNodeStats()){
+        chunks += stats.chunks;
+    }
+    EXPECT_EQ(chunks, num_chunks);
+    executor.resetNodeStats();
+    EXPECT_EQ(executor.getNodeStats()[0].chunks, 0u);
+}
+
+// without remote stealing every chunk runs on the node it was placed on
+TEST(NumaExecutor, PlacedWithoutStealing)
+{
+    NumaExecutor::Options options;
+    options.pin_threads = false;
+    options.allow_remote_steal = false;
+    NumaExecutor executor(twoNodeTopology(), options);
+    const std::vector<float> data(1 << 16, 1.f);
+    std::atomic<size_t> ran{0};
+    executor.parallelForPlaced(64, [&](size_t, size_t){
+        ran++;
+    }, [&](size_t chunk)->const void*{
+        return data.data() + chunk * 1024;
+    });
+    EXPECT_EQ(ran, 64u);
+    const std::vector<NumaExecutor::NodeStats> stats = executor.getNodeStats();
+    EXPECT_EQ(stats[0].chunks + stats[1].chunks, 64u);
+    EXPECT_EQ(stats[0].remote_chunks + stats[1].remote_chunks, 0u);
+}
+
+TEST(NumaExecutor, ChunkThrows)
+{
+    NumaExecutor executor(twoNodeTopology());
+    EXPECT_THROW(executor.parallelFor(100, [&](size_t chunk, size_t){
+        if(chunk == 3){
+            throw std::runtime_error("chunk failed");
+        }
+    }), std::runtime_error);
+    std::atomic<size_t> runs{0};
+    executor.parallelFor(100, [&](size_t, size_t){
+        runs++;
+    });
+    EXPECT_EQ(runs, 100u);
+}
+
+TEST(NumaExecutor, NestedRunsInline)
+{
+    NumaExecutor executor(twoNodeTopology());
+    std::atomic<size_t> inner{0};
+    executor.parallelFor(8, [&](size_t, size_t){
+        executor.parallelFor(4, [&](size_t, size_t){
+            inner++;
+        });
+    });
+    EXPECT_EQ(inner, 32u);
+}
+
+TEST(NumaExecutor, FirstTouchStatsMatchDefault)
+{
+    NumaExecutor executor(twoNodeTopology());
+    StatsContext context = parallelContext(executor);
+    std::vector<float> values(100000);
+    for(size_t k=0; k<values.size(); k++){
+        values[k] = static_cast<float>(k % 17) * 0.25f + 1.f;
+    }
+    values[500] = -9999.f;
+    const DoesTheStats<0> expected(values, {-9999.f}, context);
+    const DoesTheStats<0, FirstTouchAllocator<float> > first_touch(values, {-9999.f}, context);
+    EXPECT_EQ(first_touch.getSum(), expected.getSum());
+    EXPECT_EQ(first_touch.isGood(), expected.isGood());
+    ASSERT_EQ(first_touch.getDifferences().size(), expected.getDifferences().size());
+    EXPECT_TRUE(std::equal(expected.getDifferences().begin(), expected.getDifferences().end(),
+                           first_touch.getDifferences().begin()));
+    EXPECT_EQ(first_touch.getDifferences()[499], 0.f);
+}
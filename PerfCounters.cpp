@@ -0,0 +1,169 @@
+#include "PerfCounters.h"
+#include <utility>
+#if defined(__linux__)
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfReport::PerfReport()
+{
+    reset();
+}
+
+void PerfReport::add(StatsPhase phase, const PerfCounts& delta)
+{
+    const size_t p = static_cast<size_t>(phase);
+    for(size_t c=0; c<num_perf_counters; c++){
+        m_counts[p][c].fetch_add(delta[c], std::memory_order_relaxed);
+    }
+    m_samples[p].fetch_add(1, std::memory_order_relaxed);
+}
+
+void PerfReport::setAvailable(const std::array<bool, num_perf_counters>& available)
+{
+    for(size_t c=0; c<num_perf_counters; c++){
+        if(available[c]){
+            m_available[c].store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+PerfPhaseTotals PerfReport::getPhase(StatsPhase phase) const
+{
+    const size_t p = static_cast<size_t>(phase);
+    PerfPhaseTotals totals;
+    for(size_t c=0; c<num_perf_counters; c++){
+        totals.counts[c] = m_counts[p][c].load(std::memory_order_relaxed);
+    }
+    totals.samples = m_samples[p].load(std::memory_order_relaxed);
+    return totals;
+}
+
+bool PerfReport::isAvailable(PerfCounter counter) const
+{
+    return m_available[counter].load(std::memory_order_relaxed);
+}
+
+void PerfReport::reset()
+{
+    for(size_t p=0; p<num_stats_phases; p++){
+        for(size_t c=0; c<num_perf_counters; c++){
+            m_counts[p][c].store(0, std::memory_order_relaxed);
+        }
+        m_samples[p].store(0, std::memory_order_relaxed);
+    }
+    for(size_t c=0; c<num_perf_counters; c++){
+        m_available[c].store(false, std::memory_order_relaxed);
+    }
+}
+
+ThreadPerfCounters& ThreadPerfCounters::current()
+{
+    thread_local ThreadPerfCounters counters;
+    return counters;
+}
+
+ThreadPerfCounters::ThreadPerfCounters()
+{
+    m_fds.fill(-1);
+#if defined(__linux__)
+    // the software clock leads the group as it opens wherever perf does, the
+    // hardware counters join it when the machine has them
+    const std::array<std::pair<uint32_t, uint64_t>, num_perf_counters> events = {{
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK}
+    }};
+    const std::array<size_t, num_perf_counters> open_order = {PerfTaskClock, PerfCycles, PerfInstructions,
+                                                               PerfLlcMisses, PerfBranchMisses};
+    for(size_t counter : open_order){
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = events[counter].first;
+        attr.config = events[counter].second;
+        attr.read_format = PERF_FORMAT_GROUP;
+        // user space of this thread only, allowed at perf_event_paranoid 2
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, 0));
+        if(fd < 0){
+            if(m_leader < 0){
+                // without the leader there is no group to read
+                return;
+            }
+            continue;
+        }
+        if(m_leader < 0){
+            m_leader = fd;
+        }
+        m_fds[counter] = fd;
+        m_available[counter] = true;
+        m_slot[counter] = m_num_open++;
+    }
+#endif
+}
+
+ThreadPerfCounters::~ThreadPerfCounters()
+{
+#if defined(__linux__)
+    for(int fd : m_fds){
+        if(fd >= 0){
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool ThreadPerfCounters::read(PerfCounts& counts) const
+{
+    counts.fill(0);
+#if defined(__linux__)
+    if(m_leader < 0){
+        return false;
+    }
+    // PERF_FORMAT_GROUP: the number of counters, then their values in the order opened
+    std::array<uint64_t, num_perf_counters + 1> buffer = {};
+    const ssize_t bytes = ::read(m_leader, buffer.data(), (m_num_open + 1) * sizeof(uint64_t));
+    if(bytes < static_cast<ssize_t>((m_num_open + 1) * sizeof(uint64_t))){
+        return false;
+    }
+    for(size_t c=0; c<num_perf_counters; c++){
+        if(m_available[c]){
+            counts[c] = buffer[1 + m_slot[c]];
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+PerfPhaseScope::PerfPhaseScope(PerfReport* report, StatsPhase phase) : m_report(report), m_phase(phase)
+{
+    if(m_report){
+        ThreadPerfCounters::current().read(m_begin);
+    }
+}
+
+PerfPhaseScope::~PerfPhaseScope()
+{
+    if(!m_report){
+        return;
+    }
+    ThreadPerfCounters& counters = ThreadPerfCounters::current();
+    PerfCounts end;
+    if(!counters.read(end)){
+        return;
+    }
+    PerfCounts delta;
+    for(size_t c=0; c<num_perf_counters; c++){
+        delta[c] = end[c] - m_begin[c];
+    }
+    m_report->setAvailable(counters.getAvailable());
+    m_report->add(m_phase, delta);
+}
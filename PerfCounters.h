@@ -0,0 +1,115 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Hardware counters around the phases of BasicStatsLoop, read per thread through
+// Linux perf_event_open and summed into a PerfReport attached to the
+// StatsContext. Build with BASICSTATS_PERF_COUNTERS=1 to compile the phase scopes
+// into the loops, otherwise STATS_PERF_SCOPE expands to nothing and the loops
+// carry no trace of it.
+//
+// Each scope reads the counters twice with one read() of a counter group, about
+// a microsecond each, so enable it to find out where time goes rather than to
+// ship. Counters the kernel refuses (no PMU in a VM, perf_event_paranoid > 2)
+// are reported as unavailable.
+
+#if !defined(BASICSTATS_PERF_COUNTERS)
+#define BASICSTATS_PERF_COUNTERS 0
+#endif
+
+enum class StatsPhase
+{
+    Classify,   // nan/inf and no data value classification of a block
+    Reduce,     // reducers over a classified block
+    Merge       // combining the totals of the chunks
+};
+constexpr size_t num_stats_phases = 3;
+
+enum PerfCounter
+{
+    PerfCycles,
+    PerfInstructions,
+    PerfLlcMisses,
+    PerfBranchMisses,
+    // software clock of the thread in ns, available wherever perf_event_open is
+    PerfTaskClock,
+    num_perf_counters
+};
+
+using PerfCounts = std::array<uint64_t, num_perf_counters>;
+
+struct PerfPhaseTotals
+{
+    PerfCounts counts = {};
+    // scopes that ended in this phase
+    uint64_t samples = 0;
+};
+
+// totals over every thread that ran a loop with this report attached. Threads
+// add to it concurrently
+class PerfReport
+{
+public:
+    PerfReport();
+    void add(StatsPhase phase, const PerfCounts& delta);
+    void setAvailable(const std::array<bool, num_perf_counters>& available);
+    PerfPhaseTotals getPhase(StatsPhase phase) const;
+    // a counter is available when at least one thread could open it
+    bool isAvailable(PerfCounter counter) const;
+    void reset();
+private:
+    std::array<std::array<std::atomic<uint64_t>, num_perf_counters>, num_stats_phases> m_counts;
+    std::array<std::atomic<uint64_t>, num_stats_phases> m_samples;
+    std::array<std::atomic<bool>, num_perf_counters> m_available;
+};
+
+// the counter group of the calling thread, opened on first use and closed when
+// the thread exits
+class ThreadPerfCounters
+{
+public:
+    static ThreadPerfCounters& current();
+    ~ThreadPerfCounters();
+    ThreadPerfCounters(const ThreadPerfCounters&) = delete;
+    ThreadPerfCounters& operator=(const ThreadPerfCounters&) = delete;
+    // counts since the group was opened, 0 for unavailable counters. False when
+    // nothing could be opened
+    bool read(PerfCounts& counts) const;
+    const std::array<bool, num_perf_counters>& getAvailable() const{
+        return m_available;
+    }
+private:
+    ThreadPerfCounters();
+    int m_leader = -1;
+    std::array<int, num_perf_counters> m_fds;
+    std::array<bool, num_perf_counters> m_available = {};
+    // position of each available counter in the group read
+    std::array<size_t, num_perf_counters> m_slot = {};
+    size_t m_num_open = 0;
+};
+
+// adds the counts between construction and destruction to report. Does nothing
+// when report is nullptr
+class PerfPhaseScope
+{
+public:
+    PerfPhaseScope(PerfReport* report, StatsPhase phase);
+    ~PerfPhaseScope();
+    PerfPhaseScope(const PerfPhaseScope&) = delete;
+    PerfPhaseScope& operator=(const PerfPhaseScope&) = delete;
+private:
+    PerfReport* m_report;
+    StatsPhase m_phase;
+    PerfCounts m_begin = {};
+};
+
+#if BASICSTATS_PERF_COUNTERS
+#define STATS_PERF_SCOPE(report, phase) PerfPhaseScope stats_perf_scope(report, phase)
+#else
+#define STATS_PERF_SCOPE(report, phase) ((void)0)
+#endif
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,77 @@
+#include <BasicStats.h>
+#include <PerfCounters.h>
+#include <gtest/gtest.h>
+
+// the counters may be missing (no PMU, perf_event_paranoid), so the tests only
+// check what is available
+
+TEST(PerfCounters, ReportAddsPerPhase)
+{
+    PerfReport report;
+    PerfCounts delta = {};
+    delta[PerfCycles] = 10;
+    delta[PerfTaskClock] = 3;
+    report.add(StatsPhase::Reduce, delta);
+    report.add(StatsPhase::Reduce, delta);
+    report.add(StatsPhase::Merge, delta);
+    EXPECT_EQ(report.getPhase(StatsPhase::Reduce).counts[PerfCycles], 20u);
+    EXPECT_EQ(report.getPhase(StatsPhase::Reduce).samples, 2u);
+    EXPECT_EQ(report.getPhase(StatsPhase::Merge).counts[PerfTaskClock], 3u);
+    EXPECT_EQ(report.getPhase(StatsPhase::Classify).samples, 0u);
+    report.reset();
+    EXPECT_EQ(report.getPhase(StatsPhase::Reduce).samples, 0u);
+    EXPECT_FALSE(report.isAvailable(PerfCycles));
+}
+
+TEST(PerfCounters, ThreadCountersAdvance)
+{
+    PerfCounts before;
+    if(!ThreadPerfCounters::current().read(before)){
+        GTEST_SKIP() << "perf_event_open is not permitted here";
+    }
+    volatile float sink = 0.f;
+    for(int i=0; i<1000000; i++){
+        sink = sink + 1.f;
+    }
+    PerfCounts after;
+    ASSERT_TRUE(ThreadPerfCounters::current().read(after));
+    const auto& available = ThreadPerfCounters::current().getAvailable();
+    for(size_t c=0; c<num_perf_counters; c++){
+        if(available[c]){
+            EXPECT_GE(after[c], before[c]);
+        }
+        else{
+            EXPECT_EQ(after[c], 0u);
+        }
+    }
+    if(available[PerfInstructions]){
+        EXPECT_GT(after[PerfInstructions], before[PerfInstructions]);
+    }
+}
+
+TEST(PerfCounters, LoopPhases)
+{
+    const std::vector<float> values(1 << 20, 1.f);
+    PerfReport report;
+    StatsContext context;
+    context.perf_report = &report;
+    context.tuning.forced_mode = ExecutionMode::Parallel;
+    DoesTheStats stats(values, {}, context);
+    EXPECT_EQ(stats.getSum(), static_cast<float>(values.size()));
+#if BASICSTATS_PERF_COUNTERS
+    PerfCounts probe;
+    if(!ThreadPerfCounters::current().read(probe)){
+        GTEST_SKIP() << "perf_event_open is not permitted here";
+    }
+    const size_t num_blocks = chunkCount(values.size(), basic_stats_block_size);
+    EXPECT_GE(report.getPhase(StatsPhase::Classify).samples, num_blocks);
+    EXPECT_GE(report.getPhase(StatsPhase::Reduce).samples, num_blocks);
+    EXPECT_EQ(report.getPhase(StatsPhase::Merge).samples, 1u);
+    EXPECT_TRUE(report.isAvailable(PerfTaskClock));
+#else
+    // the scopes compile to nothing
+    for(size_t p=0; p<num_stats_phases; p++){
+        EXPECT_EQ(report.getPhase(static_cast<StatsPhase>(p)).samples, 0u);
+    }
+#endif
+}
@@ -0,0 +1,24 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+#include <cstddef>
+
+
+// hints the cpu to start loading the cache line holding address for reading.
+// Compiles to nothing where no intrinsic is known, prefetching is only ever a hint.
+
+#if !defined (PREFETCH_READ)
+#	if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#		include <xmmintrin.h>
+#		define PREFETCH_READ(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#	elif defined(__clang__) || defined(__GNUC__)
+#		define PREFETCH_READ(address) __builtin_prefetch((address), 0, 3)
+#	else
+#		define PREFETCH_READ(address) ((void)(address))
+#	endif
+#endif //!defined (PREFETCH_READ)
+
+// bytes between consecutive prefetches, one cache line on current x86 and arm
+constexpr size_t prefetch_stride_bytes = 64;
+
+
+#endif // PREFETCH_H
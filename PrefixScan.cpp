@@ -0,0 +1,269 @@
+#include "PrefixScan.h"
+#include <NoDataClassifier.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace {
+
+// independent running sums per block in the plain sum scan, so the adds of one
+// do not wait on the others
+constexpr size_t scan_lanes = 4;
+
+struct SumScan
+{
+    static double identity(){
+        return 0.0;
+    }
+    static double combine(double total, double value){
+        return total + value;
+    }
+};
+
+struct ProductScan
+{
+    static double identity(){
+        return 1.0;
+    }
+    static double combine(double total, double value){
+        return total * value;
+    }
+};
+
+// per chunk result of the first pass
+struct ChunkTotal
+{
+    double total = 0.0;
+    // a no data value in the chunk restarted the scan, total is what followed it
+    bool reset = false;
+};
+
+struct WorkerScratch
+{
+    std::vector<uint8_t> valid;
+    std::vector<float> clean;
+    std::vector<float> lanes;
+    bool contains_ndvs = false;
+    bool contains_nan_infs = false;
+};
+
+// classifies a block and writes the values the scan sees: nan/inf and no data
+// values become the identity to skip them, or nan to propagate. Returns the
+// index one past the last invalid value, 0 if there is none
+template<class Op>
+size_t prepareBlock(const NoDataClassifier& classifier, const float* values, size_t count, ScanNoData no_data,
+                    WorkerScratch& scratch, bool record)
+{
+    uint8_t* valid = scratch.valid.data();
+    float* clean = scratch.clean.data();
+    std::fill_n(valid, count, uint8_t(1));
+    const BlockClassification classification = classifier.classifyBlock(values, count, valid);
+    if(record){
+        scratch.contains_nan_infs |= classification.num_nan_infs > 0;
+        scratch.contains_ndvs |= classification.num_ndvs > 0;
+    }
+    const float replacement = no_data == ScanNoData::Propagate
+            ? std::numeric_limits<float>::quiet_NaN() : static_cast<float>(Op::identity());
+    for(size_t k=0; k<count; k++){
+        clean[k] = valid[k] ? values[k] : replacement;
+    }
+    if(classification.num_nan_infs + classification.num_ndvs == 0){
+        return 0;
+    }
+    size_t last_invalid = count;
+    while(valid[last_invalid - 1]){
+        last_invalid--;
+    }
+    return last_invalid;
+}
+
+template<class Op>
+double reduceBlock(const float* clean, size_t count)
+{
+    double total = Op::identity();
+    for(size_t k=0; k<count; k++){
+        total = Op::combine(total, clean[k]);
+    }
+    return total;
+}
+
+// first pass, a chunk's combined values and whether it reset
+template<class Op>
+ChunkTotal reduceChunk(const NoDataClassifier& classifier, const float* values, size_t count, ScanNoData no_data,
+                       WorkerScratch& scratch)
+{
+    ChunkTotal chunk;
+    chunk.total = Op::identity();
+    for(size_t block_begin=0; block_begin<count; block_begin+=prefix_scan_block_size){
+        const size_t block_count = std::min(prefix_scan_block_size, count - block_begin);
+        const size_t restart = prepareBlock<Op>(classifier, values + block_begin, block_count, no_data, scratch, false);
+        const float* clean = scratch.clean.data();
+        if(no_data == ScanNoData::Reset && restart > 0){
+            chunk.total = reduceBlock<Op>(clean + restart, block_count - restart);
+            chunk.reset = true;
+        }
+        else{
+            chunk.total = Op::combine(chunk.total, reduceBlock<Op>(clean, block_count));
+        }
+    }
+    return chunk;
+}
+
+// plain sum of a block on top of carry. Each of scan_lanes slices is scanned
+// on its own, interleaved, then shifted by the slices before it
+void scanSumBlock(const float* clean, size_t count, float* out, double& carry, std::vector<float>& lane_scratch)
+{
+    const size_t lane_size = count / scan_lanes;
+    float* lanes = lane_scratch.data();
+    float lane_totals[scan_lanes] = {};
+    for(size_t k=0; k<lane_size; k++){
+        for(size_t lane=0; lane<scan_lanes; lane++){
+            lane_totals[lane] += clean[lane * lane_size + k];
+            lanes[lane * lane_size + k] = lane_totals[lane];
+        }
+    }
+    double offset = carry;
+    for(size_t lane=0; lane<scan_lanes; lane++){
+        const float* in = lanes + lane * lane_size;
+        float* dst = out + lane * lane_size;
+        #pragma omp simd
+        for(size_t k=0; k<lane_size; k++){
+            dst[k] = static_cast<float>(offset + in[k]);
+        }
+        offset += lane_totals[lane];
+    }
+    // what does not divide into the slices
+    float tail = 0.f;
+    for(size_t k=lane_size*scan_lanes; k<count; k++){
+        tail += clean[k];
+        out[k] = static_cast<float>(offset + tail);
+    }
+    carry = offset + tail;
+}
+
+// Neumaier: the running sum and the low order bits it dropped, both float.
+// The compensation is folded back every step so it stays below the sum's last
+// bit and cannot itself drift on a long series of equal roundings
+void scanCompensatedBlock(const float* clean, size_t count, float* out, float& sum, float& compensation)
+{
+    for(size_t k=0; k<count; k++){
+        const float value = clean[k];
+        const float next = sum + value;
+        compensation += std::abs(sum) >= std::abs(value) ? (sum - next) + value : (value - next) + sum;
+        sum = next + compensation;
+        compensation -= sum - next;
+        out[k] = sum;
+    }
+}
+
+// second pass, a chunk scanned from the combined values before it
+template<class Op>
+void scanChunk(const NoDataClassifier& classifier, const float* values, size_t count, float* out, double carry,
+               const ScanOptions& options, WorkerScratch& scratch)
+{
+    const bool plain_sum = std::is_same<Op, SumScan>::value && options.no_data != ScanNoData::Reset;
+    const bool compensated = std::is_same<Op, SumScan>::value && options.compensated;
+    // the compensated sum carries on in float from the double carry in
+    float sum = static_cast<float>(carry);
+    float compensation = static_cast<float>(carry - sum);
+    for(size_t block_begin=0; block_begin<count; block_begin+=prefix_scan_block_size){
+        const size_t block_count = std::min(prefix_scan_block_size, count - block_begin);
+        prepareBlock<Op>(classifier, values + block_begin, block_count, options.no_data, scratch, true);
+        const float* clean = scratch.clean.data();
+        const uint8_t* valid = scratch.valid.data();
+        float* block_out = out + block_begin;
+        if(compensated){
+            if(options.no_data == ScanNoData::Reset){
+                for(size_t k=0; k<block_count; k++){
+                    if(!valid[k]){
+                        sum = 0.f;
+                        compensation = 0.f;
+                        block_out[k] = 0.f;
+                        continue;
+                    }
+                    scanCompensatedBlock(clean + k, 1, block_out + k, sum, compensation);
+                }
+            }
+            else{
+                scanCompensatedBlock(clean, block_count, block_out, sum, compensation);
+            }
+        }
+        else if(plain_sum){
+            scanSumBlock(clean, block_count, block_out, carry, scratch.lanes);
+        }
+        else{
+            // resets and products depend on every step before them
+            const double identity = Op::identity();
+            for(size_t k=0; k<block_count; k++){
+                carry = valid[k] || options.no_data != ScanNoData::Reset ? Op::combine(carry, clean[k]) : identity;
+                block_out[k] = static_cast<float>(carry);
+            }
+        }
+    }
+}
+
+template<class Op>
+ScanSummary runScan(const float* values, size_t count, float* out, const std::vector<float>& ndvs,
+                    const ScanOptions& options, const StatsContext& context)
+{
+    ScanSummary summary;
+    if(count == 0){
+        return summary;
+    }
+    const NoDataClassifier classifier(ndvs);
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(count, 4, executor.concurrency());
+    const size_t per_chunk = plan.mode == ExecutionMode::Parallel ? std::max(plan.chunk_size, prefix_scan_block_size) : count;
+    const ChunkLayout layout(count, per_chunk, plan.schedule, plan.num_threads);
+    const size_t num_chunks = layout.numChunks();
+    std::vector<WorkerScratch> worker_scratch(executor.concurrency());
+    for(WorkerScratch& scratch : worker_scratch){
+        scratch.valid.resize(prefix_scan_block_size);
+        scratch.clean.resize(prefix_scan_block_size);
+        scratch.lanes.resize(prefix_scan_block_size);
+    }
+
+    // exclusive scan of the chunk totals, each chunk's carry in
+    std::vector<double> carries(num_chunks, Op::identity());
+    if(num_chunks > 1){
+        std::vector<ChunkTotal> totals(num_chunks);
+        LoopTelemetryRecorder telemetry(context.telemetry_callback, plan);
+        runChunked(executor, layout, [&](size_t chunk, size_t begin, size_t end, size_t worker){
+            totals[chunk] = reduceChunk<Op>(classifier, values + begin, end - begin, options.no_data, worker_scratch[worker]);
+        }, values, sizeof(float), telemetry.get());
+        telemetry.startMerge();
+        for(size_t chunk=1; chunk<num_chunks; chunk++){
+            const ChunkTotal& previous = totals[chunk - 1];
+            carries[chunk] = previous.reset ? previous.total : Op::combine(carries[chunk - 1], previous.total);
+        }
+        telemetry.publish();
+    }
+
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan);
+    runChunked(executor, layout, [&](size_t chunk, size_t begin, size_t end, size_t worker){
+        scanChunk<Op>(classifier, values + begin, end - begin, out + begin, carries[chunk], options, worker_scratch[worker]);
+    }, out, sizeof(float), telemetry.get());
+    telemetry.startMerge();
+    for(const WorkerScratch& scratch : worker_scratch){
+        summary.contains_ndvs |= scratch.contains_ndvs;
+        summary.contains_nan_infs |= scratch.contains_nan_infs;
+    }
+    telemetry.publish();
+    return summary;
+}
+
+} // namespace
+
+ScanSummary cumulativeSum(const float* values, size_t count, float* out, const std::vector<float>& ndvs,
+                          const ScanOptions& options, const StatsContext& context)
+{
+    return runScan<SumScan>(values, count, out, ndvs, options, context);
+}
+
+ScanSummary cumulativeProduct(const float* values, size_t count, float* out, const std::vector<float>& ndvs,
+                              const ScanOptions& options, const StatsContext& context)
+{
+    return runScan<ProductScan>(values, count, out, ndvs, options, context);
+}
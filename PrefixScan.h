@@ -0,0 +1,47 @@
+#ifndef PREFIXSCAN_H
+#define PREFIXSCAN_H
+#include <vector>
+#include <cstddef>
+#include <StatsContext.h>
+
+// values classified and scanned at once
+constexpr size_t prefix_scan_block_size = 1024;
+
+// what an inclusive scan does at a nan/inf or no data value
+enum class ScanNoData
+{
+    Skip,       // left out, the output repeats the running total
+    Reset,      // the total starts again after it, the output is 0 for sums and 1 for products
+    Propagate   // it and every output after it are nan
+};
+
+struct ScanOptions
+{
+    ScanNoData no_data = ScanNoData::Skip;
+    // Neumaier compensated running sum, so long cumulative sums keep close to
+    // full float precision. About twice the work. Products ignore it
+    bool compensated = false;
+};
+
+// what a scan met on the way
+struct ScanSummary
+{
+    bool contains_ndvs = false;
+    bool contains_nan_infs = false;
+    bool isGood() const{
+        return !contains_ndvs && !contains_nan_infs;
+    }
+};
+
+// inclusive cumulative sum and product of count values into the caller's out,
+// which may be values itself. The inverse of DoesTheStats' differences: the
+// cumulative sum of a series' differences gives the series back less its first
+// value. Parallel inputs run in two passes over the same chunks, each chunk's
+// total first, then each chunk scanned from the combined totals of the chunks
+// before it
+ScanSummary cumulativeSum(const float* values, size_t count, float* out, const std::vector<float>& ndvs,
+                          const ScanOptions& options = ScanOptions(), const StatsContext& context = defaultStatsContext());
+ScanSummary cumulativeProduct(const float* values, size_t count, float* out, const std::vector<float>& ndvs,
+                              const ScanOptions& options = ScanOptions(), const StatsContext& context = defaultStatsContext());
+
+#endif // PREFIXSCAN_H
@@ -0,0 +1,143 @@
+#include <PrefixScan.h>
+#include <cmath>
+#include <limits>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+// serial scan in double with the same no data policy
+std::vector<double> directScan(const std::vector<float>& values, float ndv, ScanNoData no_data, bool product)
+{
+    const double identity = product ? 1.0 : 0.0;
+    std::vector<double> result(values.size());
+    double total = identity;
+    for(size_t i=0; i<values.size(); i++){
+        const float value = values[i];
+        if(std::isnan(value) || std::isinf(value) || value == ndv){
+            if(no_data == ScanNoData::Reset){
+                total = identity;
+            }
+            else if(no_data == ScanNoData::Propagate){
+                total = std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+        else{
+            total = product ? total * value : total + value;
+        }
+        result[i] = total;
+    }
+    return result;
+}
+
+void expectMatchesDirect(const std::vector<float>& scanned, const std::vector<double>& expected, double tolerance)
+{
+    ASSERT_EQ(scanned.size(), expected.size());
+    for(size_t i=0; i<expected.size(); i++){
+        if(std::isnan(expected[i])){
+            ASSERT_TRUE(std::isnan(scanned[i])) << "index " << i;
+            continue;
+        }
+        ASSERT_NEAR(scanned[i], expected[i], tolerance * (std::abs(expected[i]) + 1.0)) << "index " << i;
+    }
+}
+
+}
+
+TEST(PrefixScan, SumsMatchDirectForEveryPolicy)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext parallel = parallelContext(pool);
+    StatsContext serial;
+    serial.tuning.forced_mode = ExecutionMode::Serial;
+    std::vector<float> values = patternSeries(20000, 113, 1.f, -50.f);
+    values[3] = -9999.f;
+    values[5000] = std::numeric_limits<float>::quiet_NaN();
+    values[12345] = -9999.f;
+    const StatsContext* contexts[] = {&serial, &parallel};
+    for(ScanNoData no_data : {ScanNoData::Skip, ScanNoData::Reset, ScanNoData::Propagate}){
+        for(bool compensated : {false, true}){
+            for(const StatsContext* context : contexts){
+                ScanOptions options;
+                options.no_data = no_data;
+                options.compensated = compensated;
+                std::vector<float> out(values.size());
+                const ScanSummary summary = cumulativeSum(values.data(), values.size(), out.data(), {-9999.f}, options, *context);
+                EXPECT_TRUE(summary.contains_ndvs);
+                EXPECT_TRUE(summary.contains_nan_infs);
+                EXPECT_FALSE(summary.isGood());
+                expectMatchesDirect(out, directScan(values, -9999.f, no_data, false), 1e-5);
+            }
+        }
+    }
+    // reset writes the identity where it restarts
+    ScanOptions reset;
+    reset.no_data = ScanNoData::Reset;
+    std::vector<float> out(values.size());
+    cumulativeSum(values.data(), values.size(), out.data(), {-9999.f}, reset, parallel);
+    EXPECT_EQ(out[12345], 0.f);
+    EXPECT_EQ(out[12346], values[12346]);
+}
+
+TEST(PrefixScan, ProductsMatchDirect)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext parallel = parallelContext(pool);
+    // factors near 1 keep a long product finite
+    std::vector<float> values(10000);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = 1.f + static_cast<float>(static_cast<int>(i % 11) - 5) * 1e-3f;
+    }
+    values[4096] = -9999.f;
+    values[7000] = std::numeric_limits<float>::infinity();
+    for(ScanNoData no_data : {ScanNoData::Skip, ScanNoData::Reset, ScanNoData::Propagate}){
+        ScanOptions options;
+        options.no_data = no_data;
+        std::vector<float> out(values.size());
+        const ScanSummary summary = cumulativeProduct(values.data(), values.size(), out.data(), {-9999.f}, options, parallel);
+        EXPECT_FALSE(summary.isGood());
+        expectMatchesDirect(out, directScan(values, -9999.f, no_data, true), 1e-5);
+    }
+}
+
+TEST(PrefixScan, CompensatedKeepsLongSumsAccurate)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext parallel = parallelContext(pool);
+    // small increments on a large running total lose their low bits
+    std::vector<float> values(1 << 20, 0.1f);
+    values[0] = 1e5f;
+    const std::vector<double> expected = directScan(values, -9999.f, ScanNoData::Skip, false);
+    double plain_error = 0.0;
+    double compensated_error = 0.0;
+    for(bool compensated : {false, true}){
+        ScanOptions options;
+        options.compensated = compensated;
+        std::vector<float> out(values.size());
+        EXPECT_TRUE(cumulativeSum(values.data(), values.size(), out.data(), {-9999.f}, options, parallel).isGood());
+        double& error = compensated ? compensated_error : plain_error;
+        for(size_t i=0; i<values.size(); i++){
+            error = std::max(error, std::abs(out[i] - expected[i]));
+        }
+    }
+    // one float rounding of the output, about 2^-24 of the total
+    EXPECT_LT(compensated_error, expected.back() * 1e-7);
+    EXPECT_LE(compensated_error, plain_error);
+}
+
+TEST(PrefixScan, InPlaceUndoesDifferences)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext parallel = parallelContext(pool);
+    const std::vector<float> values = patternSeries(50000, 113, 1.f, -50.f);
+    std::vector<float> differences(values.size() - 1);
+    for(size_t i=0; i+1<values.size(); i++){
+        differences[i] = values[i + 1] - values[i];
+    }
+    // the cumulative sum of the differences is the series less its first value
+    cumulativeSum(differences.data(), differences.size(), differences.data(), {}, ScanOptions(), parallel);
+    for(size_t i=0; i<differences.size(); i++){
+        ASSERT_FLOAT_EQ(differences[i] + values[0], values[i + 1]) << "index " << i;
+    }
+    EXPECT_TRUE(cumulativeSum(nullptr, 0, nullptr, {}).isGood());
+}
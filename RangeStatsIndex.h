@@ -0,0 +1,216 @@
+#ifndef RANGESTATSINDEX_H
+#define RANGESTATSINDEX_H
+#include <vector>
+#include <string>
+#include <fstream>
+#include <functional>
+#include <typeinfo>
+#include <type_traits>
+#include <algorithm>
+#include <cstdint>
+#include <StatsExpression.h>
+#include <StatsCache.h>
+
+// values per leaf of the tree by default. A query reduces at most two partial
+// leaves directly, the rest comes from merged summaries
+constexpr size_t range_stats_default_block_size = 4 * expression_stats_block_size;
+// first bytes of a saved index
+constexpr uint32_t range_stats_file_magic = 0x58495352; // "RSIX"
+constexpr uint32_t range_stats_file_version = 1;
+
+// a segment tree of a ReducerSet's feature states over fixed size blocks of a
+// series, built once. Statistics of any [begin, end) then cost O(log n) merges
+// of summaries plus the direct reduction of the partial blocks at the two
+// ends. Summaries are merged in series order, so a range's result does not
+// depend on how the tree splits it beyond rounding.
+//
+// The index can be saved next to the data and loaded instead of rebuilt; a
+// file only loads for the same reducers, no data values, block size and data
+// content. The buffer is not copied and must outlive the index unchanged.
+template<typename... Reducers>
+class RangeStatsIndex
+{
+public:
+    using States = typename ExpressionStatsLoop<Reducers...>::States;
+    // statistics of one range
+    using Result = StatsSummary<Reducers...>;
+private:
+    StatsContext m_context;
+    const std::vector<float>& m_data;
+    NoDataClassifier m_classifier;
+    size_t m_block_size;
+    size_t m_num_blocks = 0;
+    // leaves start at m_num_leaves, node n has children 2n and 2n + 1
+    size_t m_num_leaves = 0;
+    std::vector<Result> m_nodes;
+    bool m_loaded = false;
+    void build();
+    Result reduceDirect(size_t begin, size_t end) const;
+    uint64_t signature() const;
+public:
+    // block_size is rounded up to a multiple of expression_stats_block_size
+    RangeStatsIndex(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& ndvs,
+                    ReducerSet<Reducers...> reducers = {}, size_t block_size = range_stats_default_block_size);
+    // loads the index saved at path if it was made for this data, builds it otherwise
+    RangeStatsIndex(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& ndvs,
+                    ReducerSet<Reducers...> reducers, const std::string& path, size_t block_size = range_stats_default_block_size);
+    // [begin, end) clamped to the series
+    Result query(size_t begin, size_t end) const;
+    bool save(const std::string& path) const;
+    // whether the constructor read the index from a file
+    bool wasLoaded() const{
+        return m_loaded;
+    }
+    size_t getBlockSize() const{
+        return m_block_size;
+    }
+    size_t getNumBlocks() const{
+        return m_num_blocks;
+    }
+};
+
+template<typename... Reducers>
+RangeStatsIndex<Reducers...>::RangeStatsIndex(const StatsContext& context, const std::vector<float>& data,
+                                              const std::vector<float>& ndvs, ReducerSet<Reducers...>, size_t block_size)
+    : m_context(context), m_data(data), m_classifier(ndvs)
+{
+    m_block_size = std::max<size_t>((block_size + expression_stats_block_size - 1) / expression_stats_block_size, 1)
+            * expression_stats_block_size;
+    m_num_blocks = (data.size() + m_block_size - 1) / m_block_size;
+    m_num_leaves = 1;
+    while(m_num_leaves < m_num_blocks){
+        m_num_leaves *= 2;
+    }
+    build();
+}
+
+template<typename... Reducers>
+RangeStatsIndex<Reducers...>::RangeStatsIndex(const StatsContext& context, const std::vector<float>& data,
+                                              const std::vector<float>& ndvs, ReducerSet<Reducers...>,
+                                              const std::string& path, size_t block_size)
+    : m_context(context), m_data(data), m_classifier(ndvs)
+{
+    m_block_size = std::max<size_t>((block_size + expression_stats_block_size - 1) / expression_stats_block_size, 1)
+            * expression_stats_block_size;
+    m_num_blocks = (data.size() + m_block_size - 1) / m_block_size;
+    m_num_leaves = 1;
+    while(m_num_leaves < m_num_blocks){
+        m_num_leaves *= 2;
+    }
+    std::ifstream file(path, std::ios::binary);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t header[5] = {};
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if(file && magic == range_stats_file_magic && version == range_stats_file_version &&
+       header[0] == signature() && header[1] == Result::numBytes() && header[2] == m_block_size &&
+       header[3] == data.size() && header[4] == hashBuffer(data, context)){
+        m_nodes.resize(2 * m_num_leaves);
+        for(Result& node : m_nodes){
+            node.forEachBytes([&](void* target, size_t size){
+                file.read(static_cast<char*>(target), static_cast<std::streamsize>(size));
+            });
+        }
+        m_loaded = static_cast<bool>(file);
+    }
+    if(!m_loaded){
+        build();
+    }
+}
+
+template<typename... Reducers>
+bool RangeStatsIndex<Reducers...>::save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file){
+        return false;
+    }
+    const uint64_t header[5] = {signature(), Result::numBytes(), m_block_size, m_data.size(), hashBuffer(m_data, m_context)};
+    file.write(reinterpret_cast<const char*>(&range_stats_file_magic), sizeof(range_stats_file_magic));
+    file.write(reinterpret_cast<const char*>(&range_stats_file_version), sizeof(range_stats_file_version));
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for(const Result& node : m_nodes){
+        node.forEachBytes([&](const void* source, size_t size){
+            file.write(static_cast<const char*>(source), static_cast<std::streamsize>(size));
+        });
+    }
+    return static_cast<bool>(file);
+}
+
+template<typename... Reducers>
+uint64_t RangeStatsIndex<Reducers...>::signature() const
+{
+    // the features and the no data values the summaries were made with. Type
+    // names are only stable within one compiler, a file from another does not load
+    uint64_t hash = std::hash<std::string>()(typeid(States).name());
+    hash = hash * 0x9E3779B185EBCA87ull + hashNoDataValues(m_classifier.getNonDataValues());
+    return hash;
+}
+
+template<typename... Reducers>
+void RangeStatsIndex<Reducers...>::build()
+{
+    m_nodes.assign(2 * m_num_leaves, Result());
+    StatsExecutor& executor = m_context.getExecutor();
+    const ExecutionPlan plan = m_context.tuning.plan(m_data.size(), std::tuple_size_v<typename ExpressionStatsLoop<Reducers...>::Features>,
+                                                     executor.concurrency());
+    const size_t blocks_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max<size_t>(plan.chunk_size / m_block_size, 1) : m_num_blocks;
+    const ChunkLayout layout(m_num_blocks, blocks_per_chunk, plan.schedule, plan.num_threads);
+    LoopTelemetryRecorder telemetry(m_context.telemetry_callback, plan, m_block_size);
+    runChunked(executor, layout, [&](size_t, size_t first_block, size_t end_block, size_t){
+        for(size_t b=first_block; b<end_block; b++){
+            m_nodes[m_num_leaves + b] = reduceDirect(b * m_block_size, std::min((b + 1) * m_block_size, m_data.size()));
+        }
+    }, m_data.data(), m_block_size * sizeof(float), telemetry.get());
+    telemetry.startMerge();
+    // the levels above hold the merges of their children, left before right
+    for(size_t node=m_num_leaves; node-->1;){
+        m_nodes[node] = m_nodes[2 * node];
+        m_nodes[node].merge(m_nodes[2 * node + 1]);
+    }
+    telemetry.publish();
+}
+
+template<typename... Reducers>
+typename RangeStatsIndex<Reducers...>::Result RangeStatsIndex<Reducers...>::reduceDirect(size_t begin, size_t end) const
+{
+    Result result;
+    result.accumulate(m_classifier, m_data.data() + begin, end - begin);
+    return result;
+}
+
+template<typename... Reducers>
+typename RangeStatsIndex<Reducers...>::Result RangeStatsIndex<Reducers...>::query(size_t begin, size_t end) const
+{
+    end = std::min(end, m_data.size());
+    if(begin >= end){
+        return Result();
+    }
+    // whole blocks inside the range
+    const size_t first_block = (begin + m_block_size - 1) / m_block_size;
+    const size_t end_block = end / m_block_size;
+    if(first_block >= end_block){
+        return reduceDirect(begin, end);
+    }
+    Result result = reduceDirect(begin, first_block * m_block_size);
+    // bottom up over the tree, the right hand nodes are merged last in reverse
+    std::vector<const Result*> right;
+    for(size_t low=first_block+m_num_leaves, high=end_block+m_num_leaves; low<high; low/=2, high/=2){
+        if(low & 1){
+            result.merge(m_nodes[low++]);
+        }
+        if(high & 1){
+            right.push_back(&m_nodes[--high]);
+        }
+    }
+    for(size_t k=right.size(); k-->0;){
+        result.merge(*right[k]);
+    }
+    result.merge(reduceDirect(end_block * m_block_size, end));
+    return result;
+}
+
+#endif // RANGESTATSINDEX_H
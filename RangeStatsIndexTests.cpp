@@ -0,0 +1,87 @@
+#include <RangeStatsIndex.h>
+#include <cstdio>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+struct TestBins
+{
+    static constexpr float lower = 0.f;
+    static constexpr float upper = 64.f;
+    static constexpr size_t count = 16;
+};
+
+using TestReducers = ReducerSet<Sum, Count, MinMax, Moments<3>, Histogram<TestBins> >;
+
+std::vector<float> testSeries(size_t count)
+{
+    std::vector<float> values = patternSeries(count, 61);
+    for(size_t i=0; i<count; i++){
+        values[i] += static_cast<float>(i % 7) * 0.125f;
+    }
+    values[1234] = -9999.f;
+    values[50000] = std::numeric_limits<float>::infinity();
+    return values;
+}
+
+}
+
+TEST(RangeStatsIndex, QueriesMatchTheSlice)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext context = parallelContext(pool);
+    const std::vector<float> values = testSeries(100003);
+    const RangeStatsIndex index(context, values, {-9999.f}, TestReducers());
+    EXPECT_EQ(index.getBlockSize(), range_stats_default_block_size);
+    EXPECT_EQ(index.getNumBlocks(), 25u);
+    const std::vector<std::pair<size_t, size_t> > ranges = {
+        {0, values.size()}, {0, 1}, {10, 20}, {4096, 8192}, {1000, 99000}, {4095, 4097},
+        {50000, 50001}, {33333, 77777}, {99999, 200000}, {123, 123}
+    };
+    for(const std::pair<size_t, size_t>& range : ranges){
+        const std::vector<float> slice(values.begin() + range.first, values.begin() + std::min(range.second, values.size()));
+        const ExpressionStatsLoop direct(context, slice, {-9999.f}, TestReducers());
+        const auto result = index.query(range.first, range.second);
+        EXPECT_EQ(result.isGood(), direct.isGood());
+        EXPECT_EQ(result.get<Count>(), direct.get<Count>());
+        EXPECT_NEAR(result.get<Sum>(), direct.get<Sum>(), std::abs(direct.get<Sum>()) * 1e-6f);
+        if(direct.get<Count>() > 0){
+            EXPECT_EQ(result.get<MinMax>().min, direct.get<MinMax>().min);
+            EXPECT_EQ(result.get<MinMax>().max, direct.get<MinMax>().max);
+        }
+        if(direct.get<Count>() > 2){
+            EXPECT_NEAR(result.get<Moments<3> >().variance, direct.get<Moments<3> >().variance, 1e-3f);
+            EXPECT_NEAR(result.get<Moments<3> >().skewness, direct.get<Moments<3> >().skewness, 1e-4f);
+        }
+        EXPECT_EQ(result.get<Histogram<TestBins> >().counts, direct.get<Histogram<TestBins> >().counts);
+    }
+}
+
+TEST(RangeStatsIndex, SavedIndexLoadsForTheSameData)
+{
+    const std::string path = testing::TempDir() + "range_stats_index.bin";
+    std::vector<float> values = testSeries(30000);
+    StatsContext context;
+    const RangeStatsIndex built(context, values, {-9999.f}, TestReducers(), 2048);
+    ASSERT_TRUE(built.save(path));
+
+    const RangeStatsIndex loaded(context, values, {-9999.f}, TestReducers(), path, 2048);
+    EXPECT_TRUE(loaded.wasLoaded());
+    const auto expected = built.query(100, 25000);
+    const auto result = loaded.query(100, 25000);
+    EXPECT_EQ(result.get<Sum>(), expected.get<Sum>());
+    EXPECT_EQ(result.get<Histogram<TestBins> >().counts, expected.get<Histogram<TestBins> >().counts);
+
+    // other no data values, another block size or other data rebuild
+    EXPECT_FALSE(RangeStatsIndex(context, values, {-1.f}, TestReducers(), path, 2048).wasLoaded());
+    EXPECT_FALSE(RangeStatsIndex(context, values, {-9999.f}, TestReducers(), path, 4096).wasLoaded());
+    EXPECT_FALSE(RangeStatsIndex(context, values, {-9999.f}, ReducerSet<Sum, Count>(), path, 2048).wasLoaded());
+    const float head_sum = built.query(0, 8).get<Sum>();
+    values[7] += 1.f;
+    const RangeStatsIndex rebuilt(context, values, {-9999.f}, TestReducers(), path, 2048);
+    EXPECT_FALSE(rebuilt.wasLoaded());
+    EXPECT_EQ(rebuilt.query(0, 8).get<Sum>(), head_sum + 1.f);
+    std::remove(path.c_str());
+    EXPECT_FALSE(RangeStatsIndex(context, values, {-9999.f}, TestReducers(), path, 2048).wasLoaded());
+}
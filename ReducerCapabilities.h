@@ -0,0 +1,164 @@
+#ifndef REDUCERCAPABILITIES_H
+#define REDUCERCAPABILITIES_H
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <ForceInline.h>
+
+// What a BasicStatsLoop reducer can do, found at compile time from its members:
+//     element(value, total)                         element-wise, never sees an index
+//     indexed(index, value, total)                  index-aware
+//     block(block_begin, values, valid, count, total)
+//                                                   block-wise, reduces a classified block
+//                                                   at once. Needs element or indexed too,
+//                                                   used for inputs too small for blocks
+//     merge(partial, total)                         combines the totals of two chunks
+// The loop only forms indices for index-aware reducers, so element-wise and
+// block-wise ones compile to plain loops over the values.
+//
+// A lambda taking (std::optional<size_t> index, float value, float& total) still
+// works: it is treated as index-aware and merges when called with an empty index.
+
+namespace reducer_detail {
+
+template<typename Fn, typename = void>
+struct hasElement : std::false_type {};
+template<typename Fn>
+struct hasElement<Fn, std::void_t<decltype(std::declval<const Fn&>().element(0.f, std::declval<float&>()))> > : std::true_type {};
+
+template<typename Fn, typename = void>
+struct hasIndexed : std::false_type {};
+template<typename Fn>
+struct hasIndexed<Fn, std::void_t<decltype(std::declval<const Fn&>().indexed(size_t(0), 0.f, std::declval<float&>()))> > : std::true_type {};
+
+template<typename Fn, typename = void>
+struct hasBlock : std::false_type {};
+template<typename Fn>
+struct hasBlock<Fn, std::void_t<decltype(std::declval<const Fn&>().block(size_t(0), std::declval<const float*>(),
+                                                                         std::declval<const uint8_t*>(), size_t(0),
+                                                                         std::declval<float&>()))> > : std::true_type {};
+
+template<typename Fn, typename = void>
+struct hasMerge : std::false_type {};
+template<typename Fn>
+struct hasMerge<Fn, std::void_t<decltype(std::declval<const Fn&>().merge(0.f, std::declval<float&>()))> > : std::true_type {};
+
+}
+
+template<typename Fn>
+struct ReducerCapabilities
+{
+    static constexpr bool element_wise = reducer_detail::hasElement<Fn>::value;
+    static constexpr bool index_aware = reducer_detail::hasIndexed<Fn>::value;
+    static constexpr bool block_wise = reducer_detail::hasBlock<Fn>::value;
+    static constexpr bool mergeable = reducer_detail::hasMerge<Fn>::value;
+    // (std::optional<size_t>, float, float&) lambda
+    static constexpr bool legacy = !element_wise && !index_aware && !block_wise && !mergeable &&
+            std::is_invocable_v<const Fn&, std::optional<size_t>, float, float&>;
+    static_assert(legacy || element_wise || index_aware, "a reducer needs element(), indexed() or the legacy call operator");
+    static_assert(legacy || mergeable, "a reducer needs merge() to combine chunk totals");
+    static_assert(!(element_wise && index_aware), "a reducer is either element-wise or index-aware");
+};
+
+// one valid element
+template<typename Fn>
+FORCE_INLINE void reduceElement(const Fn& fn, size_t index, float value, float& total)
+{
+    if constexpr(ReducerCapabilities<Fn>::element_wise){
+        (void)index;
+        fn.element(value, total);
+    }
+    else if constexpr(ReducerCapabilities<Fn>::index_aware){
+        fn.indexed(index, value, total);
+    }
+    else{
+        fn(index, value, total);
+    }
+}
+
+// folds the total of a chunk into the running total
+template<typename Fn>
+FORCE_INLINE void mergeTotal(const Fn& fn, float partial, float& total)
+{
+    if constexpr(ReducerCapabilities<Fn>::mergeable){
+        fn.merge(partial, total);
+    }
+    else{
+        fn(std::nullopt, partial, total);
+    }
+}
+
+// element-wise reducer from two lambdas, element(value, total) and merge(partial, total)
+template<typename ElementFn, typename MergeFn>
+struct ElementReducer
+{
+    ElementFn element_fn;
+    MergeFn merge_fn;
+    FORCE_INLINE void element(float value, float& total) const{
+        element_fn(value, total);
+    }
+    FORCE_INLINE void merge(float partial, float& total) const{
+        merge_fn(partial, total);
+    }
+};
+
+template<typename ElementFn, typename MergeFn>
+ElementReducer<ElementFn, MergeFn> elementReducer(ElementFn element_fn, MergeFn merge_fn)
+{
+    return {element_fn, merge_fn};
+}
+
+// index-aware reducer from two lambdas, indexed(index, value, total) and merge(partial, total)
+template<typename IndexedFn, typename MergeFn>
+struct IndexedReducer
+{
+    IndexedFn indexed_fn;
+    MergeFn merge_fn;
+    FORCE_INLINE void indexed(size_t index, float value, float& total) const{
+        indexed_fn(index, value, total);
+    }
+    FORCE_INLINE void merge(float partial, float& total) const{
+        merge_fn(partial, total);
+    }
+};
+
+template<typename IndexedFn, typename MergeFn>
+IndexedReducer<IndexedFn, MergeFn> indexedReducer(IndexedFn indexed_fn, MergeFn merge_fn)
+{
+    return {indexed_fn, merge_fn};
+}
+
+// sum, reduced a block at a time in a vectorized loop
+struct PlusReducer
+{
+    FORCE_INLINE void element(float value, float& total) const{
+        total += value;
+    }
+    void block(size_t, const float* values, const uint8_t* valid, size_t count, float& total) const{
+        float sum = 0.f;
+        #pragma omp simd reduction(+:sum)
+        for(size_t k=0; k<count; k++){
+            sum += valid[k] ? values[k] : 0.f;
+        }
+        total += sum;
+    }
+    FORCE_INLINE void merge(float partial, float& total) const{
+        total += partial;
+    }
+};
+
+// product. Element-wise only: a product that overflows to inf in one vector lane
+// and meets a zero in another would become nan, so the order is kept
+struct MultiplyReducer
+{
+    FORCE_INLINE void element(float value, float& total) const{
+        total *= value;
+    }
+    FORCE_INLINE void merge(float partial, float& total) const{
+        total *= partial;
+    }
+};
+
+#endif // REDUCERCAPABILITIES_H
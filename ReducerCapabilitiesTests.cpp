@@ -0,0 +1,79 @@
+#include <BasicStats.h>
+#include <ReducerCapabilities.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+auto legacy_plus = [](std::optional<size_t>, float value, float& total)->void{
+    total += value;
+};
+
+// records the largest index it was given
+struct MaxIndexReducer
+{
+    void indexed(size_t index, float, float& total) const{
+        total = std::max(total, static_cast<float>(index));
+    }
+    void merge(float partial, float& total) const{
+        total = std::max(total, partial);
+    }
+};
+
+std::vector<float> testSeries()
+{
+    std::vector<float> values(20000);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = static_cast<float>(i % 13);
+    }
+    values[19999] = -1.f;
+    values[42] = std::numeric_limits<float>::infinity();
+    return values;
+}
+
+}
+
+TEST(ReducerCapabilities, Detection)
+{
+    EXPECT_TRUE(ReducerCapabilities<decltype(legacy_plus)>::legacy);
+    EXPECT_FALSE(ReducerCapabilities<decltype(legacy_plus)>::block_wise);
+
+    EXPECT_TRUE(ReducerCapabilities<PlusReducer>::element_wise);
+    EXPECT_TRUE(ReducerCapabilities<PlusReducer>::block_wise);
+    EXPECT_TRUE(ReducerCapabilities<PlusReducer>::mergeable);
+    EXPECT_FALSE(ReducerCapabilities<PlusReducer>::index_aware);
+
+    EXPECT_TRUE(ReducerCapabilities<MultiplyReducer>::element_wise);
+    EXPECT_FALSE(ReducerCapabilities<MultiplyReducer>::block_wise);
+
+    EXPECT_TRUE(ReducerCapabilities<MaxIndexReducer>::index_aware);
+    EXPECT_FALSE(ReducerCapabilities<MaxIndexReducer>::legacy);
+}
+
+// every kind of reducer gives the same total in every execution mode, and the
+// index-aware one still sees real indices next to element-wise ones
+TEST(ReducerCapabilities, KindsAgree)
+{
+    const std::vector<float> values = testSeries();
+    float expected_sum = 0.f;
+    for(float v : values){
+        expected_sum += std::isfinite(v) && v != -1.f ? v : 0.f;
+    }
+    const auto element_plus = elementReducer([](float value, float& total)->void{
+        total += value;
+    }, [](float partial, float& total)->void{
+        total += partial;
+    });
+    for(ExecutionMode mode : {ExecutionMode::Serial, ExecutionMode::SimdOnly, ExecutionMode::Parallel}){
+        StatsContext context;
+        context.tuning.forced_mode = mode;
+        context.tuning.min_grain_work = 0;
+        BasicStatsLoop loop(context, values, {-1.f}, {0.f, 0.f, 0.f, -1.f},
+                            legacy_plus, element_plus, PlusReducer(), MaxIndexReducer());
+        EXPECT_EQ(loop.getResult<0>(), expected_sum);
+        EXPECT_EQ(loop.getResult<1>(), expected_sum);
+        EXPECT_EQ(loop.getResult<2>(), expected_sum);
+        // the last value is a no data value
+        EXPECT_EQ(loop.getResult<3>(), 19998.f);
+        EXPECT_FALSE(loop.isGood());
+    }
+}
@@ -0,0 +1,224 @@
+#ifndef ROLLINGSTATS_H
+#define ROLLINGSTATS_H
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <ForceInline.h>
+#include <NoDataClassifier.h>
+#include <StatsContext.h>
+
+// values classified at once when a chunk's input is prepared
+constexpr size_t rolling_stats_block_size = 1024;
+// the running sums are recomputed from the window at least this many steps
+// apart, which bounds the rounding error removing values leaves behind
+constexpr size_t rolling_stats_recompute_steps = 4096;
+// a parallel chunk covers at least this many windows, so re-reading the
+// window - 1 values it overlaps with its neighbour costs little
+constexpr size_t rolling_stats_min_chunk_windows = 4;
+
+// moving sum, mean, variance, min and max over every window of window
+// consecutive values. Entry k covers values[k, k + window), so there are
+// values.size() - window + 1 entries and the window centre is k + window / 2.
+// No data values, nans and infs are left out of a window; counts says how many
+// values each one kept. Sums and squares slide in O(1) per step in double,
+// shifted by a reference value and recomputed every few thousand steps. Min and
+// max use the van Herk/Gil-Werman scheme: prefix and suffix extremes of
+// window sized runs, three comparisons per value for any window. Threads take
+// overlapping chunks of the series.
+template<int i = 0>
+class DoesTheRollingStats
+{
+private:
+    std::vector<float> sums;
+    std::vector<float> means;
+    std::vector<float> variances;
+    std::vector<float> mins;
+    std::vector<float> maxs;
+    std::vector<uint32_t> counts;
+    bool window_ok = true;
+    bool contains_ndvs = false;
+    bool contains_nan_infs = false;
+public:
+    DoesTheRollingStats(const std::vector<float>& values, size_t window, const std::vector<float>& ndvs,
+                        const StatsContext& context = defaultStatsContext());
+    size_t getNumWindows() const{
+        return counts.size();
+    }
+    // 0 for a window without valid values
+    const std::vector<float>& getSums() const{
+        return sums;
+    }
+    // nan for a window without valid values
+    const std::vector<float>& getMeans() const{
+        return means;
+    }
+    // sample variance, nan for windows with less than two valid values
+    const std::vector<float>& getVariances() const{
+        return variances;
+    }
+    const std::vector<float>& getMins() const{
+        return mins;
+    }
+    const std::vector<float>& getMaxs() const{
+        return maxs;
+    }
+    const std::vector<uint32_t>& getCounts() const{
+        return counts;
+    }
+    // false for a window of 0
+    bool isWindowValid() const{
+        return window_ok;
+    }
+    // no nan/inf and no no data value anywhere in the series
+    bool isGood() const{
+        return !contains_ndvs && !contains_nan_infs;
+    }
+};
+
+template<int i>
+DoesTheRollingStats<i>::DoesTheRollingStats(const std::vector<float>& values, size_t window, const std::vector<float>& ndvs,
+                                            const StatsContext& context)
+{
+    if(window == 0){
+        window_ok = false;
+        return;
+    }
+    if(values.size() < window){
+        return;
+    }
+    const size_t num_windows = values.size() - window + 1;
+    sums.resize(num_windows);
+    means.resize(num_windows);
+    variances.resize(num_windows);
+    mins.resize(num_windows);
+    maxs.resize(num_windows);
+    counts.resize(num_windows);
+    const NoDataClassifier classifier(ndvs);
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(num_windows, 5, executor.concurrency());
+    const size_t windows_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max(plan.chunk_size, rolling_stats_min_chunk_windows * window) : num_windows;
+    const size_t recompute_steps = std::max(window, rolling_stats_recompute_steps);
+    const float inf = std::numeric_limits<float>::infinity();
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    // scratch is reused by every chunk a worker runs
+    struct WorkerScratch
+    {
+        std::vector<uint8_t> valid;
+        std::vector<float> prefix_min;
+        std::vector<float> suffix_min;
+        std::vector<float> prefix_max;
+        std::vector<float> suffix_max;
+        bool contains_ndvs = false;
+        bool contains_nan_infs = false;
+    };
+    std::vector<WorkerScratch> worker_scratch(executor.concurrency());
+    const ChunkLayout layout(num_windows, windows_per_chunk, plan.schedule, plan.num_threads);
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan);
+    runChunked(executor, layout, [&](size_t, size_t first_window, size_t end_window, size_t worker){
+        // the chunk reads the window - 1 values after its last window too
+        const float* input = values.data() + first_window;
+        const size_t input_count = end_window - first_window + window - 1;
+        WorkerScratch& scratch = worker_scratch[worker];
+        scratch.valid.resize(input_count);
+        scratch.prefix_min.resize(input_count);
+        scratch.suffix_min.resize(input_count);
+        scratch.prefix_max.resize(input_count);
+        scratch.suffix_max.resize(input_count);
+        uint8_t* valid = scratch.valid.data();
+        for(size_t block_begin=0; block_begin<input_count; block_begin+=rolling_stats_block_size){
+            const size_t count = std::min(rolling_stats_block_size, input_count - block_begin);
+            std::fill_n(valid + block_begin, count, uint8_t(1));
+            const BlockClassification classification = classifier.classifyBlock(input + block_begin, count, valid + block_begin);
+            scratch.contains_nan_infs |= classification.num_nan_infs > 0;
+            scratch.contains_ndvs |= classification.num_ndvs > 0;
+        }
+
+        // van Herk/Gil-Werman: runs of window values from the chunk start, a
+        // window spans the suffix of one run and the prefix of the next
+        for(size_t run_begin=0; run_begin<input_count; run_begin+=window){
+            const size_t run_end = std::min(run_begin + window, input_count);
+            float low = inf;
+            float high = -inf;
+            for(size_t k=run_begin; k<run_end; k++){
+                low = std::min(low, valid[k] ? input[k] : inf);
+                high = std::max(high, valid[k] ? input[k] : -inf);
+                scratch.prefix_min[k] = low;
+                scratch.prefix_max[k] = high;
+            }
+            low = inf;
+            high = -inf;
+            for(size_t k=run_end; k-->run_begin;){
+                low = std::min(low, valid[k] ? input[k] : inf);
+                high = std::max(high, valid[k] ? input[k] : -inf);
+                scratch.suffix_min[k] = low;
+                scratch.suffix_max[k] = high;
+            }
+        }
+
+        // sums of value - reference keep the squares small for data far from 0
+        double reference = 0.0;
+        for(size_t k=0; k<input_count; k++){
+            if(valid[k]){
+                reference = input[k];
+                break;
+            }
+        }
+        double sum = 0.0;
+        double sum_squares = 0.0;
+        size_t count = 0;
+        const auto add = [&](size_t k){
+            const double shifted = valid[k] ? input[k] - reference : 0.0;
+            sum += shifted;
+            sum_squares += shifted * shifted;
+            count += valid[k];
+        };
+        for(size_t k=0; k+1<window; k++){
+            add(k);
+        }
+        for(size_t w=0; w<end_window-first_window; w++){
+            if(w > 0 && w % recompute_steps == 0){
+                // drop what removing values has left behind
+                sum = 0.0;
+                sum_squares = 0.0;
+                count = 0;
+                for(size_t k=w; k+1<w+window; k++){
+                    add(k);
+                }
+            }
+            add(w + window - 1);
+            const size_t out = first_window + w;
+            counts[out] = static_cast<uint32_t>(count);
+            if(count > 0){
+                sums[out] = static_cast<float>(sum + reference * count);
+                means[out] = static_cast<float>(sum / count + reference);
+                mins[out] = std::min(scratch.suffix_min[w], scratch.prefix_min[w + window - 1]);
+                maxs[out] = std::max(scratch.suffix_max[w], scratch.prefix_max[w + window - 1]);
+            }
+            else{
+                sums[out] = 0.f;
+                means[out] = nan;
+                mins[out] = nan;
+                maxs[out] = nan;
+            }
+            variances[out] = count > 1
+                    ? static_cast<float>(std::max(sum_squares - sum * sum / count, 0.0) / (count - 1.0)) : nan;
+            // leaves the window
+            const double shifted = valid[w] ? input[w] - reference : 0.0;
+            sum -= shifted;
+            sum_squares -= shifted * shifted;
+            count -= valid[w];
+        }
+    }, values.data(), sizeof(float), telemetry.get());
+    telemetry.startMerge();
+    for(const WorkerScratch& scratch : worker_scratch){
+        contains_ndvs |= scratch.contains_ndvs;
+        contains_nan_infs |= scratch.contains_nan_infs;
+    }
+    telemetry.publish();
+}
+
+#endif // ROLLINGSTATS_H
@@ -0,0 +1,116 @@
+#include <RollingStats.h>
+#include <limits>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+// checks every window against a direct computation in double
+void expectMatchesDirect(const DoesTheRollingStats<>& rolling, const std::vector<float>& values, size_t window, float ndv)
+{
+    ASSERT_EQ(rolling.getNumWindows(), values.size() - window + 1);
+    for(size_t k=0; k<rolling.getNumWindows(); k++){
+        double sum = 0.0;
+        double sum_squares = 0.0;
+        size_t count = 0;
+        float min = std::numeric_limits<float>::infinity();
+        float max = -std::numeric_limits<float>::infinity();
+        for(size_t j=k; j<k+window; j++){
+            const float value = values[j];
+            if(std::isnan(value) || std::isinf(value) || value == ndv){
+                continue;
+            }
+            sum += value;
+            sum_squares += static_cast<double>(value) * value;
+            count++;
+            min = std::min(min, value);
+            max = std::max(max, value);
+        }
+        ASSERT_EQ(rolling.getCounts()[k], count) << "window " << k;
+        EXPECT_NEAR(rolling.getSums()[k], sum, 1e-4 * (std::abs(sum) + 1.0)) << "window " << k;
+        if(count == 0){
+            EXPECT_TRUE(std::isnan(rolling.getMeans()[k]));
+            EXPECT_TRUE(std::isnan(rolling.getMins()[k]));
+            continue;
+        }
+        EXPECT_NEAR(rolling.getMeans()[k], sum / count, 1e-4 * (std::abs(sum / count) + 1.0));
+        EXPECT_EQ(rolling.getMins()[k], min) << "window " << k;
+        EXPECT_EQ(rolling.getMaxs()[k], max) << "window " << k;
+        if(count > 1){
+            const double variance = (sum_squares - sum * sum / count) / (count - 1.0);
+            EXPECT_NEAR(rolling.getVariances()[k], variance, 1e-3 * (variance + 1.0)) << "window " << k;
+        }
+        else{
+            EXPECT_TRUE(std::isnan(rolling.getVariances()[k]));
+        }
+    }
+}
+
+}
+
+TEST(RollingStats, MatchesDirectWithNoData)
+{
+    std::vector<float> values = patternSeries(5000, 113, 1.f, -50.f);
+    const float ndv = -50.f;
+    values[10] = std::numeric_limits<float>::quiet_NaN();
+    // a run of no data longer than the small windows
+    std::fill(values.begin() + 100, values.begin() + 140, ndv);
+    for(size_t window : {size_t(1), size_t(3), size_t(17), size_t(1000)}){
+        DoesTheRollingStats rolling(values, window, {ndv});
+        EXPECT_TRUE(rolling.isWindowValid());
+        EXPECT_FALSE(rolling.isGood());
+        expectMatchesDirect(rolling, values, window, ndv);
+    }
+}
+
+TEST(RollingStats, ParallelChunksOverlap)
+{
+    const std::vector<float> values = patternSeries(200000, 113, 1.f, -50.f);
+    ThreadPoolExecutor pool(3);
+    StatsContext context;
+    context.executor = &pool;
+    context.tuning.forced_mode = ExecutionMode::Parallel;
+    context.tuning.min_grain_work = 1024;
+    for(size_t window : {size_t(3), size_t(257), size_t(10000)}){
+        DoesTheRollingStats parallel(values, window, {}, context);
+        EXPECT_TRUE(parallel.isGood());
+        expectMatchesDirect(parallel, values, window, std::numeric_limits<float>::quiet_NaN());
+    }
+}
+
+// a long series far from 0 would lose the variance to rounding without the
+// reference shift and the periodic recompute
+TEST(RollingStats, NoDriftOverLongSeries)
+{
+    std::vector<float> values(300000);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = 10000.f + static_cast<float>(i % 7) * 0.25f;
+    }
+    StatsContext context;
+    context.tuning.forced_mode = ExecutionMode::SimdOnly;
+    DoesTheRollingStats rolling(values, 7, {}, context);
+    // every window holds each of the 7 steps once
+    const double mean = 10000.0 + 0.75;
+    double variance = 0.0;
+    for(int step=0; step<7; step++){
+        variance += (step * 0.25 - 0.75) * (step * 0.25 - 0.75);
+    }
+    variance /= 6.0;
+    for(size_t k=0; k<rolling.getNumWindows(); k+=997){
+        EXPECT_NEAR(rolling.getMeans()[k], mean, 1e-3);
+        EXPECT_NEAR(rolling.getVariances()[k], variance, 1e-4);
+    }
+}
+
+TEST(RollingStats, WindowEdges)
+{
+    const std::vector<float> values = patternSeries(10, 113, 1.f, -50.f);
+    DoesTheRollingStats empty(values, 0, {});
+    EXPECT_FALSE(empty.isWindowValid());
+    DoesTheRollingStats too_long(values, 11, {});
+    EXPECT_TRUE(too_long.isWindowValid());
+    EXPECT_EQ(too_long.getNumWindows(), 0u);
+    DoesTheRollingStats whole(values, 10, {});
+    ASSERT_EQ(whole.getNumWindows(), 1u);
+    expectMatchesDirect(whole, values, 10, std::numeric_limits<float>::quiet_NaN());
+}
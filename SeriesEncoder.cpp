@@ -0,0 +1,225 @@
+#include "SeriesEncoder.h"
+#include <NoDataClassifier.h>
+#include <cstring>
+#if defined(BASICSTATS_ZSTD) && __has_include(<zstd.h>)
+#include <zstd.h>
+#define SERIES_ENCODER_ZSTD 1
+#endif
+
+namespace {
+
+constexpr size_t lz4_min_match = 4;
+// the LZ4 block rules: the last 5 bytes are literals and no match starts in
+// the last 12
+constexpr size_t lz4_last_literals = 5;
+constexpr size_t lz4_match_find_limit = 12;
+constexpr unsigned lz4_hash_bits = 12;
+constexpr size_t lz4_max_offset = 65535;
+// misses in a row before the search starts skipping ahead, so data without
+// matches goes by quickly
+constexpr unsigned lz4_skip_trigger = 6;
+
+uint32_t read32(const uint8_t* data)
+{
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+void appendLz4Length(std::vector<uint8_t>& out, size_t length)
+{
+    for(; length>=255; length-=255){
+        out.push_back(255);
+    }
+    out.push_back(static_cast<uint8_t>(length));
+}
+
+// one sequence: literals, then a match of match_length at offset back unless
+// match_length is 0 for the last one
+void appendLz4Sequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t num_literals, size_t offset, size_t match_length)
+{
+    const size_t match_code = match_length ? match_length - lz4_min_match : 0;
+    out.push_back(static_cast<uint8_t>((std::min<size_t>(num_literals, 15) << 4) | std::min<size_t>(match_code, 15)));
+    if(num_literals >= 15){
+        appendLz4Length(out, num_literals - 15);
+    }
+    out.insert(out.end(), literals, literals + num_literals);
+    if(match_length == 0){
+        return;
+    }
+    out.push_back(static_cast<uint8_t>(offset & 0xff));
+    out.push_back(static_cast<uint8_t>(offset >> 8));
+    if(match_code >= 15){
+        appendLz4Length(out, match_code - 15);
+    }
+}
+
+// the predictor of filter from values into words, vectorizable since every
+// word only reads the input
+void predict(const uint32_t* values, size_t count, FrameFilter filter, uint32_t* words)
+{
+    if(count == 0){
+        return;
+    }
+    words[0] = values[0];
+    if(filter == FrameFilter::Delta || filter == FrameFilter::ShuffleDelta){
+        #pragma omp simd
+        for(size_t i=1; i<count; i++){
+            words[i] = values[i] - values[i - 1];
+        }
+    }
+    else if(filter == FrameFilter::Xor || filter == FrameFilter::ShuffleXor){
+        #pragma omp simd
+        for(size_t i=1; i<count; i++){
+            words[i] = values[i] ^ values[i - 1];
+        }
+    }
+    else{
+        std::memcpy(words + 1, values + 1, (count - 1) * sizeof(uint32_t));
+    }
+}
+
+}
+
+size_t lz4CompressBlock(const uint8_t* source, size_t bytes, std::vector<uint8_t>& out)
+{
+    const size_t start = out.size();
+    size_t anchor = 0;
+    if(bytes > lz4_match_find_limit){
+        constexpr uint32_t empty = UINT32_MAX;
+        std::vector<uint32_t> table(size_t(1) << lz4_hash_bits, empty);
+        const size_t match_end_limit = bytes - lz4_last_literals;
+        size_t position = 0;
+        unsigned misses = 0;
+        while(position + lz4_match_find_limit < bytes){
+            const uint32_t sequence = read32(source + position);
+            const uint32_t hash = (sequence * 2654435761u) >> (32 - lz4_hash_bits);
+            const uint32_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(position);
+            if(candidate == empty || position - candidate > lz4_max_offset || read32(source + candidate) != sequence){
+                position += 1 + (misses++ >> lz4_skip_trigger);
+                continue;
+            }
+            misses = 0;
+            size_t match = candidate;
+            // the match may start earlier than where it was found
+            while(position > anchor && match > 0 && source[position - 1] == source[match - 1]){
+                position--;
+                match--;
+            }
+            size_t length = lz4_min_match;
+            while(position + length < match_end_limit && source[position + length] == source[match + length]){
+                length++;
+            }
+            appendLz4Sequence(out, source + anchor, position - anchor, position - match, length);
+            position += length;
+            anchor = position;
+        }
+    }
+    appendLz4Sequence(out, source + anchor, bytes - anchor, 0, 0);
+    return out.size() - start;
+}
+
+void encodeFrame(const float* values, size_t count, const SeriesEncoderOptions& options, EncodedFrame& frame)
+{
+    const size_t raw_bytes = count * sizeof(float);
+    frame.num_values = count;
+    frame.filter = options.filter;
+    // the filtered values, then their byte planes when shuffled
+    thread_local std::vector<uint32_t> words;
+    thread_local std::vector<uint8_t> planes;
+    words.resize(count);
+    predict(reinterpret_cast<const uint32_t*>(values), count, options.filter, words.data());
+    const uint8_t* filtered = reinterpret_cast<const uint8_t*>(words.data());
+    if(options.filter == FrameFilter::ShuffleDelta || options.filter == FrameFilter::ShuffleXor){
+        planes.resize(raw_bytes);
+        shuffleBytes(filtered, count, planes.data());
+        filtered = planes.data();
+    }
+    frame.bytes.clear();
+    frame.codec = options.codec;
+    switch(options.codec){
+    case FrameCodec::Lz4:
+        lz4CompressBlock(filtered, raw_bytes, frame.bytes);
+        break;
+    case FrameCodec::Zstd:
+#ifdef SERIES_ENCODER_ZSTD
+    {
+        frame.bytes.resize(ZSTD_compressBound(raw_bytes));
+        const size_t compressed = ZSTD_compress(frame.bytes.data(), frame.bytes.size(), filtered, raw_bytes, 1);
+        if(ZSTD_isError(compressed)){
+            frame.codec = FrameCodec::None;
+        }
+        else{
+            frame.bytes.resize(compressed);
+        }
+    }
+#else
+        frame.codec = FrameCodec::Lz4;
+        lz4CompressBlock(filtered, raw_bytes, frame.bytes);
+#endif
+        break;
+    default:
+        frame.codec = FrameCodec::None;
+        break;
+    }
+    if(frame.codec == FrameCodec::None || frame.bytes.size() >= raw_bytes){
+        frame.codec = FrameCodec::None;
+        frame.bytes.assign(filtered, filtered + raw_bytes);
+    }
+}
+
+std::vector<uint8_t> assembleCompressedSeries(const std::vector<EncodedFrame>& frames, size_t frame_values)
+{
+    uint64_t num_values = 0;
+    size_t total_bytes = 24 + frames.size() * 24;
+    for(const EncodedFrame& frame : frames){
+        num_values += frame.num_values;
+        total_bytes += frame.bytes.size();
+    }
+    std::vector<uint8_t> series(total_bytes, 0);
+    uint8_t* out = series.data();
+    const auto write = [&](size_t at, const auto& value){
+        std::memcpy(out + at, &value, sizeof(value));
+    };
+    write(0, compressed_series_magic);
+    write(4, compressed_series_version);
+    write(8, num_values);
+    write(16, static_cast<uint32_t>(frame_values));
+    write(20, static_cast<uint32_t>(frames.size()));
+    uint64_t offset = 24 + frames.size() * 24;
+    for(size_t f=0; f<frames.size(); f++){
+        const EncodedFrame& frame = frames[f];
+        const size_t entry = 24 + f * 24;
+        write(entry, offset);
+        write(entry + 8, static_cast<uint32_t>(frame.bytes.size()));
+        write(entry + 12, static_cast<uint32_t>(frame.num_values));
+        out[entry + 16] = static_cast<uint8_t>(frame.filter);
+        out[entry + 17] = static_cast<uint8_t>(frame.codec);
+        std::memcpy(out + offset, frame.bytes.data(), frame.bytes.size());
+        offset += frame.bytes.size();
+    }
+    return series;
+}
+
+std::vector<uint8_t> encodeSeries(const float* values, size_t count, const SeriesEncoderOptions& options, const StatsContext& context)
+{
+    return encodeSeriesFrames(context, count, options, [&](size_t begin, size_t frame_count, float* out){
+        std::memcpy(out, values + begin, frame_count * sizeof(float));
+    });
+}
+
+std::vector<uint8_t> encodeDifferences(const std::vector<float>& numbers, const std::vector<float>& ndvs,
+                                       const SeriesEncoderOptions& options, const StatsContext& context)
+{
+    const NoDataClassifier classifier(ndvs);
+    const size_t num_differences = numbers.empty() ? 0 : numbers.size() - 1;
+    const float* data = numbers.data();
+    return encodeSeriesFrames(context, num_differences, options, [&](size_t begin, size_t count, float* out){
+        // difference k ends at value k + 1
+        for(size_t k=0; k<count; k++){
+            const float value = data[begin + k + 1];
+            out[k] = classifier.isValid(value) ? value - data[begin + k] : 0.f;
+        }
+    });
+}
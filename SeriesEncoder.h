@@ -0,0 +1,79 @@
+#ifndef SERIESENCODER_H
+#define SERIESENCODER_H
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <CompressedSeries.h>
+
+struct SeriesEncoderOptions
+{
+    FrameFilter filter = FrameFilter::ShuffleXor;
+    // zstd only when built with BASICSTATS_ZSTD, LZ4 otherwise
+    FrameCodec codec = FrameCodec::Lz4;
+    // at most compressed_series_max_frame_values
+    size_t frame_values = compressed_series_default_frame_values;
+};
+
+// a frame ready to be written, as CompressedSeriesReader reads it back
+struct EncodedFrame
+{
+    std::vector<uint8_t> bytes;
+    size_t num_values = 0;
+    FrameFilter filter = FrameFilter::None;
+    FrameCodec codec = FrameCodec::None;
+};
+
+// compresses bytes as one LZ4 block appended to out, greedy matches through a
+// hash table of the last position of every 4 byte sequence. Readable by any
+// LZ4 block decoder. Returns the compressed size
+size_t lz4CompressBlock(const uint8_t* source, size_t bytes, std::vector<uint8_t>& out);
+// filters and compresses count values into frame, kept uncompressed when the
+// codec does not make it smaller
+void encodeFrame(const float* values, size_t count, const SeriesEncoderOptions& options, EncodedFrame& frame);
+// the header, frame table and frames, in a buffer CompressedStats reads
+std::vector<uint8_t> assembleCompressedSeries(const std::vector<EncodedFrame>& frames, size_t frame_values);
+
+// a compressed series of num_values values that fill(begin, count, out)
+// writes frame by frame into the worker's scratch, straight before it is
+// filtered and compressed. The series is never held uncompressed, only one
+// frame per worker; frames are encoded in parallel
+template<typename Fill>
+std::vector<uint8_t> encodeSeriesFrames(const StatsContext& context, size_t num_values, const SeriesEncoderOptions& options, Fill&& fill)
+{
+    const size_t frame_values = std::clamp<size_t>(options.frame_values, 1, compressed_series_max_frame_values);
+    const size_t num_frames = (num_values + frame_values - 1) / frame_values;
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(num_values, 4, executor.concurrency());
+    const size_t frames_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max<size_t>(plan.chunk_size / frame_values, 1) : num_frames;
+    const ChunkLayout layout(num_frames, frames_per_chunk, plan.schedule, plan.num_threads);
+    std::vector<EncodedFrame> frames(num_frames);
+    std::vector<std::vector<float> > worker_scratch(executor.concurrency());
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan, frame_values);
+    runChunked(executor, layout, [&](size_t, size_t first_frame, size_t end_frame, size_t worker){
+        std::vector<float>& scratch = worker_scratch[worker];
+        scratch.resize(frame_values);
+        for(size_t f=first_frame; f<end_frame; f++){
+            const size_t begin = f * frame_values;
+            const size_t count = std::min(frame_values, num_values - begin);
+            fill(begin, count, scratch.data());
+            encodeFrame(scratch.data(), count, options, frames[f]);
+        }
+    }, nullptr, 0, telemetry.get());
+    telemetry.startMerge();
+    std::vector<uint8_t> series = assembleCompressedSeries(frames, frame_values);
+    telemetry.publish();
+    return series;
+}
+
+// count values as a compressed series
+std::vector<uint8_t> encodeSeries(const float* values, size_t count, const SeriesEncoderOptions& options = SeriesEncoderOptions(),
+                                  const StatsContext& context = defaultStatsContext());
+// the differences DoesTheStats::getDifferences() gives for numbers, value less
+// the value before and 0 where the value is nan/inf or a no data value,
+// computed and compressed in the same pass
+std::vector<uint8_t> encodeDifferences(const std::vector<float>& numbers, const std::vector<float>& ndvs,
+                                       const SeriesEncoderOptions& options = SeriesEncoderOptions(),
+                                       const StatsContext& context = defaultStatsContext());
+
+#endif // SERIESENCODER_H
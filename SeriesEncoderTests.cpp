@@ -0,0 +1,101 @@
+#include <SeriesEncoder.h>
+#include <BasicStats.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<float> decodeAll(const std::vector<uint8_t>& series)
+{
+    const CompressedSeriesReader reader(series.data(), series.size());
+    std::vector<float> values(reader.isValid() ? reader.getNumValues() : 0);
+    size_t at = 0;
+    for(size_t f=0; f<reader.getNumFrames(); f++){
+        EXPECT_TRUE(decodeFrame(reader.getFrame(f), values.data() + at)) << "frame " << f;
+        at += reader.getFrame(f).num_values;
+    }
+    return values;
+}
+
+bool sameBits(const std::vector<float>& a, const std::vector<float>& b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+}
+
+TEST(SeriesEncoder, Lz4BlocksRoundTrip)
+{
+    std::mt19937 random(7);
+    std::vector<uint8_t> noise(100000);
+    for(uint8_t& byte : noise){
+        byte = static_cast<uint8_t>(random());
+    }
+    std::vector<uint8_t> repetitive(100000);
+    for(size_t i=0; i<repetitive.size(); i++){
+        repetitive[i] = static_cast<uint8_t>((i / 3) % 17);
+    }
+    const std::vector<uint8_t> tiny = {1, 2, 3};
+    const std::vector<uint8_t>* inputs[] = {&noise, &repetitive, &tiny};
+    for(const std::vector<uint8_t>* input : inputs){
+        std::vector<uint8_t> block;
+        lz4CompressBlock(input->data(), input->size(), block);
+        std::vector<uint8_t> decoded(input->size());
+        ASSERT_EQ(lz4DecompressBlock(block.data(), block.size(), decoded.data(), decoded.size()), long(input->size()));
+        EXPECT_EQ(decoded, *input);
+    }
+    std::vector<uint8_t> block;
+    EXPECT_LT(lz4CompressBlock(repetitive.data(), repetitive.size(), block), repetitive.size() / 10);
+}
+
+TEST(SeriesEncoder, EveryFilterRoundTripsBitForBit)
+{
+    std::vector<float> values(200003);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = 100.f + std::sin(static_cast<float>(i) * 0.001f) * 10.f;
+    }
+    values[17] = std::numeric_limits<float>::quiet_NaN();
+    values[18] = -0.f;
+    values[99999] = std::numeric_limits<float>::infinity();
+    ThreadPoolExecutor pool(3);
+    StatsContext context = parallelContext(pool);
+    const FrameFilter filters[] = {FrameFilter::None, FrameFilter::Delta, FrameFilter::Xor,
+                                   FrameFilter::ShuffleDelta, FrameFilter::ShuffleXor};
+    for(FrameFilter filter : filters){
+        SeriesEncoderOptions options;
+        options.filter = filter;
+        options.frame_values = 10000;
+        const std::vector<uint8_t> series = encodeSeries(values.data(), values.size(), options, context);
+        EXPECT_TRUE(sameBits(decodeAll(series), values)) << "filter " << int(filter);
+    }
+    SeriesEncoderOptions options;
+    EXPECT_LT(encodeSeries(values.data(), values.size(), options, context).size(), values.size() * sizeof(float) * 3 / 4);
+}
+
+TEST(SeriesEncoder, DifferencesMatchDoesTheStats)
+{
+    std::vector<float> numbers(150001);
+    for(size_t i=0; i<numbers.size(); i++){
+        numbers[i] = static_cast<float>(i / 10) * 0.5f;
+    }
+    numbers[500] = -9999.f;
+    numbers[70000] = std::numeric_limits<float>::quiet_NaN();
+    const DoesTheStats<> stats(numbers, {-9999.f});
+    SeriesEncoderOptions options;
+    options.frame_values = 4096;
+    const std::vector<uint8_t> series = encodeDifferences(numbers, {-9999.f}, options);
+    const std::vector<float> differences(stats.getDifferences().begin(), stats.getDifferences().end());
+    EXPECT_TRUE(sameBits(decodeAll(series), differences));
+    // mostly zeros and one step, far below the raw size
+    EXPECT_LT(series.size(), differences.size() * sizeof(float) / 8);
+
+    // and straight into the fused decode and reduce
+    const CompressedStats compressed(defaultStatsContext(), series, {}, ReducerSet<Sum, Count>());
+    ASSERT_TRUE(compressed.isDecodeGood());
+    // the difference after the nan is nan too
+    EXPECT_EQ(compressed.get<Count>(), differences.size() - 1);
+}
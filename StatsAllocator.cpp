@@ -0,0 +1,182 @@
+#include "StatsAllocator.h"
+#include <algorithm>
+#include <new>
+#if defined(__linux__)
+#include <sys/mman.h>
+#define STATS_ALLOCATOR_MMAP 1
+#endif
+
+namespace {
+
+// peak = max(peak, value) from any thread
+void raisePeak(std::atomic<size_t>& peak, size_t value)
+{
+    size_t current = peak.load(std::memory_order_relaxed);
+    while(value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)){
+    }
+}
+
+}
+
+void* HeapAllocator::allocate(size_t bytes, size_t alignment)
+{
+    void* pointer = ::operator new(bytes, std::align_val_t(alignment));
+    m_allocations.fetch_add(1, std::memory_order_relaxed);
+    raisePeak(m_peak_bytes_in_use, m_bytes_in_use.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    return pointer;
+}
+
+void HeapAllocator::deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+    m_bytes_in_use.fetch_sub(bytes, std::memory_order_relaxed);
+    ::operator delete(pointer, std::align_val_t(alignment));
+}
+
+StatsAllocatorCounters HeapAllocator::getCounters() const
+{
+    StatsAllocatorCounters counters;
+    counters.allocations = m_allocations.load(std::memory_order_relaxed);
+    counters.system_allocations = counters.allocations;
+    counters.bytes_in_use = m_bytes_in_use.load(std::memory_order_relaxed);
+    counters.peak_bytes_in_use = m_peak_bytes_in_use.load(std::memory_order_relaxed);
+    return counters;
+}
+
+HeapAllocator& HeapAllocator::shared()
+{
+    static HeapAllocator allocator;
+    return allocator;
+}
+
+PoolAllocator::PoolAllocator(size_t cache_bytes, size_t huge_page_bytes)
+    : m_cache_bytes(cache_bytes), m_huge_page_bytes(huge_page_bytes)
+{
+}
+
+PoolAllocator::~PoolAllocator()
+{
+    trim();
+}
+
+size_t PoolAllocator::classBytes(size_t bytes, size_t alignment) const
+{
+    // a power of two at least as large as the alignment. Both system
+    // allocations below align it to page_alignment or its own size, whichever
+    // is smaller, which covers any alignment up to a page
+    size_t class_bytes = std::max(min_class_bytes, alignment);
+    while(class_bytes < bytes){
+        class_bytes *= 2;
+    }
+    return class_bytes;
+}
+
+size_t PoolAllocator::classIndex(size_t class_bytes)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctzll(class_bytes));
+#else
+    size_t k = 0;
+    while((class_bytes >> k) > 1){
+        k++;
+    }
+    return k;
+#endif
+}
+
+void* PoolAllocator::systemAllocate(size_t class_bytes)
+{
+#ifdef STATS_ALLOCATOR_MMAP
+    if(class_bytes >= m_huge_page_bytes){
+        // systemFree unmaps every buffer of this class, so there is no heap fallback
+        void* pointer = mmap(nullptr, class_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(pointer == MAP_FAILED){
+            throw std::bad_alloc();
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(pointer, class_bytes, MADV_HUGEPAGE);
+#endif
+        m_counters.huge_page_allocations++;
+        return pointer;
+    }
+#endif
+    return ::operator new(class_bytes, std::align_val_t(std::min(class_bytes, page_alignment)));
+}
+
+void PoolAllocator::systemFree(void* pointer, size_t class_bytes)
+{
+#ifdef STATS_ALLOCATOR_MMAP
+    if(class_bytes >= m_huge_page_bytes){
+        munmap(pointer, class_bytes);
+        return;
+    }
+#endif
+    ::operator delete(pointer, std::align_val_t(std::min(class_bytes, page_alignment)));
+}
+
+void* PoolAllocator::allocate(size_t bytes, size_t alignment)
+{
+    const size_t class_bytes = classBytes(bytes, alignment);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    void* pointer = nullptr;
+    if(alignment > page_alignment){
+        // neither the pool's buffers nor mapped ones are aligned to it
+        pointer = ::operator new(class_bytes, std::align_val_t(alignment));
+        m_counters.system_allocations++;
+    }
+    else{
+        std::vector<void*>& free_list = m_free[classIndex(class_bytes)];
+        if(!free_list.empty()){
+            pointer = free_list.back();
+            free_list.pop_back();
+            m_counters.bytes_cached -= class_bytes;
+            m_counters.reused++;
+        }
+        else{
+            pointer = systemAllocate(class_bytes);
+            m_counters.system_allocations++;
+        }
+    }
+    // counted once the buffer exists, a failed allocation leaves the counters alone
+    m_counters.allocations++;
+    m_counters.bytes_in_use += class_bytes;
+    m_counters.peak_bytes_in_use = std::max(m_counters.peak_bytes_in_use, m_counters.bytes_in_use);
+    return pointer;
+}
+
+void PoolAllocator::deallocate(void* pointer, size_t bytes, size_t alignment)
+{
+    if(!pointer){
+        return;
+    }
+    const size_t class_bytes = classBytes(bytes, alignment);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counters.bytes_in_use -= class_bytes;
+    if(alignment > page_alignment){
+        ::operator delete(pointer, std::align_val_t(alignment));
+        return;
+    }
+    if(m_counters.bytes_cached + class_bytes > m_cache_bytes){
+        systemFree(pointer, class_bytes);
+        return;
+    }
+    m_free[classIndex(class_bytes)].push_back(pointer);
+    m_counters.bytes_cached += class_bytes;
+}
+
+StatsAllocatorCounters PoolAllocator::getCounters() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_counters;
+}
+
+void PoolAllocator::trim()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(size_t k=0; k<num_classes; k++){
+        for(void* pointer : m_free[k]){
+            systemFree(pointer, size_t(1) << k);
+        }
+        m_free[k].clear();
+    }
+    m_counters.bytes_cached = 0;
+}
@@ -0,0 +1,123 @@
+#ifndef STATSALLOCATOR_H
+#define STATSALLOCATOR_H
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+struct StatsAllocatorCounters
+{
+    // calls to allocate, and of those the ones served by a recycled buffer
+    size_t allocations = 0;
+    size_t reused = 0;
+    // buffers taken from the system, and of those the huge page backed ones
+    size_t system_allocations = 0;
+    size_t huge_page_allocations = 0;
+    size_t bytes_in_use = 0;
+    size_t peak_bytes_in_use = 0;
+    // free buffers kept for later calls
+    size_t bytes_cached = 0;
+};
+
+// where the stats loops get their scratch and output buffers from. Shared by
+// every thread of a context, so implementations are thread safe
+class StatsAllocator
+{
+public:
+    virtual ~StatsAllocator() = default;
+    // alignment is a power of two
+    virtual void* allocate(size_t bytes, size_t alignment) = 0;
+    // the bytes and alignment the buffer was allocated with
+    virtual void deallocate(void* pointer, size_t bytes, size_t alignment) = 0;
+    virtual StatsAllocatorCounters getCounters() const = 0;
+};
+
+// straight to operator new and delete, the behaviour without an allocator
+class HeapAllocator : public StatsAllocator
+{
+public:
+    void* allocate(size_t bytes, size_t alignment) override;
+    void deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    StatsAllocatorCounters getCounters() const override;
+    // allocator shared by the whole process
+    static HeapAllocator& shared();
+private:
+    std::atomic<size_t> m_allocations{0};
+    std::atomic<size_t> m_bytes_in_use{0};
+    std::atomic<size_t> m_peak_bytes_in_use{0};
+};
+
+// keeps freed buffers in power of two size classes and hands them out again,
+// so a call that runs thousands of times a second stops going to malloc and
+// faulting in fresh pages. Buffers of huge_page_bytes and up are mapped on
+// their own and advised to use transparent huge pages, a mapping that fails
+// throws std::bad_alloc like operator new. Freed buffers are kept
+// up to cache_bytes, past that they go back to the system. Every buffer must be
+// freed before the pool is destroyed. Alignments above a page are not pooled
+class PoolAllocator : public StatsAllocator
+{
+public:
+    explicit PoolAllocator(size_t cache_bytes = size_t(256) << 20, size_t huge_page_bytes = size_t(2) << 20);
+    ~PoolAllocator() override;
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+    void* allocate(size_t bytes, size_t alignment) override;
+    void deallocate(void* pointer, size_t bytes, size_t alignment) override;
+    StatsAllocatorCounters getCounters() const override;
+    // gives every cached buffer back to the system
+    void trim();
+private:
+    static constexpr size_t min_class_bytes = 64;
+    static constexpr size_t num_classes = 8 * sizeof(size_t);
+    // pooled buffers are aligned to their class size up to this
+    static constexpr size_t page_alignment = 4096;
+    size_t classBytes(size_t bytes, size_t alignment) const;
+    // k for a class of 2^k bytes
+    static size_t classIndex(size_t class_bytes);
+    void* systemAllocate(size_t class_bytes);
+    void systemFree(void* pointer, size_t class_bytes);
+
+    mutable std::mutex m_mutex;
+    size_t m_cache_bytes;
+    size_t m_huge_page_bytes;
+    // free buffers of 2^k bytes
+    std::array<std::vector<void*>, num_classes> m_free;
+    StatsAllocatorCounters m_counters;
+};
+
+// std allocator over a StatsAllocator, the context's usually. Default
+// constructed it uses HeapAllocator::shared()
+template<typename T>
+struct ContextAllocator
+{
+    using value_type = T;
+    StatsAllocator* allocator;
+    ContextAllocator() : allocator(&HeapAllocator::shared()) {}
+    ContextAllocator(StatsAllocator& stats_allocator) : allocator(&stats_allocator) {}
+    template<typename U>
+    ContextAllocator(const ContextAllocator<U>& other) : allocator(other.allocator) {}
+    T* allocate(size_t n){
+        return static_cast<T*>(allocator->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* p, size_t n){
+        allocator->deallocate(p, n * sizeof(T), alignof(T));
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const ContextAllocator<T>& a, const ContextAllocator<U>& b)
+{
+    return a.allocator == b.allocator;
+}
+
+template<typename T, typename U>
+bool operator!=(const ContextAllocator<T>& a, const ContextAllocator<U>& b)
+{
+    return a.allocator != b.allocator;
+}
+
+template<typename T>
+using ContextVector = std::vector<T, ContextAllocator<T> >;
+
+#endif // STATSALLOCATOR_H
@@ -0,0 +1,108 @@
+#include <StatsAllocator.h>
+#include <BasicStats.h>
+#include <new>
+#include <thread>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+TEST(StatsAllocator, PoolRecyclesBuffersAcrossCalls)
+{
+    ThreadPoolExecutor executor(3);
+    PoolAllocator pool;
+    const StatsContext context = parallelContext(executor, &pool);
+    std::vector<float> values(200003);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = static_cast<float>(i % 13) * 0.25f;
+    }
+    values[50] = -9999.f;
+    const DoesTheStats<> plain(values, {-9999.f}, context);
+    {
+        const DoesTheStats<0, ContextAllocator<float> > first(values, {-9999.f}, context);
+        EXPECT_EQ(first.getSum(), plain.getSum());
+        EXPECT_EQ(first.getProduct(), plain.getProduct());
+        EXPECT_EQ(first.isGood(), plain.isGood());
+        EXPECT_TRUE(std::equal(first.getDifferences().begin(), first.getDifferences().end(), plain.getDifferences().begin()));
+    }
+    const StatsAllocatorCounters warm = pool.getCounters();
+    EXPECT_GT(warm.system_allocations, 0u);
+    EXPECT_EQ(warm.bytes_in_use, 0u);
+    EXPECT_GT(warm.bytes_cached, 0u);
+
+    // every buffer of a repeated call comes from the pool
+    for(int call=0; call<5; call++){
+        const DoesTheStats<0, ContextAllocator<float> > again(values, {-9999.f}, context);
+        EXPECT_EQ(again.getSum(), plain.getSum());
+    }
+    const StatsAllocatorCounters counters = pool.getCounters();
+    EXPECT_EQ(counters.system_allocations, warm.system_allocations);
+    EXPECT_EQ(counters.reused - warm.reused, counters.allocations - warm.allocations);
+    EXPECT_GE(counters.peak_bytes_in_use, values.size() * sizeof(float));
+
+    pool.trim();
+    EXPECT_EQ(pool.getCounters().bytes_cached, 0u);
+}
+
+TEST(StatsAllocator, LargeBuffersAndCacheBudget)
+{
+    PoolAllocator pool(size_t(1) << 20, size_t(1) << 20);
+    {
+        ContextVector<float> large(size_t(1) << 19, 1.f, pool);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(large.data()) % 4096, 0u);
+        EXPECT_EQ(large.back(), 1.f);
+    }
+    StatsAllocatorCounters counters = pool.getCounters();
+#if defined(__linux__)
+    EXPECT_EQ(counters.huge_page_allocations, 1u);
+#endif
+    // 2 MiB does not fit a 1 MiB cache, so it went back to the system
+    EXPECT_EQ(counters.bytes_cached, 0u);
+    {
+        ContextVector<double> small(100, 0.0, pool);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(small.data()) % alignof(double), 0u);
+    }
+    counters = pool.getCounters();
+    EXPECT_EQ(counters.bytes_cached, 1024u);
+    EXPECT_EQ(counters.bytes_in_use, 0u);
+
+    // above a page, in the pool's size range and past the huge page size
+    for(size_t bytes : {size_t(100), size_t(3) << 20}){
+        void* aligned = pool.allocate(bytes, 8192);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(aligned) % 8192, 0u);
+        pool.deallocate(aligned, bytes, 8192);
+    }
+    counters = pool.getCounters();
+    EXPECT_EQ(counters.bytes_cached, 1024u);
+    EXPECT_EQ(counters.bytes_in_use, 0u);
+
+    // more than the address space, the failure leaves the counters alone
+    EXPECT_THROW(pool.allocate(size_t(1) << 62, 64), std::bad_alloc);
+    EXPECT_EQ(pool.getCounters().bytes_in_use, 0u);
+    EXPECT_EQ(pool.getCounters().allocations, counters.allocations);
+    HeapAllocator heap;
+    EXPECT_THROW(heap.allocate(size_t(1) << 62, 64), std::bad_alloc);
+    EXPECT_EQ(heap.getCounters().bytes_in_use, 0u);
+}
+
+TEST(StatsAllocator, ThreadSafe)
+{
+    PoolAllocator pool;
+    std::vector<std::thread> threads;
+    for(int t=0; t<4; t++){
+        threads.emplace_back([&pool, t](){
+            for(int round=0; round<2000; round++){
+                ContextVector<int> buffer(static_cast<size_t>(16 << (round % 6)), t, pool);
+                for(int value : buffer){
+                    ASSERT_EQ(value, t);
+                }
+            }
+        });
+    }
+    for(std::thread& thread : threads){
+        thread.join();
+    }
+    const StatsAllocatorCounters counters = pool.getCounters();
+    EXPECT_EQ(counters.allocations, 8000u);
+    EXPECT_EQ(counters.bytes_in_use, 0u);
+    // at most one buffer per size class and thread was ever taken from the system
+    EXPECT_LE(counters.system_allocations, 24u);
+}
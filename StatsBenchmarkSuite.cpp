@@ -0,0 +1,270 @@
+#include <BasicStats.h>
+#include <BatchStats.h>
+#include <BenchmarkHarness.h>
+#include <MultiStats.h>
+#include <StatsExpression.h>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+
+// sweeps the stats loops over input size, thread count, no data and nan
+// density and reducer combination, printing a table and optionally writing
+// JSON for tracking across versions:
+//     statsbench --max-mb=4096 --threads=1,8,32 --json=results.json
+// Options: --max-mb (largest input, default 256), --threads (comma separated,
+// default 1 and every hardware thread), --min-time (seconds per batch, default
+// 0.1), --repetitions (default 3), --filter (substring of the case name).
+// Every loop reads float32, the only element type they take.
+
+namespace {
+
+const float benchmark_ndv = -9999.f;
+
+struct SuiteOptions
+{
+    BenchmarkOptions benchmark;
+    size_t max_bytes = size_t(256) << 20;
+    std::vector<size_t> threads;
+    std::string json_path;
+};
+
+std::vector<size_t> parseList(const std::string& text)
+{
+    std::vector<size_t> values;
+    std::stringstream stream(text);
+    std::string item;
+    while(std::getline(stream, item, ',')){
+        values.push_back(std::strtoull(item.c_str(), nullptr, 10));
+    }
+    return values;
+}
+
+void printUsage(std::ostream& os, const char* program)
+{
+    os << "usage: " << program << " [--max-mb=N] [--threads=N,N,...] [--min-time=SECONDS]"
+       << " [--repetitions=N] [--filter=TEXT] [--json=PATH]" << std::endl;
+}
+
+// exits with status 2 after printing the usage on an unknown option
+SuiteOptions parseOptions(int argc, char** argv)
+{
+    SuiteOptions options;
+    for(int i=1; i<argc; i++){
+        const std::string arg = argv[i];
+        const size_t equals = arg.find('=');
+        const std::string key = arg.substr(0, equals);
+        const std::string value = equals == std::string::npos ? "" : arg.substr(equals + 1);
+        if(key == "--max-mb"){
+            options.max_bytes = std::strtoull(value.c_str(), nullptr, 10) << 20;
+        }
+        else if(key == "--threads"){
+            options.threads = parseList(value);
+        }
+        else if(key == "--min-time"){
+            options.benchmark.min_seconds = std::atof(value.c_str());
+        }
+        else if(key == "--repetitions"){
+            options.benchmark.repetitions = std::atoi(value.c_str());
+        }
+        else if(key == "--filter"){
+            options.benchmark.filter = value;
+        }
+        else if(key == "--json"){
+            options.json_path = value;
+        }
+        else{
+            std::cerr << "unknown option " << arg << std::endl;
+            printUsage(std::cerr, argv[0]);
+            std::exit(2);
+        }
+    }
+    if(options.threads.empty()){
+        options.threads = {1, std::max<size_t>(std::thread::hardware_concurrency(), 1)};
+        if(options.threads[1] == 1){
+            options.threads.pop_back();
+        }
+    }
+    return options;
+}
+
+// deterministic pseudo random values in [0, 1000) with the given fractions of
+// no data values and nans
+std::vector<float> makeSeries(size_t count, double ndv_density, double nan_density, uint64_t seed)
+{
+    std::vector<float> values(count);
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    const uint64_t ndv_limit = static_cast<uint64_t>(ndv_density * 4294967296.0);
+    const uint64_t nan_limit = static_cast<uint64_t>(nan_density * 4294967296.0);
+    for(size_t i=0; i<count; i++){
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        const uint64_t draw = state & 0xffffffffull;
+        const uint64_t pick = state >> 32;
+        if(pick < ndv_limit){
+            values[i] = benchmark_ndv;
+        }
+        else if(pick < ndv_limit + nan_limit){
+            values[i] = std::numeric_limits<float>::quiet_NaN();
+        }
+        else{
+            values[i] = static_cast<float>(draw % 1000000) * 1e-3f;
+        }
+    }
+    return values;
+}
+
+std::string sizeLabel(size_t bytes)
+{
+    if(bytes >= (size_t(1) << 30)){
+        return std::to_string(bytes >> 30) + "G";
+    }
+    if(bytes >= (size_t(1) << 20)){
+        return std::to_string(bytes >> 20) + "M";
+    }
+    return std::to_string(bytes >> 10) + "K";
+}
+
+std::string densityLabel(double density)
+{
+    std::ostringstream label;
+    label << density;
+    return label.str();
+}
+
+// the reducer combinations, each reading first (and second for the paired loop)
+const std::vector<std::string> all_combos = {"sum", "DoesTheStats", "sum|count|minmax|moments4", "paired", "batch256"};
+
+bool runCombo(const std::string& combo, const std::vector<float>& first, const std::vector<float>& second,
+              const StatsContext& context)
+{
+    const std::vector<float> ndvs = {benchmark_ndv};
+    if(combo == "sum"){
+        BasicStatsLoop loop(context, first, ndvs, {0.f}, PlusReducer());
+        return loop.getResult<0>() > 0.f;
+    }
+    if(combo == "DoesTheStats"){
+        DoesTheStats stats(first, ndvs, context);
+        return stats.getSum() > 0.f;
+    }
+    if(combo == "sum|count|minmax|moments4"){
+        ExpressionStatsLoop stats(context, first, ndvs, Sum{} | Count{} | MinMax{} | Moments<4>{});
+        return stats.get<Count>() > 0;
+    }
+    if(combo == "paired"){
+        DoesThePairedStats stats(first, second, ndvs, context);
+        return stats.getCount() > 0;
+    }
+    if(combo == "batch256"){
+        DoesTheBatchStats batch(first, std::min<size_t>(256, std::max<size_t>(first.size(), 1)), ndvs, false, context);
+        return batch.getNumSeries() > 0;
+    }
+    return false;
+}
+
+size_t comboBytes(const std::string& combo, size_t elements)
+{
+    return (combo == "paired" ? 2 : 1) * elements * sizeof(float);
+}
+
+class Suite
+{
+public:
+    explicit Suite(const SuiteOptions& options) : m_options(options)
+    {
+        for(size_t threads : options.threads){
+            // the caller of parallelFor is the last thread
+            m_pools[threads] = std::make_unique<ThreadPoolExecutor>(std::max<size_t>(threads, 1) - 1);
+        }
+    }
+    void add(const std::string& combo, const std::vector<float>& first, const std::vector<float>& second, size_t threads,
+             double ndv_density, double nan_density)
+    {
+        const std::string name = "BM_" + combo;
+        const std::string size = sizeLabel(first.size() * sizeof(float));
+        if(!m_options.benchmark.filter.empty() && (name + "/" + size).find(m_options.benchmark.filter) == std::string::npos){
+            return;
+        }
+        StatsContext context;
+        context.tuning = defaultStatsContext().tuning;
+        context.executor = m_pools.at(threads).get();
+        BenchmarkCase benchmark;
+        benchmark.name = name;
+        benchmark.params = {{"size", size}, {"threads", std::to_string(threads)}, {"ndv_density", densityLabel(ndv_density)},
+                            {"nan_density", densityLabel(nan_density)}, {"element", "float32"}};
+        benchmark.elements = first.size();
+        benchmark.bytes = comboBytes(combo, first.size());
+        benchmark.run = [&, combo, context](){
+            volatile bool sink = runCombo(combo, first, second, context);
+            (void)sink;
+        };
+        m_results.push_back(runBenchmark(benchmark, m_options.benchmark));
+        printBenchmarkResult(std::cout, m_results.back());
+    }
+    const std::vector<BenchmarkResult>& getResults() const{
+        return m_results;
+    }
+private:
+    const SuiteOptions& m_options;
+    std::map<size_t, std::unique_ptr<ThreadPoolExecutor> > m_pools;
+    std::vector<BenchmarkResult> m_results;
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    const SuiteOptions options = parseOptions(argc, argv);
+    Suite suite(options);
+    const size_t max_threads = *std::max_element(options.threads.begin(), options.threads.end());
+    printBenchmarkHeader(std::cout);
+
+    // size sweep, every combination on clean data with all threads
+    for(size_t bytes=1024; bytes<=options.max_bytes; bytes*=4){
+        const std::vector<float> first = makeSeries(bytes / sizeof(float), 0.0, 0.0, 1);
+        const std::vector<float> second = makeSeries(bytes / sizeof(float), 0.0, 0.0, 2);
+        for(const std::string& combo : all_combos){
+            suite.add(combo, first, second, max_threads, 0.0, 0.0);
+        }
+    }
+
+    // thread sweep on an input well past the last level cache
+    {
+        const size_t bytes = std::min<size_t>(options.max_bytes, size_t(64) << 20);
+        const std::vector<float> first = makeSeries(bytes / sizeof(float), 0.0, 0.0, 1);
+        const std::vector<float> second = makeSeries(bytes / sizeof(float), 0.0, 0.0, 2);
+        for(size_t threads : options.threads){
+            for(const std::string& combo : {std::string("sum"), std::string("DoesTheStats"), std::string("sum|count|minmax|moments4")}){
+                suite.add(combo, first, second, threads, 0.0, 0.0);
+            }
+        }
+    }
+
+    // no data and nan density sweep, the compaction and classification costs
+    {
+        const size_t bytes = std::min<size_t>(options.max_bytes, size_t(16) << 20);
+        for(double ndv_density : {0.0, 0.001, 0.1, 0.5}){
+            for(double nan_density : {0.0, 0.001, 0.1}){
+                const std::vector<float> first = makeSeries(bytes / sizeof(float), ndv_density, nan_density, 1);
+                const std::vector<float> second = makeSeries(bytes / sizeof(float), ndv_density, nan_density, 2);
+                for(const std::string& combo : {std::string("sum"), std::string("DoesTheStats"),
+                                                std::string("sum|count|minmax|moments4"), std::string("paired")}){
+                    suite.add(combo, first, second, max_threads, ndv_density, nan_density);
+                }
+            }
+        }
+    }
+
+    if(!options.json_path.empty()){
+        const bool written = writeBenchmarkJson(options.json_path, suite.getResults(),
+                                                {{"max_bytes", std::to_string(options.max_bytes)},
+                                                 {"cycle_counter", readCycleCounter() != 0 ? "tsc" : "none"}});
+        if(!written){
+            std::cerr << "could not write " << options.json_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
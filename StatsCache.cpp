@@ -0,0 +1,243 @@
+#include "StatsCache.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr uint64_t prime32_1 = 0x9E3779B1ull;
+constexpr uint64_t prime64_1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t prime64_2 = 0xC2B2AE3D27D4EB4Full;
+constexpr size_t hash_lanes = 8;
+// values per stripe, two per lane
+constexpr size_t stripe_values = 2 * hash_lanes;
+constexpr size_t stripes_per_scramble = 16;
+constexpr uint64_t secret[hash_lanes + 1] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+    0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+    0xcb00c391bb52283cull
+};
+
+uint64_t avalanche(uint64_t hash)
+{
+    hash ^= hash >> 37;
+    hash *= 0x165667919E3779F9ull;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t mix(uint64_t a, uint64_t b)
+{
+    return avalanche((a ^ b) * prime64_2 + (b >> 29));
+}
+
+void accumulateStripe(uint64_t* acc, const uint32_t* words)
+{
+    for(size_t lane=0; lane<hash_lanes; lane++){
+        const uint64_t value = words[2 * lane] | (uint64_t(words[2 * lane + 1]) << 32);
+        const uint64_t keyed = value ^ secret[lane];
+        acc[lane ^ 1] += value;
+        acc[lane] += (keyed & 0xffffffffull) * (keyed >> 32);
+    }
+}
+
+}
+
+uint64_t hashBlock(const float* values, size_t count)
+{
+    uint64_t acc[hash_lanes];
+    for(size_t lane=0; lane<hash_lanes; lane++){
+        acc[lane] = secret[lane] * prime64_1;
+    }
+    uint32_t words[stripe_values];
+    size_t k = 0;
+    for(size_t stripe=1; k+stripe_values<=count; k+=stripe_values, stripe++){
+        std::memcpy(words, values + k, sizeof(words));
+        accumulateStripe(acc, words);
+        if(stripe % stripes_per_scramble == 0){
+            for(size_t lane=0; lane<hash_lanes; lane++){
+                acc[lane] = (acc[lane] ^ (acc[lane] >> 47) ^ secret[lane + 1]) * prime32_1;
+            }
+        }
+    }
+    if(k < count){
+        // the last partial stripe, zero padded
+        std::fill_n(words, stripe_values, 0u);
+        std::memcpy(words, values + k, (count - k) * sizeof(float));
+        accumulateStripe(acc, words);
+    }
+    uint64_t hash = count * prime64_1;
+    for(size_t lane=0; lane<hash_lanes; lane+=2){
+        hash += mix(acc[lane] ^ secret[lane], acc[lane + 1] ^ secret[lane + 1]);
+    }
+    return avalanche(hash);
+}
+
+uint64_t ContentHashFeature::finish(const State& state)
+{
+    return avalanche(state.hash ^ (state.length * prime64_2));
+}
+
+uint64_t hashBuffer(const std::vector<float>& data, const StatsContext& context)
+{
+    const size_t num_elements = data.size();
+    const size_t num_blocks = (num_elements + expression_stats_block_size - 1) / expression_stats_block_size;
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(num_elements, 1, executor.concurrency());
+    const size_t blocks_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max<size_t>(plan.chunk_size / expression_stats_block_size, 1) : num_blocks;
+    const ChunkLayout layout(num_blocks, blocks_per_chunk, plan.schedule, plan.num_threads);
+    std::vector<ContentHashFeature::State> chunk_states(layout.numChunks());
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan, expression_stats_block_size);
+    runChunked(executor, layout, [&](size_t chunk, size_t first_block, size_t end_block, size_t){
+        PreparedBlock block;
+        for(size_t b=first_block; b<end_block; b++){
+            block.values = data.data() + b * expression_stats_block_size;
+            block.count = std::min(expression_stats_block_size, num_elements - b * expression_stats_block_size);
+            ContentHashFeature::accumulate(chunk_states[chunk], block);
+        }
+    }, data.data(), expression_stats_block_size * sizeof(float), telemetry.get());
+    telemetry.startMerge();
+    ContentHashFeature::State state;
+    for(const ContentHashFeature::State& chunk_state : chunk_states){
+        ContentHashFeature::merge(state, chunk_state);
+    }
+    telemetry.publish();
+    return ContentHashFeature::finish(state);
+}
+
+uint64_t hashNoDataValues(const std::vector<float>& ndvs)
+{
+    // the set, not the order it was given in
+    std::vector<uint32_t> bits(ndvs.size());
+    for(size_t i=0; i<ndvs.size(); i++){
+        std::memcpy(&bits[i], &ndvs[i], sizeof(float));
+    }
+    std::sort(bits.begin(), bits.end());
+    bits.erase(std::unique(bits.begin(), bits.end()), bits.end());
+    uint64_t hash = bits.size();
+    for(uint32_t value : bits){
+        hash = mix(hash, value);
+    }
+    return hash;
+}
+
+bool StatsCacheKey::operator==(const StatsCacheKey& other) const
+{
+    return data == other.data && length == other.length && generation == other.generation &&
+           ndvs == other.ndvs && result == other.result && by_identity == other.by_identity;
+}
+
+size_t StatsCacheKeyHash::operator()(const StatsCacheKey& key) const
+{
+    uint64_t hash = mix(key.data, key.length);
+    hash = mix(hash, key.generation + key.by_identity);
+    hash = mix(hash, key.ndvs);
+    return static_cast<size_t>(mix(hash, key.result.hash_code()));
+}
+
+StatsCache::StatsCache(size_t byte_budget) : m_byte_budget(byte_budget)
+{
+}
+
+void StatsCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_content_groups.clear();
+    m_counters.entries = 0;
+    m_counters.bytes = 0;
+}
+
+void StatsCache::setByteBudget(size_t byte_budget)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_byte_budget = byte_budget;
+    evict(m_byte_budget);
+}
+
+size_t StatsCache::getByteBudget() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_byte_budget;
+}
+
+StatsCacheCounters StatsCache::getCounters() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_counters;
+}
+
+std::shared_ptr<const void> StatsCache::find(const StatsCacheKey& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto found = m_index.find(key);
+    if(found == m_index.end()){
+        m_counters.misses++;
+        return nullptr;
+    }
+    m_counters.hits++;
+    m_entries.splice(m_entries.begin(), m_entries, found->second);
+    return found->second->value;
+}
+
+void StatsCache::insert(const StatsCacheKey& key, std::shared_ptr<const void> value, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(bytes > m_byte_budget){
+        return;
+    }
+    const auto found = m_index.find(key);
+    if(found != m_index.end()){
+        // another thread got there first
+        m_counters.bytes += bytes - found->second->bytes;
+        found->second->value = std::move(value);
+        found->second->bytes = bytes;
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+    }
+    else{
+        m_entries.push_front(Entry{key, std::move(value), bytes});
+        m_index.emplace(key, m_entries.begin());
+        if(!key.by_identity){
+            m_content_groups[contentGroup(key)]++;
+        }
+        m_counters.bytes += bytes;
+        m_counters.entries++;
+    }
+    evict(m_byte_budget);
+}
+
+bool StatsCache::mayHoldContent(const StatsCacheKey& key) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_content_groups.count(contentGroup(key)) > 0;
+}
+
+void StatsCache::countMiss()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counters.misses++;
+}
+
+void StatsCache::evict(size_t byte_budget)
+{
+    while(m_counters.bytes > byte_budget && !m_entries.empty()){
+        const Entry& oldest = m_entries.back();
+        if(!oldest.key.by_identity){
+            const auto group = m_content_groups.find(contentGroup(oldest.key));
+            if(--group->second == 0){
+                m_content_groups.erase(group);
+            }
+        }
+        m_counters.bytes -= oldest.bytes;
+        m_counters.entries--;
+        m_counters.evictions++;
+        m_index.erase(oldest.key);
+        m_entries.pop_back();
+    }
+}
+
+uint64_t StatsCache::contentGroup(const StatsCacheKey& key)
+{
+    return mix(mix(key.length, key.ndvs), key.result.hash_code());
+}
@@ -0,0 +1,245 @@
+#ifndef STATSCACHE_H
+#define STATSCACHE_H
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <typeindex>
+#include <unordered_map>
+#include <cstdint>
+#include <StatsExpression.h>
+
+// 64 bit digest of count values, read as raw bits so -0 and nan payloads
+// count as content. Stripes of 16 values go through 8 multiply-accumulate
+// lanes the way xxh3 does it, with the accumulators scrambled every 16
+// stripes and avalanched at the end. Not xxh3 compatible
+uint64_t hashBlock(const float* values, size_t count);
+// content hash of a whole buffer, the same value ContentHash gives. Blocks of
+// expression_stats_block_size are hashed in parallel and combined in order
+uint64_t hashBuffer(const std::vector<float>& data, const StatsContext& context = defaultStatsContext());
+// hash of a set of no data values, whatever order they are given in
+uint64_t hashNoDataValues(const std::vector<float>& ndvs);
+
+// every value, valid or not, hashed block by block. The block digests are
+// combined as a polynomial so chunks merge in any grouping to the same hash
+struct ContentHashFeature
+{
+    static constexpr bool uses_squares = false;
+    static constexpr uint64_t multiplier = 0x9E3779B185EBCA87ull;
+    struct State
+    {
+        uint64_t hash = 0;
+        uint64_t power = 1;
+        uint64_t length = 0;
+    };
+    static void accumulate(State& state, const PreparedBlock& block){
+        state.hash = state.hash * multiplier + hashBlock(block.values, block.count);
+        state.power *= multiplier;
+        state.length += block.count;
+    }
+    static void merge(State& total, const State& partial){
+        total.hash = total.hash * partial.power + partial.hash;
+        total.power *= partial.power;
+        total.length += partial.length;
+    }
+    static uint64_t finish(const State& state);
+};
+
+// the content hash of the series, a reducer like any other so the hash can
+// come from the same pass as the stats
+struct ContentHash
+{
+    using Needs = std::tuple<ContentHashFeature>;
+    using Result = uint64_t;
+    template<typename States>
+    static Result finalize(const States& states){
+        return ContentHashFeature::finish(states.template get<ContentHashFeature>());
+    }
+};
+
+// a ReducerSet result served by a StatsCache
+template<typename... Reducers>
+class CachedStats
+{
+public:
+    using States = typename ExpressionStatsLoop<Reducers...>::States;
+    template<typename Reducer>
+    typename Reducer::Result get() const{
+        static_assert((std::is_same_v<Reducer, Reducers> || ...), "reducer is not part of this set");
+        return Reducer::finalize(m_states);
+    }
+    const States& getStates() const{
+        return m_states;
+    }
+    uint64_t getContentHash() const{
+        return m_content_hash;
+    }
+    // no nan/inf and no no data value in the data
+    bool isGood() const{
+        return m_good;
+    }
+    // came from the cache without reading the data
+    bool isHit() const{
+        return m_hit;
+    }
+private:
+    friend class StatsCache;
+    States m_states;
+    uint64_t m_content_hash = 0;
+    bool m_good = true;
+    bool m_hit = false;
+};
+
+struct StatsCacheCounters
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+};
+
+// what an entry is found by. Content keys hold the content hash, identity
+// keys the buffer address and a generation the caller bumps on every write
+struct StatsCacheKey
+{
+    uint64_t data = 0;
+    uint64_t length = 0;
+    uint64_t generation = 0;
+    uint64_t ndvs = 0;
+    // the CachedStats type, reducer sets with the same features stay apart
+    std::type_index result = typeid(void);
+    bool by_identity = false;
+    bool operator==(const StatsCacheKey& other) const;
+};
+
+struct StatsCacheKeyHash
+{
+    size_t operator()(const StatsCacheKey& key) const;
+};
+
+// results of ReducerSets over buffers seen before, keyed by (data, no data
+// values, reducer set), least recently used entries evicted past a byte
+// budget. Safe to share between threads; two threads missing the same key both
+// compute it. DoesTheStats' differences are a whole series and are not cached
+class StatsCache
+{
+public:
+    explicit StatsCache(size_t byte_budget = size_t(16) << 20);
+    // looked up by content: data is hashed first, unless no entry with the same
+    // length, no data values and reducers exists, in which case the hash comes
+    // from the stats pass. Data is hashed once either way. With a generation, by pointer + length + generation
+    // instead, and data is not read at all on a hit. Only for buffers that
+    // change solely together with the generation
+    template<typename... Reducers>
+    CachedStats<Reducers...> get(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& ndvs,
+                                 ReducerSet<Reducers...> reducers = {}, std::optional<uint64_t> generation = std::nullopt);
+    template<typename Reducer, typename = std::enable_if_t<isStatsReducer<Reducer>::value> >
+    CachedStats<Reducer> get(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& ndvs,
+                             Reducer, std::optional<uint64_t> generation = std::nullopt){
+        return get(context, data, ndvs, ReducerSet<Reducer>(), generation);
+    }
+    void clear();
+    // evicts down to the new budget straight away
+    void setByteBudget(size_t byte_budget);
+    size_t getByteBudget() const;
+    StatsCacheCounters getCounters() const;
+private:
+    struct Entry
+    {
+        StatsCacheKey key;
+        std::shared_ptr<const void> value;
+        size_t bytes = 0;
+    };
+    // counts a hit or a miss, a hit becomes the most recently used entry
+    std::shared_ptr<const void> find(const StatsCacheKey& key);
+    void insert(const StatsCacheKey& key, std::shared_ptr<const void> value, size_t bytes);
+    // whether a content key like this one could be present at all
+    bool mayHoldContent(const StatsCacheKey& key) const;
+    void countMiss();
+    void evict(size_t byte_budget);
+    static uint64_t contentGroup(const StatsCacheKey& key);
+
+    mutable std::mutex m_mutex;
+    size_t m_byte_budget;
+    StatsCacheCounters m_counters;
+    // most recently used first
+    std::list<Entry> m_entries;
+    std::unordered_map<StatsCacheKey, std::list<Entry>::iterator, StatsCacheKeyHash> m_index;
+    // content entries per length, no data values and reducers
+    std::unordered_map<uint64_t, size_t> m_content_groups;
+};
+
+namespace stats_cache_detail {
+
+template<typename Tuple, size_t... I>
+auto tuplePrefix(const Tuple& tuple, std::index_sequence<I...>)
+{
+    return std::make_tuple(std::get<I>(tuple)...);
+}
+
+}
+
+template<typename... Reducers>
+CachedStats<Reducers...> StatsCache::get(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& ndvs,
+                                         ReducerSet<Reducers...>, std::optional<uint64_t> generation)
+{
+    using Result = CachedStats<Reducers...>;
+    StatsCacheKey key;
+    key.length = data.size();
+    key.ndvs = hashNoDataValues(ndvs);
+    key.result = typeid(Result);
+    bool may_hit = true;
+    bool hashed = false;
+    if(generation){
+        key.by_identity = true;
+        key.data = reinterpret_cast<uintptr_t>(data.data());
+        key.generation = *generation;
+    }
+    else if(mayHoldContent(key)){
+        key.data = hashBuffer(data, context);
+        hashed = true;
+    }
+    else{
+        // nothing to hit, the hash can come with the stats
+        may_hit = false;
+    }
+    if(!may_hit){
+        countMiss();
+    }
+    else if(std::shared_ptr<const void> found = find(key)){
+        Result result = *std::static_pointer_cast<const Result>(found);
+        result.m_hit = true;
+        return result;
+    }
+
+    auto value = std::make_shared<Result>();
+    if(hashed){
+        ExpressionStatsLoop<Reducers...> loop(context, data, ndvs);
+        value->m_states = loop.getStates();
+        value->m_content_hash = key.data;
+        value->m_good = loop.isGood();
+    }
+    else{
+        // the stats and the content hash in one pass. The features of Reducers...
+        // come first in the combined loop, so their states are a prefix of its states
+        ExpressionStatsLoop<Reducers..., ContentHash> loop(context, data, ndvs);
+        value->m_states.states = stats_cache_detail::tuplePrefix(loop.getStates().states,
+                                                                 std::make_index_sequence<std::tuple_size_v<typename ExpressionStatsLoop<Reducers...>::Features> >());
+        value->m_content_hash = loop.template get<ContentHash>();
+        value->m_good = loop.isGood();
+    }
+    const size_t bytes = sizeof(Result) + sizeof(Entry);
+    if(key.by_identity){
+        insert(key, value, bytes);
+        // buffers with the same content hit it too
+        key.by_identity = false;
+        key.generation = 0;
+    }
+    key.data = value->m_content_hash;
+    insert(key, value, bytes);
+    return *value;
+}
+
+#endif // STATSCACHE_H
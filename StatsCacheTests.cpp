@@ -0,0 +1,132 @@
+#include <StatsCache.h>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<float> testTile(size_t count, float offset)
+{
+    std::vector<float> values = patternSeries(count, 101, 0.25f, offset);
+    values[count / 3] = -9999.f;
+    return values;
+}
+
+}
+
+TEST(StatsCache, HashIsOneValueForAnyChunking)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext parallel = parallelContext(pool);
+    StatsContext serial;
+    serial.tuning.forced_mode = ExecutionMode::Serial;
+    for(size_t count : {size_t(1), size_t(1000), size_t(1024), size_t(70001)}){
+        std::vector<float> values = testTile(count, 3.f);
+        const uint64_t hash = hashBuffer(values, serial);
+        EXPECT_EQ(hashBuffer(values, parallel), hash);
+        ExpressionStatsLoop loop(parallel, values, {-9999.f}, Sum{} | ContentHash{});
+        EXPECT_EQ(loop.get<ContentHash>(), hash);
+        // any bit of any value changes it, so does the length
+        values[count - 1] = -values[count - 1] - 1.f;
+        EXPECT_NE(hashBuffer(values, parallel), hash);
+        values.push_back(0.f);
+        EXPECT_NE(hashBuffer(values, parallel), hash);
+    }
+    EXPECT_NE(hashBuffer(std::vector<float>(4096, 0.f)), hashBuffer(std::vector<float>(4097, 0.f)));
+}
+
+TEST(StatsCache, ContentKeysHitOnEqualData)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext context = parallelContext(pool);
+    StatsCache cache;
+    const std::vector<float> tile = testTile(50000, 100.f);
+    const auto first = cache.get(context, tile, {-9999.f, -1.f}, Sum{} | Count{} | Moments<2>{});
+    EXPECT_FALSE(first.isHit());
+    EXPECT_FALSE(first.isGood());
+    ExpressionStatsLoop direct(context, tile, {-9999.f}, Sum{} | Count{} | Moments<2>{});
+    EXPECT_EQ(first.get<Sum>(), direct.get<Sum>());
+    EXPECT_EQ(first.get<Count>(), direct.get<Count>());
+    EXPECT_EQ(first.get<Moments<2> >().variance, direct.get<Moments<2> >().variance);
+    EXPECT_EQ(first.getContentHash(), hashBuffer(tile, context));
+
+    // a copy of the same tile, no data values in another order
+    const std::vector<float> copy = tile;
+    const auto second = cache.get(context, copy, {-1.f, -9999.f}, Sum{} | Count{} | Moments<2>{});
+    EXPECT_TRUE(second.isHit());
+    EXPECT_EQ(second.get<Sum>(), first.get<Sum>());
+    EXPECT_EQ(second.get<Count>(), first.get<Count>());
+
+    // other no data values, other reducers and other data all miss
+    EXPECT_FALSE(cache.get(context, tile, {-9999.f}, Sum{} | Count{} | Moments<2>{}).isHit());
+    EXPECT_FALSE(cache.get(context, tile, {-9999.f, -1.f}, Sum{}).isHit());
+    EXPECT_FALSE(cache.get(context, testTile(50000, 101.f), {-9999.f, -1.f}, Sum{} | Count{} | Moments<2>{}).isHit());
+    const StatsCacheCounters counters = cache.getCounters();
+    EXPECT_EQ(counters.hits, 1u);
+    EXPECT_EQ(counters.misses, 4u);
+    EXPECT_EQ(counters.entries, 4u);
+    EXPECT_GT(counters.bytes, 0u);
+}
+
+TEST(StatsCache, ReducerSetsWithTheSameFeaturesAreKeptApart)
+{
+    StatsCache cache;
+    const std::vector<float> tile = testTile(5000, 10.f);
+    StatsContext context;
+    // both need only the sum and count features
+    const auto sum_count = cache.get(context, tile, {-9999.f}, Sum{} | Count{});
+    const auto mean = cache.get(context, tile, {-9999.f}, Mean{});
+    EXPECT_FALSE(mean.isHit());
+    EXPECT_FLOAT_EQ(mean.get<Mean>(), sum_count.get<Sum>() / sum_count.get<Count>());
+    EXPECT_TRUE(cache.get(context, tile, {-9999.f}, Mean{}).isHit());
+    EXPECT_TRUE(cache.get(context, tile, {-9999.f}, Sum{} | Count{}).isHit());
+    EXPECT_EQ(cache.getCounters().entries, 2u);
+}
+
+TEST(StatsCache, IdentityKeysFollowTheGeneration)
+{
+    ThreadPoolExecutor pool(3);
+    const StatsContext context = parallelContext(pool);
+    StatsCache cache;
+    std::vector<float> tile = testTile(20000, 0.f);
+    EXPECT_FALSE(cache.get(context, tile, {-9999.f}, Mean{}, 1).isHit());
+    const auto again = cache.get(context, tile, {-9999.f}, Mean{}, 1);
+    EXPECT_TRUE(again.isHit());
+    // the first miss also stored the content, so an equal buffer hits by content
+    const std::vector<float> copy = tile;
+    EXPECT_TRUE(cache.get(context, copy, {-9999.f}, Mean{}).isHit());
+
+    // an edit comes with a new generation
+    for(float& value : tile){
+        value += value == -9999.f ? 0.f : 1.f;
+    }
+    const auto edited = cache.get(context, tile, {-9999.f}, Mean{}, 2);
+    EXPECT_FALSE(edited.isHit());
+    EXPECT_NEAR(edited.get<Mean>(), again.get<Mean>() + 1.f, 1e-3f);
+}
+
+TEST(StatsCache, LeastRecentlyUsedEntriesAreEvicted)
+{
+    StatsCache cache;
+    const std::vector<std::vector<float> > tiles = {testTile(3000, 1.f), testTile(3000, 2.f), testTile(3000, 3.f)};
+    StatsContext context;
+    cache.get(context, tiles[0], {}, Sum{});
+    const size_t entry_bytes = cache.getCounters().bytes;
+    cache.setByteBudget(2 * entry_bytes);
+    cache.get(context, tiles[1], {}, Sum{});
+    // tile 0 becomes the most recently used, tile 1 is evicted for tile 2
+    EXPECT_TRUE(cache.get(context, tiles[0], {}, Sum{}).isHit());
+    cache.get(context, tiles[2], {}, Sum{});
+    StatsCacheCounters counters = cache.getCounters();
+    EXPECT_EQ(counters.evictions, 1u);
+    EXPECT_EQ(counters.entries, 2u);
+    EXPECT_LE(counters.bytes, cache.getByteBudget());
+    EXPECT_TRUE(cache.get(context, tiles[0], {}, Sum{}).isHit());
+    EXPECT_TRUE(cache.get(context, tiles[2], {}, Sum{}).isHit());
+    EXPECT_FALSE(cache.get(context, tiles[1], {}, Sum{}).isHit());
+
+    cache.setByteBudget(0);
+    counters = cache.getCounters();
+    EXPECT_EQ(counters.entries, 0u);
+    EXPECT_EQ(counters.bytes, 0u);
+    EXPECT_FALSE(cache.get(context, tiles[0], {}, Sum{}).isHit());
+}
@@ -0,0 +1,21 @@
+#include "StatsContext.h"
+#include <cstdlib>
+
+StatsContext& defaultStatsContext()
+{
+    static StatsContext context = [](){
+        StatsContext initial;
+        const char* tuning_file = std::getenv("BASICSTATS_TUNING_FILE");
+        if(tuning_file){
+            initial.tuning.load(tuning_file);
+        }
+        return initial;
+    }();
+    return context;
+}
+
+void calibrateDefaultStatsContext()
+{
+    StatsContext& context = defaultStatsContext();
+    context.tuning = StatsTuning::calibrate(context.getExecutor());
+}
@@ -0,0 +1,57 @@
+#ifndef STATSCONTEXT_H
+#define STATSCONTEXT_H
+#include <StatsTuning.h>
+#include <StatsExecutor.h>
+#include <PerfCounters.h>
+#include <StatsAllocator.h>
+#include <type_traits>
+
+// settings shared by the stats loops of a process or of a caller that wants
+// its own. Loops constructed without one use defaultStatsContext()
+struct StatsContext
+{
+    StatsTuning tuning;
+    // runs the parallel chunks, not owned. nullptr means the process wide
+    // ThreadPoolExecutor::shared()
+    StatsExecutor* executor = nullptr;
+    // receives the counters of the loops run with this context, not owned.
+    // Only filled when built with BASICSTATS_PERF_COUNTERS, see PerfCounters.h
+    PerfReport* perf_report = nullptr;
+    // called on the constructing thread after each parallel loop with what its
+    // workers did, see LoopTelemetry.h. Empty records nothing
+    LoopTelemetryCallback telemetry_callback;
+    // where the loops take their scratch and output buffers from, not owned.
+    // nullptr means the process wide HeapAllocator::shared(); a PoolAllocator
+    // recycles them across calls
+    StatsAllocator* allocator = nullptr;
+    StatsExecutor& getExecutor() const{
+        return executor ? *executor : ThreadPoolExecutor::shared();
+    }
+    StatsAllocator& getAllocator() const{
+        return allocator ? *allocator : HeapAllocator::shared();
+    }
+};
+
+// process wide context. On first use the tuning is read from the file named by
+// the BASICSTATS_TUNING_FILE environment variable, or left at the StatsTuning
+// defaults, so no stats call pays for calibration and runs plan alike
+StatsContext& defaultStatsContext();
+// replaces the default context's tuning with StatsTuning::calibrate() on its
+// executor. Opt in, once at start up before loops run with the default context
+void calibrateDefaultStatsContext();
+
+// an Allocator for a container a loop run with context fills: over the
+// context's allocator when Allocator can wrap one, like ContextAllocator,
+// default constructed otherwise
+template<typename Allocator>
+Allocator contextAllocator(const StatsContext& context)
+{
+    if constexpr(std::is_constructible_v<Allocator, StatsAllocator&>){
+        return Allocator(context.getAllocator());
+    }
+    else{
+        return Allocator();
+    }
+}
+
+#endif // STATSCONTEXT_H
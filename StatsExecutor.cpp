@@ -0,0 +1,256 @@
+#include "StatsExecutor.h"
+#include <cstdint>
+#include <exception>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// pool and queue the current thread works for, so tasks submitted from inside a
+// task go to the worker's own deque
+thread_local const void* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+}
+
+ChunkLayout::ChunkLayout(size_t num_items, size_t items_per_chunk)
+    : m_num_items(num_items), m_items_per_chunk(items_per_chunk)
+{
+}
+
+ChunkLayout::ChunkLayout(size_t num_items, size_t items_per_chunk, ChunkSchedule schedule, size_t num_threads)
+    : ChunkLayout(num_items, items_per_chunk)
+{
+    if(schedule != ChunkSchedule::Guided || chunkCount(num_items, items_per_chunk) <= 1){
+        return;
+    }
+    // like OpenMP's guided schedule, half of an even share of what is left, in
+    // whole multiples of items_per_chunk so chunks stay block aligned
+    const size_t grain = std::max<size_t>(items_per_chunk, 1);
+    const size_t share = 2 * std::max<size_t>(num_threads, 1);
+    m_boundaries.push_back(0);
+    size_t begin = 0;
+    while(begin < num_items){
+        const size_t left = num_items - begin;
+        const size_t grains = std::max<size_t>(left / share / grain, 1);
+        begin += std::min(grains * grain, left);
+        m_boundaries.push_back(begin);
+    }
+}
+
+void SerialExecutor::parallelFor(size_t num_chunks, const ChunkFunction& fn)
+{
+    for(size_t chunk=0; chunk<num_chunks; chunk++){
+        fn(chunk, 0);
+    }
+}
+
+void OpenMPExecutor::parallelFor(size_t num_chunks, const ChunkFunction& fn)
+{
+    const int64_t num_chunks_64_t = static_cast<int64_t>(num_chunks);
+    #pragma omp parallel
+    {
+#ifdef _OPENMP
+        const size_t worker = static_cast<size_t>(omp_get_thread_num());
+#else
+        const size_t worker = 0;
+#endif
+        #pragma omp for schedule(dynamic)
+        for(int64_t chunk=0; chunk<num_chunks_64_t; chunk++){
+            fn(static_cast<size_t>(chunk), worker);
+        }
+    }
+}
+
+size_t OpenMPExecutor::concurrency() const
+{
+#ifdef _OPENMP
+    return static_cast<size_t>(omp_get_max_threads());
+#else
+    return 1;
+#endif
+}
+
+size_t ThreadPoolExecutor::defaultWorkerCount()
+{
+    const size_t hardware_threads = std::thread::hardware_concurrency();
+    return hardware_threads > 1 ? hardware_threads - 1 : 0;
+}
+
+ThreadPoolExecutor& ThreadPoolExecutor::shared()
+{
+    static ThreadPoolExecutor pool;
+    return pool;
+}
+
+ThreadPoolExecutor::ThreadPoolExecutor(size_t num_workers)
+{
+    for(size_t i=0; i<num_workers; i++){
+        m_queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for(size_t i=0; i<num_workers; i++){
+        m_workers.emplace_back([this, i](){
+            workerLoop(i);
+        });
+    }
+}
+
+ThreadPoolExecutor::~ThreadPoolExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for(std::thread& worker : m_workers){
+        worker.join();
+    }
+}
+
+void ThreadPoolExecutor::submit(std::function<void()> task)
+{
+    if(m_workers.empty()){
+        task();
+        return;
+    }
+    size_t queue;
+    if(current_pool == this){
+        queue = current_queue;
+    }
+    else{
+        queue = m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+        m_queues[queue]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_pending++;
+    }
+    m_wake.notify_one();
+}
+
+bool ThreadPoolExecutor::tryRunOne(size_t home)
+{
+    std::function<void()> task;
+    const size_t num_queues = m_queues.size();
+    for(size_t offset=0; offset<num_queues && !task; offset++){
+        WorkerQueue& queue = *m_queues[(home + offset) % num_queues];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if(queue.tasks.empty()){
+            continue;
+        }
+        // newest own work is hottest in cache, stolen work is the oldest
+        if(offset == 0){
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else{
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if(!task){
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_pending--;
+    }
+    task();
+    return true;
+}
+
+void ThreadPoolExecutor::workerLoop(size_t index)
+{
+    current_pool = this;
+    current_queue = index;
+    for(;;){
+        if(tryRunOne(index)){
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_wake.wait(lock, [this](){
+            return m_stop || m_pending > 0;
+        });
+        if(m_stop && m_pending == 0){
+            return;
+        }
+    }
+}
+
+void ThreadPoolExecutor::parallelFor(size_t num_chunks, const ChunkFunction& fn)
+{
+    if(num_chunks == 0){
+        return;
+    }
+    if(num_chunks == 1 || m_workers.empty()){
+        for(size_t chunk=0; chunk<num_chunks; chunk++){
+            fn(chunk, 0);
+        }
+        return;
+    }
+    // shared between the helpers. Helpers that only start once every chunk is
+    // claimed exit without touching fn, which may be gone by then
+    struct Job
+    {
+        std::atomic<size_t> next_chunk{0};
+        std::atomic<size_t> next_worker{0};
+        std::atomic<size_t> done{0};
+        size_t num_chunks = 0;
+        const ChunkFunction* fn = nullptr;
+        // set once a chunk threw, the chunks not started yet are skipped
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto job = std::make_shared<Job>();
+    job->num_chunks = num_chunks;
+    job->fn = &fn;
+    const auto claim_chunks = [job](){
+        size_t worker = 0;
+        bool has_worker = false;
+        for(;;){
+            const size_t chunk = job->next_chunk.fetch_add(1);
+            if(chunk >= job->num_chunks){
+                return;
+            }
+            if(!has_worker){
+                worker = job->next_worker.fetch_add(1);
+                has_worker = true;
+            }
+            if(!job->failed.load(std::memory_order_relaxed)){
+                try{
+                    (*job->fn)(chunk, worker);
+                }
+                catch(...){
+                    std::lock_guard<std::mutex> lock(job->mutex);
+                    if(!job->error){
+                        job->error = std::current_exception();
+                    }
+                    job->failed.store(true, std::memory_order_relaxed);
+                }
+            }
+            if(job->done.fetch_add(1) + 1 == job->num_chunks){
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->finished.notify_all();
+            }
+        }
+    };
+    const size_t num_helpers = std::min(num_chunks - 1, m_workers.size());
+    for(size_t helper=0; helper<num_helpers; helper++){
+        submit(claim_chunks);
+    }
+    claim_chunks();
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&](){
+        return job->done.load() == num_chunks;
+    });
+    // every chunk is accounted for and no helper touches fn any more
+    if(job->error){
+        std::rethrow_exception(job->error);
+    }
+}
@@ -0,0 +1,188 @@
+#ifndef STATSEXECUTOR_H
+#define STATSEXECUTOR_H
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <utility>
+#include <LoopTelemetry.h>
+
+// runs the independent chunks of a stats loop. The loops only ever talk to this
+// interface, so a host application can plug in the pool it already runs instead
+// of having a second set of threads compete with it
+class StatsExecutor
+{
+public:
+    // fn(chunk, worker). worker is below concurrency() and no two chunks with the
+    // same worker run at the same time, so it can index per worker scratch
+    using ChunkFunction = std::function<void(size_t chunk, size_t worker)>;
+    // returns an address inside the data a chunk reads
+    using ChunkHomeFunction = std::function<const void*(size_t chunk)>;
+    virtual ~StatsExecutor() = default;
+    // calls fn for every chunk in [0, num_chunks) and returns once all have
+    // finished. When fn throws, chunks not started yet may be skipped and the
+    // first exception is rethrown on the caller once the running ones are done
+    virtual void parallelFor(size_t num_chunks, const ChunkFunction& fn) = 0;
+    // parallelFor with a hint of where each chunk's data lives, for executors that
+    // place work next to its memory. Others ignore the hint
+    virtual void parallelForPlaced(size_t num_chunks, const ChunkFunction& fn, const ChunkHomeFunction& home){
+        (void)home;
+        parallelFor(num_chunks, fn);
+    }
+    // most chunks that can run at once
+    virtual size_t concurrency() const = 0;
+};
+
+// runs every chunk in order on the calling thread
+class SerialExecutor : public StatsExecutor
+{
+public:
+    void parallelFor(size_t num_chunks, const ChunkFunction& fn) override;
+    size_t concurrency() const override{
+        return 1;
+    }
+};
+
+// hands the chunks to an OpenMP parallel region, the behaviour the loops had
+// before executors. Serial when built without OpenMP
+class OpenMPExecutor : public StatsExecutor
+{
+public:
+    void parallelFor(size_t num_chunks, const ChunkFunction& fn) override;
+    size_t concurrency() const override;
+};
+
+// persistent pool of worker threads. Every worker owns a task deque it pops from
+// the back of, idle workers steal from the front of the others. parallelFor posts
+// helper tasks that claim chunks from a shared counter and the calling thread
+// claims chunks too, so nested calls from inside a task cannot deadlock
+class ThreadPoolExecutor : public StatsExecutor
+{
+public:
+    // num_workers background threads, the caller of parallelFor makes one more
+    explicit ThreadPoolExecutor(size_t num_workers = defaultWorkerCount());
+    ~ThreadPoolExecutor() override;
+    ThreadPoolExecutor(const ThreadPoolExecutor&) = delete;
+    ThreadPoolExecutor& operator=(const ThreadPoolExecutor&) = delete;
+    void parallelFor(size_t num_chunks, const ChunkFunction& fn) override;
+    size_t concurrency() const override{
+        return m_workers.size() + 1;
+    }
+    // runs task on a worker without waiting for it
+    void submit(std::function<void()> task);
+    // one less than the hardware threads, the caller being the last one
+    static size_t defaultWorkerCount();
+    // pool shared by the whole process, created on first use
+    static ThreadPoolExecutor& shared();
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_workers;
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wake;
+    size_t m_pending = 0;
+    bool m_stop = false;
+    std::atomic<size_t> m_next_queue{0};
+    bool tryRunOne(size_t home);
+    void workerLoop(size_t index);
+};
+
+// number of chunks of items_per_chunk needed to cover num_items, at least one
+inline size_t chunkCount(size_t num_items, size_t items_per_chunk)
+{
+    if(items_per_chunk == 0 || num_items <= items_per_chunk){
+        return 1;
+    }
+    return (num_items + items_per_chunk - 1) / items_per_chunk;
+}
+
+// [begin, end) of every chunk of a loop over num_items
+class ChunkLayout
+{
+public:
+    // equal chunks of items_per_chunk, the last one shorter
+    ChunkLayout(size_t num_items, size_t items_per_chunk);
+    // chunks of a plan's schedule. Guided chunks start at a share of the items
+    // left for each of num_threads and shrink to items_per_chunk
+    ChunkLayout(size_t num_items, size_t items_per_chunk, ChunkSchedule schedule, size_t num_threads);
+    size_t numChunks() const{
+        return m_boundaries.empty() ? chunkCount(m_num_items, m_items_per_chunk) : m_boundaries.size() - 1;
+    }
+    size_t begin(size_t chunk) const{
+        return m_boundaries.empty() ? std::min(chunk * m_items_per_chunk, m_num_items) : m_boundaries[chunk];
+    }
+    size_t end(size_t chunk) const{
+        return m_boundaries.empty() ? std::min((chunk + 1) * m_items_per_chunk, m_num_items) : m_boundaries[chunk + 1];
+    }
+private:
+    size_t m_num_items;
+    size_t m_items_per_chunk;
+    // only for uneven chunks, numChunks() + 1 entries
+    std::vector<size_t> m_boundaries;
+};
+
+namespace executor_detail {
+
+template<typename Fn>
+void runLayout(StatsExecutor& executor, const ChunkLayout& layout, Fn&& fn, const void* data, size_t item_bytes)
+{
+    const size_t num_chunks = layout.numChunks();
+    if(num_chunks == 1){
+        fn(size_t(0), layout.begin(0), layout.end(0), size_t(0));
+        return;
+    }
+    const StatsExecutor::ChunkFunction chunk_function = [&](size_t chunk, size_t worker){
+        fn(chunk, layout.begin(chunk), layout.end(chunk), worker);
+    };
+    if(!data){
+        executor.parallelFor(num_chunks, chunk_function);
+        return;
+    }
+    executor.parallelForPlaced(num_chunks, chunk_function, [&](size_t chunk)->const void*{
+        return static_cast<const char*>(data) + layout.begin(chunk) * item_bytes;
+    });
+}
+
+}
+
+// calls fn(chunk, begin, end, worker) for each chunk of layout through the
+// executor. A single chunk runs directly on the calling thread. When data is
+// given, item k of the loop lives at data + k * item_bytes, which tells
+// placement aware executors where each chunk's memory is. With telemetry every
+// chunk is timed into it
+template<typename Fn>
+void runChunked(StatsExecutor& executor, const ChunkLayout& layout, Fn&& fn,
+                const void* data = nullptr, size_t item_bytes = 0, LoopTelemetry* telemetry = nullptr)
+{
+    if(!telemetry){
+        executor_detail::runLayout(executor, layout, fn, data, item_bytes);
+        return;
+    }
+    ChunkTimer timer(*telemetry, executor.concurrency());
+    executor_detail::runLayout(executor, layout, [&](size_t chunk, size_t begin, size_t end, size_t worker){
+        const ChunkTimer::Clock::time_point start = ChunkTimer::Clock::now();
+        fn(chunk, begin, end, worker);
+        timer.chunkDone(worker, start, ChunkTimer::Clock::now(), end - begin);
+    }, data, item_bytes);
+    timer.finish();
+}
+
+// splits [0, num_items) into equal chunks, see above
+template<typename Fn>
+void runChunked(StatsExecutor& executor, size_t num_items, size_t items_per_chunk, Fn&& fn,
+                const void* data = nullptr, size_t item_bytes = 0)
+{
+    runChunked(executor, ChunkLayout(num_items, items_per_chunk), std::forward<Fn>(fn), data, item_bytes);
+}
+
+#endif // STATSEXECUTOR_H
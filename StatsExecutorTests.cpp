@@ -0,0 +1,139 @@
+#include <BasicStats.h>
+#include <MultiStats.h>
+#include <StatsExecutor.h>
+#include <atomic>
+#include <stdexcept>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+// every chunk runs exactly once and workers stay below concurrency()
+void checkRunsEveryChunkOnce(StatsExecutor& executor)
+{
+    const size_t num_chunks = 1000;
+    std::vector<std::atomic<int> > runs(num_chunks);
+    std::vector<std::atomic<int> > busy(executor.concurrency());
+    std::atomic<bool> worker_shared{false};
+    std::atomic<bool> worker_out_of_range{false};
+    executor.parallelFor(num_chunks, [&](size_t chunk, size_t worker){
+        if(worker >= busy.size()){
+            worker_out_of_range = true;
+            return;
+        }
+        if(busy[worker].fetch_add(1) != 0){
+            worker_shared = true;
+        }
+        runs[chunk]++;
+        busy[worker]--;
+    });
+    EXPECT_FALSE(worker_out_of_range);
+    EXPECT_FALSE(worker_shared);
+    for(size_t chunk=0; chunk<num_chunks; chunk++){
+        EXPECT_EQ(runs[chunk], 1);
+    }
+}
+
+}
+
+TEST(StatsExecutor, SerialRunsEveryChunkOnce)
+{
+    SerialExecutor executor;
+    checkRunsEveryChunkOnce(executor);
+}
+
+TEST(StatsExecutor, OpenMPRunsEveryChunkOnce)
+{
+    OpenMPExecutor executor;
+    checkRunsEveryChunkOnce(executor);
+}
+
+TEST(StatsExecutor, ThreadPoolRunsEveryChunkOnce)
+{
+    ThreadPoolExecutor executor(3);
+    EXPECT_EQ(executor.concurrency(), 4u);
+    checkRunsEveryChunkOnce(executor);
+    ThreadPoolExecutor no_workers(0);
+    checkRunsEveryChunkOnce(no_workers);
+}
+
+// a chunk that itself runs a parallelFor on the same pool must not deadlock,
+// even when every worker is busy with an outer chunk
+TEST(StatsExecutor, ThreadPoolNested)
+{
+    ThreadPoolExecutor executor(2);
+    std::atomic<size_t> inner_runs{0};
+    executor.parallelFor(8, [&](size_t, size_t){
+        executor.parallelFor(16, [&](size_t, size_t){
+            inner_runs++;
+        });
+    });
+    EXPECT_EQ(inner_runs, 8u * 16u);
+}
+
+// a throwing chunk reaches the caller once the other chunks are done and the
+// pool stays usable afterwards
+TEST(StatsExecutor, ThreadPoolChunkThrows)
+{
+    ThreadPoolExecutor executor(3);
+    std::atomic<size_t> running{0};
+    std::atomic<bool> ran_after_return{false};
+    std::atomic<bool> returned{false};
+    EXPECT_THROW(executor.parallelFor(1000, [&](size_t chunk, size_t){
+        running++;
+        if(returned){
+            ran_after_return = true;
+        }
+        running--;
+        if(chunk == 10){
+            throw std::runtime_error("chunk failed");
+        }
+    }), std::runtime_error);
+    returned = true;
+    EXPECT_EQ(running, 0u);
+    EXPECT_FALSE(ran_after_return);
+    checkRunsEveryChunkOnce(executor);
+}
+
+TEST(StatsExecutor, ThreadPoolSubmit)
+{
+    std::atomic<int> ran{0};
+    {
+        ThreadPoolExecutor executor(2);
+        for(int task=0; task<100; task++){
+            executor.submit([&](){
+                ran++;
+            });
+        }
+        // destruction waits for queued tasks
+    }
+    EXPECT_EQ(ran, 100);
+}
+
+// the loops give the same answers whichever executor runs them
+TEST(StatsExecutor, LoopsAgreeAcrossExecutors)
+{
+    std::vector<float> values(300000);
+    std::vector<float> other(values.size());
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = static_cast<float>(i % 11);
+        other[i] = static_cast<float>(i % 5);
+    }
+    SerialExecutor serial;
+    OpenMPExecutor openmp;
+    ThreadPoolExecutor pool(3);
+    std::vector<StatsExecutor*> executors = {&serial, &openmp, &pool};
+    StatsContext reference_context;
+    reference_context.executor = &serial;
+    DoesTheStats reference(values, {}, reference_context);
+    DoesThePairedStats paired_reference(values, other, {}, reference_context);
+    for(StatsExecutor* executor : executors){
+        StatsContext context = parallelContext(*executor);
+        DoesTheStats stats(values, {}, context);
+        EXPECT_EQ(stats.getSum(), reference.getSum());
+        EXPECT_TRUE(stats.getDifferences() == reference.getDifferences());
+        DoesThePairedStats paired(values, other, {}, context);
+        EXPECT_NEAR(paired.getCorrelation(), paired_reference.getCorrelation(), 1e-6);
+        EXPECT_EQ(paired.getCount(), paired_reference.getCount());
+    }
+}
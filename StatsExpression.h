@@ -0,0 +1,657 @@
+#ifndef STATSEXPRESSION_H
+#define STATSEXPRESSION_H
+#include <vector>
+#include <array>
+#include <tuple>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <limits>
+#include <ForceInline.h>
+#include <NoDataClassifier.h>
+#include <StatsContext.h>
+
+// elements prepared and reduced together, the prepared block stays in L1
+// while every feature runs over it
+constexpr size_t expression_stats_block_size = 1024;
+
+// Composable reducers, e.g.
+//     ExpressionStatsLoop stats(values, ndvs, Sum{} | Count{} | MinMax{} | Moments<4>{});
+//     float mean = stats.get<Moments<4> >().mean;
+// A reducer does not touch the data itself. It lists the features it Needs and
+// finalizes its Result from their merged states. The loop runs every distinct
+// feature once, however many reducers ask for it, in one pass over the data.
+//
+// Features are reduced block by block from a PreparedBlock. Work shared between
+// features happens once per block while preparing it: the validity mask, the
+// masked values and the block sum always, the block sum of squares only when a
+// feature sets uses_squares.
+
+struct PreparedBlock
+{
+    const float* values = nullptr;
+    const uint8_t* valid = nullptr;
+    // values with invalid positions replaced by 0
+    const float* masked = nullptr;
+    size_t count = 0;
+    size_t num_valid = 0;
+    double sum = 0.0;
+    // 0 unless a feature uses squares
+    double sum_squares = 0.0;
+};
+
+// number of valid values
+struct CountFeature
+{
+    static constexpr bool uses_squares = false;
+    struct State
+    {
+        double count = 0.0;
+    };
+    static void accumulate(State& state, const PreparedBlock& block){
+        state.count += static_cast<double>(block.num_valid);
+    }
+    static void merge(State& total, const State& partial){
+        total.count += partial.count;
+    }
+};
+
+struct SumFeature
+{
+    static constexpr bool uses_squares = false;
+    struct State
+    {
+        double sum = 0.0;
+    };
+    static void accumulate(State& state, const PreparedBlock& block){
+        state.sum += block.sum;
+    }
+    static void merge(State& total, const State& partial){
+        total.sum += partial.sum;
+    }
+};
+
+struct SumSquaresFeature
+{
+    static constexpr bool uses_squares = true;
+    struct State
+    {
+        double sum_squares = 0.0;
+    };
+    static void accumulate(State& state, const PreparedBlock& block){
+        state.sum_squares += block.sum_squares;
+    }
+    static void merge(State& total, const State& partial){
+        total.sum_squares += partial.sum_squares;
+    }
+};
+
+struct MinFeature
+{
+    static constexpr bool uses_squares = false;
+    struct State
+    {
+        float min = std::numeric_limits<float>::infinity();
+    };
+    static void accumulate(State& state, const PreparedBlock& block){
+        float min = state.min;
+        #pragma omp simd reduction(min:min)
+        for(size_t k=0; k<block.count; k++){
+            min = std::min(min, block.valid[k] ? block.values[k] : std::numeric_limits<float>::infinity());
+        }
+        state.min = min;
+    }
+    static void merge(State& total, const State& partial){
+        total.min = std::min(total.min, partial.min);
+    }
+};
+
+struct MaxFeature
+{
+    static constexpr bool uses_squares = false;
+    struct State
+    {
+        float max = -std::numeric_limits<float>::infinity();
+    };
+    static void accumulate(State& state, const PreparedBlock& block){
+        float max = state.max;
+        #pragma omp simd reduction(max:max)
+        for(size_t k=0; k<block.count; k++){
+            max = std::max(max, block.valid[k] ? block.values[k] : -std::numeric_limits<float>::infinity());
+        }
+        state.max = max;
+    }
+    static void merge(State& total, const State& partial){
+        total.max = std::max(total.max, partial.max);
+    }
+};
+
+// count, mean and the central sums sum((x-mean)^p) for p up to K. Each block is
+// centred on its own mean (from the prepared sum) and blocks are combined with
+// the arbitrary order update of Pebay (2008), which stays accurate for large offsets
+template<int K>
+struct CentralMomentsFeature
+{
+    static_assert(K >= 2, "central moments start at the variance");
+    static constexpr bool uses_squares = false;
+    struct State
+    {
+        double count = 0.0;
+        double mean = 0.0;
+        // central_sums[p] for p in [2, K], entries 0 and 1 are unused
+        std::array<double, K + 1> central_sums = {};
+    };
+    static void accumulate(State& state, const PreparedBlock& block){
+        if(block.num_valid == 0){
+            return;
+        }
+        State block_state;
+        block_state.count = static_cast<double>(block.num_valid);
+        block_state.mean = block.sum / block_state.count;
+        const double mean = block_state.mean;
+        std::array<double, K + 1> sums = {};
+        for(size_t k=0; k<block.count; k++){
+            const double d = block.valid[k] ? block.values[k] - mean : 0.0;
+            double power = d;
+            for(int p=2; p<=K; p++){
+                power *= d;
+                sums[p] += power;
+            }
+        }
+        block_state.central_sums = sums;
+        merge(state, block_state);
+    }
+    static void merge(State& total, const State& partial){
+        if(partial.count == 0.0){
+            return;
+        }
+        if(total.count == 0.0){
+            total = partial;
+            return;
+        }
+        const double n_a = total.count;
+        const double n_b = partial.count;
+        const double n = n_a + n_b;
+        const double delta = partial.mean - total.mean;
+        // highest order first, every order reads the lower ones before they change
+        for(int p=K; p>=2; p--){
+            double combined = total.central_sums[p] + partial.central_sums[p];
+            for(int k=1; k<=p-2; k++){
+                combined += binomial(p, k) * std::pow(delta, k) *
+                        (std::pow(-n_b / n, k) * total.central_sums[p-k] + std::pow(n_a / n, k) * partial.central_sums[p-k]);
+            }
+            combined += std::pow(n_a * n_b * delta / n, p) * (1.0 / std::pow(n_b, p-1) - std::pow(-1.0 / n_a, p-1));
+            total.central_sums[p] = combined;
+        }
+        total.mean += delta * n_b / n;
+        total.count = n;
+    }
+private:
+    static double binomial(int n, int k){
+        double result = 1.0;
+        for(int j=1; j<=k; j++){
+            result = result * (n - k + j) / j;
+        }
+        return result;
+    }
+};
+
+// counts of the valid values in Bins::count equal bins over [Bins::lower,
+// Bins::upper), with the values outside counted below and above. Bins is a
+// struct with static constexpr float lower, upper and size_t count
+template<typename Bins>
+struct HistogramFeature
+{
+    static_assert(Bins::count > 0 && Bins::lower < Bins::upper, "histogram needs bins over a non empty range");
+    static constexpr bool uses_squares = false;
+    struct State
+    {
+        std::array<uint64_t, Bins::count> counts = {};
+        uint64_t below = 0;
+        uint64_t above = 0;
+    };
+    static void accumulate(State& state, const PreparedBlock& block){
+        constexpr float scale = static_cast<float>(Bins::count) / (Bins::upper - Bins::lower);
+        for(size_t k=0; k<block.count; k++){
+            if(!block.valid[k]){
+                continue;
+            }
+            const float value = block.values[k];
+            if(value < Bins::lower){
+                state.below++;
+            }
+            else if(value >= Bins::upper){
+                state.above++;
+            }
+            else{
+                // rounding can put a value just under upper past the last bin
+                state.counts[std::min(static_cast<size_t>((value - Bins::lower) * scale), Bins::count - 1)]++;
+            }
+        }
+    }
+    static void merge(State& total, const State& partial){
+        for(size_t bin=0; bin<Bins::count; bin++){
+            total.counts[bin] += partial.counts[bin];
+        }
+        total.below += partial.below;
+        total.above += partial.above;
+    }
+};
+
+// the reducers. Each lists the features it Needs and turns their states into a Result
+
+// sum of the valid values
+struct Sum
+{
+    using Needs = std::tuple<SumFeature>;
+    using Result = float;
+    template<typename States>
+    static Result finalize(const States& states){
+        return static_cast<float>(states.template get<SumFeature>().sum);
+    }
+};
+
+// number of valid values
+struct Count
+{
+    using Needs = std::tuple<CountFeature>;
+    using Result = size_t;
+    template<typename States>
+    static Result finalize(const States& states){
+        return static_cast<size_t>(states.template get<CountFeature>().count);
+    }
+};
+
+// sum / count, derived when finalizing. nan without valid values
+struct Mean
+{
+    using Needs = std::tuple<SumFeature, CountFeature>;
+    using Result = float;
+    template<typename States>
+    static Result finalize(const States& states){
+        const double count = states.template get<CountFeature>().count;
+        if(count == 0.0){
+            return std::numeric_limits<float>::quiet_NaN();
+        }
+        return static_cast<float>(states.template get<SumFeature>().sum / count);
+    }
+};
+
+// nan for both without valid values
+struct MinMax
+{
+    using Needs = std::tuple<MinFeature, MaxFeature, CountFeature>;
+    struct Result
+    {
+        float min;
+        float max;
+    };
+    template<typename States>
+    static Result finalize(const States& states){
+        if(states.template get<CountFeature>().count == 0.0){
+            return {std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN()};
+        }
+        return {states.template get<MinFeature>().min, states.template get<MaxFeature>().max};
+    }
+};
+
+// square root of the mean of the squares
+struct RootMeanSquare
+{
+    using Needs = std::tuple<SumSquaresFeature, CountFeature>;
+    using Result = float;
+    template<typename States>
+    static Result finalize(const States& states){
+        const double count = states.template get<CountFeature>().count;
+        if(count == 0.0){
+            return std::numeric_limits<float>::quiet_NaN();
+        }
+        return static_cast<float>(std::sqrt(states.template get<SumSquaresFeature>().sum_squares / count));
+    }
+};
+
+// mean, sample variance and, from K = 3 and 4, skewness and excess kurtosis.
+// central_moments[p] is the population central moment sum((x-mean)^p) / n
+template<int K>
+struct Moments
+{
+    using Needs = std::tuple<CentralMomentsFeature<K> >;
+    struct Result
+    {
+        float mean = std::numeric_limits<float>::quiet_NaN();
+        float variance = std::numeric_limits<float>::quiet_NaN();
+        float skewness = std::numeric_limits<float>::quiet_NaN();
+        float kurtosis = std::numeric_limits<float>::quiet_NaN();
+        std::array<float, K + 1> central_moments = {};
+    };
+    template<typename States>
+    static Result finalize(const States& states){
+        const auto& state = states.template get<CentralMomentsFeature<K> >();
+        Result result;
+        const double n = state.count;
+        if(n == 0.0){
+            return result;
+        }
+        result.mean = static_cast<float>(state.mean);
+        result.central_moments[0] = 1.f;
+        for(int p=2; p<=K; p++){
+            result.central_moments[p] = static_cast<float>(state.central_sums[p] / n);
+        }
+        const double m2 = state.central_sums[2] / n;
+        if(n >= 2.0){
+            result.variance = static_cast<float>(state.central_sums[2] / (n - 1.0));
+        }
+        if constexpr(K >= 3){
+            if(m2 > 0.0){
+                result.skewness = static_cast<float>(state.central_sums[3] / n / std::pow(m2, 1.5));
+            }
+        }
+        if constexpr(K >= 4){
+            if(m2 > 0.0){
+                result.kurtosis = static_cast<float>(state.central_sums[4] / n / (m2 * m2) - 3.0);
+            }
+        }
+        return result;
+    }
+};
+
+// bin counts of the valid values, see HistogramFeature
+template<typename Bins>
+struct Histogram
+{
+    using Needs = std::tuple<HistogramFeature<Bins> >;
+    using Result = typename HistogramFeature<Bins>::State;
+    template<typename States>
+    static Result finalize(const States& states){
+        return states.template get<HistogramFeature<Bins> >();
+    }
+};
+
+// a list of reducers built with operator|
+template<typename... Reducers>
+struct ReducerSet
+{
+};
+
+template<typename T, typename = void>
+struct isStatsReducer : std::false_type {};
+template<typename T>
+struct isStatsReducer<T, std::void_t<typename T::Needs, typename T::Result> > : std::true_type {};
+
+template<typename A, typename B, typename = std::enable_if_t<isStatsReducer<A>::value && isStatsReducer<B>::value> >
+ReducerSet<A, B> operator|(A, B)
+{
+    return {};
+}
+
+template<typename... Reducers, typename B, typename = std::enable_if_t<isStatsReducer<B>::value> >
+ReducerSet<Reducers..., B> operator|(ReducerSet<Reducers...>, B)
+{
+    return {};
+}
+
+// compile time helpers that flatten the features of every reducer into a
+// list without repeats
+template<typename T, typename Tuple> struct tupleContains;
+template<typename T, typename... Ts>
+struct tupleContains<T, std::tuple<Ts...> > : std::disjunction<std::is_same<T, Ts>...> {};
+
+template<typename Unique, typename Remaining> struct uniqueTypes;
+template<typename... Us>
+struct uniqueTypes<std::tuple<Us...>, std::tuple<> >
+{
+    using type = std::tuple<Us...>;
+};
+template<typename... Us, typename T, typename... Ts>
+struct uniqueTypes<std::tuple<Us...>, std::tuple<T, Ts...> >
+    : std::conditional_t<tupleContains<T, std::tuple<Us...> >::value,
+                         uniqueTypes<std::tuple<Us...>, std::tuple<Ts...> >,
+                         uniqueTypes<std::tuple<Us..., T>, std::tuple<Ts...> > > {};
+
+template<typename T, typename Tuple> struct tupleIndex;
+template<typename T, typename... Ts>
+struct tupleIndex<T, std::tuple<T, Ts...> > : std::integral_constant<size_t, 0> {};
+template<typename T, typename U, typename... Ts>
+struct tupleIndex<T, std::tuple<U, Ts...> > : std::integral_constant<size_t, 1 + tupleIndex<T, std::tuple<Ts...> >::value> {};
+
+// the states of a list of features, looked up by feature type
+template<typename Features> struct FeatureStates;
+template<typename... Features>
+struct FeatureStates<std::tuple<Features...> >
+{
+    using Tuple = std::tuple<typename Features::State...>;
+    Tuple states;
+    template<typename Feature> const auto& get() const{
+        return std::get<tupleIndex<Feature, std::tuple<Features...> >::value>(states);
+    }
+    void accumulate(const PreparedBlock& block){
+        accumulateAll(block, std::index_sequence_for<Features...>());
+    }
+    void merge(const FeatureStates& partial){
+        mergeAll(partial, std::index_sequence_for<Features...>());
+    }
+    static constexpr bool uses_squares = (Features::uses_squares || ...);
+private:
+    template<size_t... I>
+    void accumulateAll(const PreparedBlock& block, std::index_sequence<I...>){
+        (Features::accumulate(std::get<I>(states), block), ...);
+    }
+    template<size_t... I>
+    void mergeAll(const FeatureStates& partial, std::index_sequence<I...>){
+        (Features::merge(std::get<I>(states), std::get<I>(partial.states)), ...);
+    }
+};
+
+// reduces count values into states, expression_stats_block_size at a time
+// from values. Blocks start at values, so callers that want the same blocks
+// as ExpressionStatsLoop pass block aligned ranges
+template<typename States>
+void accumulateExpressionBlocks(States& states, const NoDataClassifier& classifier, const float* values, size_t count,
+                                bool& contains_nan_infs, bool& contains_ndvs)
+{
+    std::array<uint8_t, expression_stats_block_size> valid;
+    std::array<float, expression_stats_block_size> masked;
+    for(size_t block_begin=0; block_begin<count; block_begin+=expression_stats_block_size)
+    {
+        PreparedBlock block;
+        block.values = values + block_begin;
+        block.count = std::min(expression_stats_block_size, count - block_begin);
+        std::fill_n(valid.begin(), block.count, uint8_t(1));
+        const BlockClassification classification = classifier.classifyBlock(block.values, block.count, valid.data());
+        contains_nan_infs |= classification.num_nan_infs > 0;
+        contains_ndvs |= classification.num_ndvs > 0;
+        // the shared sub computations, done once for every feature
+        double sum = 0.0;
+        size_t num_valid = 0;
+        #pragma omp simd reduction(+:sum,num_valid)
+        for(size_t k=0; k<block.count; k++){
+            masked[k] = valid[k] ? block.values[k] : 0.f;
+            sum += masked[k];
+            num_valid += valid[k];
+        }
+        if constexpr(States::uses_squares){
+            double sum_squares = 0.0;
+            #pragma omp simd reduction(+:sum_squares)
+            for(size_t k=0; k<block.count; k++){
+                sum_squares += static_cast<double>(masked[k]) * masked[k];
+            }
+            block.sum_squares = sum_squares;
+        }
+        block.valid = valid.data();
+        block.masked = masked.data();
+        block.num_valid = num_valid;
+        block.sum = sum;
+        states.accumulate(block);
+    }
+}
+
+// runs a ReducerSet over one series of floats, skipping nan/inf and no data
+// values. Chunks are reduced through the context's executor and merged in chunk
+// order, so results do not depend on the thread count.
+template<typename... Reducers>
+class StatsSummary;
+
+template<typename... Reducers>
+class ExpressionStatsLoop
+{
+    friend class StatsSummary<Reducers...>;
+public:
+    using Features = typename uniqueTypes<std::tuple<>, decltype(std::tuple_cat(std::declval<typename Reducers::Needs>()...))>::type;
+    using States = FeatureStates<Features>;
+private:
+    States m_states;
+    bool m_contains_nan_infs = false;
+    bool m_contains_ndvs = false;
+public:
+    ExpressionStatsLoop(const std::vector<float>& data, const std::vector<float>& no_data_values,
+                        ReducerSet<Reducers...> reducers = {})
+        : ExpressionStatsLoop(defaultStatsContext(), data, no_data_values, reducers)
+    {
+    }
+    ExpressionStatsLoop(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& no_data_values,
+                        ReducerSet<Reducers...> reducers = {})
+        : ExpressionStatsLoop(context, data.data(), data.size(), no_data_values, reducers)
+    {
+    }
+    // count values the loop does not own, such as a buffer read from a file
+    ExpressionStatsLoop(const StatsContext& context, const float* data, size_t count, const std::vector<float>& no_data_values,
+                        ReducerSet<Reducers...> reducers = {});
+    // a single reducer, without any |
+    template<typename Reducer, typename = std::enable_if_t<isStatsReducer<Reducer>::value> >
+    ExpressionStatsLoop(const std::vector<float>& data, const std::vector<float>& no_data_values, Reducer)
+        : ExpressionStatsLoop(defaultStatsContext(), data, no_data_values, ReducerSet<Reducers...>())
+    {
+    }
+    template<typename Reducer, typename = std::enable_if_t<isStatsReducer<Reducer>::value> >
+    ExpressionStatsLoop(const StatsContext& context, const std::vector<float>& data, const std::vector<float>& no_data_values, Reducer)
+        : ExpressionStatsLoop(context, data, no_data_values, ReducerSet<Reducers...>())
+    {
+    }
+    // result of one of the reducers the loop was built with
+    template<typename Reducer>
+    typename Reducer::Result get() const{
+        static_assert((std::is_same_v<Reducer, Reducers> || ...), "reducer is not part of this loop");
+        return Reducer::finalize(m_states);
+    }
+    const States& getStates() const{
+        return m_states;
+    }
+    bool isGood() const{
+        return !m_contains_nan_infs && !m_contains_ndvs;
+    }
+};
+
+template<typename... Reducers>
+ExpressionStatsLoop(const std::vector<float>&, const std::vector<float>&, ReducerSet<Reducers...>) -> ExpressionStatsLoop<Reducers...>;
+template<typename... Reducers>
+ExpressionStatsLoop(const StatsContext&, const std::vector<float>&, const std::vector<float>&, ReducerSet<Reducers...>) -> ExpressionStatsLoop<Reducers...>;
+template<typename Reducer, typename = std::enable_if_t<isStatsReducer<Reducer>::value> >
+ExpressionStatsLoop(const std::vector<float>&, const std::vector<float>&, Reducer) -> ExpressionStatsLoop<Reducer>;
+template<typename Reducer, typename = std::enable_if_t<isStatsReducer<Reducer>::value> >
+ExpressionStatsLoop(const StatsContext&, const std::vector<float>&, const std::vector<float>&, Reducer) -> ExpressionStatsLoop<Reducer>;
+
+template<typename... Reducers>
+ExpressionStatsLoop<Reducers...>::ExpressionStatsLoop(const StatsContext& context, const float* data, size_t count,
+                                                      const std::vector<float>& no_data_values, ReducerSet<Reducers...>)
+{
+    const NoDataClassifier classifier(no_data_values);
+    const size_t num_elements = count;
+    const size_t num_blocks = (num_elements + expression_stats_block_size - 1) / expression_stats_block_size;
+    StatsExecutor& executor = context.getExecutor();
+    const ExecutionPlan plan = context.tuning.plan(num_elements, std::tuple_size_v<Features>, executor.concurrency());
+    const size_t blocks_per_chunk = plan.mode == ExecutionMode::Parallel
+            ? std::max<size_t>(plan.chunk_size / expression_stats_block_size, 1) : num_blocks;
+
+    struct ChunkResult
+    {
+        States states;
+        bool contains_nan_infs = false;
+        bool contains_ndvs = false;
+    };
+    const ChunkLayout layout(num_blocks, blocks_per_chunk, plan.schedule, plan.num_threads);
+    ContextVector<ChunkResult> chunk_results(layout.numChunks(), context.getAllocator());
+    LoopTelemetryRecorder telemetry(context.telemetry_callback, plan, expression_stats_block_size);
+    runChunked(executor, layout, [&](size_t chunk, size_t first_block, size_t end_block, size_t){
+        ChunkResult& result = chunk_results[chunk];
+        const size_t begin = first_block * expression_stats_block_size;
+        const size_t end = std::min(end_block * expression_stats_block_size, num_elements);
+        accumulateExpressionBlocks(result.states, classifier, data + begin, end - begin,
+                                   result.contains_nan_infs, result.contains_ndvs);
+    }, data, expression_stats_block_size * sizeof(float), telemetry.get());
+    telemetry.startMerge();
+    for(const ChunkResult& result : chunk_results){
+        m_states.merge(result.states);
+        m_contains_nan_infs |= result.contains_nan_infs;
+        m_contains_ndvs |= result.contains_ndvs;
+    }
+    telemetry.publish();
+}
+
+// the merged feature states of part of a series and whether it held invalid
+// values, the unit the indexes over a series keep and merge
+template<typename... Reducers>
+class StatsSummary
+{
+public:
+    using States = typename ExpressionStatsLoop<Reducers...>::States;
+    StatsSummary() = default;
+    // everything a loop reduced
+    explicit StatsSummary(const ExpressionStatsLoop<Reducers...>& loop)
+        : m_states(loop.m_states), m_contains_nan_infs(loop.m_contains_nan_infs), m_contains_ndvs(loop.m_contains_ndvs)
+    {
+    }
+    template<typename Reducer>
+    typename Reducer::Result get() const{
+        static_assert((std::is_same_v<Reducer, Reducers> || ...), "reducer is not part of this summary");
+        return Reducer::finalize(m_states);
+    }
+    const States& getStates() const{
+        return m_states;
+    }
+    bool isGood() const{
+        return !m_contains_nan_infs && !m_contains_ndvs;
+    }
+    // reduces count more values, see accumulateExpressionBlocks
+    void accumulate(const NoDataClassifier& classifier, const float* values, size_t count){
+        accumulateExpressionBlocks(m_states, classifier, values, count, m_contains_nan_infs, m_contains_ndvs);
+    }
+    // partial holds values after those of this summary
+    void merge(const StatsSummary& partial){
+        m_states.merge(partial.m_states);
+        m_contains_nan_infs |= partial.m_contains_nan_infs;
+        m_contains_ndvs |= partial.m_contains_ndvs;
+    }
+    // fn(pointer, size) over the plain data a summary is made of, for saving
+    // and loading it. Pointers are const for a const summary
+    template<typename Fn>
+    void forEachBytes(Fn&& fn){
+        forEachBytes(*this, fn);
+    }
+    template<typename Fn>
+    void forEachBytes(Fn&& fn) const{
+        forEachBytes(*this, fn);
+    }
+    static constexpr size_t numBytes(){
+        return std::apply([](const auto&... states){
+            return (sizeof(states) + ... + 0);
+        }, typename States::Tuple()) + 2 * sizeof(bool);
+    }
+private:
+    States m_states;
+    bool m_contains_nan_infs = false;
+    bool m_contains_ndvs = false;
+    template<typename Summary, typename Fn>
+    static void forEachBytes(Summary& summary, Fn& fn){
+        std::apply([&](auto&... states){
+            static_assert((std::is_trivially_copyable_v<std::decay_t<decltype(states)> > && ...),
+                          "feature states are saved as raw bytes");
+            (fn(&states, sizeof(states)), ...);
+        }, summary.m_states.states);
+        fn(&summary.m_contains_nan_infs, sizeof(bool));
+        fn(&summary.m_contains_ndvs, sizeof(bool));
+    }
+};
+
+#endif // STATSEXPRESSION_H
@@ -0,0 +1,110 @@
+#include <StatsExpression.h>
+#include <BasicStats.h>
+#include <numeric>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<float> testSeries()
+{
+    std::vector<float> values = patternSeries(30000, 101, 0.5f, 1000.f);
+    values[10] = -9999.f;
+    values[20000] = std::numeric_limits<float>::quiet_NaN();
+    return values;
+}
+
+}
+
+// features asked for by several reducers are only computed once
+TEST(StatsExpression, SharedFeaturesAreDeduplicated)
+{
+    using Loop = ExpressionStatsLoop<Sum, Count, Mean, MinMax, RootMeanSquare>;
+    EXPECT_EQ(std::tuple_size_v<Loop::Features>, 5u);
+    EXPECT_TRUE((tupleContains<CountFeature, Loop::Features>::value));
+    EXPECT_TRUE(Loop::States::uses_squares);
+    EXPECT_FALSE((ExpressionStatsLoop<Sum, Mean>::States::uses_squares));
+}
+
+TEST(StatsExpression, MatchesReference)
+{
+    const std::vector<float> values = testSeries();
+    std::vector<double> valid;
+    for(float v : values){
+        if(std::isfinite(v) && v != -9999.f){
+            valid.push_back(v);
+        }
+    }
+    const double n = static_cast<double>(valid.size());
+    const double sum = std::accumulate(valid.begin(), valid.end(), 0.0);
+    const double mean = sum / n;
+    double m2 = 0, m3 = 0, m4 = 0, squares = 0;
+    for(double v : valid){
+        m2 += (v - mean) * (v - mean);
+        m3 += (v - mean) * (v - mean) * (v - mean);
+        m4 += (v - mean) * (v - mean) * (v - mean) * (v - mean);
+        squares += v * v;
+    }
+
+    for(ExecutionMode mode : {ExecutionMode::SimdOnly, ExecutionMode::Parallel}){
+        StatsContext context;
+        context.tuning.forced_mode = mode;
+        context.tuning.min_grain_work = 0;
+        ExpressionStatsLoop stats(context, values, {-9999.f}, Sum{} | Count{} | Mean{} | MinMax{} | RootMeanSquare{} | Moments<4>{});
+        EXPECT_FALSE(stats.isGood());
+        EXPECT_EQ(stats.get<Count>(), valid.size());
+        EXPECT_FLOAT_EQ(stats.get<Sum>(), static_cast<float>(sum));
+        EXPECT_FLOAT_EQ(stats.get<Mean>(), static_cast<float>(mean));
+        EXPECT_EQ(stats.get<MinMax>().min, 1000.f);
+        EXPECT_EQ(stats.get<MinMax>().max, 1050.f);
+        EXPECT_FLOAT_EQ(stats.get<RootMeanSquare>(), static_cast<float>(std::sqrt(squares / n)));
+        const Moments<4>::Result moments = stats.get<Moments<4> >();
+        EXPECT_FLOAT_EQ(moments.mean, static_cast<float>(mean));
+        EXPECT_FLOAT_EQ(moments.variance, static_cast<float>(m2 / (n - 1)));
+        EXPECT_NEAR(moments.skewness, m3 / n / std::pow(m2 / n, 1.5), 1e-4);
+        EXPECT_NEAR(moments.kurtosis, m4 / n / ((m2 / n) * (m2 / n)) - 3.0, 1e-4);
+    }
+}
+
+// a lone reducer needs no |, and the sum agrees with DoesTheStats
+TEST(StatsExpression, SingleReducer)
+{
+    const std::vector<float> values = {1, 2, 3, 4, -9999, 5};
+    ExpressionStatsLoop sum(values, {-9999.f}, Sum{});
+    DoesTheStats stats(values, {-9999.f});
+    EXPECT_EQ(sum.get<Sum>(), stats.getSum());
+
+    ExpressionStatsLoop empty(std::vector<float>(), {}, Mean{} | MinMax{} | Moments<2>{});
+    EXPECT_TRUE(empty.isGood());
+    EXPECT_TRUE(std::isnan(empty.get<Mean>()));
+    EXPECT_TRUE(std::isnan(empty.get<MinMax>().min));
+    EXPECT_TRUE(std::isnan(empty.get<Moments<2> >().variance));
+}
+
+namespace {
+
+struct TenBins
+{
+    static constexpr float lower = 0.f;
+    static constexpr float upper = 10.f;
+    static constexpr size_t count = 10;
+};
+
+}
+
+TEST(StatsExpression, HistogramCountsValidValues)
+{
+    const std::vector<float> values = {-1.f, 0.f, 0.5f, 3.f, 9.99f, 10.f, 42.f, -9999.f, std::numeric_limits<float>::quiet_NaN()};
+    ExpressionStatsLoop stats(values, {-9999.f}, Histogram<TenBins>{} | Count{});
+    const Histogram<TenBins>::Result histogram = stats.get<Histogram<TenBins> >();
+    EXPECT_EQ(histogram.below, 1u);
+    EXPECT_EQ(histogram.above, 2u);
+    EXPECT_EQ(histogram.counts[0], 2u);
+    EXPECT_EQ(histogram.counts[3], 1u);
+    EXPECT_EQ(histogram.counts[9], 1u);
+    uint64_t total = histogram.below + histogram.above;
+    for(uint64_t count : histogram.counts){
+        total += count;
+    }
+    EXPECT_EQ(total, stats.get<Count>());
+}
@@ -0,0 +1,213 @@
+#include "StatsJobs.h"
+#include <algorithm>
+
+double StatsJobControl::getProgress() const
+{
+    if(isFinished()){
+        return 1.0;
+    }
+    const size_t scheduled = getScheduledChunks();
+    return scheduled == 0 ? 0.0 : static_cast<double>(getCompletedChunks()) / static_cast<double>(scheduled);
+}
+
+bool StatsJobControl::isFinished() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_finished;
+}
+
+bool StatsJobControl::setContinuation(std::function<void()> continuation)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_finished){
+        return false;
+    }
+    m_continuation = std::move(continuation);
+    return true;
+}
+
+void StatsJobControl::markFinished()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_finished = true;
+}
+
+void StatsJobControl::finish()
+{
+    std::function<void()> continuation;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished = true;
+        continuation.swap(m_continuation);
+    }
+    if(continuation){
+        continuation();
+    }
+}
+
+void StatsJobExecutor::parallelFor(size_t num_chunks, const ChunkFunction& fn)
+{
+    runWaves(num_chunks, fn, nullptr);
+}
+
+void StatsJobExecutor::parallelForPlaced(size_t num_chunks, const ChunkFunction& fn, const ChunkHomeFunction& home)
+{
+    runWaves(num_chunks, fn, &home);
+}
+
+void StatsJobExecutor::runWaves(size_t num_chunks, const ChunkFunction& fn, const ChunkHomeFunction* home)
+{
+    m_control.m_scheduled.fetch_add(num_chunks, std::memory_order_relaxed);
+    // the top priority never waits, it runs in one go
+    const size_t wave = m_priority == StatsJobPriority::Interactive
+            ? num_chunks : std::max<size_t>(stats_job_chunks_per_wave * m_executor.concurrency(), 1);
+    for(size_t first=0; first<num_chunks; first+=wave){
+        if(first > 0){
+            m_queue.giveWay(m_priority);
+        }
+        const size_t count = std::min(wave, num_chunks - first);
+        if(m_control.isCancelled()){
+            // counted as done so the progress still ends at 1
+            m_control.m_completed.fetch_add(num_chunks - first, std::memory_order_relaxed);
+            return;
+        }
+        const ChunkFunction wave_function = [&](size_t chunk, size_t worker){
+            if(!m_control.isCancelled()){
+                fn(first + chunk, worker);
+            }
+            m_control.m_completed.fetch_add(1, std::memory_order_relaxed);
+        };
+        if(home){
+            m_executor.parallelForPlaced(count, wave_function, [&](size_t chunk){
+                return (*home)(first + chunk);
+            });
+        }
+        else{
+            m_executor.parallelFor(count, wave_function);
+        }
+    }
+}
+
+StatsJobQueue::StatsJobQueue(size_t num_runners)
+{
+    for(size_t i=0; i<std::max<size_t>(num_runners, 1); i++){
+        m_runners.emplace_back([this](){
+            runnerLoop();
+        });
+    }
+}
+
+StatsJobQueue::~StatsJobQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        for(std::deque<QueuedJob>& queued : m_queued){
+            for(QueuedJob& job : queued){
+                job.control->cancel();
+            }
+        }
+    }
+    m_changed.notify_all();
+    for(std::thread& runner : m_runners){
+        runner.join();
+    }
+}
+
+void StatsJobQueue::push(StatsJobPriority priority, QueuedJob job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_stop){
+            job.control->cancel();
+        }
+        m_queued[static_cast<size_t>(priority)].push_back(std::move(job));
+    }
+    m_changed.notify_all();
+}
+
+void StatsJobQueue::runnerLoop()
+{
+    for(;;){
+        QueuedJob job;
+        size_t priority = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [&](){
+                return m_stop || std::any_of(m_queued.begin(), m_queued.end(), [](const std::deque<QueuedJob>& queued){
+                    return !queued.empty();
+                });
+            });
+            // the queued jobs, cancelled by then, still resolve their futures
+            priority = stats_job_num_priorities;
+            while(priority > 0 && m_queued[priority - 1].empty()){
+                priority--;
+            }
+            if(priority == 0){
+                return;
+            }
+            priority--;
+            job = std::move(m_queued[priority].front());
+            m_queued[priority].pop_front();
+            m_running[priority]++;
+        }
+        run(static_cast<StatsJobPriority>(priority), job);
+    }
+}
+
+bool StatsJobQueue::runHigherJob(StatsJobPriority priority)
+{
+    QueuedJob job;
+    size_t level = stats_job_num_priorities;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while(level > static_cast<size_t>(priority) + 1 && m_queued[level - 1].empty()){
+            level--;
+        }
+        if(level == static_cast<size_t>(priority) + 1){
+            return false;
+        }
+        level--;
+        job = std::move(m_queued[level].front());
+        m_queued[level].pop_front();
+        m_running[level]++;
+    }
+    run(static_cast<StatsJobPriority>(level), job);
+    return true;
+}
+
+void StatsJobQueue::giveWay(StatsJobPriority priority)
+{
+    // jobs above only ever wait for jobs above them, so this cannot go round in a circle
+    for(;;){
+        while(runHigherJob(priority)){
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        bool running = false;
+        bool queued = false;
+        const auto look = [&](){
+            running = false;
+            queued = false;
+            for(size_t level=static_cast<size_t>(priority)+1; level<stats_job_num_priorities; level++){
+                running |= m_running[level] > 0;
+                queued |= !m_queued[level].empty();
+            }
+            return !running || queued;
+        };
+        m_changed.wait(lock, look);
+        if(!queued){
+            return;
+        }
+    }
+}
+
+void StatsJobQueue::run(StatsJobPriority priority, QueuedJob& job)
+{
+    job.run();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running[static_cast<size_t>(priority)]--;
+    }
+    m_changed.notify_all();
+    job.control->finish();
+}
@@ -0,0 +1,235 @@
+#ifndef STATSJOBS_H
+#define STATSJOBS_H
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <StatsContext.h>
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#define STATS_JOBS_COROUTINES 1
+#endif
+
+// chunks of a waiting job's loop that run between two looks at the queue.
+// Jobs of a lower priority give way to higher ones every wave
+constexpr size_t stats_job_chunks_per_wave = 4;
+
+enum class StatsJobPriority
+{
+    Batch,
+    Normal,
+    Interactive
+};
+constexpr size_t stats_job_num_priorities = 3;
+
+// what a job and its callers share: the cancellation flag, the chunk counts
+// behind the progress and who to wake when it is done
+class StatsJobControl
+{
+public:
+    // the job's loops skip their remaining chunks and the result is empty.
+    // A queued job never starts
+    void cancel(){
+        m_cancelled.store(true, std::memory_order_relaxed);
+    }
+    bool isCancelled() const{
+        return m_cancelled.load(std::memory_order_relaxed);
+    }
+    // chunks done out of the chunks of the loops the job started so far, so
+    // it only ever counts what the job reached. 1 once finished
+    double getProgress() const;
+    size_t getScheduledChunks() const{
+        return m_scheduled.load(std::memory_order_relaxed);
+    }
+    size_t getCompletedChunks() const{
+        return m_completed.load(std::memory_order_relaxed);
+    }
+    bool isFinished() const;
+    // continuation runs on the finishing thread, or not at all and false when
+    // the job already finished
+    bool setContinuation(std::function<void()> continuation);
+private:
+    friend class StatsJobExecutor;
+    friend class StatsJobQueue;
+    // before the result is set, so a caller that got the result sees it finished
+    void markFinished();
+    // after, wakes the continuation
+    void finish();
+    std::atomic<bool> m_cancelled{false};
+    std::atomic<size_t> m_scheduled{0};
+    std::atomic<size_t> m_completed{0};
+    mutable std::mutex m_mutex;
+    bool m_finished = false;
+    std::function<void()> m_continuation;
+};
+
+class StatsJobQueue;
+
+// the executor a job's loops see. Chunks go to the context's executor in
+// waves; between waves the job runs queued jobs of a higher priority and waits
+// for running ones, and once cancelled the rest of its chunks are skipped
+class StatsJobExecutor : public StatsExecutor
+{
+public:
+    StatsJobExecutor(StatsJobQueue& queue, StatsJobControl& control, StatsJobPriority priority, StatsExecutor& executor)
+        : m_queue(queue), m_control(control), m_priority(priority), m_executor(executor)
+    {
+    }
+    void parallelFor(size_t num_chunks, const ChunkFunction& fn) override;
+    void parallelForPlaced(size_t num_chunks, const ChunkFunction& fn, const ChunkHomeFunction& home) override;
+    size_t concurrency() const override{
+        return m_executor.concurrency();
+    }
+private:
+    void runWaves(size_t num_chunks, const ChunkFunction& fn, const ChunkHomeFunction* home);
+    StatsJobQueue& m_queue;
+    StatsJobControl& m_control;
+    StatsJobPriority m_priority;
+    StatsExecutor& m_executor;
+};
+
+// handle to a submitted job. Copies refer to the same job
+template<typename T>
+class StatsJob
+{
+public:
+    StatsJob(std::shared_future<std::optional<T> > future, std::shared_ptr<StatsJobControl> control)
+        : m_future(std::move(future)), m_control(std::move(control))
+    {
+    }
+    // blocks until the job finished. Empty when it was cancelled, rethrows
+    // what the job threw
+    const std::optional<T>& get() const{
+        return m_future.get();
+    }
+    void wait() const{
+        m_future.wait();
+    }
+    bool isReady() const{
+        return m_control->isFinished();
+    }
+    void cancel(){
+        m_control->cancel();
+    }
+    double getProgress() const{
+        return m_control->getProgress();
+    }
+    const std::shared_future<std::optional<T> >& getFuture() const{
+        return m_future;
+    }
+#ifdef STATS_JOBS_COROUTINES
+    // co_await job resumes the coroutine on the thread that finished the job
+    auto operator co_await() const{
+        struct Awaiter
+        {
+            const StatsJob* job;
+            bool await_ready() const{
+                return job->isReady();
+            }
+            bool await_suspend(std::coroutine_handle<> handle) const{
+                return job->m_control->setContinuation([handle](){
+                    handle.resume();
+                });
+            }
+            const std::optional<T>& await_resume() const{
+                return job->get();
+            }
+        };
+        return Awaiter{this};
+    }
+#endif
+private:
+    std::shared_future<std::optional<T> > m_future;
+    std::shared_ptr<StatsJobControl> m_control;
+};
+
+// runs stats jobs off the caller's thread. A job is fn(context) with a copy of
+// the submitted context whose executor is the job's, so the loops it constructs
+// report progress, see cancellation and give way to jobs of a higher priority.
+// Jobs start highest priority first, in submission order within a priority;
+// a runner busy with a lower priority job picks up a higher one at the next
+// wave of chunks, so small interactive requests are not stuck behind a batch.
+// Whatever fn reads must outlive the job. Destroying the queue cancels the
+// jobs not started yet and waits for the running ones
+class StatsJobQueue
+{
+public:
+    explicit StatsJobQueue(size_t num_runners = 2);
+    ~StatsJobQueue();
+    StatsJobQueue(const StatsJobQueue&) = delete;
+    StatsJobQueue& operator=(const StatsJobQueue&) = delete;
+    template<typename Fn>
+    StatsJob<std::invoke_result_t<Fn&, const StatsContext&> > submit(Fn fn, StatsJobPriority priority = StatsJobPriority::Normal,
+                                                                     const StatsContext& context = defaultStatsContext());
+private:
+    friend class StatsJobExecutor;
+    struct QueuedJob
+    {
+        std::function<void()> run;
+        std::shared_ptr<StatsJobControl> control;
+    };
+    void push(StatsJobPriority priority, QueuedJob job);
+    void runnerLoop();
+    // pops and runs a queued job above priority, false when there is none
+    bool runHigherJob(StatsJobPriority priority);
+    // runs queued jobs above priority and waits for running ones
+    void giveWay(StatsJobPriority priority);
+    void run(StatsJobPriority priority, QueuedJob& job);
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::array<std::deque<QueuedJob>, stats_job_num_priorities> m_queued;
+    std::array<size_t, stats_job_num_priorities> m_running = {};
+    bool m_stop = false;
+    std::vector<std::thread> m_runners;
+};
+
+template<typename Fn>
+StatsJob<std::invoke_result_t<Fn&, const StatsContext&> > StatsJobQueue::submit(Fn fn, StatsJobPriority priority,
+                                                                               const StatsContext& context)
+{
+    using T = std::invoke_result_t<Fn&, const StatsContext&>;
+    auto control = std::make_shared<StatsJobControl>();
+    auto promise = std::make_shared<std::promise<std::optional<T> > >();
+    std::shared_future<std::optional<T> > future = promise->get_future().share();
+    QueuedJob job;
+    job.control = control;
+    job.run = [this, fn = std::move(fn), promise, control, priority, context]() mutable{
+        if(control->isCancelled()){
+            control->markFinished();
+            promise->set_value(std::nullopt);
+            return;
+        }
+        StatsJobExecutor executor(*this, *control, priority, context.getExecutor());
+        StatsContext job_context = context;
+        job_context.executor = &executor;
+        std::optional<T> result;
+        try{
+            result.emplace(fn(job_context));
+        }
+        catch(...){
+            // get() rethrows it, the runner and the other jobs carry on
+            control->markFinished();
+            promise->set_exception(std::current_exception());
+            return;
+        }
+        // cut short, whatever fn returned is not the statistics
+        if(control->isCancelled()){
+            result.reset();
+        }
+        control->markFinished();
+        promise->set_value(std::move(result));
+    };
+    push(priority, std::move(job));
+    return StatsJob<T>(std::move(future), std::move(control));
+}
+
+#endif // STATSJOBS_H
@@ -0,0 +1,164 @@
+#include <StatsJobs.h>
+#include <BasicStats.h>
+#include <future>
+#include <stdexcept>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<float> makeSeries(size_t count)
+{
+    std::vector<float> values(count);
+    for(size_t i=0; i<count; i++){
+        values[i] = 1.f + static_cast<float>(i % 7) * 0.001f;
+    }
+    return values;
+}
+
+#ifdef STATS_JOBS_COROUTINES
+// starts straight away and runs to its end without anyone resuming it
+struct DetachedCoroutine
+{
+    struct promise_type
+    {
+        DetachedCoroutine get_return_object(){
+            return {};
+        }
+        std::suspend_never initial_suspend(){
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept{
+            return {};
+        }
+        void return_void(){
+        }
+        void unhandled_exception(){
+        }
+    };
+};
+
+DetachedCoroutine sumWhenDone(StatsJob<float> job, std::promise<float>& sum)
+{
+    const std::optional<float>& result = co_await job;
+    sum.set_value(result ? *result : 0.f);
+}
+#endif
+
+}
+
+TEST(StatsJobs, ResultMatchesBlockingCall)
+{
+    ThreadPoolExecutor pool(3);
+    StatsContext context = parallelContext(pool);
+    const std::vector<float> values = makeSeries(200000);
+    const DoesTheStats<> blocking(values, {-9999.f}, context);
+
+    StatsJobQueue queue;
+    StatsJob<float> job = queue.submit([&](const StatsContext& job_context){
+        return DoesTheStats<>(values, {-9999.f}, job_context).getSum();
+    }, StatsJobPriority::Normal, context);
+    ASSERT_TRUE(job.get().has_value());
+    EXPECT_EQ(*job.get(), blocking.getSum());
+    EXPECT_TRUE(job.isReady());
+    EXPECT_EQ(job.getProgress(), 1.0);
+
+#ifdef STATS_JOBS_COROUTINES
+    std::promise<float> awaited;
+    sumWhenDone(queue.submit([&](const StatsContext& job_context){
+        return DoesTheStats<>(values, {-9999.f}, job_context).getSum();
+    }, StatsJobPriority::Normal, context), awaited);
+    EXPECT_EQ(awaited.get_future().get(), blocking.getSum());
+#endif
+}
+
+TEST(StatsJobs, CancelledJobsStopAndComeBackEmpty)
+{
+    SerialExecutor serial;
+    StatsContext context;
+    context.executor = &serial;
+    StatsJobQueue queue(1);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<StatsJob<size_t>*> self(nullptr);
+    StatsJob<size_t> running = queue.submit([&](const StatsContext& job_context){
+        released.wait();
+        size_t chunks_run = 0;
+        runChunked(job_context.getExecutor(), 1000, 1, [&](size_t chunk, size_t, size_t, size_t){
+            chunks_run++;
+            if(chunk == 10){
+                self.load()->cancel();
+            }
+        });
+        return chunks_run;
+    }, StatsJobPriority::Batch, context);
+    self = &running;
+    // behind the first one on the only runner, cancelled before it starts
+    bool started = false;
+    StatsJob<int> queued = queue.submit([&](const StatsContext&){
+        started = true;
+        return 1;
+    }, StatsJobPriority::Batch, context);
+    queued.cancel();
+    release.set_value();
+
+    EXPECT_FALSE(running.get().has_value());
+    EXPECT_FALSE(queued.get().has_value());
+    EXPECT_FALSE(started);
+    EXPECT_EQ(running.getProgress(), 1.0);
+}
+
+TEST(StatsJobs, ThrowingJobsRethrowFromGet)
+{
+    SerialExecutor serial;
+    StatsContext context;
+    context.executor = &serial;
+    StatsJobQueue queue(1);
+    StatsJob<float> failed = queue.submit([](const StatsContext&) -> float{
+        throw std::runtime_error("bad raster");
+    }, StatsJobPriority::Normal, context);
+    EXPECT_THROW(failed.get(), std::runtime_error);
+    EXPECT_TRUE(failed.isReady());
+
+    // the runner is still there for the next job
+    const std::vector<float> values = makeSeries(1000);
+    StatsJob<float> next = queue.submit([&](const StatsContext& job_context){
+        return DoesTheStats<>(values, {}, job_context).getSum();
+    }, StatsJobPriority::Normal, context);
+    ASSERT_TRUE(next.get().has_value());
+    EXPECT_EQ(*next.get(), DoesTheStats<>(values, {}, context).getSum());
+}
+
+TEST(StatsJobs, InteractiveJobsOvertakeBatchJobs)
+{
+    SerialExecutor serial;
+    StatsContext context;
+    context.executor = &serial;
+    StatsJobQueue queue(1);
+    const size_t num_chunks = 1000;
+    std::promise<void> batch_started;
+    std::promise<void> submitted;
+    std::shared_future<void> was_submitted = submitted.get_future().share();
+    std::atomic<size_t> batch_chunks(0);
+    StatsJob<size_t> batch = queue.submit([&](const StatsContext& job_context){
+        runChunked(job_context.getExecutor(), num_chunks, 1, [&](size_t chunk, size_t, size_t, size_t){
+            if(chunk == 0){
+                batch_started.set_value();
+                was_submitted.wait();
+            }
+            batch_chunks++;
+        });
+        return batch_chunks.load();
+    }, StatsJobPriority::Batch, context);
+    batch_started.get_future().wait();
+    // the only runner is busy with the batch job, which lets this one in at its next wave
+    StatsJob<size_t> interactive = queue.submit([&](const StatsContext&){
+        return batch_chunks.load();
+    }, StatsJobPriority::Interactive, context);
+    submitted.set_value();
+
+    ASSERT_TRUE(interactive.get().has_value());
+    EXPECT_EQ(*interactive.get(), stats_job_chunks_per_wave * serial.concurrency());
+    ASSERT_TRUE(batch.get().has_value());
+    EXPECT_EQ(*batch.get(), num_chunks);
+}
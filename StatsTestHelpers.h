@@ -0,0 +1,31 @@
+#ifndef STATSTESTHELPERS_H
+#define STATSTESTHELPERS_H
+#include <vector>
+#include <StatsContext.h>
+
+// shared by the test files, not part of the library
+
+// (i * 7919) % period * scale + offset. 7919 is prime, so the values do not
+// line up with block, chunk or tile sizes
+inline std::vector<float> patternSeries(size_t count, size_t period, float scale = 1.f, float offset = 0.f)
+{
+    std::vector<float> values(count);
+    for(size_t i=0; i<count; i++){
+        values[i] = offset + static_cast<float>((i * 7919) % period) * scale;
+    }
+    return values;
+}
+
+// every loop parallel on executor whatever its size, so small test inputs
+// still cross chunk seams
+inline StatsContext parallelContext(StatsExecutor& executor, StatsAllocator* allocator = nullptr)
+{
+    StatsContext context;
+    context.executor = &executor;
+    context.allocator = allocator;
+    context.tuning.forced_mode = ExecutionMode::Parallel;
+    context.tuning.min_grain_work = 0;
+    return context;
+}
+
+#endif // STATSTESTHELPERS_H
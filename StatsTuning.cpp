@@ -0,0 +1,219 @@
+#include "StatsTuning.h"
+#include "StatsContext.h"
+#include "BasicStats.h"
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+// elements in the calibration probe, big enough to time but stays in L2
+constexpr size_t calibration_elements = 1 << 15;
+// a parallel region should cost at most 1/parallel_overhead_factor of the work it splits
+constexpr double parallel_overhead_factor = 4.0;
+
+template<typename Fn>
+double bestSeconds(int repetitions, Fn&& fn)
+{
+    double best = 1e30;
+    for(int r=0; r<repetitions; r++){
+        const auto begin = std::chrono::steady_clock::now();
+        fn();
+        const auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(end - begin).count());
+    }
+    return best;
+}
+
+double secondsPerElement(ExecutionMode mode, const std::vector<float>& probe)
+{
+    SerialExecutor serial;
+    StatsContext context;
+    context.tuning.forced_mode = mode;
+    context.executor = &serial;
+    volatile float sink = 0.f;
+    const double seconds = bestSeconds(5, [&](){
+        BasicStatsLoop loop(context, probe, {}, {0.f}, PlusReducer());
+        sink = loop.getResult<0>();
+    });
+    (void)sink;
+    return seconds / static_cast<double>(probe.size());
+}
+
+const char* scheduleName(ChunkSchedule schedule)
+{
+    switch(schedule){
+    case ChunkSchedule::Static: return "static";
+    case ChunkSchedule::Dynamic: return "dynamic";
+    case ChunkSchedule::Guided: return "guided";
+    }
+    return "";
+}
+
+// a non negative number and nothing but blanks after it. field keeps its value
+// otherwise, so a typo cannot turn a threshold into 0
+bool readSize(std::istringstream& value, size_t& field)
+{
+    value >> std::ws;
+    if(!std::isdigit(static_cast<unsigned char>(value.peek()))){
+        return false;
+    }
+    size_t read = 0;
+    if(!(value >> read) || !(value >> std::ws).eof()){
+        return false;
+    }
+    field = read;
+    return true;
+}
+
+size_t roundUpToBlock(size_t elements)
+{
+    const size_t blocks = std::max<size_t>((elements + basic_stats_block_size - 1) / basic_stats_block_size, 1);
+    return blocks * basic_stats_block_size;
+}
+
+}
+
+ExecutionPlan StatsTuning::plan(size_t num_elements, size_t reducer_cost, size_t concurrency) const
+{
+    ExecutionPlan plan;
+    const size_t cost = std::max<size_t>(reducer_cost, 1);
+    const size_t work = num_elements * cost;
+    const size_t max_threads = std::max<size_t>(concurrency, 1);
+    if(forced_mode){
+        plan.mode = *forced_mode;
+    }
+    else if(work < simd_work_threshold){
+        plan.mode = ExecutionMode::Serial;
+    }
+    else if(work < parallel_work_threshold || max_threads < 2){
+        plan.mode = ExecutionMode::SimdOnly;
+    }
+    else{
+        plan.mode = ExecutionMode::Parallel;
+    }
+    if(plan.mode != ExecutionMode::Parallel){
+        return plan;
+    }
+    // enough chunks per thread to balance, but never less work than a grain
+    plan.schedule = schedule;
+    const size_t grain = min_grain_work / cost;
+    size_t chunk_size = 0;
+    switch(plan.schedule){
+    case ChunkSchedule::Static:
+        chunk_size = std::max((num_elements + max_threads - 1) / max_threads, grain);
+        break;
+    case ChunkSchedule::Dynamic:
+        chunk_size = std::max(num_elements / (max_threads * std::max<size_t>(chunks_per_thread, 1)), grain);
+        break;
+    case ChunkSchedule::Guided:
+        // ChunkLayout grows the first chunks from here
+        chunk_size = grain;
+        break;
+    }
+    plan.chunk_size = roundUpToBlock(chunk_size);
+    const size_t num_chunks = (num_elements + plan.chunk_size - 1) / plan.chunk_size;
+    plan.num_threads = static_cast<int>(std::clamp<size_t>(num_chunks, 1, max_threads));
+    return plan;
+}
+
+bool StatsTuning::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if(!file){
+        return false;
+    }
+    bool well_formed = true;
+    std::string line;
+    while(std::getline(file, line)){
+        const size_t equals = line.find('=');
+        if(line.empty() || line[0] == '#' || equals == std::string::npos){
+            continue;
+        }
+        const std::string key = line.substr(0, equals);
+        std::istringstream value(line.substr(equals + 1));
+        if(key == "simd_work_threshold"){
+            well_formed &= readSize(value, simd_work_threshold);
+        }
+        else if(key == "parallel_work_threshold"){
+            well_formed &= readSize(value, parallel_work_threshold);
+        }
+        else if(key == "min_grain_work"){
+            well_formed &= readSize(value, min_grain_work);
+        }
+        else if(key == "chunks_per_thread"){
+            size_t chunks = chunks_per_thread;
+            well_formed &= readSize(value, chunks);
+            chunks_per_thread = chunks;
+        }
+        else if(key == "prefetch_distance"){
+            well_formed &= readSize(value, prefetch_distance);
+        }
+        else if(key == "schedule"){
+            // whitespace and a \r from a file saved on Windows are not part of it
+            std::string name;
+            value >> name;
+            bool known = false;
+            for(ChunkSchedule candidate : {ChunkSchedule::Static, ChunkSchedule::Dynamic, ChunkSchedule::Guided}){
+                if(name == scheduleName(candidate)){
+                    schedule = candidate;
+                    known = true;
+                }
+            }
+            well_formed &= known;
+        }
+    }
+    return well_formed;
+}
+
+bool StatsTuning::save(const std::string& path) const
+{
+    std::ofstream file(path);
+    if(!file){
+        return false;
+    }
+    file << "# BasicStats tuning, see StatsTuning.h\n";
+    file << "simd_work_threshold=" << simd_work_threshold << "\n";
+    file << "parallel_work_threshold=" << parallel_work_threshold << "\n";
+    file << "min_grain_work=" << min_grain_work << "\n";
+    file << "chunks_per_thread=" << chunks_per_thread << "\n";
+    file << "prefetch_distance=" << prefetch_distance << "\n";
+    file << "schedule=" << scheduleName(schedule) << "\n";
+    return static_cast<bool>(file);
+}
+
+StatsTuning StatsTuning::calibrate(StatsExecutor& executor)
+{
+    StatsTuning tuning;
+    std::vector<float> probe(calibration_elements, 1.f);
+
+    // scalar against blocked on growing tiny inputs, the first size where
+    // blocks win is where classification setup has paid for itself
+    tuning.simd_work_threshold = basic_stats_block_size;
+    for(size_t size=16; size<=basic_stats_block_size; size*=2){
+        const std::vector<float> tiny(probe.begin(), probe.begin() + size);
+        if(secondsPerElement(ExecutionMode::SimdOnly, tiny) < secondsPerElement(ExecutionMode::Serial, tiny)){
+            tuning.simd_work_threshold = size;
+            break;
+        }
+    }
+
+    const size_t max_threads = executor.concurrency();
+    if(max_threads < 2){
+        return tuning;
+    }
+    const double per_element = secondsPerElement(ExecutionMode::SimdOnly, probe);
+    const double fork_join = bestSeconds(20, [&](){
+        executor.parallelFor(max_threads, [](size_t, size_t){});
+    });
+    // threads save (1 - 1/threads) of the work, which must outweigh the
+    // region several times over
+    const double saved_fraction = 1.0 - 1.0 / static_cast<double>(max_threads);
+    const double threshold = parallel_overhead_factor * fork_join / (per_element * saved_fraction);
+    tuning.parallel_work_threshold = std::clamp<size_t>(static_cast<size_t>(threshold), 4096, size_t(1) << 24);
+    tuning.min_grain_work = std::clamp<size_t>(tuning.parallel_work_threshold / 4, 4096, size_t(1) << 20);
+    return tuning;
+}
@@ -0,0 +1,107 @@
+#ifndef STATSTUNING_H
+#define STATSTUNING_H
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <optional>
+
+class StatsExecutor;
+
+// elements classified together by the vectorized paths. Chunks are rounded to it
+constexpr size_t basic_stats_block_size = 1024;
+
+// how a stats loop runs over its input
+enum class ExecutionMode
+{
+    Serial,     // one thread, one element at a time. Lowest latency for tiny inputs
+    SimdOnly,   // one thread, vectorized block classification
+    Parallel    // vectorized blocks split into chunks across threads
+};
+
+// how a parallel loop is cut into chunks. Executors hand a chunk to whichever
+// thread is free next, so smaller chunks even out uneven work (no data heavy
+// regions, a busy core) at the cost of more claims and merges
+enum class ChunkSchedule
+{
+    Static,     // one chunk per thread
+    Dynamic,    // chunks_per_thread equal chunks per thread
+    Guided      // large chunks first, shrinking to a grain so the tail balances
+};
+
+// a field one thread may change while loops on other threads read it, as
+// ScheduleBalancer does on a shared context. Copies take the current value
+template<typename T>
+class RelaxedAtomic
+{
+public:
+    RelaxedAtomic(T value = T()) : m_value(value) {}
+    RelaxedAtomic(const RelaxedAtomic& other) : m_value(other.load()) {}
+    RelaxedAtomic& operator=(const RelaxedAtomic& other){
+        store(other.load());
+        return *this;
+    }
+    RelaxedAtomic& operator=(T value){
+        store(value);
+        return *this;
+    }
+    operator T() const{
+        return load();
+    }
+    T load() const{
+        return m_value.load(std::memory_order_relaxed);
+    }
+    void store(T value){
+        m_value.store(value, std::memory_order_relaxed);
+    }
+private:
+    std::atomic<T> m_value;
+};
+
+struct ExecutionPlan
+{
+    ExecutionMode mode = ExecutionMode::Serial;
+    ChunkSchedule schedule = ChunkSchedule::Dynamic;
+    // elements per chunk handed to a thread, only used when Parallel. The
+    // smallest chunk when Guided
+    size_t chunk_size = 0;
+    int num_threads = 1;
+};
+
+// thresholds that pick an ExecutionPlan from the size of the work. Work is
+// measured as elements times reducer cost, the cost being the number of
+// reducers run per element. The defaults are conservative, calibrate()
+// measures them on the running machine.
+struct StatsTuning
+{
+    // below this much work a plain scalar loop beats setting up blocks
+    size_t simd_work_threshold = 256;
+    // below this much work fork/join costs more than the threads save
+    size_t parallel_work_threshold = 1 << 16;
+    // smallest amount of work worth handing to a thread as one chunk
+    size_t min_grain_work = 1 << 14;
+    // chunks per thread, more balances uneven chunks better
+    RelaxedAtomic<size_t> chunks_per_thread = 4;
+    // ScheduleBalancer adjusts this and chunks_per_thread from loop telemetry,
+    // while other loops may be planning with them
+    RelaxedAtomic<ChunkSchedule> schedule = ChunkSchedule::Dynamic;
+    // elements ahead of the block being reduced that are software prefetched,
+    // 0 turns it off. Off by default as hardware prefetchers usually keep up
+    // with one sequential stream. Try a few blocks ahead on machines where the
+    // benchmark shows bandwidth dropping as lambdas are added
+    size_t prefetch_distance = 0;
+    // skips the thresholds, used by benchmarks and calibration
+    std::optional<ExecutionMode> forced_mode;
+
+    // concurrency is how many chunks the executor can run at once
+    ExecutionPlan plan(size_t num_elements, size_t reducer_cost, size_t concurrency) const;
+    // reads/writes "key=value" lines, unknown keys are ignored. load is false
+    // when the file cannot be read or a value is malformed; a malformed value
+    // keeps its previous setting and the other lines are still read
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+    // times an empty parallelFor on executor against the per element cost of
+    // the loop to place the thresholds. Takes a few milliseconds
+    static StatsTuning calibrate(StatsExecutor& executor);
+};
+
+#endif // STATSTUNING_H
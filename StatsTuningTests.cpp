@@ -0,0 +1,167 @@
+#include <BasicStats.h>
+#include <StatsTuning.h>
+#include <numeric>
+#include <limits>
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+
+TEST(StatsTuning, PlanFollowsThresholds)
+{
+    StatsTuning tuning;
+    tuning.simd_work_threshold = 100;
+    tuning.parallel_work_threshold = 10000;
+    tuning.min_grain_work = 4096;
+
+    EXPECT_EQ(tuning.plan(6, 3, 8).mode, ExecutionMode::Serial);
+    EXPECT_EQ(tuning.plan(1000, 3, 8).mode, ExecutionMode::SimdOnly);
+    // reducer cost moves the cut off, the same size with more reducers is more work
+    EXPECT_EQ(tuning.plan(40, 1, 8).mode, ExecutionMode::Serial);
+    EXPECT_EQ(tuning.plan(40, 3, 8).mode, ExecutionMode::SimdOnly);
+
+    const ExecutionPlan big = tuning.plan(10000000, 3, 8);
+    EXPECT_EQ(big.mode, ExecutionMode::Parallel);
+    EXPECT_EQ(big.chunk_size % basic_stats_block_size, 0u);
+    EXPECT_GE(big.chunk_size * 3, tuning.min_grain_work);
+    EXPECT_EQ(big.num_threads, 8);
+    // a single thread never goes parallel on its own
+    EXPECT_EQ(tuning.plan(10000000, 3, 1).mode, ExecutionMode::SimdOnly);
+
+    tuning.forced_mode = ExecutionMode::Parallel;
+    const ExecutionPlan forced = tuning.plan(6, 3, 8);
+    EXPECT_EQ(forced.mode, ExecutionMode::Parallel);
+    EXPECT_EQ(forced.num_threads, 1);
+}
+
+TEST(StatsTuning, SaveAndLoad)
+{
+    StatsTuning tuning;
+    tuning.simd_work_threshold = 123;
+    tuning.parallel_work_threshold = 45678;
+    tuning.min_grain_work = 9999;
+    tuning.chunks_per_thread = 7;
+    tuning.prefetch_distance = 4096;
+    tuning.schedule = ChunkSchedule::Guided;
+    const std::string path = testing::TempDir() + "basicstats_tuning.txt";
+    ASSERT_TRUE(tuning.save(path));
+
+    StatsTuning loaded;
+    ASSERT_TRUE(loaded.load(path));
+    EXPECT_EQ(loaded.simd_work_threshold, 123u);
+    EXPECT_EQ(loaded.parallel_work_threshold, 45678u);
+    EXPECT_EQ(loaded.min_grain_work, 9999u);
+    EXPECT_EQ(loaded.chunks_per_thread, 7u);
+    EXPECT_EQ(loaded.prefetch_distance, 4096u);
+    EXPECT_EQ(loaded.schedule, ChunkSchedule::Guided);
+    std::remove(path.c_str());
+
+    EXPECT_FALSE(loaded.load(path));
+
+    // hand edited, with trailing blanks and Windows line ends
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "schedule=static \r\nchunks_per_thread=5\r\n";
+    }
+    ASSERT_TRUE(loaded.load(path));
+    EXPECT_EQ(loaded.schedule, ChunkSchedule::Static);
+    EXPECT_EQ(loaded.chunks_per_thread, 5u);
+
+    // malformed values keep their setting, the other lines still load
+    {
+        std::ofstream file(path);
+        file << "parallel_work_threshold=lots\nmin_grain_work=-1\nsimd_work_threshold=12x\nschedule=fastest\nchunks_per_thread=6\n";
+    }
+    EXPECT_FALSE(loaded.load(path));
+    EXPECT_EQ(loaded.parallel_work_threshold, 45678u);
+    EXPECT_EQ(loaded.min_grain_work, 9999u);
+    EXPECT_EQ(loaded.simd_work_threshold, 123u);
+    EXPECT_EQ(loaded.schedule, ChunkSchedule::Static);
+    EXPECT_EQ(loaded.chunks_per_thread, 6u);
+    std::remove(path.c_str());
+}
+
+// every execution mode gives the same answers
+TEST(StatsTuning, ModesAgree)
+{
+    std::vector<float> values(50000);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = static_cast<float>(i % 7);
+    }
+    float negative = -1.f;
+    values[12345] = std::sqrt(negative);
+    const std::vector<float> ndvs = {3.f};
+    for(ExecutionMode mode : {ExecutionMode::Serial, ExecutionMode::SimdOnly, ExecutionMode::Parallel}){
+        StatsContext context;
+        context.tuning.forced_mode = mode;
+        DoesTheStats stats(values, ndvs, context);
+        float expected_sum = 0.f;
+        for(size_t i=0; i<values.size(); i++){
+            if(std::isfinite(values[i]) && values[i] != 3.f){
+                expected_sum += values[i];
+            }
+        }
+        EXPECT_EQ(stats.getSum(), expected_sum);
+        EXPECT_FALSE(stats.isGood());
+        EXPECT_EQ(stats.getDifferences()[8], values[9] - values[8]);
+    }
+}
+
+// ten lambdas over the same blocks, with and without prefetching, give the
+// per element answers
+TEST(StatsTuning, ManyReducersAgree)
+{
+    std::vector<float> values(40000);
+    for(size_t i=0; i<values.size(); i++){
+        values[i] = static_cast<float>(i % 11) - 5.f;
+    }
+    values[777] = -9999.f;
+    values[20001] = std::numeric_limits<float>::infinity();
+    auto plus = [](std::optional<size_t>, float value, float& total)->void{
+        total += value;
+    };
+    auto squares = [](std::optional<size_t> index, float value, float& total)->void{
+        total += index ? value * value : value;
+    };
+    auto count = [](std::optional<size_t> index, float value, float& total)->void{
+        total += index ? 1.f : value;
+    };
+    auto min = [](std::optional<size_t>, float value, float& total)->void{
+        total = std::min(total, value);
+    };
+    auto max = [](std::optional<size_t>, float value, float& total)->void{
+        total = std::max(total, value);
+    };
+    float expected_sum = 0.f;
+    for(size_t i=0; i<values.size(); i++){
+        expected_sum += i == 777 || i == 20001 ? 0.f : values[i];
+    }
+    const float inf = std::numeric_limits<float>::infinity();
+    for(ExecutionMode mode : {ExecutionMode::Serial, ExecutionMode::SimdOnly, ExecutionMode::Parallel}){
+        for(size_t prefetch_distance : {size_t(0), size_t(2048), size_t(100000)}){
+            StatsContext context;
+            context.tuning.forced_mode = mode;
+            context.tuning.prefetch_distance = prefetch_distance;
+            BasicStatsLoop loop(context, values, {-9999.f}, {0.f, 0.f, 0.f, inf, -inf, 0.f, 0.f, 0.f, inf, -inf},
+                                plus, squares, count, min, max, plus, squares, count, min, max);
+            EXPECT_EQ(loop.getResult<0>(), expected_sum);
+            EXPECT_EQ(loop.getResult<0>(), loop.getResult<5>());
+            EXPECT_EQ(loop.getResult<2>(), static_cast<float>(values.size() - 2));
+            EXPECT_EQ(loop.getResult<3>(), -5.f);
+            EXPECT_EQ(loop.getResult<4>(), 5.f);
+            EXPECT_EQ(loop.getResult<9>(), 5.f);
+            EXPECT_FALSE(loop.isGood());
+        }
+    }
+}
+
+// the naive test series is too small to be worth a parallel region
+TEST(StatsTuning, TinySeriesStaysSerial)
+{
+    const std::vector<float> values = {0,1,2,3,4,5};
+    auto plus = [](std::optional<size_t>, float value, float& total)->void{
+        total += value;
+    };
+    BasicStatsLoop loop(values, {}, {0.f}, plus);
+    EXPECT_NE(loop.getExecutionPlan().mode, ExecutionMode::Parallel);
+    EXPECT_EQ(loop.getResult<0>(), 15.f);
+}
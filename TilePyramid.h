@@ -0,0 +1,317 @@
+#ifndef TILEPYRAMID_H
+#define TILEPYRAMID_H
+#include <vector>
+#include <string>
+#include <fstream>
+#include <functional>
+#include <typeinfo>
+#include <algorithm>
+#include <cstdint>
+#include <StatsExpression.h>
+#include <StatsCache.h>
+
+// first bytes of a saved pyramid
+constexpr uint32_t tile_pyramid_file_magic = 0x44595054; // "TPYD"
+constexpr uint32_t tile_pyramid_file_version = 1;
+
+// per tile statistics of a row major raster at every zoom level. The finest
+// level cuts the raster into tile_size x tile_size tiles (smaller at the right
+// and bottom edges) reduced straight from the cells; each coarser level is
+// derived purely by merging the up to four children of every tile, so the
+// raster is read once however many levels there are. Level 0 is a single tile
+// over the whole raster, tile (x, y) of level l + 1 has the parent (x / 2, y / 2)
+// on level l. Tiles of a level are reduced in parallel.
+//
+// save() writes a compact binary index: a header, the tile counts of every
+// level, then one fixed size record per tile in (level, y, x) order, so a tile
+// can be read on its own with readTile() by seeking to its record.
+template<typename... Reducers>
+class TilePyramid
+{
+public:
+    using Tile = StatsSummary<Reducers...>;
+private:
+    struct Level
+    {
+        uint64_t tiles_x = 0;
+        uint64_t tiles_y = 0;
+        // index of the level's first tile in m_tiles
+        uint64_t offset = 0;
+    };
+    size_t m_width = 0;
+    size_t m_height = 0;
+    size_t m_tile_size = 0;
+    uint64_t m_signature = 0;
+    std::vector<Level> m_levels;
+    std::vector<Tile> m_tiles;
+    bool m_layout_ok = true;
+    uint64_t layoutLevels();
+    void build(const StatsContext& context, const std::vector<float>& raster, const NoDataClassifier& classifier);
+    static uint64_t signature(const std::vector<float>& ndvs);
+    static constexpr size_t header_size = sizeof(uint32_t) * 2 + sizeof(uint64_t) * 6;
+public:
+    TilePyramid(const StatsContext& context, const std::vector<float>& raster, size_t width, size_t height,
+                size_t tile_size, const std::vector<float>& ndvs, ReducerSet<Reducers...> reducers = {});
+    TilePyramid(const std::vector<float>& raster, size_t width, size_t height, size_t tile_size,
+                const std::vector<float>& ndvs, ReducerSet<Reducers...> reducers = {})
+        : TilePyramid(defaultStatsContext(), raster, width, height, tile_size, ndvs, reducers)
+    {
+    }
+    // reads a pyramid written by save() with the same reducers and no data
+    // values, isLayoutValid() is false when the file holds anything else
+    TilePyramid(const std::string& path, const std::vector<float>& ndvs, ReducerSet<Reducers...> reducers = {});
+    bool save(const std::string& path) const;
+    // reads the one record of tile (level, x, y) from a saved pyramid, false
+    // when the file does not hold that tile for these reducers and no data values
+    static bool readTile(const std::string& path, const std::vector<float>& ndvs, size_t level, size_t x, size_t y, Tile& tile);
+    size_t getNumLevels() const{
+        return m_levels.size();
+    }
+    size_t getTilesX(size_t level) const{
+        return level < m_levels.size() ? m_levels[level].tiles_x : 0;
+    }
+    size_t getTilesY(size_t level) const{
+        return level < m_levels.size() ? m_levels[level].tiles_y : 0;
+    }
+    // nullptr outside the level
+    const Tile* getTile(size_t level, size_t x, size_t y) const{
+        if(level >= m_levels.size() || x >= m_levels[level].tiles_x || y >= m_levels[level].tiles_y){
+            return nullptr;
+        }
+        return &m_tiles[m_levels[level].offset + y * m_levels[level].tiles_x + x];
+    }
+    size_t getTileSize() const{
+        return m_tile_size;
+    }
+    // false when the raster does not hold width * height cells, for a tile
+    // size of 0 or for a file that could not be read
+    bool isLayoutValid() const{
+        return m_layout_ok;
+    }
+};
+
+template<typename... Reducers>
+TilePyramid<Reducers...>::TilePyramid(const StatsContext& context, const std::vector<float>& raster, size_t width, size_t height,
+                                      size_t tile_size, const std::vector<float>& ndvs, ReducerSet<Reducers...>)
+    : m_width(width), m_height(height), m_tile_size(tile_size), m_signature(signature(ndvs))
+{
+    if(tile_size == 0 || raster.size() != width * height){
+        m_layout_ok = false;
+        return;
+    }
+    m_tiles.assign(layoutLevels(), Tile());
+    build(context, raster, NoDataClassifier(ndvs));
+}
+
+// fills the level table and returns the number of tiles, m_tiles is left to the caller
+template<typename... Reducers>
+uint64_t TilePyramid<Reducers...>::layoutLevels()
+{
+    m_levels.clear();
+    Level level;
+    level.tiles_x = m_width / m_tile_size + (m_width % m_tile_size != 0 ? 1 : 0);
+    level.tiles_y = m_height / m_tile_size + (m_height % m_tile_size != 0 ? 1 : 0);
+    if(level.tiles_x == 0 || level.tiles_y == 0){
+        return 0;
+    }
+    // finest first, then halved up to the single tile
+    m_levels.push_back(level);
+    while(level.tiles_x > 1 || level.tiles_y > 1){
+        level.tiles_x = (level.tiles_x + 1) / 2;
+        level.tiles_y = (level.tiles_y + 1) / 2;
+        m_levels.push_back(level);
+    }
+    std::reverse(m_levels.begin(), m_levels.end());
+    uint64_t offset = 0;
+    for(Level& each : m_levels){
+        each.offset = offset;
+        offset += each.tiles_x * each.tiles_y;
+    }
+    return offset;
+}
+
+template<typename... Reducers>
+void TilePyramid<Reducers...>::build(const StatsContext& context, const std::vector<float>& raster, const NoDataClassifier& classifier)
+{
+    if(m_levels.empty()){
+        return;
+    }
+    StatsExecutor& executor = context.getExecutor();
+    constexpr size_t num_features = std::tuple_size_v<typename ExpressionStatsLoop<Reducers...>::Features>;
+    const Level& finest = m_levels.back();
+    // the finest level from the cells, a chunk is a run of tile rows
+    {
+        const ExecutionPlan plan = context.tuning.plan(raster.size(), num_features, executor.concurrency());
+        const size_t cells_per_tile_row = m_width * m_tile_size;
+        const size_t rows_per_chunk = plan.mode == ExecutionMode::Parallel
+                ? std::max<size_t>(plan.chunk_size / cells_per_tile_row, 1) : finest.tiles_y;
+        const ChunkLayout layout(finest.tiles_y, rows_per_chunk, plan.schedule, plan.num_threads);
+        LoopTelemetryRecorder telemetry(context.telemetry_callback, plan, cells_per_tile_row);
+        runChunked(executor, layout, [&](size_t, size_t first_row, size_t end_row, size_t){
+            for(size_t y=first_row; y<end_row; y++){
+                const size_t row_end = std::min((y + 1) * m_tile_size, m_height);
+                for(size_t x=0; x<finest.tiles_x; x++){
+                    Tile& tile = m_tiles[finest.offset + y * finest.tiles_x + x];
+                    const size_t column = x * m_tile_size;
+                    const size_t columns = std::min(m_tile_size, m_width - column);
+                    for(size_t row=y*m_tile_size; row<row_end; row++){
+                        tile.accumulate(classifier, raster.data() + row * m_width + column, columns);
+                    }
+                }
+            }
+        }, raster.data(), cells_per_tile_row * sizeof(float), telemetry.get());
+        telemetry.startMerge();
+        telemetry.publish();
+    }
+    // every coarser level from the one below, children merged in row major order
+    for(size_t l=m_levels.size()-1; l-->0;){
+        const Level& parent = m_levels[l];
+        const Level& child = m_levels[l + 1];
+        const ExecutionPlan plan = context.tuning.plan(4 * parent.tiles_x * parent.tiles_y, num_features, executor.concurrency());
+        const size_t rows_per_chunk = plan.mode == ExecutionMode::Parallel
+                ? std::max<size_t>(plan.chunk_size / (4 * parent.tiles_x), 1) : parent.tiles_y;
+        const ChunkLayout layout(parent.tiles_y, rows_per_chunk, plan.schedule, plan.num_threads);
+        runChunked(executor, layout, [&](size_t, size_t first_row, size_t end_row, size_t){
+            for(size_t y=first_row; y<end_row; y++){
+                for(size_t x=0; x<parent.tiles_x; x++){
+                    Tile& tile = m_tiles[parent.offset + y * parent.tiles_x + x];
+                    for(size_t child_y=2*y; child_y<std::min<size_t>(2 * y + 2, child.tiles_y); child_y++){
+                        for(size_t child_x=2*x; child_x<std::min<size_t>(2 * x + 2, child.tiles_x); child_x++){
+                            tile.merge(m_tiles[child.offset + child_y * child.tiles_x + child_x]);
+                        }
+                    }
+                }
+            }
+        }, m_tiles.data() + parent.offset, 4 * parent.tiles_x * sizeof(Tile));
+    }
+}
+
+template<typename... Reducers>
+uint64_t TilePyramid<Reducers...>::signature(const std::vector<float>& ndvs)
+{
+    // type names are only stable within one compiler, a file from another does not load
+    uint64_t hash = std::hash<std::string>()(typeid(typename Tile::States).name());
+    return hash * 0x9E3779B185EBCA87ull + hashNoDataValues(ndvs);
+}
+
+template<typename... Reducers>
+bool TilePyramid<Reducers...>::save(const std::string& path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file || !m_layout_ok){
+        return false;
+    }
+    const uint64_t header[6] = {m_signature, Tile::numBytes(), m_width, m_height, m_tile_size, m_levels.size()};
+    file.write(reinterpret_cast<const char*>(&tile_pyramid_file_magic), sizeof(tile_pyramid_file_magic));
+    file.write(reinterpret_cast<const char*>(&tile_pyramid_file_version), sizeof(tile_pyramid_file_version));
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for(const Level& level : m_levels){
+        file.write(reinterpret_cast<const char*>(&level.tiles_x), sizeof(level.tiles_x));
+        file.write(reinterpret_cast<const char*>(&level.tiles_y), sizeof(level.tiles_y));
+    }
+    for(const Tile& tile : m_tiles){
+        tile.forEachBytes([&](const void* source, size_t size){
+            file.write(static_cast<const char*>(source), static_cast<std::streamsize>(size));
+        });
+    }
+    return static_cast<bool>(file);
+}
+
+template<typename... Reducers>
+TilePyramid<Reducers...>::TilePyramid(const std::string& path, const std::vector<float>& ndvs, ReducerSet<Reducers...>)
+    : m_signature(signature(ndvs))
+{
+    std::ifstream file(path, std::ios::binary);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t header[6] = {};
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    m_layout_ok = file && magic == tile_pyramid_file_magic && version == tile_pyramid_file_version &&
+            header[0] == m_signature && header[1] == Tile::numBytes() && header[4] > 0;
+    if(!m_layout_ok){
+        return;
+    }
+    m_width = header[2];
+    m_height = header[3];
+    m_tile_size = header[4];
+    // the header is untrusted, the tiles its dimensions imply have to fit in the
+    // file before anything is sized from them
+    const std::streamoff table_begin = file.tellg();
+    file.seekg(0, std::ios::end);
+    const std::streamoff file_end = file.tellg();
+    file.seekg(table_begin);
+    const uint64_t table_bytes = 2 * sizeof(uint64_t) * header[5];
+    const uint64_t num_tiles = layoutLevels();
+    m_layout_ok = file && header[5] == m_levels.size() && table_begin <= file_end &&
+            table_bytes <= static_cast<uint64_t>(file_end - table_begin);
+    uint64_t tile_capacity = m_layout_ok ? (static_cast<uint64_t>(file_end - table_begin) - table_bytes) / Tile::numBytes() : 0;
+    for(const Level& level : m_levels){
+        if(!m_layout_ok || level.tiles_x > tile_capacity / level.tiles_y){
+            m_layout_ok = false;
+            break;
+        }
+        tile_capacity -= level.tiles_x * level.tiles_y;
+    }
+    // the stored level table has to be the one these dimensions give
+    for(size_t l=0; l<m_levels.size() && m_layout_ok; l++){
+        uint64_t tiles[2] = {};
+        file.read(reinterpret_cast<char*>(tiles), sizeof(tiles));
+        if(!file){
+            m_layout_ok = false;
+            break;
+        }
+        m_layout_ok &= tiles[0] == m_levels[l].tiles_x && tiles[1] == m_levels[l].tiles_y;
+    }
+    if(m_layout_ok){
+        m_tiles.assign(num_tiles, Tile());
+    }
+    for(size_t t=0; t<m_tiles.size() && m_layout_ok; t++){
+        m_tiles[t].forEachBytes([&](void* target, size_t size){
+            file.read(static_cast<char*>(target), static_cast<std::streamsize>(size));
+        });
+    }
+    m_layout_ok &= static_cast<bool>(file);
+    if(!m_layout_ok){
+        m_levels.clear();
+        m_tiles.clear();
+    }
+}
+
+template<typename... Reducers>
+bool TilePyramid<Reducers...>::readTile(const std::string& path, const std::vector<float>& ndvs, size_t level, size_t x, size_t y, Tile& tile)
+{
+    std::ifstream file(path, std::ios::binary);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t header[6] = {};
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if(!file || magic != tile_pyramid_file_magic || version != tile_pyramid_file_version ||
+       header[0] != signature(ndvs) || header[1] != Tile::numBytes() || level >= header[5]){
+        return false;
+    }
+    // tiles before the level, from the level table
+    uint64_t index = 0;
+    uint64_t tiles[2] = {};
+    for(size_t l=0; l<=level; l++){
+        file.read(reinterpret_cast<char*>(tiles), sizeof(tiles));
+        if(l < level){
+            index += tiles[0] * tiles[1];
+        }
+    }
+    if(!file || x >= tiles[0] || y >= tiles[1]){
+        return false;
+    }
+    index += y * tiles[0] + x;
+    const uint64_t offset = header_size + header[5] * 2 * sizeof(uint64_t) + index * Tile::numBytes();
+    file.seekg(static_cast<std::streamoff>(offset));
+    tile.forEachBytes([&](void* target, size_t size){
+        file.read(static_cast<char*>(target), static_cast<std::streamsize>(size));
+    });
+    return static_cast<bool>(file);
+}
+
+#endif // TILEPYRAMID_H
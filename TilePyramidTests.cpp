@@ -0,0 +1,131 @@
+#include <TilePyramid.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <StatsTestHelpers.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+struct TestBins
+{
+    static constexpr float lower = 0.f;
+    static constexpr float upper = 256.f;
+    static constexpr size_t count = 8;
+};
+
+using TestReducers = ReducerSet<Count, Sum, MinMax, Moments<2>, Histogram<TestBins> >;
+
+std::vector<float> testRaster(size_t width, size_t height)
+{
+    std::vector<float> raster = patternSeries(width * height, 251);
+    raster[width * 5 + 7] = -9999.f;
+    raster[width * (height - 1) + width - 1] = std::numeric_limits<float>::quiet_NaN();
+    return raster;
+}
+
+}
+
+TEST(TilePyramid, TilesMatchTheirCells)
+{
+    ThreadPoolExecutor pool(3);
+    StatsContext context = parallelContext(pool);
+    const size_t width = 1000;
+    const size_t height = 700;
+    const std::vector<float> raster = testRaster(width, height);
+    const TilePyramid pyramid(context, raster, width, height, 128, {-9999.f}, TestReducers());
+    ASSERT_TRUE(pyramid.isLayoutValid());
+    // 8 x 6 tiles, then 4 x 3, 2 x 2 and 1 x 1
+    ASSERT_EQ(pyramid.getNumLevels(), 4u);
+    EXPECT_EQ(pyramid.getTilesX(3), 8u);
+    EXPECT_EQ(pyramid.getTilesY(3), 6u);
+    EXPECT_EQ(pyramid.getTilesX(1), 2u);
+    EXPECT_EQ(pyramid.getTilesY(0), 1u);
+    EXPECT_EQ(pyramid.getTile(3, 8, 0), nullptr);
+    EXPECT_EQ(pyramid.getTile(4, 0, 0), nullptr);
+
+    // a tile of every level against the cells it covers
+    for(size_t level=0; level<pyramid.getNumLevels(); level++){
+        const size_t edge = 128 << (pyramid.getNumLevels() - 1 - level);
+        const size_t x = pyramid.getTilesX(level) - 1;
+        const size_t y = pyramid.getTilesY(level) / 2;
+        std::vector<float> cells;
+        for(size_t row=y*edge; row<std::min((y + 1) * edge, height); row++){
+            for(size_t column=x*edge; column<std::min((x + 1) * edge, width); column++){
+                cells.push_back(raster[row * width + column]);
+            }
+        }
+        const ExpressionStatsLoop direct(cells, {-9999.f}, TestReducers());
+        const auto* tile = pyramid.getTile(level, x, y);
+        ASSERT_NE(tile, nullptr);
+        EXPECT_EQ(tile->get<Count>(), direct.get<Count>()) << "level " << level;
+        EXPECT_EQ(tile->get<MinMax>().min, direct.get<MinMax>().min);
+        EXPECT_EQ(tile->get<MinMax>().max, direct.get<MinMax>().max);
+        EXPECT_EQ(tile->get<Histogram<TestBins> >().counts, direct.get<Histogram<TestBins> >().counts);
+        EXPECT_NEAR(tile->get<Sum>(), direct.get<Sum>(), direct.get<Sum>() * 1e-6f);
+        EXPECT_NEAR(tile->get<Moments<2> >().variance, direct.get<Moments<2> >().variance, 1e-2f);
+        EXPECT_EQ(tile->isGood(), direct.isGood());
+    }
+    EXPECT_FALSE(pyramid.getTile(0, 0, 0)->isGood());
+    EXPECT_TRUE(pyramid.getTile(3, 4, 4)->isGood());
+
+    // the same pyramid without threads
+    StatsContext serial;
+    serial.tuning.forced_mode = ExecutionMode::Serial;
+    const TilePyramid single(serial, raster, width, height, 128, {-9999.f}, TestReducers());
+    EXPECT_EQ(single.getTile(0, 0, 0)->get<Sum>(), pyramid.getTile(0, 0, 0)->get<Sum>());
+    EXPECT_EQ(single.getTile(0, 0, 0)->get<Moments<2> >().variance, pyramid.getTile(0, 0, 0)->get<Moments<2> >().variance);
+
+    EXPECT_FALSE(TilePyramid(raster, width + 1, height, 128, {-9999.f}, TestReducers()).isLayoutValid());
+    EXPECT_FALSE(TilePyramid(raster, width, height, 0, {-9999.f}, TestReducers()).isLayoutValid());
+}
+
+TEST(TilePyramid, SavedIndexReadsBack)
+{
+    const std::string path = testing::TempDir() + "tile_pyramid.bin";
+    const size_t width = 300;
+    const size_t height = 200;
+    const std::vector<float> raster = testRaster(width, height);
+    const TilePyramid pyramid(raster, width, height, 64, {-9999.f}, TestReducers());
+    // 5 x 4 tiles, then 3 x 2, 2 x 1 and 1 x 1
+    ASSERT_EQ(pyramid.getNumLevels(), 4u);
+    ASSERT_TRUE(pyramid.save(path));
+
+    const TilePyramid loaded(path, {-9999.f}, TestReducers());
+    ASSERT_TRUE(loaded.isLayoutValid());
+    ASSERT_EQ(loaded.getNumLevels(), pyramid.getNumLevels());
+    for(size_t level=0; level<pyramid.getNumLevels(); level++){
+        for(size_t y=0; y<pyramid.getTilesY(level); y++){
+            for(size_t x=0; x<pyramid.getTilesX(level); x++){
+                EXPECT_EQ(loaded.getTile(level, x, y)->get<Sum>(), pyramid.getTile(level, x, y)->get<Sum>());
+            }
+        }
+    }
+    // one tile on its own, by seeking to its record
+    TilePyramid<Count, Sum, MinMax, Moments<2>, Histogram<TestBins> >::Tile tile;
+    ASSERT_TRUE(decltype(pyramid)::readTile(path, {-9999.f}, 3, 4, 1, tile));
+    EXPECT_EQ(tile.get<Count>(), pyramid.getTile(3, 4, 1)->get<Count>());
+    EXPECT_EQ(tile.get<Histogram<TestBins> >().counts, pyramid.getTile(3, 4, 1)->get<Histogram<TestBins> >().counts);
+    EXPECT_FALSE(decltype(pyramid)::readTile(path, {-9999.f}, 3, 5, 1, tile));
+    EXPECT_FALSE(decltype(pyramid)::readTile(path, {-9999.f}, 4, 0, 0, tile));
+
+    // other no data values or reducers do not load
+    EXPECT_FALSE(TilePyramid(path, {-1.f}, TestReducers()).isLayoutValid());
+    EXPECT_FALSE(TilePyramid(path, {-9999.f}, Count{} | Sum{}).isLayoutValid());
+
+    // a truncated file, or dimensions whose tiles the file cannot hold, do not load
+    const uintmax_t file_bytes = std::filesystem::file_size(path);
+    std::filesystem::resize_file(path, file_bytes - 1);
+    EXPECT_FALSE(TilePyramid(path, {-9999.f}, TestReducers()).isLayoutValid());
+    std::filesystem::resize_file(path, file_bytes);
+    {
+        // width and height follow the magic, the version, the signature and the tile bytes
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        const uint64_t dimensions[2] = {uint64_t(1) << 40, uint64_t(1) << 40};
+        file.seekp(24);
+        file.write(reinterpret_cast<const char*>(dimensions), sizeof(dimensions));
+    }
+    EXPECT_FALSE(TilePyramid(path, {-9999.f}, TestReducers()).isLayoutValid());
+    std::remove(path.c_str());
+    EXPECT_FALSE(TilePyramid(path, {-9999.f}, TestReducers()).isLayoutValid());
+}
@@ -0,0 +1,43 @@
+TEMPLATE = app
+CONFIG += console c++17 release
+CONFIG -= app_bundle
+CONFIG -= qt
+
+# OpenMP is only needed for the OpenMPExecutor and the simd loop hints,
+# threads otherwise come from StatsExecutor
+msvc {
+    QMAKE_CXXFLAGS_RELEASE += /O2			# Max optimization
+    QMAKE_CXXFLAGS += -openmp
+} else {
+    QMAKE_CXXFLAGS_RELEASE += -O2
+    QMAKE_CXXFLAGS += -fopenmp
+    LIBS += -fopenmp -lpthread
+}
+
+# per phase hardware counters in BasicStatsLoop, see PerfCounters.h
+# DEFINES += BASICSTATS_PERF_COUNTERS=1
+
+SOURCES += \
+        BasicStatsBenchmark.cpp \
+        LoopTelemetry.cpp \
+        NumaExecutor.cpp \
+        PerfCounters.cpp \
+        StatsAllocator.cpp \
+        StatsContext.cpp \
+        StatsExecutor.cpp \
+        StatsTuning.cpp
+
+HEADERS += \
+    BasicStats.h \
+    FirstTouchAllocator.h \
+    ForceInline.h \
+    LoopTelemetry.h \
+    NoDataClassifier.h \
+    NumaExecutor.h \
+    PerfCounters.h \
+    Prefetch.h \
+    ReducerCapabilities.h \
+    StatsAllocator.h \
+    StatsContext.h \
+    StatsExecutor.h \
+    StatsTuning.h
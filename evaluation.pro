@@ -6,12 +6,49 @@ CONFIG -= qt
 INCLUDEPATH +=googletest-main/googletest/include
 INCLUDEPATH +=googletest-main/googletest/
 
-QMAKE_CXXFLAGS_RELEASE += /O2			# Max optimization
-QMAKE_CXXFLAGS += -openmp
-LIBS += -fopenmp
+# OpenMP is only needed for the OpenMPExecutor and the simd loop hints,
+# threads otherwise come from StatsExecutor
+msvc {
+    QMAKE_CXXFLAGS_RELEASE += /O2			# Max optimization
+    QMAKE_CXXFLAGS += -openmp
+} else {
+    QMAKE_CXXFLAGS_RELEASE += -O2
+    QMAKE_CXXFLAGS += -fopenmp
+    LIBS += -fopenmp -lpthread
+}
+
+# per phase hardware counters in BasicStatsLoop, see PerfCounters.h
+# DEFINES += BASICSTATS_PERF_COUNTERS=1
+
+# zstd frames in compressed series, see CompressedSeries.h
+# DEFINES += BASICSTATS_ZSTD=1
+# LIBS += -lzstd
 
 SOURCES += \
     BasicStatsTests.cpp \
+    MultiStatsTests.cpp \
+    BandStatsTests.cpp \
+    BatchStatsTests.cpp \
+    StatsTuningTests.cpp \
+    StatsExecutorTests.cpp \
+    NumaExecutorTests.cpp \
+    StatsExpressionTests.cpp \
+    ReducerCapabilitiesTests.cpp \
+    PerfCountersTests.cpp \
+    LoopTelemetryTests.cpp \
+    RollingStatsTests.cpp \
+    FocalStatsTests.cpp \
+    PrefixScanTests.cpp \
+    StatsCacheTests.cpp \
+    BlockSummaryIndexTests.cpp \
+    RangeStatsIndexTests.cpp \
+    TilePyramidTests.cpp \
+    BufferValidationTests.cpp \
+    StatsJobsTests.cpp \
+    FileStatsPipelineTests.cpp \
+    CompressedSeriesTests.cpp \
+    SeriesEncoderTests.cpp \
+    StatsAllocatorTests.cpp \
 googletest-main/googletest/src/gtest-all.cc \
 googletest-main/googletest/src/gtest-assertion-result.cc \
 googletest-main/googletest/src/gtest-death-test.cc \
@@ -52,8 +89,50 @@ googletest-main/googletest/src/gtest-internal-inl.h
 
 SOURCES += \
         BasicStats.cpp \
+        BufferValidation.cpp \
+        CompressedSeries.cpp \
+        FileStatsPipeline.cpp \
+        LoopTelemetry.cpp \
+        NumaExecutor.cpp \
+        PerfCounters.cpp \
+        PrefixScan.cpp \
+        SeriesEncoder.cpp \
+        StatsAllocator.cpp \
+        StatsCache.cpp \
+        StatsContext.cpp \
+        StatsExecutor.cpp \
+        StatsJobs.cpp \
+        StatsTuning.cpp \
         main.cpp
 
 HEADERS += \
+    BandStats.h \
     BasicStats.h \
-    ForceInline.h
+    BatchStats.h \
+    BlockSummaryIndex.h \
+    BufferValidation.h \
+    CompressedSeries.h \
+    FileStatsPipeline.h \
+    FirstTouchAllocator.h \
+    FocalStats.h \
+    ForceInline.h \
+    LoopTelemetry.h \
+    MultiStats.h \
+    NoDataClassifier.h \
+    NumaExecutor.h \
+    PerfCounters.h \
+    Prefetch.h \
+    PrefixScan.h \
+    RangeStatsIndex.h \
+    ReducerCapabilities.h \
+    RollingStats.h \
+    SeriesEncoder.h \
+    StatsAllocator.h \
+    StatsCache.h \
+    StatsContext.h \
+    StatsExecutor.h \
+    StatsExpression.h \
+    StatsJobs.h \
+    StatsTestHelpers.h \
+    StatsTuning.h \
+    TilePyramid.h
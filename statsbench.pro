@@ -0,0 +1,42 @@
+TEMPLATE = app
+TARGET = statsbench
+CONFIG += console c++17 release
+CONFIG -= app_bundle
+CONFIG -= qt
+
+# benchmark suite, see StatsBenchmarkSuite.cpp for its options
+msvc {
+    QMAKE_CXXFLAGS_RELEASE += /O2			# Max optimization
+    QMAKE_CXXFLAGS += -openmp
+} else {
+    QMAKE_CXXFLAGS_RELEASE += -O2
+    QMAKE_CXXFLAGS += -fopenmp
+    LIBS += -fopenmp -lpthread
+}
+
+SOURCES += \
+        StatsBenchmarkSuite.cpp \
+        LoopTelemetry.cpp \
+        PerfCounters.cpp \
+        StatsAllocator.cpp \
+        StatsContext.cpp \
+        StatsExecutor.cpp \
+        StatsTuning.cpp
+
+HEADERS += \
+    BasicStats.h \
+    BatchStats.h \
+    BenchmarkHarness.h \
+    FirstTouchAllocator.h \
+    ForceInline.h \
+    LoopTelemetry.h \
+    MultiStats.h \
+    NoDataClassifier.h \
+    PerfCounters.h \
+    Prefetch.h \
+    ReducerCapabilities.h \
+    StatsAllocator.h \
+    StatsContext.h \
+    StatsExecutor.h \
+    StatsExpression.h \
+    StatsTuning.h